@@ -0,0 +1,1844 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "bitpack.h"
+#include "btree.h"
+#include "externalsort.h"
+#include "hashindex.h"
+#include "keysearch.h"
+#include "lsmindex.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "file_iterator.h"
+#include "filescan.h"
+#include "page.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Benchmark driver.
+//
+//   bench [name [relationSize]]
+//
+// runs the benchmark called name, or all of them, over a relation of
+// relationSize tuples.  Each measured configuration runs in a child process of
+// its own so that its peak RSS is not hidden by an earlier configuration.
+// -----------------------------------------------------------------------------
+
+const std::string relationName = "relBench";
+std::string intIndexName;
+
+// This is the structure for tuples in the base relation
+
+typedef struct tuple {
+  int i;
+  double d;
+  char s[64];
+} RECORD;
+
+// -----------------------------------------------------------------------------
+// Measurement helpers
+// -----------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+/**
+ * Peak resident set size of this process, in KB.
+ */
+long maxRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * Size of the operating system page cache, in KB.
+ */
+long pageCacheKb() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while (std::getline(meminfo, line)) {
+    if (line.compare(0, 7, "Cached:") == 0) {
+      return std::atol(line.c_str() + 7);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Runs fn in a child process and waits for it, so that every configuration
+ * starts with a fresh heap and its own peak RSS.
+ */
+template <class F>
+void runIsolated(F fn) {
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid == 0) {
+    fn();
+    std::cout.flush();
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+}
+
+/**
+ * Size of a file, in KB.
+ */
+long fileSizeKb(const std::string &name) {
+  struct stat st;
+  if (stat(name.c_str(), &st) != 0) {
+    return 0;
+  }
+  return st.st_size / 1024;
+}
+
+void removeFile(const std::string &name) {
+  try {
+    File::remove(name);
+  } catch (FileNotFoundException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// createRelationRandom
+// -----------------------------------------------------------------------------
+
+void createRelationRandom(const int relationSize, const FileIOMode ioMode) {
+  removeFile(relationName);
+  PageFile file = PageFile::create(relationName, ioMode);
+
+  std::vector<int> keys(relationSize);
+  for (int i = 0; i < relationSize; i++) {
+    keys[i] = i;
+  }
+  srand(1);
+  for (int i = relationSize - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rand() % (i + 1)]);
+  }
+
+  RECORD record;
+  memset(record.s, ' ', sizeof(record.s));
+  PageId new_page_number;
+  Page new_page = file.allocatePage(new_page_number);
+  for (int i = 0; i < relationSize; i++) {
+    sprintf(record.s, "%05d string record", keys[i]);
+    record.i = keys[i];
+    record.d = (double)keys[i];
+    std::string new_data(reinterpret_cast<char *>(&record), sizeof(record));
+    while (1) {
+      try {
+        new_page.insertRecord(new_data);
+        break;
+      } catch (InsufficientSpaceException &e) {
+        file.writePage(new_page_number, new_page);
+        new_page = file.allocatePage(new_page_number);
+      }
+    }
+  }
+  file.writePage(new_page_number, new_page);
+}
+
+/**
+ * Scans every entry of the index, returning how many were found.
+ */
+int fullIndexScan(BTreeIndex &index) {
+  int lowVal = std::numeric_limits<int>::min();
+  int highVal = std::numeric_limits<int>::max();
+  RecordId rid;
+  int numResults = 0;
+  index.startScan(&lowVal, GTE, &highVal, LTE);
+  try {
+    while (1) {
+      index.scanNext(rid);
+      numResults++;
+    }
+  } catch (IndexScanCompletedException &e) {
+  }
+  index.endScan();
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// directio: buffered versus O_DIRECT index build and scan
+// -----------------------------------------------------------------------------
+
+void benchDirectIO(const int relationSize) {
+  const std::uint32_t frames = 256;
+  std::cout << "directio: " << relationSize << " tuples, " << frames
+            << " buffer frames" << std::endl;
+  std::cout << std::setw(10) << "mode" << std::setw(12) << "build ms"
+            << std::setw(12) << "scan ms" << std::setw(12) << "heap ms"
+            << std::setw(14) << "maxrss KB" << std::setw(14) << "+cache KB"
+            << std::endl;
+
+  const FileIOMode modes[] = {IO_BUFFERED, IO_DIRECT};
+  for (FileIOMode mode : modes) {
+    runIsolated([&]() {
+      createRelationRandom(relationSize, mode);
+      std::ostringstream idxstr;
+      idxstr << relationName << '.' << offsetof(tuple, i);
+      removeFile(idxstr.str());
+
+      BTreeOptions options;
+      options.ioMode = mode;
+      const long cacheBefore = pageCacheKb();
+      double buildMs, scanMs, heapMs;
+      int found;
+      {
+        BufMgr bufMgr(frames);
+        Clock::time_point start = Clock::now();
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER, options);
+        buildMs = elapsedMs(start);
+
+        start = Clock::now();
+        found = fullIndexScan(index);
+        scanMs = elapsedMs(start);
+
+        start = Clock::now();
+        {
+          FileScan scan(relationName, &bufMgr, mode);
+          RecordId rid;
+          try {
+            while (1) {
+              scan.scanNext(rid);
+            }
+          } catch (EndOfFileException &e) {
+          }
+        }
+        heapMs = elapsedMs(start);
+      }
+      const long cacheGrowth = pageCacheKb() - cacheBefore;
+
+      std::cout << std::setw(10)
+                << (mode == IO_DIRECT ? "direct" : "buffered") << std::fixed
+                << std::setprecision(1) << std::setw(12) << buildMs
+                << std::setw(12) << scanMs << std::setw(12) << heapMs
+                << std::setw(14) << maxRssKb() << std::setw(14) << cacheGrowth
+                << (found == relationSize ? "" : "  (wrong entry count)")
+                << std::endl;
+
+      removeFile(intIndexName);
+      removeFile(relationName);
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+// batchread: readPage() per page versus readPages() for random page fetches
+// -----------------------------------------------------------------------------
+
+void benchBatchRead(const int relationSize) {
+  const std::size_t batchSize = 64;
+  std::cout << "batchread: " << relationSize << " tuples, batches of "
+            << batchSize << " pages" << std::endl;
+  std::cout << std::setw(10) << "mode" << std::setw(12) << "fetches"
+            << std::setw(14) << "readPage ms" << std::setw(14) << "readPages ms"
+            << std::setw(10) << "speedup" << std::endl;
+
+  const FileIOMode modes[] = {IO_BUFFERED, IO_DIRECT};
+  for (FileIOMode mode : modes) {
+    runIsolated([&]() {
+      createRelationRandom(relationSize, mode);
+      {
+        PageFile file = PageFile::open(relationName, mode);
+        std::vector<PageId> pageNos;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+          pageNos.push_back((*iter).page_number());
+        }
+
+        // half of the pages, in page order, as a sorted list of RIDs from an
+        // index scan would ask for them
+        srand(2);
+        std::vector<PageRef> refs;
+        for (std::size_t i = 0; i < pageNos.size(); i++) {
+          if (rand() % 2 == 0) {
+            PageRef ref = {&file, pageNos[i]};
+            refs.push_back(ref);
+          }
+        }
+
+        double singleMs, batchMs;
+        {
+          BufMgr bufMgr(batchSize);
+          Clock::time_point start = Clock::now();
+          for (std::size_t i = 0; i < refs.size(); i++) {
+            Page *page;
+            bufMgr.readPage(refs[i].file, refs[i].pageNo, page);
+            bufMgr.unPinPage(refs[i].file, refs[i].pageNo, false);
+          }
+          singleMs = elapsedMs(start);
+          bufMgr.flushFile(&file);
+        }
+        {
+          BufMgr bufMgr(batchSize);
+          Clock::time_point start = Clock::now();
+          std::vector<PageRef> batch;
+          std::vector<Page *> pages;
+          for (std::size_t i = 0; i < refs.size(); i += batchSize) {
+            batch.assign(refs.begin() + i,
+                         refs.begin() + std::min(i + batchSize, refs.size()));
+            bufMgr.readPages(batch, pages);
+            for (std::size_t k = 0; k < batch.size(); k++) {
+              bufMgr.unPinPage(batch[k].file, batch[k].pageNo, false);
+            }
+          }
+          batchMs = elapsedMs(start);
+          bufMgr.flushFile(&file);
+        }
+
+        std::cout << std::setw(10)
+                  << (file.ioMode() == IO_DIRECT ? "direct" : "buffered")
+                  << std::setw(12) << refs.size() << std::fixed
+                  << std::setprecision(1) << std::setw(14) << singleMs
+                  << std::setw(14) << batchMs << std::setw(9)
+                  << std::setprecision(2) << singleMs / batchMs << "x"
+                  << std::endl;
+      }
+      removeFile(relationName);
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+// bulkload: inserting every entry versus bulk loading the index, with one
+// thread or several
+// -----------------------------------------------------------------------------
+
+void benchBulkLoad(const int relationSize) {
+  const std::uint32_t frames = 256;
+  std::cout << "bulkload: " << relationSize << " tuples, " << frames
+            << " buffer frames, " << std::thread::hardware_concurrency()
+            << " cores" << std::endl;
+  std::cout << std::setw(18) << "build" << std::setw(12) << "build ms"
+            << std::setw(12) << "scan ms" << std::setw(14) << "index KB"
+            << std::endl;
+
+  struct Config {
+    const char *name;
+    bool bulkLoad;
+    double fillFactor;
+    std::size_t sortMemory;
+    int threads;
+  };
+  const Config configs[] = {
+      {"insert", false, 1.0, 0, 1},
+      {"bulk", true, 1.0, 64 << 20, 1},
+      {"bulk fill 0.7", true, 0.7, 64 << 20, 1},
+      {"bulk 1MB sort", true, 1.0, 1 << 20, 1},
+      {"bulk 2 threads", true, 1.0, 64 << 20, 2},
+      {"bulk 4 threads", true, 1.0, 64 << 20, 4},
+      {"bulk 4 thr 1MB", true, 1.0, 1 << 20, 4},
+  };
+
+  createRelationRandom(relationSize, IO_BUFFERED);
+  for (const Config &config : configs) {
+    runIsolated([&]() {
+      std::ostringstream idxstr;
+      idxstr << relationName << '.' << offsetof(tuple, i);
+      removeFile(idxstr.str());
+
+      BTreeOptions options;
+      options.bulkLoad = config.bulkLoad;
+      options.fillFactor = config.fillFactor;
+      options.sortMemory = config.sortMemory;
+      options.buildThreads = config.threads;
+      double buildMs, scanMs;
+      int found;
+      {
+        BufMgr bufMgr(frames);
+        Clock::time_point start = Clock::now();
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER, options);
+        buildMs = elapsedMs(start);
+
+        start = Clock::now();
+        found = fullIndexScan(index);
+        scanMs = elapsedMs(start);
+      }
+
+      std::cout << std::setw(18) << config.name << std::fixed
+                << std::setprecision(1) << std::setw(12) << buildMs
+                << std::setw(12) << scanMs << std::setw(14)
+                << fileSizeKb(intIndexName)
+                << (found == relationSize ? "" : "  (wrong entry count)")
+                << std::endl;
+
+      removeFile(intIndexName);
+    });
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// extsort: ExternalSort of a relation 10 times the size of the buffer pool
+// -----------------------------------------------------------------------------
+
+void benchExternalSort(const int relationSize) {
+  createRelationRandom(relationSize, IO_BUFFERED);
+  const long relationKb = fileSizeKb(relationName);
+  const std::uint32_t frames =
+      std::max<long>(8, relationKb * 1024 / Page::SIZE / 10);
+  std::cout << "extsort: " << relationSize << " tuples, " << relationKb
+            << " KB, " << frames << " buffer frames" << std::endl;
+  std::cout << std::setw(18) << "sort" << std::setw(12) << "budget"
+            << std::setw(8) << "runs" << std::setw(8) << "passes"
+            << std::setw(12) << "sort ms" << std::setw(14) << "maxrss KB"
+            << std::endl;
+
+  // the budget of the sort, in pages; 0 sorts in memory with std::sort
+  const std::uint32_t budgets[] = {0, frames / 2, frames / 8};
+  for (std::uint32_t budget : budgets) {
+    runIsolated([&]() {
+      BufMgr bufMgr(frames);
+      Clock::time_point start = Clock::now();
+      RecordLess less = attributeLess<int>(offsetof(tuple, i));
+      std::uint32_t runs = 0, passes = 0;
+      int inOrder = 0;
+      std::string record;
+      if (budget == 0) {
+        std::vector<std::string> records;
+        {
+          FileScan scan(relationName, &bufMgr);
+          RecordId rid;
+          try {
+            while (1) {
+              scan.scanNext(rid);
+              records.push_back(scan.getRecord());
+            }
+          } catch (EndOfFileException &e) {
+          }
+        }
+        std::stable_sort(records.begin(), records.end(), less);
+        for (std::size_t i = 0; i < records.size(); i++) {
+          inOrder += ((const RECORD *)records[i].data())->i == inOrder;
+        }
+      } else {
+        ExternalSort sorter(relationName + ".sort", &bufMgr, less, budget);
+        {
+          FileScan scan(relationName, &bufMgr);
+          RecordId rid;
+          try {
+            while (1) {
+              scan.scanNext(rid);
+              sorter.add(scan.getRecord());
+            }
+          } catch (EndOfFileException &e) {
+          }
+        }
+        sorter.sort();
+        try {
+          while (1) {
+            sorter.next(record);
+            inOrder += ((const RECORD *)record.data())->i == inOrder;
+          }
+        } catch (EndOfFileException &e) {
+        }
+        runs = sorter.getNumRuns();
+        passes = sorter.getNumPasses();
+      }
+      const double sortMs = elapsedMs(start);
+
+      std::cout << std::setw(18) << (budget == 0 ? "in memory" : "external")
+                << std::setw(12) << budget << std::setw(8) << runs
+                << std::setw(8) << passes << std::fixed << std::setprecision(1)
+                << std::setw(12) << sortMs << std::setw(14) << maxRssKb()
+                << (inOrder == relationSize ? "" : "  (wrong order)")
+                << std::endl;
+    });
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// concurrent: inserts and lookups from many threads on disjoint key ranges
+// -----------------------------------------------------------------------------
+
+void benchConcurrent(const int relationSize) {
+  // every page of the index stays in the buffer pool
+  const std::uint32_t frames = relationSize / 300 + 64;
+  std::cout << "concurrent: " << relationSize << " entries, " << frames
+            << " buffer frames, " << std::thread::hardware_concurrency()
+            << " hardware threads" << std::endl;
+  std::cout << std::setw(10) << "threads" << std::setw(14) << "insert ms"
+            << std::setw(14) << "insert Kops" << std::setw(14) << "lookup ms"
+            << std::setw(14) << "lookup Kops" << std::endl;
+
+  const int threadCounts[] = {1, 2, 4, 8};
+  for (int numThreads : threadCounts) {
+    runIsolated([&]() {
+      removeFile(relationName);
+      { PageFile::create(relationName); }
+      std::ostringstream idxstr;
+      idxstr << relationName << '.' << offsetof(tuple, i);
+      removeFile(idxstr.str());
+
+      // thread t owns the keys [t * perThread, (t + 1) * perThread), which it
+      // inserts and then looks up in a random order
+      const int perThread = relationSize / numThreads;
+      std::vector<std::vector<int> > keys(numThreads);
+      srand(1);
+      for (int t = 0; t < numThreads; t++) {
+        for (int j = 0; j < perThread; j++) {
+          keys[t].push_back(t * perThread + j);
+        }
+        for (int j = perThread - 1; j > 0; j--) {
+          std::swap(keys[t][j], keys[t][rand() % (j + 1)]);
+        }
+      }
+
+      double insertMs, lookupMs;
+      std::atomic<int> found(0);
+      {
+        BufMgr bufMgr(frames);
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER);
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (int t = 0; t < numThreads; t++) {
+          threads.push_back(std::thread([&index, &keys, t]() {
+            RecordId rid;
+            rid.slot_number = 0;
+            for (int key : keys[t]) {
+              rid.page_number = key + 1;
+              index.insertEntry(&key, rid);
+            }
+          }));
+        }
+        for (std::thread &thread : threads) thread.join();
+        insertMs = elapsedMs(start);
+
+        threads.clear();
+        start = Clock::now();
+        for (int t = 0; t < numThreads; t++) {
+          threads.push_back(std::thread([&index, &keys, &found, t]() {
+            int numFound = 0;
+            for (int key : keys[t]) {
+              numFound += index.lookup(&key).has_value();
+            }
+            found += numFound;
+          }));
+        }
+        for (std::thread &thread : threads) thread.join();
+        lookupMs = elapsedMs(start);
+      }
+
+      const int numEntries = perThread * numThreads;
+      std::cout << std::setw(10) << numThreads << std::fixed
+                << std::setprecision(1) << std::setw(14) << insertMs
+                << std::setw(14) << numEntries / insertMs << std::setw(14)
+                << lookupMs << std::setw(14) << numEntries / lookupMs
+                << (found == numEntries ? "" : "  (wrong lookup count)")
+                << std::endl;
+
+      removeFile(intIndexName);
+      removeFile(relationName);
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+// nodesearch: key search in nodes at several fill levels
+// -----------------------------------------------------------------------------
+
+/**
+ * Nanoseconds per search of a node of n keys with search, over many nodes so
+ * that they are not all in the CPU cache. Adds the results to checksum.
+ */
+template <class T, class F>
+double timeNodeSearch(const std::vector<T> &keys, const int n,
+                      const std::vector<T> &probes,
+                      const std::vector<int> &nodes, F search,
+                      long &checksum) {
+  Clock::time_point start = Clock::now();
+  for (std::size_t i = 0; i < probes.size(); i++) {
+    checksum += search(&keys[(std::size_t)nodes[i] * n], n, probes[i]);
+  }
+  return elapsedMs(start) * 1e6 / probes.size();
+}
+
+/**
+ * Searches nodes of nodeSize keys filled to several levels. The nodes take up
+ * 64 KB, which stays in the CPU cache like the upper levels of a tree, or
+ * 64 MB, which does not.
+ */
+template <class T>
+void benchNodeSearchType(const char *type, const int nodeSize,
+                         const int numProbes, const int setSize) {
+  const double fills[] = {0.1, 0.25, 0.5, 0.75, 1.0};
+  for (double fill : fills) {
+    const int n = std::max(1, (int)(nodeSize * fill));
+    const int numNodes = std::max(1, setSize / (int)(n * sizeof(T)));
+    std::vector<T> keys((std::size_t)n * numNodes);
+    for (int node = 0; node < numNodes; node++) {
+      for (int i = 0; i < n; i++) {
+        keys[(std::size_t)node * n + i] = (T)(2 * i);
+      }
+    }
+    std::vector<T> probes(numProbes);
+    std::vector<int> nodes(numProbes);
+    srand(1);
+    for (int i = 0; i < numProbes; i++) {
+      probes[i] = (T)(rand() % (2 * n + 1));
+      nodes[i] = rand() % numNodes;
+    }
+
+    long scalarSum = 0, simdSum = 0;
+    const double lowerScalar = timeNodeSearch(
+        keys, n, probes, nodes,
+        [](const T *k, int len, const T &key) {
+          return (int)(std::lower_bound(k, k + len, key) - k);
+        },
+        scalarSum);
+    const double lowerSimd = timeNodeSearch(
+        keys, n, probes, nodes,
+        [](const T *k, int len, const T &key) {
+          return keyLowerBound(k, len, key);
+        },
+        simdSum);
+    const double upperScalar = timeNodeSearch(
+        keys, n, probes, nodes,
+        [](const T *k, int len, const T &key) {
+          return (int)(std::upper_bound(k, k + len, key) - k);
+        },
+        scalarSum);
+    const double upperSimd = timeNodeSearch(
+        keys, n, probes, nodes,
+        [](const T *k, int len, const T &key) {
+          return keyUpperBound(k, len, key);
+        },
+        simdSum);
+
+    std::cout << std::setw(8) << type << std::setw(8) << (setSize >> 10)
+              << std::setw(8) << n << std::fixed
+              << std::setprecision(2) << std::setw(8) << fill
+              << std::setprecision(1) << std::setw(14) << lowerScalar
+              << std::setw(12) << lowerSimd << std::setw(14) << upperScalar
+              << std::setw(12) << upperSimd
+              << (scalarSum == simdSum ? "" : "  (wrong result)") << std::endl;
+  }
+}
+
+void benchNodeSearch(const int numProbes) {
+  std::cout << "nodesearch: " << numProbes << " searches per test, "
+            << KEYSEARCHISA << " blocks of " << KEYSEARCHBLOCK
+            << " keys, ns per search" << std::endl;
+  std::cout << std::setw(8) << "type" << std::setw(8) << "set KB"
+            << std::setw(8) << "keys"
+            << std::setw(8) << "fill" << std::setw(14) << "lower_bound"
+            << std::setw(12) << "keyLower" << std::setw(14) << "upper_bound"
+            << std::setw(12) << "keyUpper" << std::endl;
+  const int setSizes[] = {64 << 10, 64 << 20};
+  for (int setSize : setSizes) {
+    benchNodeSearchType<int>("int", INTARRAYLEAFSIZE, numProbes, setSize);
+    benchNodeSearchType<int>("int", INTARRAYNONLEAFSIZE, numProbes, setSize);
+    benchNodeSearchType<double>("double", DOUBLEARRAYLEAFSIZE, numProbes,
+                                setSize);
+    benchNodeSearchType<double>("double", DOUBLEARRAYNONLEAFSIZE, numProbes,
+                                setSize);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// scanbatch: range scans with scanNext() and scanNextBatch()
+// -----------------------------------------------------------------------------
+
+/**
+ * Milliseconds to read every entry of the range [lowVal, highVal) with
+ * scanNext() if batchSize is 0, else with scanNextBatch() into batch. Sets
+ * numScanned to the number of entries read.
+ */
+double timeRangeScan(BTreeIndex &index, int lowVal, int highVal,
+                     const std::size_t batchSize, RecordId *batch,
+                     long &numScanned) {
+  numScanned = 0;
+  Clock::time_point start = Clock::now();
+  IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+  if (batchSize == 0) {
+    RecordId rid;
+    try {
+      while (1) {
+        scan.scanNext(rid);
+        numScanned++;
+      }
+    } catch (IndexScanCompletedException &e) {
+    }
+  } else {
+    std::size_t n;
+    while ((n = scan.scanNextBatch(batch, batchSize)) > 0) {
+      numScanned += n;
+    }
+  }
+  return elapsedMs(start);
+}
+
+void benchScanBatch(const int relationSize) {
+  // every page of the index stays in the buffer pool
+  const std::uint32_t frames = relationSize / 300 + 64;
+  std::cout << "scanbatch: " << relationSize << " entries, " << frames
+            << " buffer frames, M entries per second" << std::endl;
+  std::cout << std::setw(10) << "range" << std::setw(12) << "scanNext"
+            << std::setw(10) << "batch 16"
+            << std::setw(10) << "batch 256" << std::setw(10) << "batch 4K"
+            << std::endl;
+
+  runIsolated([&]() {
+    removeFile(relationName);
+    { PageFile::create(relationName); }
+    std::ostringstream idxstr;
+    idxstr << relationName << '.' << offsetof(tuple, i);
+    removeFile(idxstr.str());
+
+    {
+      BufMgr bufMgr(frames);
+      BTreeIndex index(relationName, intIndexName, &bufMgr, offsetof(tuple, i),
+                       INTEGER);
+      std::vector<int> keys(relationSize);
+      for (int i = 0; i < relationSize; i++) keys[i] = i;
+      srand(1);
+      for (int i = relationSize - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rand() % (i + 1)]);
+      }
+      RecordId rid;
+      rid.slot_number = 0;
+      for (int key : keys) {
+        rid.page_number = key + 1;
+        index.insertEntry(&key, rid);
+      }
+
+      // ranges of 100% down to 0.01% of the entries, scanned over and over so
+      // that every configuration reads about the same number of entries
+      const int divisors[] = {1, 100, 10000};
+      const std::size_t batchSizes[] = {0, 16, 256, 4096};
+      std::vector<RecordId> batch(4096);
+      for (int divisor : divisors) {
+        const int width = std::max(1, relationSize / divisor);
+        const int numScans = std::max(1, 10 * divisor);
+        std::cout << std::setw(9) << std::fixed << std::setprecision(2)
+                  << 100.0 / divisor << "%";
+        for (std::size_t batchSize : batchSizes) {
+          double ms = 0;
+          long total = 0, numScanned;
+          srand(2);
+          for (int s = 0; s < numScans; s++) {
+            const int lowVal = rand() % (relationSize - width + 1);
+            ms += timeRangeScan(index, lowVal, lowVal + width, batchSize,
+                                batch.data(), numScanned);
+            total += numScanned;
+          }
+          std::cout << std::setprecision(1)
+                    << std::setw(batchSize == 0 ? 12 : 10)
+                    << total / ms / 1000;
+        }
+        std::cout << std::endl;
+      }
+    }
+
+    removeFile(intIndexName);
+    removeFile(relationName);
+  });
+}
+
+// -----------------------------------------------------------------------------
+// multiget: point lookups of an index nested loop join
+// -----------------------------------------------------------------------------
+
+/**
+ * Looks up every probe key with a GTE/LTE scan. Returns the number found.
+ */
+int scanLookups(BTreeIndex &index, const std::vector<int> &probes) {
+  int numFound = 0;
+  RecordId rid;
+  for (int key : probes) {
+    try {
+      index.startScan(&key, GTE, &key, LTE);
+      index.scanNext(rid);
+      numFound++;
+      index.endScan();
+    } catch (NoSuchKeyFoundException &e) {
+    }
+  }
+  return numFound;
+}
+
+/**
+ * Looks up the probe keys batchSize at a time with multiGet(). Returns the
+ * number found.
+ */
+int multiGetLookups(BTreeIndex &index, const std::vector<int> &probes,
+                    const std::size_t batchSize) {
+  int numFound = 0;
+  std::vector<const void *> keys(batchSize);
+  std::vector<std::optional<RecordId> > rids(batchSize);
+  for (std::size_t start = 0; start < probes.size(); start += batchSize) {
+    const std::size_t n = std::min(batchSize, probes.size() - start);
+    for (std::size_t k = 0; k < n; k++) keys[k] = &probes[start + k];
+    index.multiGet(keys.data(), n, rids.data());
+    for (std::size_t k = 0; k < n; k++) numFound += rids[k].has_value();
+  }
+  return numFound;
+}
+
+void benchMultiGet(const int relationSize) {
+  // every page of the index stays in the buffer pool
+  const std::uint32_t frames = relationSize / 300 + 64;
+  const int numProbes = 1000000;
+  std::cout << "multiget: " << relationSize << " entries, " << numProbes
+            << " probes of an outer relation, half of them matching, "
+            << "K probes per second" << std::endl;
+  std::cout << std::setw(10) << "outer" << std::setw(10) << "scan"
+            << std::setw(10) << "lookup" << std::setw(10) << "batch 16"
+            << std::setw(10) << "batch 256" << std::setw(10) << "batch 4K"
+            << std::endl;
+
+  runIsolated([&]() {
+    removeFile(relationName);
+    { PageFile::create(relationName); }
+    std::ostringstream idxstr;
+    idxstr << relationName << '.' << offsetof(tuple, i);
+    removeFile(idxstr.str());
+
+    {
+      BufMgr bufMgr(frames);
+      BTreeIndex index(relationName, intIndexName, &bufMgr, offsetof(tuple, i),
+                       INTEGER);
+      // the index holds the even keys below 2 * relationSize
+      std::vector<int> keys(relationSize);
+      for (int i = 0; i < relationSize; i++) keys[i] = 2 * i;
+      srand(1);
+      for (int i = relationSize - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rand() % (i + 1)]);
+      }
+      RecordId rid;
+      rid.slot_number = 0;
+      for (int key : keys) {
+        rid.page_number = key + 1;
+        index.insertEntry(&key, rid);
+      }
+
+      // the outer relation in random order, and clustered on the join key
+      std::vector<int> probes(numProbes);
+      for (int &key : probes) key = rand() % (2 * relationSize);
+      std::vector<int> sortedProbes(probes);
+      std::sort(sortedProbes.begin(), sortedProbes.end());
+
+      for (int sorted = 0; sorted < 2; sorted++) {
+        const std::vector<int> &outer = sorted ? sortedProbes : probes;
+        std::cout << std::setw(10) << (sorted ? "sorted" : "random");
+        std::vector<int> numFound;
+        Clock::time_point start = Clock::now();
+        numFound.push_back(scanLookups(index, outer));
+        std::cout << std::fixed << std::setprecision(1) << std::setw(10)
+                  << numProbes / elapsedMs(start);
+
+        start = Clock::now();
+        int found = 0;
+        for (int key : outer) found += index.lookup(&key).has_value();
+        numFound.push_back(found);
+        std::cout << std::setw(10) << numProbes / elapsedMs(start);
+
+        const std::size_t batchSizes[] = {16, 256, 4096};
+        for (std::size_t batchSize : batchSizes) {
+          start = Clock::now();
+          numFound.push_back(multiGetLookups(index, outer, batchSize));
+          std::cout << std::setw(10) << numProbes / elapsedMs(start);
+        }
+        const bool same = std::count(numFound.begin(), numFound.end(),
+                                     numFound[0]) == (long)numFound.size();
+        std::cout << (same ? "" : "  (wrong lookup count)") << std::endl;
+      }
+    }
+
+    removeFile(intIndexName);
+    removeFile(relationName);
+  });
+}
+
+// -----------------------------------------------------------------------------
+// append: inserts of increasing keys, as from a time ordered ingest
+// -----------------------------------------------------------------------------
+
+void benchAppend(const int relationSize) {
+  // every page of the index stays in the buffer pool
+  const std::uint32_t frames = relationSize / 150 + 64;
+  std::cout << "append: " << relationSize << " inserts, " << frames
+            << " buffer frames" << std::endl;
+  std::cout << std::setw(12) << "order" << std::setw(12) << "insert ms"
+            << std::setw(14) << "insert Kops" << std::setw(14) << "index KB"
+            << std::endl;
+
+  const char *orders[] = {"increasing", "random", "decreasing"};
+  for (const char *order : orders) {
+    runIsolated([&]() {
+      removeFile(relationName);
+      { PageFile::create(relationName); }
+      std::ostringstream idxstr;
+      idxstr << relationName << '.' << offsetof(tuple, i);
+      removeFile(idxstr.str());
+
+      std::vector<int> keys(relationSize);
+      for (int i = 0; i < relationSize; i++) keys[i] = i;
+      if (order == std::string("random")) {
+        srand(1);
+        for (int i = relationSize - 1; i > 0; i--) {
+          std::swap(keys[i], keys[rand() % (i + 1)]);
+        }
+      } else if (order == std::string("decreasing")) {
+        std::reverse(keys.begin(), keys.end());
+      }
+
+      double insertMs;
+      {
+        BufMgr bufMgr(frames);
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER);
+        RecordId rid;
+        rid.slot_number = 0;
+        Clock::time_point start = Clock::now();
+        for (int key : keys) {
+          rid.page_number = key + 1;
+          index.insertEntry(&key, rid);
+        }
+        insertMs = elapsedMs(start);
+      }
+
+      std::cout << std::setw(12) << order << std::fixed
+                << std::setprecision(1) << std::setw(12) << insertMs
+                << std::setw(14) << relationSize / insertMs << std::setw(14)
+                << fileSizeKb(intIndexName) << std::endl;
+
+      removeFile(intIndexName);
+      removeFile(relationName);
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+// postings: inserts of few distinct keys, with and without posting lists,
+// then scans through a buffer pool smaller than the index
+// -----------------------------------------------------------------------------
+
+void benchPostingLists(const int relationSize) {
+  const std::uint32_t frames = relationSize / 150 + 64;
+  const std::uint32_t scanFrames = 32;
+  const int numScans = 20;
+  std::cout << "postings: " << relationSize << " inserts, " << frames
+            << " buffer frames, " << numScans << " scans with " << scanFrames
+            << " frames" << std::endl;
+  std::cout << std::setw(8) << "keys" << std::setw(10) << "postings"
+            << std::setw(12) << "insert ms" << std::setw(12) << "index KB"
+            << std::setw(12) << "scan ms" << std::setw(14) << "disk reads"
+            << std::endl;
+
+  const int distinctKeys[] = {10, 100, 1000};
+  for (int numKeys : distinctKeys) {
+    for (bool postingLists : {false, true}) {
+      runIsolated([&]() {
+        removeFile(relationName);
+        { PageFile::create(relationName); }
+        removeFile(intIndexName);
+
+        BTreeOptions options;
+        options.postingLists = postingLists;
+        double insertMs, scanMs;
+        {
+          BufMgr bufMgr(frames);
+          BTreeIndex index(relationName, intIndexName, &bufMgr,
+                           offsetof(tuple, i), INTEGER, options);
+          RecordId rid;
+          rid.slot_number = 0;
+          srand(1);
+          Clock::time_point start = Clock::now();
+          for (int i = 0; i < relationSize; i++) {
+            int key = rand() % numKeys;
+            rid.page_number = i + 1;
+            index.insertEntry(&key, rid);
+          }
+          insertMs = elapsedMs(start);
+        }
+
+        // the leaves are read from the file on every scan
+        std::size_t numScanned = 0;
+        std::uint64_t diskReads;
+        {
+          BufMgr bufMgr(scanFrames);
+          BTreeIndex index(relationName, intIndexName, &bufMgr,
+                           offsetof(tuple, i), INTEGER, options);
+          bufMgr.clearBufStats();
+          int lowVal = 0, highVal = numKeys;
+          std::vector<RecordId> batch(1024);
+          Clock::time_point start = Clock::now();
+          for (int s = 0; s < numScans; s++) {
+            IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+            std::size_t n;
+            while ((n = scan.scanNextBatch(batch.data(), batch.size())) > 0) {
+              numScanned += n;
+            }
+          }
+          scanMs = elapsedMs(start) / numScans;
+          diskReads = bufMgr.getBufStats().diskreads / numScans;
+        }
+        if (numScanned != (std::size_t)relationSize * numScans) {
+          std::cout << "scan returned " << numScanned / numScans
+                    << " entries" << std::endl;
+        }
+
+        std::cout << std::setw(8) << numKeys << std::setw(10)
+                  << (postingLists ? "on" : "off") << std::fixed
+                  << std::setprecision(1) << std::setw(12) << insertMs
+                  << std::setw(12) << fileSizeKb(intIndexName)
+                  << std::setprecision(2) << std::setw(12) << scanMs
+                  << std::setw(14) << diskReads << std::endl;
+
+        removeFile(intIndexName);
+        removeFile(relationName);
+      });
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// compressed: plain versus compressed leaves, built by inserts or a bulk load
+// -----------------------------------------------------------------------------
+
+void benchCompressedLeaves(const int relationSize) {
+  // every page of the index stays in the buffer pool
+  const std::uint32_t frames = relationSize / 150 + 64;
+  const int numProbes = 1000000;
+  std::cout << "compressed: " << relationSize << " tuples, " << frames
+            << " buffer frames, " << numProbes << " lookups, decode "
+            << BITPACKISA << std::endl;
+  std::cout << std::setw(8) << "leaves" << std::setw(8) << "build"
+            << std::setw(12) << "build ms" << std::setw(12) << "index KB"
+            << std::setw(12) << "scan ms" << std::setw(14) << "lookup Kops"
+            << std::endl;
+
+  createRelationRandom(relationSize, IO_BUFFERED);
+  for (bool bulkLoad : {false, true}) {
+    for (bool compressLeaves : {false, true}) {
+      runIsolated([&]() {
+        std::ostringstream idxstr;
+        idxstr << relationName << '.' << offsetof(tuple, i);
+        removeFile(idxstr.str());
+
+        BTreeOptions options;
+        options.bulkLoad = bulkLoad;
+        options.compressLeaves = compressLeaves;
+        double buildMs, scanMs, lookupMs;
+        std::size_t numScanned = 0;
+        int numFound = 0;
+        {
+          BufMgr bufMgr(frames);
+          Clock::time_point start = Clock::now();
+          BTreeIndex index(relationName, intIndexName, &bufMgr,
+                           offsetof(tuple, i), INTEGER, options);
+          buildMs = elapsedMs(start);
+
+          int lowVal = std::numeric_limits<int>::min();
+          int highVal = std::numeric_limits<int>::max();
+          std::vector<RecordId> batch(1024);
+          start = Clock::now();
+          IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LTE);
+          std::size_t n;
+          while ((n = scan.scanNextBatch(batch.data(), batch.size())) > 0) {
+            numScanned += n;
+          }
+          scanMs = elapsedMs(start);
+
+          srand(2);
+          std::vector<int> probes(numProbes);
+          for (int &key : probes) key = rand() % relationSize;
+          start = Clock::now();
+          for (int key : probes) numFound += index.lookup(&key).has_value();
+          lookupMs = elapsedMs(start);
+        }
+        const bool right = numScanned == (std::size_t)relationSize &&
+                           numFound == numProbes;
+
+        std::cout << std::setw(8) << (compressLeaves ? "packed" : "plain")
+                  << std::setw(8) << (bulkLoad ? "bulk" : "insert")
+                  << std::fixed << std::setprecision(1) << std::setw(12)
+                  << buildMs << std::setw(12) << fileSizeKb(intIndexName)
+                  << std::setw(12) << scanMs << std::setw(14)
+                  << numProbes / lookupMs
+                  << (right ? "" : "  (wrong entry count)") << std::endl;
+
+        removeFile(intIndexName);
+      });
+    }
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// covering: a range scan that fetches a column from the heap versus one that
+// reads it from the payload of a covering index
+// -----------------------------------------------------------------------------
+
+void benchCovering(const int relationSize) {
+  // the buffer pool holds a fraction of the heap, as for a large relation
+  const std::uint32_t frames = 256;
+  const int numScans = 100;
+  std::cout << "covering: " << relationSize << " tuples, " << frames
+            << " buffer frames, " << numScans << " scans of 1% of the keys"
+            << std::endl;
+  std::cout << std::setw(10) << "index" << std::setw(12) << "build ms"
+            << std::setw(12) << "index KB" << std::setw(12) << "scan ms"
+            << std::setw(14) << "M rows/s" << std::endl;
+
+  createRelationRandom(relationSize, IO_BUFFERED);
+  for (bool covering : {false, true}) {
+    runIsolated([&]() {
+      std::ostringstream idxstr;
+      idxstr << relationName << '.' << offsetof(tuple, i);
+      removeFile(idxstr.str());
+
+      std::vector<PayloadColumn> columns;
+      if (covering) {
+        PayloadColumn d = {(int)offsetof(tuple, d), (int)sizeof(double)};
+        columns.push_back(d);
+      }
+      double buildMs, scanMs;
+      long numRows = 0;
+      double sum = 0;
+      {
+        BufMgr bufMgr(frames);
+        PageFile file = PageFile::open(relationName);
+        Clock::time_point start = Clock::now();
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER, columns);
+        buildMs = elapsedMs(start);
+
+        // sum the column d over random ranges of the key
+        const int width = std::max(1, relationSize / 100);
+        std::vector<RecordId> rids(1024);
+        std::vector<double> payloads(1024);
+        srand(2);
+        start = Clock::now();
+        for (int s = 0; s < numScans; s++) {
+          int lowVal = rand() % (relationSize - width + 1);
+          int highVal = lowVal + width;
+          IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+          std::size_t n;
+          if (covering) {
+            while ((n = scan.scanNextBatch(rids.data(), payloads.data(),
+                                           rids.size())) > 0) {
+              for (std::size_t k = 0; k < n; k++) sum += payloads[k];
+              numRows += n;
+            }
+            continue;
+          }
+          while ((n = scan.scanNextBatch(rids.data(), rids.size())) > 0) {
+            for (std::size_t k = 0; k < n; k++) {
+              Page *page;
+              bufMgr.readPage(&file, rids[k].page_number, page);
+              sum += ((const RECORD *)page->getRecord(rids[k]).c_str())->d;
+              bufMgr.unPinPage(&file, rids[k].page_number, false);
+            }
+            numRows += n;
+          }
+        }
+        scanMs = elapsedMs(start);
+        bufMgr.flushFile(&file);
+      }
+      const bool right = numRows == (long)numScans * (relationSize / 100) &&
+                         sum > 0;
+
+      std::cout << std::setw(10) << (covering ? "covering" : "plain")
+                << std::fixed << std::setprecision(1) << std::setw(12)
+                << buildMs << std::setw(12) << fileSizeKb(intIndexName)
+                << std::setw(12) << scanMs << std::setw(14)
+                << numRows / scanMs / 1000
+                << (right ? "" : "  (wrong row count)") << std::endl;
+
+      removeFile(intIndexName);
+    });
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// counted: range counts and medians from a counted tree versus index scans
+// -----------------------------------------------------------------------------
+
+void benchCounted(const int relationSize) {
+  // every page of the index stays in the buffer pool
+  const std::uint32_t frames = relationSize / 150 + 64;
+  const int numQueries = 1000;
+  std::cout << "counted: " << relationSize << " tuples, " << frames
+            << " buffer frames, " << numQueries
+            << " queries, us per query" << std::endl;
+  std::cout << std::setw(8) << "tree" << std::setw(12) << "build ms"
+            << std::setw(12) << "count 1%" << std::setw(12) << "count 50%"
+            << std::setw(12) << "median" << std::endl;
+
+  createRelationRandom(relationSize, IO_BUFFERED);
+  for (bool counted : {false, true}) {
+    runIsolated([&]() {
+      std::ostringstream idxstr;
+      idxstr << relationName << '.' << offsetof(tuple, i);
+      removeFile(idxstr.str());
+
+      BTreeOptions options;
+      options.countedTree = counted;
+      double buildMs, countMs[2], medianMs;
+      bool right = true;
+      {
+        BufMgr bufMgr(frames);
+        Clock::time_point start = Clock::now();
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER, options);
+        buildMs = elapsedMs(start);
+
+        // the plain index counts the entries of a range with a scan
+        std::vector<RecordId> batch(1024);
+        auto countRange = [&](int lowVal, int highVal) {
+          if (counted) {
+            return index.countRange(&lowVal, GTE, &highVal, LT);
+          }
+          std::size_t numScanned = 0, n;
+          IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+          while ((n = scan.scanNextBatch(batch.data(), batch.size())) > 0) {
+            numScanned += n;
+          }
+          return numScanned;
+        };
+        const int widths[] = {std::max(1, relationSize / 100),
+                              relationSize / 2};
+        for (int w = 0; w < 2; w++) {
+          srand(2);
+          start = Clock::now();
+          for (int q = 0; q < numQueries; q++) {
+            const int lowVal = rand() % (relationSize - widths[w] + 1);
+            right &= countRange(lowVal, lowVal + widths[w]) ==
+                     (std::size_t)widths[w];
+          }
+          countMs[w] = elapsedMs(start);
+        }
+
+        // the median of the keys below a random bound, which the plain
+        // index finds by counting and then scanning to the middle
+        srand(3);
+        start = Clock::now();
+        for (int q = 0; q < numQueries; q++) {
+          const int highVal = 2 + rand() % (relationSize - 1);
+          const std::size_t below = counted ? index.rank(&highVal)
+                                            : countRange(0, highVal);
+          int median = -1;
+          if (counted) {
+            index.select(below / 2, &median);
+          } else {
+            int lowVal = 0;
+            IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+            std::size_t skip = below / 2;
+            while (skip > 0) {
+              skip -= scan.scanNextBatch(batch.data(),
+                                         std::min(skip, batch.size()));
+            }
+            RecordId rid;
+            scan.scanNext(rid);
+            median = below / 2;
+          }
+          right &= median == (int)(below / 2);
+        }
+        medianMs = elapsedMs(start);
+      }
+
+      std::cout << std::setw(8) << (counted ? "counted" : "plain")
+                << std::fixed << std::setprecision(1) << std::setw(12)
+                << buildMs << std::setw(12) << countMs[0] * 1000 / numQueries
+                << std::setw(12) << countMs[1] * 1000 / numQueries
+                << std::setw(12) << medianMs * 1000 / numQueries
+                << (right ? "" : "  (wrong results)") << std::endl;
+
+      removeFile(intIndexName);
+    });
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// bloom: point lookups of keys that are mostly not in the index, with and
+// without a Bloom filter
+// -----------------------------------------------------------------------------
+
+void benchBloom(const int relationSize) {
+  const int numProbes = 1000000;
+  std::cout << "bloom: " << relationSize << " entries, " << numProbes
+            << " probes, 1 in 10 of them matching, K probes per second"
+            << std::endl;
+  std::cout << std::setw(10) << "filter" << std::setw(10) << "frames"
+            << std::setw(12) << "insert ms" << std::setw(10) << "lookup"
+            << std::setw(10) << "batch 256" << std::setw(12) << "filter KB"
+            << std::endl;
+
+  // the index cached, and a pool that holds a small part of it
+  const std::uint32_t frameCounts[] = {(std::uint32_t)relationSize / 300 + 64,
+                                       64};
+  const double rates[] = {0, 0.01, 0.001};
+  for (const std::uint32_t frames : frameCounts) {
+    for (const double rate : rates) {
+      runIsolated([&]() {
+        removeFile(relationName);
+        { PageFile::create(relationName); }
+        std::ostringstream idxstr;
+        idxstr << relationName << '.' << offsetof(tuple, i);
+        removeFile(idxstr.str());
+
+        BTreeOptions options;
+        options.bloomFalsePositiveRate = rate;
+        double insertMs, lookupMs, batchMs;
+        int numFound[2];
+        {
+          BufMgr bufMgr(frames);
+          BTreeIndex index(relationName, intIndexName, &bufMgr,
+                           offsetof(tuple, i), INTEGER, options);
+          // the index holds every tenth key below 10 * relationSize, so the
+          // probes that miss spread over all leaves
+          std::vector<int> keys(relationSize);
+          for (int i = 0; i < relationSize; i++) keys[i] = 10 * i;
+          srand(1);
+          for (int i = relationSize - 1; i > 0; i--) {
+            std::swap(keys[i], keys[rand() % (i + 1)]);
+          }
+          RecordId rid;
+          rid.slot_number = 0;
+          Clock::time_point start = Clock::now();
+          for (int key : keys) {
+            rid.page_number = key + 1;
+            index.insertEntry(&key, rid);
+          }
+          insertMs = elapsedMs(start);
+
+          std::vector<int> probes(numProbes);
+          for (int &key : probes) key = rand() % (10 * relationSize);
+          start = Clock::now();
+          numFound[0] = 0;
+          for (int key : probes) numFound[0] += index.lookup(&key).has_value();
+          lookupMs = elapsedMs(start);
+          start = Clock::now();
+          numFound[1] = multiGetLookups(index, probes, 256);
+          batchMs = elapsedMs(start);
+        }
+
+        std::ostringstream name;
+        if (rate == 0) {
+          name << "none";
+        } else {
+          name << rate;
+        }
+        std::cout << std::setw(10) << name.str() << std::setw(10) << frames
+                  << std::fixed << std::setprecision(1) << std::setw(12)
+                  << insertMs << std::setw(10) << numProbes / lookupMs
+                  << std::setw(10) << numProbes / batchMs << std::setw(12)
+                  << fileSizeKb(BTreeIndex::bloomFileName(intIndexName))
+                  << (numFound[0] == numFound[1] ? "" : "  (wrong results)")
+                  << std::endl;
+
+        removeFile(intIndexName);
+        removeFile(BTreeIndex::bloomFileName(intIndexName));
+        removeFile(relationName);
+      });
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// hash: point lookups in an extendible hash index and in a B+ tree
+// -----------------------------------------------------------------------------
+
+void benchHash(const int relationSize) {
+  const int numProbes = 1000000;
+  std::cout << "hash: " << relationSize << " entries, " << numProbes
+            << " probes, half of them matching, K probes per second"
+            << std::endl;
+  std::cout << std::setw(10) << "index" << std::setw(10) << "frames"
+            << std::setw(12) << "build ms" << std::setw(10) << "lookup"
+            << std::setw(14) << "pages/lookup" << std::setw(12) << "index KB"
+            << std::endl;
+  createRelationRandom(relationSize, IO_BUFFERED);
+
+  // the index cached, and a pool that holds a small part of it
+  const std::uint32_t frameCounts[] = {(std::uint32_t)relationSize / 300 + 64,
+                                       64};
+  const char *const kinds[] = {"btree", "hash"};
+  for (const std::uint32_t frames : frameCounts) {
+    for (const char *kind : kinds) {
+      runIsolated([&]() {
+        const bool hash = std::string(kind) == "hash";
+        std::string indexName;
+        double buildMs, lookupMs;
+        int pageReads;
+        {
+          BufMgr bufMgr(frames);
+          BTreeOptions options;
+          options.bulkLoad = true;
+          Clock::time_point start = Clock::now();
+          std::unique_ptr<BTreeIndex> tree;
+          std::unique_ptr<HashIndex> hashIndex;
+          if (hash) {
+            hashIndex.reset(new HashIndex(relationName, indexName, &bufMgr,
+                                          offsetof(tuple, i), INTEGER));
+          } else {
+            tree.reset(new BTreeIndex(relationName, indexName, &bufMgr,
+                                      offsetof(tuple, i), INTEGER, options));
+          }
+          buildMs = elapsedMs(start);
+
+          std::vector<int> probes(numProbes);
+          srand(2);
+          for (int &key : probes) key = rand() % (2 * relationSize);
+          int numFound = 0;
+          bufMgr.clearBufStats();
+          start = Clock::now();
+          if (hash) {
+            for (int key : probes) {
+              numFound += hashIndex->lookup(&key).has_value();
+            }
+          } else {
+            for (int key : probes) numFound += tree->lookup(&key).has_value();
+          }
+          lookupMs = elapsedMs(start);
+          pageReads = bufMgr.getBufStats().pagereads;
+          if (numFound == 0) {
+            std::cout << "(no key found)" << std::endl;
+          }
+        }
+
+        std::cout << std::setw(10) << kind << std::setw(10) << frames
+                  << std::fixed << std::setprecision(1) << std::setw(12)
+                  << buildMs << std::setw(10) << numProbes / lookupMs
+                  << std::setprecision(2) << std::setw(14)
+                  << (double)pageReads / numProbes << std::setw(12)
+                  << fileSizeKb(indexName) << std::endl;
+        removeFile(indexName);
+      });
+    }
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// innercache: point lookups with the upper levels of the tree cached
+// -----------------------------------------------------------------------------
+
+void benchInnerCache(const int relationSize) {
+  const int numProbes = 1000000;
+  std::cout << "innercache: " << relationSize << " entries, " << numProbes
+            << " probes, half of them matching, K probes per second"
+            << std::endl;
+  std::cout << std::setw(10) << "levels" << std::setw(10) << "frames"
+            << std::setw(10) << "height" << std::setw(10) << "lookup"
+            << std::setw(14) << "pages/lookup" << std::endl;
+  createRelationRandom(relationSize, IO_BUFFERED);
+
+  // the index cached, and a pool that holds a small part of it
+  const std::uint32_t frameCounts[] = {(std::uint32_t)relationSize / 300 + 64,
+                                       64};
+  for (const std::uint32_t frames : frameCounts) {
+    for (int cachedLevels = 0; cachedLevels <= 2; cachedLevels++) {
+      runIsolated([&]() {
+        double lookupMs;
+        int pageReads, height;
+        {
+          BufMgr bufMgr(frames);
+          BTreeOptions options;
+          options.bulkLoad = true;
+          options.cachedLevels = cachedLevels;
+          BTreeIndex index(relationName, intIndexName, &bufMgr,
+                           offsetof(tuple, i), INTEGER, options);
+          height = index.stats().height;
+
+          std::vector<int> probes(numProbes);
+          srand(2);
+          for (int &key : probes) key = rand() % (2 * relationSize);
+          int numFound = 0;
+          bufMgr.clearBufStats();
+          Clock::time_point start = Clock::now();
+          for (int key : probes) numFound += index.lookup(&key).has_value();
+          lookupMs = elapsedMs(start);
+          pageReads = bufMgr.getBufStats().pagereads;
+          if (numFound == 0) {
+            std::cout << "(no key found)" << std::endl;
+          }
+        }
+
+        std::cout << std::setw(10) << cachedLevels << std::setw(10) << frames
+                  << std::setw(10) << height << std::fixed
+                  << std::setprecision(1) << std::setw(10)
+                  << numProbes / lookupMs << std::setprecision(2)
+                  << std::setw(14) << (double)pageReads / numProbes
+                  << std::endl;
+        removeFile(intIndexName);
+      });
+    }
+  }
+  removeFile(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// insertbuffer: inserts in random order with and without an insert buffer,
+// alone and between scans and counts
+// -----------------------------------------------------------------------------
+
+void benchInsertBuffer(const int relationSize) {
+  std::cout << "insertbuffer: " << relationSize
+            << " inserts in random order, K inserts per second" << std::endl;
+  std::cout << std::setw(10) << "buffer" << std::setw(10) << "frames"
+            << std::setw(10) << "io" << std::setw(10) << "insert"
+            << std::setw(14) << "reads/insert" << std::endl;
+  std::vector<int> keys(relationSize);
+  for (int i = 0; i < relationSize; i++) keys[i] = i;
+  srand(1);
+  for (int i = relationSize - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rand() % (i + 1)]);
+  }
+
+  // the index cached, and a pool that holds a small part of it
+  const std::uint32_t frameCounts[] = {(std::uint32_t)relationSize / 300 + 64,
+                                       64};
+  const FileIOMode modes[] = {IO_BUFFERED, IO_DIRECT};
+  const std::size_t bufferSizes[] = {0, (std::size_t)relationSize / 100,
+                                     (std::size_t)relationSize / 10};
+  for (const std::uint32_t frames : frameCounts) {
+    for (const FileIOMode mode : modes) {
+      for (const std::size_t bufferSize : bufferSizes) {
+        runIsolated([&]() {
+          removeFile(relationName);
+          { PageFile::create(relationName); }
+          removeFile(intIndexName);
+
+          BTreeOptions options;
+          options.ioMode = mode;
+          options.insertBufferEntries = bufferSize;
+          double insertMs;
+          int diskReads;
+          {
+            BufMgr bufMgr(frames);
+            BTreeIndex index(relationName, intIndexName, &bufMgr,
+                             offsetof(tuple, i), INTEGER, options);
+            RecordId rid;
+            rid.slot_number = 0;
+            bufMgr.clearBufStats();
+            Clock::time_point start = Clock::now();
+            for (int key : keys) {
+              rid.page_number = key + 1;
+              index.insertEntry(&key, rid);
+            }
+            index.flushInserts();
+            insertMs = elapsedMs(start);
+            diskReads = bufMgr.getBufStats().diskreads;
+          }
+
+          std::cout << std::setw(10) << bufferSize << std::setw(10) << frames
+                    << std::setw(10)
+                    << (mode == IO_DIRECT ? "direct" : "buffered")
+                    << std::fixed << std::setprecision(1) << std::setw(10)
+                    << relationSize / insertMs << std::setprecision(3)
+                    << std::setw(14) << (double)diskReads / relationSize
+                    << std::endl;
+          removeFile(intIndexName);
+          removeFile(relationName);
+        });
+      }
+    }
+  }
+
+  // a scan and a count of a short range every 100 inserts into a counted
+  // tree many times the size of the pool, which either see the buffered
+  // entries where they are or first flush the buffer
+  const int queryEvery = 100, queryWidth = 100;
+  const std::uint32_t frames = 64;
+  std::cout << "insertbuffer: " << relationSize
+            << " inserts in random order into a counted tree, a scan and a "
+            << "count of " << queryWidth << " keys every " << queryEvery
+            << ", " << frames << " buffer frames, K inserts per second"
+            << std::endl;
+  std::cout << std::setw(10) << "buffer" << std::setw(10) << "queries"
+            << std::setw(10) << "insert" << std::setw(14) << "reads/insert"
+            << std::endl;
+  const std::size_t buffers[] = {0, (std::size_t)relationSize / 10,
+                                 (std::size_t)relationSize / 10};
+  for (int run = 0; run < 3; run++) {
+    const std::size_t buffer = buffers[run];
+    const bool flushFirst = run == 1;
+    runIsolated([&]() {
+      removeFile(relationName);
+      { PageFile::create(relationName); }
+      removeFile(intIndexName);
+
+      BTreeOptions options;
+      options.countedTree = true;
+      options.insertBufferEntries = buffer;
+      double insertMs;
+      int diskReads;
+      bool right = true;
+      {
+        BufMgr bufMgr(frames);
+        BTreeIndex index(relationName, intIndexName, &bufMgr,
+                         offsetof(tuple, i), INTEGER, options);
+        std::vector<RecordId> batch(queryWidth);
+        RecordId rid;
+        rid.slot_number = 0;
+        srand(2);
+        bufMgr.clearBufStats();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < relationSize; i++) {
+          rid.page_number = keys[i] + 1;
+          index.insertEntry(&keys[i], rid);
+          if (i % queryEvery != queryEvery - 1) {
+            continue;
+          }
+          int lowVal = rand() % relationSize, highVal = lowVal + queryWidth;
+          if (flushFirst) {
+            index.flushInserts();
+          }
+          std::size_t numScanned = 0;
+          try {
+            IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+            numScanned = scan.scanNextBatch(batch.data(), batch.size());
+          } catch (NoSuchKeyFoundException &e) {
+          }
+          right &= index.countRange(&lowVal, GTE, &highVal, LT) == numScanned;
+        }
+        index.flushInserts();
+        insertMs = elapsedMs(start);
+        diskReads = bufMgr.getBufStats().diskreads;
+      }
+
+      std::cout << std::setw(10) << buffer << std::setw(10)
+                << (buffer == 0 ? "-" : flushFirst ? "flush" : "merge")
+                << std::fixed << std::setprecision(1) << std::setw(10)
+                << relationSize / insertMs << std::setprecision(3)
+                << std::setw(14) << (double)diskReads / relationSize
+                << (right ? "" : "  (wrong results)") << std::endl;
+      removeFile(intIndexName);
+      removeFile(relationName);
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+// lsm: inserts in random order, lookups and a scan, in an LSM index and in a
+// B+ tree
+// -----------------------------------------------------------------------------
+
+void benchLsm(const int relationSize) {
+  const int numProbes = 200000;
+  std::cout << "lsm: " << relationSize << " inserts in random order, "
+            << numProbes << " probes, half of them matching, and a full scan, "
+            << "K per second" << std::endl;
+  std::cout << std::setw(10) << "index" << std::setw(10) << "frames"
+            << std::setw(10) << "insert" << std::setw(14) << "writes/insert"
+            << std::setw(10) << "lookup" << std::setw(14) << "pages/lookup"
+            << std::setw(10) << "scan" << std::endl;
+  std::vector<int> keys(relationSize);
+  for (int i = 0; i < relationSize; i++) keys[i] = i;
+  srand(1);
+  for (int i = relationSize - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rand() % (i + 1)]);
+  }
+  std::vector<int> probes(numProbes);
+  for (int &key : probes) key = rand() % (2 * relationSize);
+
+  // the index cached, and a pool that holds a small part of it
+  const std::uint32_t frameCounts[] = {(std::uint32_t)relationSize / 300 + 64,
+                                       64};
+  const char *const kinds[] = {"btree", "lsm"};
+  for (const std::uint32_t frames : frameCounts) {
+    for (const char *kind : kinds) {
+      runIsolated([&]() {
+        const bool lsm = std::string(kind) == "lsm";
+        removeFile(relationName);
+        { PageFile::create(relationName); }
+        std::string indexName;
+        double insertMs, lookupMs, scanMs;
+        int diskWrites, pageReads;
+        {
+          BufMgr bufMgr(frames);
+          std::unique_ptr<BTreeIndex> tree;
+          std::unique_ptr<LSMIndex> lsmIndex;
+          LSMOptions options;
+          options.memtableEntries = relationSize / 100;
+          auto open = [&]() {
+            if (lsm) {
+              lsmIndex.reset(new LSMIndex(relationName, indexName, &bufMgr,
+                                          offsetof(tuple, i), INTEGER,
+                                          options));
+            } else {
+              tree.reset(new BTreeIndex(relationName, indexName, &bufMgr,
+                                        offsetof(tuple, i), INTEGER));
+            }
+          };
+          open();
+
+          // closing the index writes what the inserts left in memory
+          RecordId rid;
+          rid.slot_number = 0;
+          bufMgr.clearBufStats();
+          Clock::time_point start = Clock::now();
+          for (int key : keys) {
+            rid.page_number = key + 1;
+            if (lsm) {
+              lsmIndex->insertEntry(&key, rid);
+            } else {
+              tree->insertEntry(&key, rid);
+            }
+          }
+          lsmIndex.reset();
+          tree.reset();
+          insertMs = elapsedMs(start);
+          diskWrites = bufMgr.getBufStats().diskwrites;
+          open();
+
+          int numFound = 0;
+          bufMgr.clearBufStats();
+          start = Clock::now();
+          if (lsm) {
+            for (int key : probes) {
+              numFound += lsmIndex->lookup(&key).has_value();
+            }
+          } else {
+            for (int key : probes) numFound += tree->lookup(&key).has_value();
+          }
+          lookupMs = elapsedMs(start);
+          pageReads = bufMgr.getBufStats().pagereads;
+
+          const int lowVal = 0, highVal = relationSize;
+          int numScanned = 0;
+          start = Clock::now();
+          try {
+            if (lsm) {
+              lsmIndex->startScan(&lowVal, GTE, &highVal, LT);
+              while (true) {
+                lsmIndex->scanNext(rid);
+                numScanned++;
+              }
+            } else {
+              tree->startScan(&lowVal, GTE, &highVal, LT);
+              while (true) {
+                tree->scanNext(rid);
+                numScanned++;
+              }
+            }
+          } catch (IndexScanCompletedException &e) {
+          }
+          scanMs = elapsedMs(start);
+          if (numFound == 0 || numScanned != relationSize) {
+            std::cout << "(wrong result)" << std::endl;
+          }
+        }
+
+        std::cout << std::setw(10) << kind << std::setw(10) << frames
+                  << std::fixed << std::setprecision(1) << std::setw(10)
+                  << relationSize / insertMs << std::setprecision(3)
+                  << std::setw(14) << (double)diskWrites / relationSize
+                  << std::setprecision(1) << std::setw(10)
+                  << numProbes / lookupMs << std::setprecision(2)
+                  << std::setw(14) << (double)pageReads / numProbes
+                  << std::setprecision(1) << std::setw(10)
+                  << relationSize / scanMs << std::endl;
+        if (lsm) {
+          LSMIndex::removeIndex(indexName);
+        } else {
+          removeFile(indexName);
+        }
+        removeFile(relationName);
+      });
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const std::string which = argc > 1 ? argv[1] : "all";
+  const int relationSize = argc > 2 ? std::atoi(argv[2]) : 100000;
+
+  if (which == "all" || which == "directio") {
+    benchDirectIO(relationSize);
+  }
+  if (which == "all" || which == "batchread") {
+    benchBatchRead(relationSize);
+  }
+  if (which == "all" || which == "bulkload") {
+    benchBulkLoad(relationSize);
+  }
+  if (which == "all" || which == "extsort") {
+    benchExternalSort(relationSize);
+  }
+  if (which == "all" || which == "concurrent") {
+    benchConcurrent(relationSize);
+  }
+  if (which == "all" || which == "nodesearch") {
+    benchNodeSearch(relationSize);
+  }
+  if (which == "all" || which == "scanbatch") {
+    benchScanBatch(relationSize);
+  }
+  if (which == "all" || which == "multiget") {
+    benchMultiGet(relationSize);
+  }
+  if (which == "all" || which == "append") {
+    benchAppend(relationSize);
+  }
+  if (which == "all" || which == "postings") {
+    benchPostingLists(relationSize);
+  }
+  if (which == "all" || which == "compressed") {
+    benchCompressedLeaves(relationSize);
+  }
+  if (which == "all" || which == "covering") {
+    benchCovering(relationSize);
+  }
+  if (which == "all" || which == "counted") {
+    benchCounted(relationSize);
+  }
+  if (which == "all" || which == "bloom") {
+    benchBloom(relationSize);
+  }
+  if (which == "all" || which == "hash") {
+    benchHash(relationSize);
+  }
+  if (which == "all" || which == "innercache") {
+    benchInnerCache(relationSize);
+  }
+  if (which == "all" || which == "insertbuffer") {
+    benchInsertBuffer(relationSize);
+  }
+  if (which == "all" || which == "lsm") {
+    benchLsm(relationSize);
+  }
+
+  return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Bit packing of the entries of compressed leaves.
+ *
+ * A field of up to 57 bits is read or written at any bit offset with one
+ * unaligned 64 bit load, and store, of the bytes that hold it, so the 7 bytes
+ * after the last field must be readable and a write stores them back
+ * unchanged. unpackInts() and unpackRecordIds() unpack fields spaced a fixed
+ * number of bits apart: four at a time with a gather and per lane shifts when
+ * the code is compiled for AVX2 (-mavx2), else one at a time.
+ */
+#if defined(__AVX2__)
+const char *const BITPACKISA = "avx2";
+#else
+const char *const BITPACKISA = "scalar";
+#endif
+
+static_assert(sizeof(RecordId) == 8 && offsetof(RecordId, slot_number) == 4,
+              "record ids are unpacked as 64 bit lanes");
+
+/**
+ * Mask of the low width bits.
+ */
+inline std::uint64_t lowBits(const int width) {
+  return width == 0 ? 0 : ~(std::uint64_t)0 >> (64 - width);
+}
+
+/**
+ * Number of bits needed for the values 0 to maxValue.
+ */
+inline int bitsFor(std::uint64_t maxValue) {
+  int bits = 0;
+  while (maxValue != 0) {
+    bits++;
+    maxValue >>= 1;
+  }
+  return bits;
+}
+
+inline std::uint64_t readBits(const unsigned char *data,
+                              const std::size_t bitPos, const int width) {
+  std::uint64_t word;
+  memcpy(&word, data + bitPos / 8, sizeof(word));
+  return (word >> (bitPos % 8)) & lowBits(width);
+}
+
+inline void writeBits(unsigned char *data, const std::size_t bitPos,
+                      const int width, const std::uint64_t value) {
+  std::uint64_t word;
+  memcpy(&word, data + bitPos / 8, sizeof(word));
+  const int shift = bitPos % 8;
+  word = (word & ~(lowBits(width) << shift)) | (value << shift);
+  memcpy(data + bitPos / 8, &word, sizeof(word));
+}
+
+/**
+ * Moves the bits [from, to) up by distance bits, as for inserting a field at
+ * from, a 56 bit chunk at a time starting with the highest.
+ */
+inline void moveBitsUp(unsigned char *data, const std::size_t from,
+                       const std::size_t to, const std::size_t distance) {
+  const int CHUNK = 56;
+  std::size_t end = to;
+  while (end > from) {
+    const int width = end - from < (std::size_t)CHUNK ? end - from : CHUNK;
+    end -= width;
+    writeBits(data, end + distance, width, readBits(data, end, width));
+  }
+}
+
+#if defined(__AVX2__)
+/**
+ * The fields at the four bit positions of pos.
+ */
+inline __m256i gatherBits(const unsigned char *data, const __m256i pos,
+                          const __m256i mask) {
+  const __m256i words = _mm256_i64gather_epi64(
+      (const long long *)data, _mm256_srli_epi64(pos, 3), 1);
+  return _mm256_and_si256(
+      _mm256_srlv_epi64(words, _mm256_and_si256(pos, _mm256_set1_epi64x(7))),
+      mask);
+}
+
+/**
+ * Bit positions of four fields stride bits apart, starting at bitPos.
+ */
+inline __m256i fieldPositions(const std::size_t bitPos, const int stride) {
+  return _mm256_add_epi64(
+      _mm256_set1_epi64x(bitPos),
+      _mm256_setr_epi64x(0, stride, 2 * stride, 3 * stride));
+}
+#endif
+
+/**
+ * Unpacks n fields of width bits, the first at bitPos and each stride bits
+ * after the one before, to out[i] = base + field. The sum wraps around like
+ * unsigned arithmetic, so a base and fields of 32 bits give any int.
+ */
+inline void unpackInts(const unsigned char *data, const std::size_t bitPos,
+                       const int stride, const int width, const int base,
+                       const int n, int *out) {
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi64x(lowBits(width));
+  const __m256i step = _mm256_set1_epi64x(4 * (std::int64_t)stride);
+  // the low halves of the four 64 bit lanes
+  const __m256i lows = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m128i baseV = _mm_set1_epi32(base);
+  __m256i pos = fieldPositions(bitPos, stride);
+  for (; i + 4 <= n; i += 4) {
+    const __m256i fields = gatherBits(data, pos, mask);
+    const __m128i values = _mm_add_epi32(
+        _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(fields, lows)),
+        baseV);
+    _mm_storeu_si128((__m128i *)(out + i), values);
+    pos = _mm256_add_epi64(pos, step);
+  }
+#endif
+  for (; i < n; i++) {
+    const std::uint64_t field =
+        readBits(data, bitPos + (std::size_t)i * stride, width);
+    out[i] = (int)((std::uint32_t)base + (std::uint32_t)field);
+  }
+}
+
+/**
+ * Unpacks n record ids, the first at bitPos and each stride bits after the
+ * one before. A record id is packed as its page number less pageBase in
+ * pageBits bits followed by its slot number in slotBits bits, the slot in the
+ * low bits.
+ */
+inline void unpackRecordIds(const unsigned char *data,
+                            const std::size_t bitPos, const int stride,
+                            const int pageBits, const int slotBits,
+                            const PageId pageBase, const int n,
+                            RecordId *out) {
+  const int width = pageBits + slotBits;
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi64x(lowBits(width));
+  const __m256i slotMask = _mm256_set1_epi64x(lowBits(slotBits));
+  const __m256i pageMask = _mm256_set1_epi64x(0xFFFFFFFF);
+  const __m256i baseV = _mm256_set1_epi64x(pageBase);
+  const __m128i slotShift = _mm_cvtsi32_si128(slotBits);
+  const __m256i step = _mm256_set1_epi64x(4 * (std::int64_t)stride);
+  __m256i pos = fieldPositions(bitPos, stride);
+  for (; i + 4 <= n; i += 4) {
+    const __m256i fields = gatherBits(data, pos, mask);
+    // a lane is a RecordId: the page number in the low 32 bits, the slot
+    // number above it and zero padding
+    const __m256i pages = _mm256_and_si256(
+        _mm256_add_epi64(_mm256_srl_epi64(fields, slotShift), baseV),
+        pageMask);
+    const __m256i slots = _mm256_and_si256(fields, slotMask);
+    _mm256_storeu_si256((__m256i *)(out + i),
+                        _mm256_or_si256(pages, _mm256_slli_epi64(slots, 32)));
+    pos = _mm256_add_epi64(pos, step);
+  }
+#endif
+  for (; i < n; i++) {
+    const std::uint64_t field =
+        readBits(data, bitPos + (std::size_t)i * stride, width);
+    out[i].page_number = pageBase + (PageId)(field >> slotBits);
+    out[i].slot_number = (SlotId)(field & lowBits(slotBits));
+  }
+}
+
+}  // namespace badgerdb
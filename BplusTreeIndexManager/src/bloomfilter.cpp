@@ -0,0 +1,126 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "bloomfilter.h"
+
+namespace badgerdb {
+
+BloomFilter::BloomFilter()
+	: capacity(0), numBlocks(0), numHashes(0)
+{
+}
+
+void BloomFilter::reset(const std::uint64_t numKeys, const double falsePositiveRate)
+{
+  // the bits per key and bits per hash of a plain Bloom filter; confining a
+  // key to one block costs a little more of both
+  const double ln2 = std::log(2.0);
+  const double bitsPerKey = -std::log(falsePositiveRate) / (ln2 * ln2) * 1.1;
+  const std::uint64_t bits = std::max<std::uint64_t>(1, numKeys) * bitsPerKey;
+  allocate(numKeys, std::max<std::uint64_t>(1, (bits + BLOCKBITS - 1) / BLOCKBITS),
+           std::min(MAXHASHES, std::max(1, (int)std::lround(bitsPerKey * ln2))));
+}
+
+void BloomFilter::allocate(const std::uint64_t capacityIn, const std::uint32_t numBlocksIn,
+                           const int numHashesIn)
+{
+  capacity = capacityIn;
+  numBlocks = numBlocksIn;
+  numHashes = numHashesIn;
+  words.reset(new std::atomic<std::uint64_t>[(std::size_t)numBlocks * BLOCKWORDS]);
+  for (std::size_t w = 0; w < (std::size_t)numBlocks * BLOCKWORDS; w++)
+    words[w].store(0, std::memory_order_relaxed);
+}
+
+std::size_t BloomFilter::blockOf(const std::uint64_t hash) const
+{
+  // the high half of the hash scaled to the number of blocks
+  return (std::size_t)(((hash >> 32) * numBlocks) >> 32) * BLOCKWORDS;
+}
+
+void BloomFilter::bitsOf(const std::uint64_t hash, std::uint32_t *bits) const
+{
+  // h1 + i * h2 for an odd h2, so that the bits differ, with h1 and h2 taken
+  // from the low half of the hash mixed with itself
+  std::uint64_t mixed = hash * 0xff51afd7ed558ccdULL;
+  mixed ^= mixed >> 33;
+  const std::uint32_t h1 = mixed % BLOCKBITS;
+  const std::uint32_t h2 = (mixed >> 9) | 1;
+  for (int i = 0; i < numHashes; i++)
+    bits[i] = (h1 + i * h2) % BLOCKBITS;
+}
+
+void BloomFilter::add(const std::uint64_t hash)
+{
+  if (numBlocks == 0)
+    return;
+  std::atomic<std::uint64_t> *block = &words[blockOf(hash)];
+  std::uint32_t bits[MAXHASHES];
+  bitsOf(hash, bits);
+  for (int i = 0; i < numHashes; i++)
+    block[bits[i] / 64].fetch_or((std::uint64_t)1 << (bits[i] % 64),
+                                 std::memory_order_relaxed);
+}
+
+bool BloomFilter::mayContain(const std::uint64_t hash) const
+{
+  if (numBlocks == 0)
+    return false;
+  const std::atomic<std::uint64_t> *block = &words[blockOf(hash)];
+  std::uint32_t bits[MAXHASHES];
+  bitsOf(hash, bits);
+  for (int i = 0; i < numHashes; i++)
+    if ((block[bits[i] / 64].load(std::memory_order_relaxed) >> (bits[i] % 64) & 1) == 0)
+      return false;
+  return true;
+}
+
+PageId BloomFilter::save(File *file, BufMgr *bufMgr) const
+{
+  const std::size_t numWords = (std::size_t)numBlocks * BLOCKWORDS;
+  const std::size_t pageWords = Page::SIZE / sizeof(std::uint64_t);
+  PageId firstPageNo = 0;
+  for (std::size_t first = 0; first < numWords; first += pageWords) {
+    PageId pageNo;
+    Page *page;
+    bufMgr->allocPage(file, pageNo, page);
+    if (firstPageNo == 0)
+      firstPageNo = pageNo;
+    std::uint64_t *out = (std::uint64_t *)page;
+    const std::size_t n = std::min(pageWords, numWords - first);
+    for (std::size_t w = 0; w < n; w++)
+      out[w] = words[first + w].load(std::memory_order_relaxed);
+    bufMgr->unPinPage(file, pageNo, true);
+  }
+  bufMgr->flushFile(file);
+  return firstPageNo;
+}
+
+void BloomFilter::load(File *file, BufMgr *bufMgr, const std::uint64_t capacityIn,
+                       const std::uint32_t numBlocksIn, const int numHashesIn,
+                       const PageId firstPageNo)
+{
+  allocate(capacityIn, numBlocksIn, numHashesIn);
+  const std::size_t numWords = (std::size_t)numBlocks * BLOCKWORDS;
+  const std::size_t pageWords = Page::SIZE / sizeof(std::uint64_t);
+  // the pages of a saved filter are numbered one after another
+  PageId pageNo = firstPageNo != 0 ? firstPageNo : file->getFirstPageNo();
+  for (std::size_t first = 0; first < numWords; first += pageWords) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page);
+    const std::uint64_t *in = (const std::uint64_t *)page;
+    const std::size_t n = std::min(pageWords, numWords - first);
+    for (std::size_t w = 0; w < n; w++)
+      words[first + w].store(in[w], std::memory_order_relaxed);
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo++;
+  }
+}
+
+}
@@ -0,0 +1,121 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief A blocked Bloom filter of 64 bit hashes of keys.
+ *
+ * A hash picks one block of BLOCKBITS bits, the size of a cache line, and
+ * sets numHashes bits in it, so a probe reads a single cache line. A filter
+ * has no false negatives: mayContain() is true for every hash that was added.
+ * Bits are set atomically, so hashes may be added while others are probed.
+ * The blocks are saved to and loaded from the pages of a BlobFile through the
+ * BufMgr, Page::SIZE bytes of blocks to a page.
+ */
+class BloomFilter
+{
+ public:
+  /**
+   * Bits of a block.
+   */
+  static const int BLOCKBITS = 512;
+
+  /**
+   * An empty filter with no blocks, which holds no hash.
+   */
+  BloomFilter();
+
+  /**
+   * Clears the filter and sizes it for numKeys hashes at about the given rate
+   * of false positives.
+   *
+   * @param numKeys            Number of hashes the filter is sized for
+   * @param falsePositiveRate  Fraction of hashes that were not added for which
+   *                           mayContain() is true, in (0, 1)
+   */
+  void reset(const std::uint64_t numKeys, const double falsePositiveRate);
+
+  /**
+   * Adds a hash.
+   */
+  void add(const std::uint64_t hash);
+
+  /**
+   * Whether the hash may have been added. False only if it was not.
+   */
+  bool mayContain(const std::uint64_t hash) const;
+
+  /**
+   * Number of hashes the filter was sized for, its blocks and the bits a
+   * hash sets.
+   */
+  std::uint64_t getCapacity() const { return capacity; }
+  std::uint32_t getNumBlocks() const { return numBlocks; }
+  int getNumHashes() const { return numHashes; }
+
+  /**
+   * Writes the blocks to new pages at the end of a file, one after another,
+   * and flushes the file.
+   *
+   * @return the page number of the first of them
+   */
+  PageId save(File *file, BufMgr *bufMgr) const;
+
+  /**
+   * Reads the blocks of a filter of the given shape from the pages of a file
+   * it was saved to, starting at firstPageNo, or at the first page of the
+   * file if it is 0.
+   */
+  void load(File *file, BufMgr *bufMgr, const std::uint64_t capacity,
+            const std::uint32_t numBlocks, const int numHashes,
+            const PageId firstPageNo = 0);
+
+ private:
+  /**
+   * Words of a block.
+   */
+  static const int BLOCKWORDS = BLOCKBITS / 64;
+
+  /**
+   * Most bits a hash sets.
+   */
+  static const int MAXHASHES = 16;
+
+  /**
+   * Allocates the blocks of the given shape, all bits clear.
+   */
+  void allocate(const std::uint64_t capacity, const std::uint32_t numBlocks,
+                const int numHashes);
+
+  /**
+   * First word of the block of a hash.
+   */
+  std::size_t blockOf(const std::uint64_t hash) const;
+
+  /**
+   * Sets bits to the numHashes bits of a hash in its block.
+   */
+  void bitsOf(const std::uint64_t hash, std::uint32_t *bits) const;
+
+  std::uint64_t capacity;
+  std::uint32_t numBlocks;
+  int numHashes;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> words;
+};
+
+}
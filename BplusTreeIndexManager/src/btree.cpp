@@ -10,6 +10,16 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -17,8 +27,12 @@
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/not_counted_tree_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
+#include "bitpack.h"
+#include "externalsort.h"
 #include "filescan.h"
+#include "keysearch.h"
 
 //#define DEBUG
 
@@ -30,591 +44,4263 @@ void page_set(IndexMetaInfo *newNode){
     newNode->attrType = INTEGER;
     newNode->rootPageNo = 0;
     newNode->initialRootPageNum = 0;
+    newNode->numPayloadColumns = 0;
+    memset(newNode->payloadColumns, 0, sizeof(newNode->payloadColumns));
+    newNode->countedTree = false;
+    memset(&newNode->counters, 0, sizeof(newNode->counters));
+    newNode->bloomRate = 0;
+    newNode->bloomCapacity = 0;
+    newNode->bloomBlocks = 0;
+    newNode->bloomHashes = 0;
+    newNode->bloomVersion = 0;
+    newNode->leafPostings = false;
 }
 
-void page_set(NonLeafNodeInt *newNode){
+template <class T>
+void page_set(NonLeafNode<T> *newNode){
     newNode->level = 0;
     newNode->keyNum = 0;
-    for (int i = 0 ; i < INTARRAYNONLEAFSIZE ; i ++){
-        newNode->keyArray[i] = 0;
-        newNode->pageNoArray[i] = 0;
-    }
-    newNode->pageNoArray[INTARRAYNONLEAFSIZE] = 0;
+    memset(newNode->keyArray, 0, sizeof(newNode->keyArray));
+    memset(newNode->pageNoArray, 0, sizeof(newNode->pageNoArray));
 }
 
-void page_set(LeafNodeInt *newNode){
+template <class T>
+void page_set(LeafNode<T> *newNode){
     newNode->rightSibPageNo = 0;
     newNode->keyNum = 0;
-    for (int i = 0 ; i < INTARRAYLEAFSIZE ; i ++){
-        newNode->keyArray[i] = 0;
-        newNode->ridArray[i].page_number = 0;
-        newNode->ridArray[i].slot_number = 0;
-    }
+    memset(newNode->keyArray, 0, sizeof(newNode->keyArray));
+    memset(newNode->ridArray, 0, sizeof(newNode->ridArray));
+}
+
+BufAccess node_access(const IndexMetaInfo *){
+    return ACCESS_INDEX_INNER;
+}
+
+template <class T>
+BufAccess node_access(const NonLeafNode<T> *){
+    return ACCESS_INDEX_INNER;
+}
+
+template <class T>
+BufAccess node_access(const LeafNode<T> *){
+    return ACCESS_INDEX_LEAF;
+}
+
+void page_set(PostingPage *newNode){
+    newNode->nextPageNo = 0;
+    newNode->lastPageNo = 0;
+    newNode->count = 0;
+    newNode->numBytes = 0;
+    newNode->firstId = 0;
+    newNode->lastId = 0;
+}
+
+BufAccess node_access(const PostingPage *){
+    return ACCESS_INDEX_LEAF;
+}
+
+void page_set(CompressedLeafInt *newNode){
+    newNode->numEntries = 0;
+    newNode->keyBase = 0;
+    newNode->pageBase = 0;
+    newNode->keyBits = 0;
+    newNode->pageBits = 0;
+    newNode->slotBits = 0;
+    newNode->unused = 0;
+    memset(newNode->data, 0, sizeof(newNode->data));
+    newNode->rightSibPageNo = 0;
+    newNode->keyNum = COMPRESSEDLEAF;
+}
+
+BufAccess node_access(const CompressedLeafInt *){
+    return ACCESS_INDEX_LEAF;
 }
 
 /**
- * Allocate a NonLeafNodeInt or LeafNodeInt
- *
- * @param newPageId page id used to contain allocated page id
- * @return newNode NonLeafNodeInt or LeafNodeInt
+ * Record ids of a posting list packed into one sortable integer.
  */
-template <class T>
-T *BTreeIndex::allocNode(PageId &newPageId) {
-    Page *dummy;
-    bufMgr->allocPage(file, newPageId, dummy);
-    T *newNode = (T *)dummy;
-    page_set(newNode);
-    return newNode;
+std::uint64_t posting_id(const RecordId &rid){
+    return (std::uint64_t)rid.page_number << 16 | rid.slot_number;
 }
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::BTreeIndex -- Constructor
-// -----------------------------------------------------------------------------
+RecordId posting_rid(const std::uint64_t id){
+    RecordId rid;
+    rid.page_number = (PageId)(id >> 16);
+    rid.slot_number = (SlotId)(id & 0xFFFF);
+    return rid;
+}
 
 /**
- * Constructor
- *
- * The constructor first checks if the specified index file exists.
- * If the index file exists, the file is opened. Else, a new index file is
- * created.
- *
- * @param relationName name of the relation on which to build the index
- * @param outIndexName name of the index file
- * @param bufMgrIn global buffer manager
- * @param attrByteOffset byte offset of the attribute to build the index
- * @param attrType data type of the indexing attribute
+ * Writes value to bytes as a varint, 7 bits a byte with the high bit set on
+ * all but the last.
+ * @return number of bytes written, at most 10
  */
-BTreeIndex::BTreeIndex(const std::string &relationName,
-                       std::string &outIndexName, BufMgr *bufMgrIn,
-                       const int attrByteOffset, const Datatype attrType) {
-  // initialize global varaibles
-  this->bufMgr = bufMgrIn;
-  this->attrByteOffset = attrByteOffset;
-  this->attributeType = attrType;
+int posting_varint(std::uint64_t value, unsigned char *bytes){
+    int len = 0;
+    do {
+        bytes[len] = (value & 0x7F) | (value >= 0x80 ? 0x80 : 0);
+        value >>= 7;
+        len++;
+    } while (value != 0);
+    return len;
+}
 
-  // construct index name
-  std::ostringstream idxstr;
-  idxstr << relationName << '.' << attrByteOffset;
-  outIndexName = idxstr.str();
+/**
+ * Reads a varint from data into value.
+ * @return the byte after it
+ */
+const unsigned char *posting_unvarint(const unsigned char *data,
+                                      std::uint64_t &value){
+    value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = *data++;
+        value |= (std::uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return data;
+}
 
-  // test if index file exists
-  try {
-    this->file = new BlobFile(outIndexName, false);
-    // read meta info
-    this->headerPageNum = file->getFirstPageNo();
-    Page *headerPage;
-    bufMgr->readPage(file, headerPageNum, headerPage);
-    // get the page that contain meta info
-    IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
+/**
+ * Appends an id to a posting page as a varint of its difference to the last
+ * one, if it is not smaller and fits.
+ * @return whether the id was appended
+ */
+bool posting_append(PostingPage *page, const std::uint64_t id){
+    unsigned char bytes[10];
+    const int len =
+        posting_varint(page->count == 0 ? id : id - page->lastId, bytes);
+    if (page->numBytes + len > POSTINGPAGEBYTES) {
+        return false;
+    }
+    memcpy(page->data + page->numBytes, bytes, len);
+    page->numBytes += len;
+    if (page->count == 0) {
+        page->firstId = id;
+    }
+    page->lastId = id;
+    page->count++;
+    return true;
+}
 
-    if (relationName != meta->relationName || attrType != meta->attrType ||
-        attrByteOffset != meta->attrByteOffset) {
-      throw BadIndexInfoException(outIndexName);
+/**
+ * Appends the ids of a posting page to ids.
+ */
+void posting_decode(const PostingPage *page, std::vector<std::uint64_t> &ids){
+    const unsigned char *data = page->data;
+    std::uint64_t id = 0;
+    for (int n = 0; n < page->count; n++) {
+        std::uint64_t delta;
+        data = posting_unvarint(data, delta);
+        id += delta;
+        ids.push_back(id);
     }
+}
 
-    // set B-tree object
-    this->rootPageNum = meta->rootPageNo;
-    this->initialRootPageNum = meta->initialRootPageNum;
-    this->scanExecuting = false;
+/**
+ * Appends the record ids of a posting page to rids. Deltas of one byte, the
+ * common case in a dense list, take no inner loop.
+ */
+void posting_read(const PostingPage *page, std::vector<RecordId> &rids){
+    const std::size_t size = rids.size();
+    rids.resize(size + page->count);
+    RecordId *out = rids.data() + size;
+    const unsigned char *data = page->data;
+    std::uint64_t id = 0;
+    for (int n = 0; n < page->count; n++) {
+        std::uint64_t delta = *data++;
+        if (delta & 0x80) {
+            delta &= 0x7F;
+            int shift = 7;
+            unsigned char byte;
+            do {
+                byte = *data++;
+                delta |= (std::uint64_t)(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+        }
+        id += delta;
+        out[n] = posting_rid(id);
+    }
+}
 
-    // write page
-    bufMgr->unPinPage(file, headerPageNum, false);
-  } catch (BadgerDbException &e) {
-    file = new BlobFile(outIndexName, true);
-    IndexMetaInfo *meta = allocNode<IndexMetaInfo>(this->headerPageNum);
+/**
+ * Empties a posting page and fills it with the ids [from, to), as many as fit.
+ * @return the id after the last one written
+ */
+std::size_t posting_fill(PostingPage *page, const std::vector<std::uint64_t> &ids,
+                         std::size_t from, const std::size_t to){
+    page->count = 0;
+    page->numBytes = 0;
+    while (from < to && posting_append(page, ids[from])) {
+        from++;
+    }
+    return from;
+}
 
-    // initialize B+ tree object in b-tree the init root page should be leaf
-    LeafNodeInt *page = allocNode<LeafNodeInt>(this->rootPageNum);
-    this->initialRootPageNum = this->rootPageNum;
-    this->scanExecuting = false;
-    page->rightSibPageNo = 0;
+/**
+ * Inline posting lists, see POSTINGINLINE. The lists of a leaf are packed
+ * together at the end of its record id slots, in its heap, and an entry gives
+ * the distance of its list from the end, which only changes when a list
+ * closer to the end goes away. A list starts with the last id whole, so that
+ * appends need not decode it, and then holds two varints for every id: the
+ * difference of its page number to the one before it, and its slot number,
+ * or the difference of the slot numbers on the same page. Unlike the deltas
+ * of packed ids, which take three bytes from one page to the next, a list of
+ * records on nearby pages takes two bytes an id.
+ */
+const int INLINEHEADER = sizeof(std::uint64_t);
 
-    // initialize indexMetaInfo for header page
-    meta->rootPageNo = this->rootPageNum;
-    meta->initialRootPageNum = this->initialRootPageNum;
-    meta->attrByteOffset = attrByteOffset;
-    meta->attrType = attrType;
-    strncpy(meta->relationName, relationName.c_str(), 20);
+bool inline_is(const RecordId &rid){
+    return rid.slot_number == POSTINGLISTSLOT &&
+           (rid.page_number & POSTINGINLINE) != 0;
+}
 
-    // set some meta info for B+ tree
+RecordId inline_rid(const int offset, const int len){
+    RecordId rid;
+    rid.page_number = POSTINGINLINE | (PageId)offset << 14 | (PageId)len;
+    rid.slot_number = POSTINGLISTSLOT;
+    return rid;
+}
 
-    // write page
-    bufMgr->unPinPage(file, this->rootPageNum, true);
-    bufMgr->unPinPage(file, this->headerPageNum, true);
+int inline_offset(const RecordId &rid){
+    return rid.page_number >> 14 & 0x3FFF;
+}
 
-    // scan the relation and insert entries
-    FileScan scan(relationName, bufMgr);
-    RecordId rid;
-    try {
-      while (true) {
-        scan.scanNext(rid);
-        std::string recordStr = scan.getRecord();
-        const char *record = recordStr.c_str();
-        int key = *((int *)(record + attrByteOffset));
-        insertEntry(&key, rid);
-      }
-    } catch (EndOfFileException &e) {
-    }
-  }
+int inline_length(const RecordId &rid){
+    return rid.page_number & 0x3FFF;
+}
+
+template <class T>
+unsigned char *inline_heap_end(const LeafNode<T> *leaf){
+    return (unsigned char *)(leaf->ridArray + KeyTraits<T>::LEAFSIZE);
+}
+
+template <class T>
+const unsigned char *inline_bytes(const LeafNode<T> *leaf,
+                                  const RecordId &rid){
+    return inline_heap_end(leaf) - inline_offset(rid);
 }
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
-// -----------------------------------------------------------------------------
 /**
- * Destructor
- *
- * clearing up any state variables,
- * unpinning any B+ Tree pages that are pinned,
- * and flushing the index file
- *
- * Note that this method does not delete the index file!
- * But, deletion of the file object is required,
- * which will call thedestructor of File class causing the index file to be
- * closed.
+ * Most bytes of a list kept in a leaf: the record id slots of a leaf with no
+ * other entry.
  */
-BTreeIndex::~BTreeIndex() {
-  if (scanExecuting) {
-    endScan();
-  }
-  bufMgr->flushFile(this->file);
-  delete this->file;
-  this->file = nullptr;
+template <class T>
+int inline_max(){
+    return (KeyTraits<T>::LEAFSIZE - 1) * (int)sizeof(RecordId);
 }
 
 /**
- * @param  page given NonLeafNode
- * @return whether it is a non leaf node just above the leaf node
+ * Bytes of the heap of a leaf, and the record id slots they take.
  */
-bool BTreeIndex::isLevelOneNode(const NonLeafNodeInt *page) {
-  return page->level == 1;
+template <class T>
+int inline_heap_size(const LeafNode<T> *leaf){
+    int heap = 0;
+    for (int i = 0; i < leaf->keyNum; i++) {
+        if (inline_is(leaf->ridArray[i])) {
+            heap += inline_length(leaf->ridArray[i]);
+        }
+    }
+    return heap;
+}
+
+int inline_slots(const int heap){
+    return (heap + (int)sizeof(RecordId) - 1) / (int)sizeof(RecordId);
 }
 
 /**
- * findIndexInNonLeaf
- *
- * @param nonLeafNode
- * @param key
- * @return loc
+ * Writes the varints of id, which follows prev in a list, to bytes.
+ * @return number of bytes written
  */
-int BTreeIndex::findIndexInNonLeaf(const NonLeafNodeInt *nonLeafNode,
-                                   const void *key) {
-  int loc = std::lower_bound(nonLeafNode->keyArray,
-                             nonLeafNode->keyArray + nonLeafNode->keyNum,
-                             *(int *)key) -
-            nonLeafNode->keyArray;
-  // in case page is full and then seg fault
-  return loc > INTARRAYNONLEAFSIZE ? -1 : loc;
+int inline_varints(const std::uint64_t prev, const std::uint64_t id,
+                   unsigned char *bytes){
+    const std::uint64_t pages = (id >> 16) - (prev >> 16);
+    const std::uint64_t slot = id & 0xFFFF;
+    const int len = posting_varint(pages, bytes);
+    return len + posting_varint(pages == 0 ? slot - (prev & 0xFFFF) : slot,
+                                bytes + len);
 }
 
 /**
- * Given a key, find index of the first element that larger than it
- * For 1 3 5 7 and key = 2 return 1
- * If array is empty, will return 0
- *
- * @param leafNode
- * @param key
- * @return loc
+ * Reads the varints of the id after id at data into id.
+ * @return the byte after them
  */
-int BTreeIndex::findIndexInLeaf(const LeafNodeInt *leafNode, const void *key) {
-  int loc =
-      std::lower_bound(leafNode->keyArray,
-                       leafNode->keyArray + leafNode->keyNum, *(int *)key) -
-      leafNode->keyArray;
-  return loc > INTARRAYLEAFSIZE ? -1 : loc;
+const unsigned char *inline_unvarints(const unsigned char *data,
+                                      std::uint64_t &id){
+    std::uint64_t pages, slot;
+    data = posting_unvarint(data, pages);
+    data = posting_unvarint(data, slot);
+    id = pages == 0 ? id + slot : ((id >> 16) + pages) << 16 | slot;
+    return data;
 }
 
 /**
- * insertToLeaf
- *
- * @param leafNode
- * @param index
- * @param key
- * @param rid
+ * Writes the bytes of a list of the sorted ids to bytes.
  */
-void BTreeIndex::insertToLeaf(LeafNodeInt *leafNode, const int index,
-                              const void *key, const RecordId rid) {
-  const size_t len = INTARRAYLEAFSIZE - index - 1;
+void inline_encode(const std::vector<std::uint64_t> &ids,
+                   std::vector<unsigned char> &bytes){
+    bytes.resize(INLINEHEADER + ids.size() * 20);
+    memcpy(bytes.data(), &ids.back(), INLINEHEADER);
+    std::size_t len = INLINEHEADER;
+    std::uint64_t prev = 0;
+    for (const std::uint64_t id : ids) {
+        len += inline_varints(prev, id, bytes.data() + len);
+        prev = id;
+    }
+    bytes.resize(len);
+}
 
-  // shift elements from the index
-  memmove(&leafNode->keyArray[index + 1], &leafNode->keyArray[index],
-          len * sizeof(int));
-  memmove(&leafNode->ridArray[index + 1], &leafNode->ridArray[index],
-          len * sizeof(RecordId));
+/**
+ * Appends the ids of the list of len bytes at bytes to ids.
+ */
+void inline_decode(const unsigned char *bytes, const int len,
+                   std::vector<std::uint64_t> &ids){
+    const unsigned char *data = bytes + INLINEHEADER;
+    const unsigned char *end = bytes + len;
+    std::uint64_t id = 0;
+    while (data < end) {
+        data = inline_unvarints(data, id);
+        ids.push_back(id);
+    }
+}
 
-  leafNode->keyNum++;
-  this->leafOccupancy++;
+/**
+ * Number of ids of a list, one for every two varints.
+ */
+int inline_count(const unsigned char *bytes, const int len){
+    int count = 0;
+    for (int pos = INLINEHEADER; pos < len; pos++) {
+        count += (bytes[pos] & 0x80) == 0;
+    }
+    return count / 2;
+}
 
-  // store the KV into this node
-  leafNode->keyArray[index] = *(int *)key;
-  leafNode->ridArray[index] = rid;
+/**
+ * Appends the record ids of a list to rids. Varints of one byte, the common
+ * case, take no call, and the ids are written to room for as many as the
+ * list could hold.
+ */
+void inline_read(const unsigned char *bytes, const int len,
+                 std::vector<RecordId> &rids){
+    const std::size_t size = rids.size();
+    rids.resize(size + (len - INLINEHEADER) / 2);
+    RecordId *out = rids.data() + size;
+    const unsigned char *data = bytes + INLINEHEADER;
+    const unsigned char *end = bytes + len;
+    RecordId rid;
+    rid.page_number = 0;
+    rid.slot_number = 0;
+    while (data < end) {
+        std::uint64_t pages = *data++;
+        if (pages & 0x80) {
+            data = posting_unvarint(data - 1, pages);
+        }
+        std::uint64_t slot = *data++;
+        if (slot & 0x80) {
+            data = posting_unvarint(data - 1, slot);
+        }
+        if (pages == 0) {
+            rid.slot_number += slot;
+        } else {
+            rid.page_number += pages;
+            rid.slot_number = slot;
+        }
+        *out++ = rid;
+    }
+    rids.resize(out - rids.data());
 }
 
 /**
- * When insert into
- *     1     |     3    |   5
- *    /      |          |    \
- *  (-,1)   [1, 3)    [3,5)  [5,+)
- * @param currNonLeafNode
- * @param index
- * @param newIndex
- * @param newPageNo
+ * Takes the list of entry i out of the heap of heap bytes of a leaf. The
+ * lists further from the end move up into its place, and the entry is left
+ * to the caller.
  */
-void BTreeIndex::insertToNonLeaf(NonLeafNodeInt *currNonLeafNode,
-                                 const int index, const int newIndex,
-                                 const PageId newPageNo) {
-  const size_t len = INTARRAYNONLEAFSIZE - index - 1;
+template <class T>
+void inline_drop(LeafNode<T> *leaf, const int i, const int heap){
+    unsigned char *end = inline_heap_end(leaf);
+    const int offset = inline_offset(leaf->ridArray[i]);
+    const int len = inline_length(leaf->ridArray[i]);
+    memmove(end - heap + len, end - heap, heap - offset);
+    for (int k = 0; k < leaf->keyNum; k++) {
+        const RecordId rid = leaf->ridArray[k];
+        if (inline_is(rid) && inline_offset(rid) > offset) {
+            leaf->ridArray[k] = inline_rid(inline_offset(rid) - len,
+                                           inline_length(rid));
+        }
+    }
+}
 
-  // shift elements from the index
-  memmove(&currNonLeafNode->keyArray[index + 1],
-          &currNonLeafNode->keyArray[index], len * sizeof(int));
-  memmove(&currNonLeafNode->pageNoArray[index + 2],
-          &currNonLeafNode->pageNoArray[index + 1], len * sizeof(PageId));
+/**
+ * Makes entry i of a leaf the list of len bytes, which goes to the front of
+ * the heap of heap bytes. The leaf has to have room for it.
+ */
+template <class T>
+void inline_put(LeafNode<T> *leaf, const int i, const unsigned char *bytes,
+                const int len, const int heap){
+    memcpy(inline_heap_end(leaf) - heap - len, bytes, len);
+    leaf->ridArray[i] = inline_rid(heap + len, len);
+}
 
-  currNonLeafNode->keyNum++;
-  this->nodeOccupancy++;
+/**
+ * Moves the lists of a leaf out to side, their entries giving their index
+ * there instead of their offset, so that entries can move between leaves.
+ * inline_attach() then packs the lists of the entries a leaf holds into its
+ * heap.
+ */
+template <class T>
+void inline_detach(LeafNode<T> *leaf,
+                   std::vector<std::vector<unsigned char> > &side){
+    for (int i = 0; i < leaf->keyNum; i++) {
+        const RecordId rid = leaf->ridArray[i];
+        if (inline_is(rid)) {
+            const unsigned char *bytes = inline_bytes(leaf, rid);
+            side.emplace_back(bytes, bytes + inline_length(rid));
+            leaf->ridArray[i] = inline_rid(side.size() - 1, inline_length(rid));
+        }
+    }
+}
 
-  // store the KV into this node
-  currNonLeafNode->keyArray[index] = newIndex;
-  currNonLeafNode->pageNoArray[index + 1] = newPageNo;
+template <class T>
+void inline_attach(LeafNode<T> *leaf,
+                   const std::vector<std::vector<unsigned char> > &side){
+    int heap = 0;
+    for (int i = 0; i < leaf->keyNum; i++) {
+        if (inline_is(leaf->ridArray[i])) {
+            const std::vector<unsigned char> &list =
+                side[inline_offset(leaf->ridArray[i])];
+            inline_put(leaf, i, list.data(), list.size(), heap);
+            heap += list.size();
+        }
+    }
 }
 
 /**
- * Because after split a non leaf node, the new node is like
- *     7     |     9    |   11
- *           |          |    \
- *          [7, 9)    [9,11)  [11,+)
- * So it's a little different from above insertToNonLeaf()
- * @param currNonLeafNode
- * @param index
- * @param newIndex
- * @param newPageNo
+ * Bits of an entry of a compressed leaf.
  */
-void BTreeIndex::insertToNewNonLeaf(NonLeafNodeInt *currNonLeafNode,
-                                    const int index, const int newIndex,
-                                    const PageId newPageNo) {
-  const size_t len = INTARRAYNONLEAFSIZE - index - 1;
+int cleaf_width(const CompressedLeafInt *leaf){
+    return leaf->keyBits + leaf->pageBits + leaf->slotBits;
+}
 
-  // shift elements from the index
-  memmove(&currNonLeafNode->keyArray[index + 1],
-          &currNonLeafNode->keyArray[index], len * sizeof(int));
-  memmove(&currNonLeafNode->pageNoArray[index + 1],
-          &currNonLeafNode->pageNoArray[index], len * sizeof(PageId));
+/**
+ * Unpacks the keys of the n entries of a compressed leaf from entry from on.
+ */
+void cleaf_keys(const CompressedLeafInt *leaf, const int from, const int n,
+                int *keys){
+    const int width = cleaf_width(leaf);
+    unpackInts(leaf->data, (std::size_t)from * width, width, leaf->keyBits,
+               leaf->keyBase, n, keys);
+}
 
-  this->nodeOccupancy++;
-  currNonLeafNode->keyNum++;
+/**
+ * Unpacks the record ids of the n entries of a compressed leaf from entry
+ * from on.
+ */
+void cleaf_rids(const CompressedLeafInt *leaf, const int from, const int n,
+                RecordId *rids){
+    const int width = cleaf_width(leaf);
+    unpackRecordIds(leaf->data, (std::size_t)from * width + leaf->keyBits,
+                    width, leaf->pageBits, leaf->slotBits, leaf->pageBase, n,
+                    rids);
+}
 
-  // store the KV into this node
-  currNonLeafNode->keyArray[index] = newIndex;
-  currNonLeafNode->pageNoArray[index] = newPageNo;
+int cleaf_key(const CompressedLeafInt *leaf, const int i){
+    const std::uint64_t field =
+        readBits(leaf->data, (std::size_t)i * cleaf_width(leaf), leaf->keyBits);
+    return (int)((std::uint32_t)leaf->keyBase + (std::uint32_t)field);
+}
+
+RecordId cleaf_rid(const CompressedLeafInt *leaf, const int i){
+    RecordId rid;
+    cleaf_rids(leaf, i, 1, &rid);
+    return rid;
 }
 
 /**
- * for
- *     7     |     9    |   11
- *           |          |    \
- *          [7, 9)    [9,11)  [11,+)
- * convert to
- *                 9    |   11
- *            /         |    \
- *          [7, 9)    [9,11)  [11,+)
- * @param currNonLeafNode
- * @return the smallest key(the parent needs)
+ * Index of the first of the entries [from, to) of a compressed leaf whose key
+ * is not less than key, or is greater than key if upper. Like blockSearch(),
+ * but the keys of the last block are unpacked before they are counted.
  */
-int BTreeIndex::deleteNewKeyNonLeaf(NonLeafNodeInt *currNonLeafNode) {
-  currNonLeafNode->keyNum--;
-  this->nodeOccupancy--;
-  int key = currNonLeafNode->keyArray[0];
-  memmove(&currNonLeafNode->keyArray[0], &currNonLeafNode->keyArray[1],
-          (currNonLeafNode->keyNum) * sizeof(int));
-  currNonLeafNode->keyArray[currNonLeafNode->keyNum] = 0;
-  return key;
+template <bool upper>
+int cleaf_search(const CompressedLeafInt *leaf, int from, const int to,
+                 const int key){
+    int len = to - from;
+    while (len > KEYSEARCHBLOCK) {
+        const int half = len / 2;
+        const int mid = cleaf_key(leaf, from + half);
+        if (upper ? !(key < mid) : mid < key) {
+            from += half + 1;
+            len -= half + 1;
+        } else {
+            len = half;
+        }
+    }
+    int keys[KEYSEARCHBLOCK];
+    cleaf_keys(leaf, from, len, keys);
+    return from + countBefore<upper>(keys, len, key);
 }
 
 /**
- * Split a leaf node into 2 parts
- *
- * @param node
- * @param newNode
- * @param leftLen
+ * Packs the n entries, sorted by key, into a compressed leaf, with the first
+ * key and the smallest page number as the references.
+ * @return false, leaving the leaf as it was, if they do not fit
  */
-void BTreeIndex::splitLeaf(LeafNodeInt *node, LeafNodeInt *newNode,
-                           PageId newPageNo, const int leftLen) {
-  const size_t rightLen = INTARRAYLEAFSIZE - leftLen;
+bool cleaf_encode(CompressedLeafInt *leaf, const int *keys,
+                  const RecordId *rids, const int n){
+    if (n > COMPRESSEDLEAFSIZE) {
+        return false;
+    }
+    PageId minPage = n > 0 ? rids[0].page_number : 0;
+    PageId maxPage = minPage;
+    SlotId maxSlot = 0;
+    for (int i = 0; i < n; i++) {
+        minPage = std::min(minPage, rids[i].page_number);
+        maxPage = std::max(maxPage, rids[i].page_number);
+        maxSlot = std::max(maxSlot, rids[i].slot_number);
+    }
+    const int keyBase = n > 0 ? keys[0] : 0;
+    const int keyBits =
+        n > 0 ? bitsFor((std::uint32_t)keys[n - 1] - (std::uint32_t)keyBase)
+              : 0;
+    const int pageBits = bitsFor(maxPage - minPage);
+    const int slotBits = bitsFor(maxSlot);
+    const int width = keyBits + pageBits + slotBits;
+    if ((std::size_t)n * width > (std::size_t)COMPRESSEDLEAFBYTES * 8) {
+        return false;
+    }
 
-  // adjust keyNum
-  node->keyNum = leftLen;
-  newNode->keyNum = rightLen;
+    leaf->numEntries = n;
+    leaf->keyBase = keyBase;
+    leaf->pageBase = minPage;
+    leaf->keyBits = keyBits;
+    leaf->pageBits = pageBits;
+    leaf->slotBits = slotBits;
+    leaf->keyNum = COMPRESSEDLEAF;
+    memset(leaf->data, 0, sizeof(leaf->data));
+    for (int i = 0; i < n; i++) {
+        const std::size_t pos = (std::size_t)i * width;
+        writeBits(leaf->data, pos, keyBits,
+                  (std::uint32_t)keys[i] - (std::uint32_t)keyBase);
+        writeBits(leaf->data, pos + keyBits, pageBits + slotBits,
+                  (std::uint64_t)(rids[i].page_number - minPage) << slotBits |
+                      rids[i].slot_number);
+    }
+    return true;
+}
 
-  // move elements from old node to new node
-  memcpy(newNode->keyArray, &node->keyArray[leftLen], rightLen * sizeof(int));
-  memcpy(newNode->ridArray, &node->ridArray[leftLen],
-         rightLen * sizeof(RecordId));
+/**
+ * Inserts an entry at index of a compressed leaf, moving the entries after it
+ * up, if it fits in the bit widths of the leaf.
+ */
+bool cleaf_insert(CompressedLeafInt *leaf, const int index, const int key,
+                  const RecordId rid){
+    const int n = leaf->numEntries;
+    const int width = cleaf_width(leaf);
+    if (n == 0 || n == COMPRESSEDLEAFSIZE ||
+        (std::size_t)(n + 1) * width > (std::size_t)COMPRESSEDLEAFBYTES * 8 ||
+        rid.page_number < leaf->pageBase) {
+        return false;
+    }
+    const std::uint32_t keyDelta =
+        (std::uint32_t)key - (std::uint32_t)leaf->keyBase;
+    const PageId pageDelta = rid.page_number - leaf->pageBase;
+    if (bitsFor(keyDelta) > leaf->keyBits ||
+        bitsFor(pageDelta) > leaf->pageBits ||
+        bitsFor(rid.slot_number) > leaf->slotBits) {
+        return false;
+    }
+    const std::size_t pos = (std::size_t)index * width;
+    moveBitsUp(leaf->data, pos, (std::size_t)n * width, width);
+    writeBits(leaf->data, pos, leaf->keyBits, keyDelta);
+    writeBits(leaf->data, pos + leaf->keyBits, leaf->pageBits + leaf->slotBits,
+              (std::uint64_t)pageDelta << leaf->slotBits | rid.slot_number);
+    leaf->numEntries = n + 1;
+    return true;
+}
 
-  // clear the space of removed elements
-  memset(&node->keyArray[leftLen], 0, rightLen * sizeof(int));
-  memset(&node->ridArray[leftLen], 0, rightLen * sizeof(RecordId));
+/**
+ * Whether a leaf is a CompressedLeafInt. Only INTEGER leaves can be.
+ */
+template <class T>
+bool leaf_compressed(const LeafNode<T> *){
+    return false;
+}
 
-  // set rightSibPageNo
-  newNode->rightSibPageNo = node->rightSibPageNo;
-  node->rightSibPageNo = newPageNo;
+bool leaf_compressed(const LeafNode<int> *leaf){
+    return leaf->keyNum == COMPRESSEDLEAF;
 }
 
 /**
- * Split a non leaf node into 2 parts
- * from
- *     1     |     3    |     5    |   7   |   9    |   11
- *    /      |          |          |       |        |     \
- *  (-,1)   [1, 3)    [3,5)       [5,7)   [7,9)    [9,11)  [11,+)
- *  to
- *     1     |     3    |   5
- *    /      |          |    \
- *  (-,1)   [1, 3)    [3,5)  [5,+)
- * and
- *     7     |     9    |   11
- *           |          |    \
- *          [7, 9)    [9,11)  [11,+)
- * @param node
- * @param newNode
- * @param leftLen
+ * Calls fn with the leaf on page, as a const LeafNode<T> * or, if it is
+ * compressed, as a const CompressedLeafInt *.
  */
-void BTreeIndex::splitNonLeaf(NonLeafNodeInt *node, NonLeafNodeInt *newNode,
-                              const int leftLen) {
-  const size_t rightLen = INTARRAYNONLEAFSIZE - leftLen;
+template <class T, class F>
+void with_leaf(const Page *page, F fn){
+    if constexpr (KeyTraits<T>::TYPE == INTEGER) {
+        if (leaf_compressed((const LeafNode<int> *)page)) {
+            fn((const CompressedLeafInt *)page);
+            return;
+        }
+    }
+    fn((const LeafNode<T> *)page);
+}
 
-  // adjust keyNum
-  node->keyNum = leftLen;
-  newNode->keyNum = rightLen;
+/**
+ * The parts of a leaf that readers use, for both kinds of leaves.
+ */
+template <class T>
+int leaf_size(const LeafNode<T> *leaf){
+    return leaf->keyNum;
+}
 
-  // move elements from old node to new node
-  memcpy(newNode->keyArray, &node->keyArray[leftLen], rightLen * sizeof(int));
-  memcpy(newNode->pageNoArray, &node->pageNoArray[leftLen + 1],
-         rightLen * sizeof(PageId));
+int leaf_size(const CompressedLeafInt *leaf){
+    return leaf->numEntries;
+}
+
+template <class T>
+const T &leaf_key(const LeafNode<T> *leaf, const int i){
+    return leaf->keyArray[i];
+}
 
-  newNode->level = (node->level == 1);
+int leaf_key(const CompressedLeafInt *leaf, const int i){
+    return cleaf_key(leaf, i);
+}
 
-  // clear the space of removed elements
-  memset(&node->keyArray[leftLen], 0, rightLen * sizeof(int));
-  memset(&node->pageNoArray[leftLen + 1], 0, rightLen * sizeof(PageId));
+template <class T>
+RecordId leaf_rid(const LeafNode<T> *leaf, const int i){
+    return leaf->ridArray[i];
+}
 
-  // printNode(node);
-  // printNode(newNode);
+RecordId leaf_rid(const CompressedLeafInt *leaf, const int i){
+    return cleaf_rid(leaf, i);
 }
 
 /**
- * When need to split the root, alloc a new page as new root and finish
- * related settings
- *
- * @param key    new parent key
- * @param left   smaller one
- * @param right	 larger one
+ * Index of the first of the entries [from, to) whose key is not less than
+ * key, or greater than key for leaf_upper_bound().
  */
-void BTreeIndex::splitRoot(const int key, const PageId left,
-                           const PageId right) {
-  // alloc a new page for root
-  PageId newRootPageId;
-  NonLeafNodeInt *newRoot = allocNode<NonLeafNodeInt>(newRootPageId);
+template <class T>
+int leaf_lower_bound(const LeafNode<T> *leaf, const int from, const int to,
+                     const T &key){
+    return from + keyLowerBound(leaf->keyArray + from, to - from, key);
+}
 
-  // set newRoot
-  newRoot->keyArray[0] = key;
-  newRoot->pageNoArray[0] = left;
-  newRoot->pageNoArray[1] = right;
-  newRoot->keyNum = 1;
-  this->nodeOccupancy++;
+int leaf_lower_bound(const CompressedLeafInt *leaf, const int from,
+                     const int to, const int &key){
+    return cleaf_search<false>(leaf, from, to, key);
+}
 
-  // set level
-  newRoot->level = (this->rootPageNum == this->initialRootPageNum);
+template <class T>
+int leaf_upper_bound(const LeafNode<T> *leaf, const int from, const int to,
+                     const T &key){
+    return from + keyUpperBound(leaf->keyArray + from, to - from, key);
+}
 
-  // unpin the root page
-  bufMgr->unPinPage(file, newRootPageId, true);
-  this->rootPageNum = newRootPageId;
+int leaf_upper_bound(const CompressedLeafInt *leaf, const int from,
+                     const int to, const int &key){
+    return cleaf_search<true>(leaf, from, to, key);
+}
 
-  // address change of root page
-  Page *page;
-  bufMgr->readPage(file, this->headerPageNum, page);
-  IndexMetaInfo *meta = (IndexMetaInfo *)page;
-  meta->rootPageNo = newRootPageId;
-  bufMgr->unPinPage(file, this->headerPageNum, true);
+/**
+ * The leaves of a covering index with payloads of length bytes: the most
+ * entries that leave room for their payloads in the free key and record id
+ * slots.
+ */
+template <class T>
+LeafPayloadLayout payload_layout(const int length){
+    const int size = KeyTraits<T>::LEAFSIZE;
+    for (int capacity = size; capacity > 1; capacity--) {
+        const int keyRoom = (size - capacity) * (int)sizeof(T) / capacity;
+        const int ridRoom =
+            (size - capacity) * (int)sizeof(RecordId) / capacity;
+        if (keyRoom + ridRoom >= length) {
+            const int keyPart = std::min(keyRoom, length);
+            return {capacity, keyPart, length - keyPart};
+        }
+    }
+    return {1, 0, length};
 }
 
 /**
- * When we can make sure we want to insert a KV to a leaf node
+ * The two parts of the payload of entry i of a leaf.
+ */
+template <class T>
+unsigned char *payload_key_part(const LeafNode<T> *leaf,
+                                const LeafPayloadLayout &layout, const int i){
+    return (unsigned char *)(leaf->keyArray + layout.capacity) +
+           i * layout.keyPart;
+}
+
+template <class T>
+unsigned char *payload_rid_part(const LeafNode<T> *leaf,
+                                const LeafPayloadLayout &layout, const int i){
+    return (unsigned char *)(leaf->ridArray + layout.capacity) +
+           i * layout.ridPart;
+}
+
+/**
+ * Moves the payloads of the n entries from src on of leaf from to the
+ * entries from dst on of leaf to, which may be the same leaf.
+ */
+template <class T>
+void payload_move(LeafNode<T> *to, const int dst, const LeafNode<T> *from,
+                  const int src, const int n, const LeafPayloadLayout &layout){
+    if (n <= 0 || layout.keyPart + layout.ridPart == 0) {
+        return;
+    }
+    memmove(payload_key_part(to, layout, dst),
+            payload_key_part(from, layout, src), n * layout.keyPart);
+    memmove(payload_rid_part(to, layout, dst),
+            payload_rid_part(from, layout, src), n * layout.ridPart);
+}
+
+/**
+ * Sets the payload of entry i of a leaf, to zeros if payload is NULL.
+ */
+template <class T>
+void payload_set(LeafNode<T> *leaf, const int i,
+                 const unsigned char *payload,
+                 const LeafPayloadLayout &layout){
+    unsigned char *keyPart = payload_key_part(leaf, layout, i);
+    unsigned char *ridPart = payload_rid_part(leaf, layout, i);
+    if (payload == NULL) {
+        memset(keyPart, 0, layout.keyPart);
+        memset(ridPart, 0, layout.ridPart);
+        return;
+    }
+    memcpy(keyPart, payload, layout.keyPart);
+    memcpy(ridPart, payload + layout.keyPart, layout.ridPart);
+}
+
+/**
+ * Appends the payloads of the entries [from, to) of a leaf to out. Compressed
+ * leaves have none.
+ */
+template <class T>
+void payload_copy_out(const LeafNode<T> *leaf, const int from, const int to,
+                      const LeafPayloadLayout &layout,
+                      std::vector<unsigned char> &out){
+    const int length = layout.keyPart + layout.ridPart;
+    if (to <= from || length == 0) {
+        return;
+    }
+    std::size_t pos = out.size();
+    out.resize(pos + (std::size_t)(to - from) * length);
+    for (int i = from; i < to; i++, pos += length) {
+        memcpy(&out[pos], payload_key_part(leaf, layout, i), layout.keyPart);
+        memcpy(&out[pos + layout.keyPart], payload_rid_part(leaf, layout, i),
+               layout.ridPart);
+    }
+}
+
+void payload_copy_out(const CompressedLeafInt *, const int, const int,
+                      const LeafPayloadLayout &, std::vector<unsigned char> &){
+}
+
+/**
+ * The non-leaf nodes of a counted tree: the most keys that leave room for
+ * the counts of their children in the free key and page number slots. Other
+ * trees use every slot for keys.
+ */
+template <class T>
+NonLeafCountLayout count_layout(const bool counted){
+    const int size = KeyTraits<T>::NONLEAFSIZE;
+    const int length = sizeof(std::uint32_t);
+    for (int capacity = size; counted && capacity > 2; capacity--) {
+        const int free = size - capacity;
+        const int keyRoom = free * (int)sizeof(T) / (capacity + 1);
+        const int pageNoRoom = free * (int)sizeof(PageId) / (capacity + 1);
+        if (keyRoom + pageNoRoom >= length) {
+            const int keyPart = std::min(keyRoom, length);
+            return {capacity, keyPart, length - keyPart};
+        }
+    }
+    return {size, 0, 0};
+}
+
+NonLeafCountLayout count_layout(const Datatype type, const bool counted){
+    switch (type) {
+        case INTEGER:
+            return count_layout<int>(counted);
+        case DOUBLE:
+            return count_layout<double>(counted);
+        default:
+            return count_layout<StringKey>(counted);
+    }
+}
+
+/**
+ * The two parts of the count of child i of a non-leaf node.
+ */
+template <class T>
+unsigned char *count_key_part(const NonLeafNode<T> *node,
+                              const NonLeafCountLayout &layout, const int i){
+    return (unsigned char *)(node->keyArray + layout.capacity) +
+           i * layout.keyPart;
+}
+
+template <class T>
+unsigned char *count_page_part(const NonLeafNode<T> *node,
+                               const NonLeafCountLayout &layout, const int i){
+    return (unsigned char *)(node->pageNoArray + layout.capacity + 1) +
+           i * layout.pageNoPart;
+}
+
+/**
+ * The count of child i of a non-leaf node, 0 if the tree is not counted.
+ */
+template <class T>
+std::uint32_t count_get(const NonLeafNode<T> *node, const int i,
+                        const NonLeafCountLayout &layout){
+    std::uint32_t count = 0;
+    memcpy(&count, count_key_part(node, layout, i), layout.keyPart);
+    memcpy((unsigned char *)&count + layout.keyPart,
+           count_page_part(node, layout, i), layout.pageNoPart);
+    return count;
+}
+
+template <class T>
+void count_set(NonLeafNode<T> *node, const int i, const std::uint32_t count,
+               const NonLeafCountLayout &layout){
+    memcpy(count_key_part(node, layout, i), &count, layout.keyPart);
+    memcpy(count_page_part(node, layout, i),
+           (const unsigned char *)&count + layout.keyPart, layout.pageNoPart);
+}
+
+/**
+ * Sum of the counts of the children [from, to) of a non-leaf node.
+ */
+template <class T>
+std::size_t count_sum(const NonLeafNode<T> *node, const int from,
+                      const int to, const NonLeafCountLayout &layout){
+    std::size_t sum = 0;
+    for (int i = from; i < to; i++) {
+        sum += count_get(node, i, layout);
+    }
+    return sum;
+}
+
+/**
+ * Moves the counts of the n children from src on of node from to the
+ * children from dst on of node to, which may be the same node.
+ */
+template <class T>
+void count_move(NonLeafNode<T> *to, const int dst, const NonLeafNode<T> *from,
+                const int src, const int n, const NonLeafCountLayout &layout){
+    if (n <= 0 || layout.keyPart + layout.pageNoPart == 0) {
+        return;
+    }
+    memmove(count_key_part(to, layout, dst),
+            count_key_part(from, layout, src), n * layout.keyPart);
+    memmove(count_page_part(to, layout, dst),
+            count_page_part(from, layout, src), n * layout.pageNoPart);
+}
+
+/**
+ * Read a key of the given type from an attribute value or a key passed to the
+ * public methods. STRING keys take the first STRINGSIZE characters.
+ */
+void key_set(int &key, const void *value){
+    key = *(const int *)value;
+}
+
+void key_set(double &key, const void *value){
+    key = *(const double *)value;
+}
+
+void key_set(StringKey &key, const void *value){
+    const std::size_t len = strnlen((const char *)value, STRINGSIZE);
+    memcpy(key.data, value, len);
+    memset(key.data + len, 0, STRINGSIZE - len);
+}
+
+/**
+ * Write a key back in the form of an attribute value.
+ */
+void key_get(const int &key, void *value){
+    *(int *)value = key;
+}
+
+void key_get(const double &key, void *value){
+    *(double *)value = key;
+}
+
+void key_get(const StringKey &key, void *value){
+    memcpy(value, key.data, STRINGSIZE);
+}
+
+template <class T>
+T key_of(const void *value){
+    T key;
+    key_set(key, value);
+    return key;
+}
+
+/**
+ * Murmur3 finalizer, which spreads every bit of x over the whole hash.
+ */
+std::uint64_t hash_mix(std::uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+std::uint64_t key_hash(const int &key){
+    return hash_mix((std::uint32_t)key);
+}
+
+std::uint64_t key_hash(const double &key){
+    // 0.0 and -0.0 are equal keys
+    const double value = key == 0 ? 0.0 : key;
+    std::uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return hash_mix(bits);
+}
+
+std::uint64_t key_hash(const StringKey &key){
+    std::uint64_t h = 0;
+    for (int i = 0; i < STRINGSIZE; i++) {
+        h = (h ^ (unsigned char)key.data[i]) * 0x100000001b3ULL;
+    }
+    return hash_mix(h);
+}
+
+std::ostream &operator<<(std::ostream &os, const StringKey &key){
+    return os << std::string(key.data, strnlen(key.data, STRINGSIZE));
+}
+
+// -----------------------------------------------------------------------------
+// PageLatchTable
+// -----------------------------------------------------------------------------
+
+PageLatchTable::PageLatchTable() {
+  for (std::size_t i = 0; i < NUMCHUNKS; i++) {
+    chunks[i].store(NULL, std::memory_order_relaxed);
+  }
+}
+
+PageLatchTable::~PageLatchTable() {
+  for (std::size_t i = 0; i < NUMCHUNKS; i++) {
+    delete[] chunks[i].load(std::memory_order_relaxed);
+  }
+}
+
+std::shared_mutex &PageLatchTable::latch(const PageId pageNo) {
+  const std::size_t slot = pageNo % (CHUNKSIZE * NUMCHUNKS);
+  std::atomic<std::shared_mutex *> &chunk = chunks[slot / CHUNKSIZE];
+  std::shared_mutex *latches = chunk.load(std::memory_order_acquire);
+  if (latches == NULL) {
+    // threads that race to create the chunk keep the first one installed
+    std::shared_mutex *created = new std::shared_mutex[CHUNKSIZE];
+    if (chunk.compare_exchange_strong(latches, created,
+                                      std::memory_order_acq_rel)) {
+      latches = created;
+    } else {
+      delete[] created;
+    }
+  }
+  return latches[slot % CHUNKSIZE];
+}
+
+/**
+ * Allocate a NonLeafNode or LeafNode
  *
- * @param currPageNo
- * @param key
- * @param rid
- * @param newPageNo
- * @param newIndex
+ * @param newPageId page id used to contain allocated page id
+ * @return newNode NonLeafNode or LeafNode
  */
-void BTreeIndex::handleLeafInsertion(const PageId currPageNo, const void *key,
-                                     const RecordId rid, PageId &newPageNo,
-                                     int &newIndex) {
-  Page *page;
-  bufMgr->readPage(file, currPageNo, page);
-  LeafNodeInt *currLeafNode = (LeafNodeInt *)page;
+template <class N>
+N *BTreeIndex::allocNode(PageId &newPageId) {
+    Page *dummy;
+    bufMgr->allocPage(file, newPageId, dummy, node_access((N *)NULL));
+    N *newNode = (N *)dummy;
+    page_set(newNode);
+    if (std::atomic<std::int64_t> *pages = pageCounter((N *)NULL)) {
+        (*pages)++;
+    }
+    return newNode;
+}
 
-  // We are sure it is a LeafNode
-  int index = findIndexInLeaf(currLeafNode, key);
-  // not full, insert directly
-  if (currLeafNode->keyNum < INTARRAYLEAFSIZE) {
-    assert(index != -1);
-    insertToLeaf(currLeafNode, index, key, rid);
-    bufMgr->unPinPage(file, currPageNo, true);
-    newPageNo = 0;
-    newIndex = -1;
-    return;
+template <class N>
+void BTreeIndex::disposeNode(const PageId pageNo) {
+    bufMgr->disposePage(file, pageNo);
+    (*pageCounter((N *)NULL))--;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor
+// -----------------------------------------------------------------------------
+/**
+ * BTreeIndex Constructor
+ *
+ * @param relationName the name of the relation on which to build the index
+ * @param outIndexName the name of the index file
+ * @param bufMgrIn global buffer manager
+ * @param attrByteOffset byte offset of the attribute to build the index
+ * @param attrType data type of the indexing attribute
+ * @param options settings that are not stored in the index
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const int attrByteOffset, const Datatype attrType,
+                       const BTreeOptions &options)
+    : BTreeIndex(relationName, outIndexName, bufMgrIn, attrByteOffset,
+                 attrType, std::vector<PayloadColumn>(), options) {}
+
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const int attrByteOffset, const Datatype attrType,
+                       const std::vector<PayloadColumn> &payloadColumns,
+                       const BTreeOptions &options) {
+  // initialize global varaibles
+  this->bufMgr = bufMgrIn;
+  this->attrByteOffset = attrByteOffset;
+  this->attributeType = attrType;
+  loadCounters(IndexCounters());
+  this->bloomRate = 0;
+  this->bloomVersion = 0;
+  this->cachedLevels = std::max(0, options.cachedLevels);
+  this->innerCacheValid = false;
+  this->insertBufferEntries = options.insertBufferEntries;
+  this->structureVersion = 0;
+  this->rightmostLeafNum = 0;
+  this->rightmostBounded = false;
+  this->currentScan = NULL;
+
+  // construct index name
+  std::ostringstream idxstr;
+  idxstr << relationName << '.' << attrByteOffset;
+  outIndexName = idxstr.str();
+
+  // the payload of a covering index takes room from the keys of its leaves,
+  // which then take no posting lists and are not compressed
+  this->payloadColumns = payloadColumns;
+  this->payloadLength = 0;
+  for (const PayloadColumn &column : payloadColumns) {
+    if (column.byteOffset < 0 || column.length <= 0) {
+      throw BadIndexInfoException(outIndexName);
+    }
+    this->payloadLength += column.length;
+  }
+  if (payloadColumns.size() > (std::size_t)MAXPAYLOADCOLUMNS ||
+      this->payloadLength > MAXPAYLOADLENGTH ||
+      options.bloomFalsePositiveRate >= 1) {
+    throw BadIndexInfoException(outIndexName);
+  }
+  switch (attrType) {
+    case INTEGER:
+      this->payloadLayout = payload_layout<int>(this->payloadLength);
+      break;
+    case DOUBLE:
+      this->payloadLayout = payload_layout<double>(this->payloadLength);
+      break;
+    case STRING:
+      this->payloadLayout = payload_layout<StringKey>(this->payloadLength);
+      break;
+  }
+  BTreeOptions buildOptions = options;
+  if (this->payloadLength > 0) {
+    buildOptions.postingLists = false;
+    buildOptions.compressLeaves = false;
+  }
+
+  // test if index file exists
+  if (File::exists(outIndexName)) {
+    this->file = new BlobFile(outIndexName, false, options.ioMode);
+    // read meta info
+    this->headerPageNum = file->getFirstPageNo();
+    Page *headerPage;
+    bufMgr->readPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+    // get the page that contain meta info
+    IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
+
+    bool samePayload =
+        meta->numPayloadColumns == (int)payloadColumns.size();
+    for (std::size_t c = 0; samePayload && c < payloadColumns.size(); c++) {
+      samePayload =
+          meta->payloadColumns[c].byteOffset == payloadColumns[c].byteOffset &&
+          meta->payloadColumns[c].length == payloadColumns[c].length;
+    }
+    if (!relation_name_matches(meta->relationName, relationName) ||
+        attrType != meta->attrType ||
+        attrByteOffset != meta->attrByteOffset || !samePayload) {
+      bufMgr->unPinPage(file, headerPageNum, false);
+      // no destructor runs for a throwing constructor, so close the file here
+      bufMgr->flushFile(file);
+      delete file;
+      file = nullptr;
+      throw BadIndexInfoException(outIndexName);
+    }
+
+    // set B-tree object
+    this->rootPageNum = meta->rootPageNo;
+    this->initialRootPageNum = meta->initialRootPageNum;
+    this->countedTree = meta->countedTree;
+    this->countLayout = count_layout(attrType, this->countedTree);
+    this->postingLists = buildOptions.postingLists && !this->countedTree;
+    // from now on leaves may hold inline lists
+    const bool newLeafPostings = this->postingLists && !meta->leafPostings;
+    meta->leafPostings = meta->leafPostings || this->postingLists;
+    this->leafPostings = meta->leafPostings;
+    const bool counted = meta->counters.leafPages > 0;
+    loadCounters(meta->counters);
+    this->bloomRate = meta->bloomRate;
+    const std::uint64_t bloomCapacity = meta->bloomCapacity;
+    const std::uint32_t bloomBlocks = meta->bloomBlocks;
+    const int bloomHashes = meta->bloomHashes;
+    this->bloomVersion = meta->bloomVersion;
+
+    // write page
+    bufMgr->unPinPage(file, headerPageNum, newLeafPostings);
+    cacheRightmostLeaf();
+    if (!counted) {
+      analyze();
+    }
+    // a filter whose file is gone or of another version is built again
+    if (this->bloomRate > 0 &&
+        !loadBloom(bloomCapacity, bloomBlocks, bloomHashes)) {
+      switch (attrType) {
+        case INTEGER:
+          rebuildBloom<int>();
+          break;
+        case DOUBLE:
+          rebuildBloom<double>();
+          break;
+        case STRING:
+          rebuildBloom<StringKey>();
+          break;
+      }
+    }
+    return;
+  }
+
+  file = new BlobFile(outIndexName, true, options.ioMode);
+  IndexMetaInfo *meta = allocNode<IndexMetaInfo>(this->headerPageNum);
+  if (File::exists(bloomFileName(outIndexName))) {
+    File::remove(bloomFileName(outIndexName));
+  }
+
+  // initialize indexMetaInfo for header page, the root is set by buildIndex
+  meta->attrByteOffset = attrByteOffset;
+  meta->attrType = attrType;
+  relation_name_set(meta->relationName, relationName);
+  meta->numPayloadColumns = payloadColumns.size();
+  std::copy(payloadColumns.begin(), payloadColumns.end(),
+            meta->payloadColumns);
+  meta->countedTree = options.countedTree;
+
+  // the count of an entry under a posting list would need its pages read
+  this->countedTree = options.countedTree;
+  this->countLayout = count_layout(attrType, this->countedTree);
+  this->postingLists = buildOptions.postingLists && !this->countedTree;
+  this->leafPostings = this->postingLists;
+  meta->leafPostings = this->leafPostings;
+  bufMgr->unPinPage(file, this->headerPageNum, true);
+
+  // scan the relation and insert entries
+  switch (attrType) {
+    case INTEGER:
+      buildIndex<int>(relationName, buildOptions);
+      break;
+    case DOUBLE:
+      buildIndex<double>(relationName, buildOptions);
+      break;
+    case STRING:
+      buildIndex<StringKey>(relationName, buildOptions);
+      break;
+  }
+}
+
+void BTreeIndex::copyPayload(const char *record,
+                             unsigned char *payload) const {
+  for (const PayloadColumn &column : this->payloadColumns) {
+    memcpy(payload, record + column.byteOffset, column.length);
+    payload += column.length;
+  }
+}
+
+/**
+ * Build the tree over every record of the relation, either by bulk loading
+ * or by creating the initial root, an empty leaf, and inserting an entry for
+ * every record.
+ *
+ * @param relationName the name of the relation on which to build the index
+ * @param options settings of the build
+ */
+template <class T>
+void BTreeIndex::buildIndex(const std::string &relationName,
+                            const BTreeOptions &options) {
+  this->leafCapacity = this->payloadLayout.capacity;
+  if (KeyTraits<T>::TYPE == INTEGER && options.compressLeaves) {
+    this->leafCapacity = COMPRESSEDLEAFSIZE;
+  }
+  if (options.bulkLoad || options.buildThreads != 1) {
+    bulkLoad<T>(relationName, options);
+  } else {
+    // in b-tree the init root page should be leaf
+    LeafNode<T> *root;
+    if (KeyTraits<T>::TYPE == INTEGER && options.compressLeaves) {
+      root = (LeafNode<T> *)allocNode<CompressedLeafInt>(this->rootPageNum);
+    } else {
+      root = allocNode<LeafNode<T> >(this->rootPageNum);
+    }
+    this->initialRootPageNum = this->rootPageNum;
+    this->height = 1;
+    root->rightSibPageNo = 0;
+    bufMgr->unPinPage(file, this->rootPageNum, true);
+    findRightmostLeaf<T>();
+
+    FileScan scan(relationName, bufMgr, options.ioMode);
+    RecordId rid;
+    unsigned char payload[MAXPAYLOADLENGTH];
+    try {
+      while (true) {
+        scan.scanNext(rid);
+        std::string recordStr = scan.getRecord();
+        const char *record = recordStr.c_str();
+        copyPayload(record, payload);
+        if (this->insertBufferEntries > 0) {
+          bufferKey(key_of<T>(record + attrByteOffset), rid, payload);
+        } else {
+          insertKey(key_of<T>(record + attrByteOffset), rid, payload);
+        }
+      }
+    } catch (EndOfFileException &e) {
+    }
+    flushInsertBuffer<T>();
+    // the inserts do not tell how many of their keys are distinct
+    analyzeTree<T>();
+    if (options.bloomFalsePositiveRate > 0) {
+      this->bloomRate = options.bloomFalsePositiveRate;
+      rebuildBloom<T>();
+    }
+  }
+
+  writeRootToMeta();
+  findRightmostLeaf<T>();
+}
+
+void BTreeIndex::writeRootToMeta() {
+  Page *headerPage;
+  bufMgr->readPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+  IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
+  meta->rootPageNo = this->rootPageNum;
+  meta->initialRootPageNum = this->initialRootPageNum;
+  saveCounters(meta->counters);
+  meta->bloomRate = this->bloomRate;
+  meta->bloomCapacity = this->bloom.getCapacity();
+  meta->bloomBlocks = this->bloom.getNumBlocks();
+  meta->bloomHashes = this->bloom.getNumHashes();
+  meta->bloomVersion = this->bloomVersion;
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+void BTreeIndex::saveCounters(IndexCounters &counters) {
+  counters.height = this->height;
+  counters.leafPages = this->leafPages;
+  counters.nonLeafPages = this->nonLeafPages;
+  counters.postingPages = this->postingPages;
+  counters.numEntries = this->entryCount;
+  counters.leafOccupancy = this->leafOccupancy;
+  counters.nodeOccupancy = this->nodeOccupancy;
+  counters.leafCapacity = this->leafCapacity;
+  counters.contiguousLinks = this->contiguousLinks;
+  counters.analyzedEntries = this->analyzedEntries;
+  counters.analyzedDistinct = this->analyzedDistinct;
+}
+
+void BTreeIndex::loadCounters(const IndexCounters &counters) {
+  this->height = counters.height;
+  this->leafPages = counters.leafPages;
+  this->nonLeafPages = counters.nonLeafPages;
+  this->postingPages = counters.postingPages;
+  this->entryCount = counters.numEntries;
+  this->leafOccupancy = counters.leafOccupancy;
+  this->nodeOccupancy = counters.nodeOccupancy;
+  this->leafCapacity = counters.leafCapacity;
+  this->contiguousLinks = counters.contiguousLinks;
+  this->analyzedEntries = counters.analyzedEntries;
+  this->analyzedDistinct = counters.analyzedDistinct;
+}
+
+void BTreeIndex::relinkLeaf(const PageId pageNo, const PageId oldSibling,
+                            const PageId newSibling) {
+  this->contiguousLinks +=
+      (newSibling == pageNo + 1) - (oldSibling == pageNo + 1);
+}
+
+void BTreeIndex::cacheRightmostLeaf() {
+  switch (attributeType) {
+    case INTEGER:
+      findRightmostLeaf<int>();
+      break;
+    case DOUBLE:
+      findRightmostLeaf<double>();
+      break;
+    case STRING:
+      findRightmostLeaf<StringKey>();
+      break;
+  }
+}
+
+template <class T>
+void BTreeIndex::findRightmostLeaf() {
+  PageId pageId = this->rootPageNum;
+  this->rightmostBounded = false;
+  if (pageId != this->initialRootPageNum) {
+    while (true) {
+      Page *page;
+      bufMgr->readPage(file, pageId, page, ACCESS_INDEX_INNER);
+      const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+      // the separators grow along the path, so the last one is the fence
+      if (node->keyNum > 0) {
+        rightmostFence((T *)NULL) = node->keyArray[node->keyNum - 1];
+        this->rightmostBounded = true;
+      }
+      const PageId next = node->pageNoArray[node->keyNum];
+      const bool levelOne = isLevelOneNode(node);
+      bufMgr->unPinPage(file, pageId, false);
+      pageId = next;
+      if (levelOne) {
+        break;
+      }
+    }
+  }
+  this->rightmostLeafNum = pageId;
+}
+
+/**
+ * Order of the entries of a bulk load, which are sorted as records holding a
+ * RIDKeyPair.
+ */
+template <class T>
+bool entryLess(const std::string &a, const std::string &b) {
+  RIDKeyPair<T> ea, eb;
+  memcpy((void *)&ea, a.data(), sizeof(ea));
+  memcpy((void *)&eb, b.data(), sizeof(eb));
+  return ea < eb;
+}
+
+/**
+ * Runs task(0) to task(numTasks - 1), each on a thread of its own but the
+ * first, which runs on the calling thread, and once all of them are done
+ * rethrows the first exception that any of them threw.
+ */
+void run_parallel(const int numTasks, const std::function<void(int)> &task) {
+    std::vector<std::exception_ptr> errors(numTasks);
+    auto guarded = [&](const int t) {
+        try {
+            task(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numTasks; t++) {
+        threads.push_back(std::thread(guarded, t));
+    }
+    guarded(0);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (const std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+template <class T>
+void BTreeIndex::bulkLoad(const std::string &relationName,
+                          const BTreeOptions &options) {
+  typedef RIDKeyPair<T> Entry;
+  const int numThreads =
+      options.buildThreads > 0
+          ? options.buildThreads
+          : std::max(1, (int)std::thread::hardware_concurrency());
+
+  PageId numPages;
+  {
+    PageFile relation(relationName, false, options.ioMode);
+    numPages = relation.getNumPages();
+  }
+  const std::vector<Entry> splitters =
+      numThreads > 1
+          ? sampleSplitters<T>(relationName, numPages, numThreads, options)
+          : std::vector<Entry>();
+  const int numParts = splitters.size() + 1;
+
+  // every part of the keys is sorted on its own, runs that do not fit in its
+  // share of sortMemory are spilled to temporary files named after the index
+  std::vector<std::unique_ptr<ExternalSort> > sorters;
+  std::vector<std::mutex> sorterLatches(numParts);
+  std::vector<std::size_t> totals(numParts, 0);
+  for (int p = 0; p < numParts; p++) {
+    std::ostringstream name;
+    name << file->filename() << ".sort";
+    if (numParts > 1) {
+      name << p;
+    }
+    sorters.emplace_back(new ExternalSort(
+        name.str(), bufMgr, entryLess<T>,
+        std::max<std::size_t>(3, options.sortMemory / numParts / Page::SIZE),
+        false, options.ioMode, numParts));
+  }
+
+  // scan the pages of the relation in numThreads ranges at once; a scanner
+  // adds its entries to a sort a batch at a time, and the payload of a
+  // covering index follows the entry in the sorted record
+  const std::size_t BATCHSIZE = 256;
+  run_parallel(numThreads, [&](const int t) {
+    FileScan scan(relationName, bufMgr,
+                  1 + (std::uint64_t)(numPages - 1) * t / numThreads,
+                  1 + (std::uint64_t)(numPages - 1) * (t + 1) / numThreads,
+                  options.ioMode);
+    std::vector<std::vector<std::string> > batches(numParts);
+    auto addBatch = [&](const int p) {
+      std::lock_guard<std::mutex> guard(sorterLatches[p]);
+      for (const std::string &sorted : batches[p]) {
+        sorters[p]->add(sorted);
+      }
+      totals[p] += batches[p].size();
+      batches[p].clear();
+    };
+    RecordId rid;
+    Entry entry;
+    std::string sorted(sizeof(entry) + this->payloadLength, '\0');
+    try {
+      while (true) {
+        scan.scanNext(rid);
+        std::string recordStr = scan.getRecord();
+        entry.set(rid, key_of<T>(recordStr.c_str() + attrByteOffset));
+        memcpy(&sorted[0], (const char *)&entry, sizeof(entry));
+        copyPayload(recordStr.c_str(), (unsigned char *)&sorted[sizeof(entry)]);
+        const int p =
+            std::upper_bound(splitters.begin(), splitters.end(), entry) -
+            splitters.begin();
+        batches[p].push_back(sorted);
+        if (batches[p].size() == BATCHSIZE) {
+          addBatch(p);
+        }
+      }
+    } catch (EndOfFileException &e) {
+    }
+    for (int p = 0; p < numParts; p++) {
+      addBatch(p);
+    }
+  });
+
+  // every sort packs the leaves of its part left to right, and the parts are
+  // linked up after; counts holds the number of entries under every node of
+  // level, and an empty index gets one empty leaf
+  std::size_t total = 0;
+  for (int p = 0; p < numParts; p++) {
+    total += totals[p];
+  }
+  bool compressed = false;
+  if constexpr (KeyTraits<T>::TYPE == INTEGER) {
+    compressed = options.compressLeaves;
+  }
+  // the leaves are packed with the keys added to a new filter
+  if (options.bloomFalsePositiveRate > 0) {
+    this->bloomRate = options.bloomFalsePositiveRate;
+    this->bloom.reset(2 * std::max<std::size_t>(total, 1), this->bloomRate);
+  }
+  std::vector<std::vector<PageKeyPair<T> > > partLevels(numParts);
+  std::vector<std::vector<std::uint32_t> > partCounts(numParts);
+  run_parallel(numParts, [&](const int p) {
+    sorters[p]->sort();
+    if (totals[p] == 0 && (p > 0 || total > 0)) {
+      return;
+    }
+    if constexpr (KeyTraits<T>::TYPE == INTEGER) {
+      if (compressed) {
+        packCompressedLeaves(*sorters[p], totals[p], options, partLevels[p],
+                             partCounts[p]);
+        return;
+      }
+    }
+    packLeaves(*sorters[p], totals[p], options, partLevels[p], partCounts[p]);
+  });
+  sorters.clear();
+
+  std::vector<PageKeyPair<T> > level;
+  std::vector<std::uint32_t> counts;
+  for (int p = 0; p < numParts; p++) {
+    if (partLevels[p].empty()) {
+      continue;
+    }
+    if (!level.empty()) {
+      // compressed leaves keep their sibling where plain ones do
+      Page *page;
+      bufMgr->readPage(file, level.back().pageNo, page,
+                       node_access((LeafNode<T> *)NULL));
+      ((LeafNode<T> *)page)->rightSibPageNo = partLevels[p][0].pageNo;
+      bufMgr->unPinPage(file, level.back().pageNo, true);
+      relinkLeaf(level.back().pageNo, 0, partLevels[p][0].pageNo);
+    }
+    level.insert(level.end(), partLevels[p].begin(), partLevels[p].end());
+    counts.insert(counts.end(), partCounts[p].begin(), partCounts[p].end());
+  }
+  this->initialRootPageNum = level[0].pageNo;
+  this->height = 1;
+  this->entryCount = total;
+  this->analyzedEntries = total;
+
+  // build the non-leaf levels bottom-up until a single node is left, the
+  // nodes of a level spread over the threads; a node has at least 3 children
+  // so that none ends up with a single one
+  const int childCapacity = std::max(
+      3, (int)(this->countLayout.capacity * options.fillFactor) + 1);
+  bool levelOne = true;
+  while (level.size() > 1) {
+    const std::size_t numNodes =
+        (level.size() + childCapacity - 1) / childCapacity;
+    std::vector<PageKeyPair<T> > parents(numNodes);
+    std::vector<std::uint32_t> parentCounts(numNodes);
+    const int numWriters = std::min<std::size_t>(numThreads, numNodes);
+    std::vector<int> numKeys(numWriters);
+    run_parallel(numWriters, [&](const int w) {
+      numKeys[w] = packNonLeaves(level, counts, levelOne,
+                                 numNodes * w / numWriters,
+                                 numNodes * (w + 1) / numWriters, parents,
+                                 parentCounts);
+    });
+    for (int w = 0; w < numWriters; w++) {
+      this->nodeOccupancy += numKeys[w];
+    }
+    level.swap(parents);
+    counts.swap(parentCounts);
+    levelOne = false;
+    this->height++;
+  }
+  this->rootPageNum = level[0].pageNo;
+}
+
+template <class T>
+std::vector<RIDKeyPair<T> > BTreeIndex::sampleSplitters(
+    const std::string &relationName, const PageId numPages,
+    const int numParts, const BTreeOptions &options) {
+  // whole pages spread evenly over the relation, 16 for every part
+  const PageId numSamplePages =
+      std::min<std::uint64_t>(numPages - 1, 16 * (std::uint64_t)numParts);
+  std::vector<RIDKeyPair<T> > sample;
+  RIDKeyPair<T> entry;
+  RecordId rid;
+  for (PageId i = 0; i < numSamplePages; i++) {
+    const PageId pageNo =
+        1 + (std::uint64_t)(numPages - 1) * i / numSamplePages;
+    FileScan scan(relationName, bufMgr, pageNo, pageNo + 1, options.ioMode);
+    try {
+      while (true) {
+        scan.scanNext(rid);
+        std::string recordStr = scan.getRecord();
+        entry.set(rid, key_of<T>(recordStr.c_str() + attrByteOffset));
+        sample.push_back(entry);
+      }
+    } catch (EndOfFileException &e) {
+    }
+  }
+  std::sort(sample.begin(), sample.end());
+
+  std::vector<RIDKeyPair<T> > splitters;
+  for (int p = 1; p < numParts && !sample.empty(); p++) {
+    splitters.push_back(sample[sample.size() * p / numParts]);
+  }
+  return splitters;
+}
+
+template <class T>
+void BTreeIndex::packLeaves(ExternalSort &sorter, const std::size_t total,
+                            const BTreeOptions &options,
+                            std::vector<PageKeyPair<T> > &level,
+                            std::vector<std::uint32_t> &counts) {
+  typedef RIDKeyPair<T> Entry;
+  const int leafCapacity =
+      std::max(1, (int)(this->payloadLayout.capacity * options.fillFactor));
+  const std::size_t numLeaves =
+      std::max<std::size_t>(1, (total + leafCapacity - 1) / leafCapacity);
+  std::string record;
+  Entry entry;
+  PageKeyPair<T> child;
+  PageId prevPageNo = 0;
+  LeafNode<T> *prev = NULL;
+  T lastKey{};
+  std::int64_t distinct = 0;
+  for (std::size_t n = 0; n < numLeaves; n++) {
+    PageId pageNo;
+    LeafNode<T> *leaf = allocNode<LeafNode<T> >(pageNo);
+    leaf->keyNum = total / numLeaves + (n < total % numLeaves);
+    for (int i = 0; i < leaf->keyNum; i++) {
+      sorter.next(record);
+      memcpy((void *)&entry, record.data(), sizeof(entry));
+      distinct += (n == 0 && i == 0) || entry.key != lastKey;
+      lastKey = entry.key;
+      this->bloom.add(key_hash(entry.key));
+      leaf->keyArray[i] = entry.key;
+      leaf->ridArray[i] = entry.rid;
+      if (this->payloadLength > 0) {
+        payload_set(leaf, i, (const unsigned char *)&record[sizeof(entry)],
+                    this->payloadLayout);
+      }
+    }
+    this->leafOccupancy += leaf->keyNum;
+
+    child.set(pageNo, leaf->keyArray[0]);
+    level.push_back(child);
+    counts.push_back(leaf->keyNum);
+    if (prev != NULL) {
+      prev->rightSibPageNo = pageNo;
+      bufMgr->unPinPage(file, prevPageNo, true);
+      relinkLeaf(prevPageNo, 0, pageNo);
+    }
+    prev = leaf;
+    prevPageNo = pageNo;
+  }
+  bufMgr->unPinPage(file, prevPageNo, true);
+  this->analyzedDistinct += distinct;
+}
+
+template <class T>
+int BTreeIndex::packNonLeaves(const std::vector<PageKeyPair<T> > &level,
+                              const std::vector<std::uint32_t> &counts,
+                              const bool levelOne, const std::size_t from,
+                              const std::size_t to,
+                              std::vector<PageKeyPair<T> > &parents,
+                              std::vector<std::uint32_t> &parentCounts) {
+  // the children are spread evenly over the nodes
+  const std::size_t numNodes = parents.size();
+  const std::size_t base = level.size() / numNodes;
+  const std::size_t extra = level.size() % numNodes;
+  int numKeys = 0;
+  for (std::size_t n = from; n < to; n++) {
+    const std::size_t first = n * base + std::min(n, extra);
+    const std::size_t count = base + (n < extra);
+    PageId pageNo;
+    NonLeafNode<T> *node = allocNode<NonLeafNode<T> >(pageNo);
+    node->level = levelOne;
+    node->pageNoArray[0] = level[first].pageNo;
+    for (std::size_t i = 1; i < count; i++) {
+      node->keyArray[i - 1] = level[first + i].key;
+      node->pageNoArray[i] = level[first + i].pageNo;
+    }
+    node->keyNum = count - 1;
+    numKeys += node->keyNum;
+    std::uint32_t sum = 0;
+    for (std::size_t i = 0; i < count; i++) {
+      count_set(node, i, counts[first + i], this->countLayout);
+      sum += counts[first + i];
+    }
+    bufMgr->unPinPage(file, pageNo, true);
+
+    parents[n].set(pageNo, level[first].key);
+    parentCounts[n] = sum;
+  }
+  return numKeys;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+/**
+ * Destructor
+ *
+ * clearing up any state variables,
+ * unpinning any B+ Tree pages that are pinned,
+ * and flushing the index file
+ *
+ * Note that this method does not delete the index file!
+ * But, deletion of the file object is required,
+ * which will call thedestructor of File class causing the index file to be
+ * closed.
+ */
+BTreeIndex::~BTreeIndex() {
+  if (currentScan != NULL) {
+    endScan();
+  }
+  flushInserts();
+  if (this->bloomRate > 0) {
+    saveBloom();
+  }
+  writeRootToMeta();
+  bufMgr->flushFile(this->file);
+  delete this->file;
+  this->file = nullptr;
+}
+
+/**
+ * @param  page given NonLeafNode
+ * @return whether it is a non leaf node just above the leaf node
+ */
+template <class T>
+bool BTreeIndex::isLevelOneNode(const NonLeafNode<T> *page) {
+  return page->level == 1;
+}
+
+/**
+ * findIndexInNonLeaf
+ *
+ * Keys equal to a separator are inserted to its right, but a run of equal
+ * keys may still span the split that created the separator.
+ *
+ * @param nonLeafNode
+ * @param key
+ * @return loc
+ */
+template <class T>
+int BTreeIndex::findIndexInNonLeaf(const NonLeafNode<T> *nonLeafNode,
+                                   const T &key) {
+  return keyUpperBound(nonLeafNode->keyArray, nonLeafNode->keyNum, key);
+}
+
+/**
+ * Given a key, find index of the first element that larger than it
+ * For 1 3 5 7 and key = 2 return 1
+ * If array is empty, will return 0
+ *
+ * @param leafNode
+ * @param key
+ * @return loc
+ */
+template <class T>
+int BTreeIndex::findIndexInLeaf(const LeafNode<T> *leafNode, const T &key) {
+  return keyUpperBound(leafNode->keyArray, leafNode->keyNum, key);
+}
+
+/**
+ * insertToLeaf
+ *
+ * @param leafNode
+ * @param index
+ * @param key
+ * @param rid
+ */
+template <class T>
+void BTreeIndex::insertToLeaf(LeafNode<T> *leafNode, const int index,
+                              const T &key, const RecordId rid,
+                              const unsigned char *payload) {
+  const size_t len = leafNode->keyNum - index;
+
+  // shift elements from the index
+  memmove(&leafNode->keyArray[index + 1], &leafNode->keyArray[index],
+          len * sizeof(T));
+  memmove(&leafNode->ridArray[index + 1], &leafNode->ridArray[index],
+          len * sizeof(RecordId));
+  if (this->payloadLength > 0) {
+    payload_move(leafNode, index + 1, leafNode, index, len,
+                 this->payloadLayout);
+    payload_set(leafNode, index, payload, this->payloadLayout);
+  }
+
+  leafNode->keyNum++;
+  this->leafOccupancy++;
+
+  // store the KV into this node
+  leafNode->keyArray[index] = key;
+  leafNode->ridArray[index] = rid;
+}
+
+/**
+ * When insert into
+ *     1     |     3    |   5
+ *    /      |          |    \
+ *  (-,1)   [1, 3)    [3,5)  [5,+)
+ * @param currNonLeafNode
+ * @param index
+ * @param newIndex
+ * @param newPageNo
+ */
+template <class T>
+void BTreeIndex::insertToNonLeaf(NonLeafNode<T> *currNonLeafNode,
+                                 const int index, const T &newIndex,
+                                 const PageId newPageNo,
+                                 const std::uint32_t newCount) {
+  const size_t len = currNonLeafNode->keyNum - index;
+
+  // shift elements from the index
+  memmove(&currNonLeafNode->keyArray[index + 1],
+          &currNonLeafNode->keyArray[index], len * sizeof(T));
+  memmove(&currNonLeafNode->pageNoArray[index + 2],
+          &currNonLeafNode->pageNoArray[index + 1], len * sizeof(PageId));
+  count_move(currNonLeafNode, index + 2, currNonLeafNode, index + 1, len,
+             this->countLayout);
+  count_set(currNonLeafNode, index + 1, newCount, this->countLayout);
+
+  currNonLeafNode->keyNum++;
+  this->nodeOccupancy++;
+
+  // store the KV into this node
+  currNonLeafNode->keyArray[index] = newIndex;
+  currNonLeafNode->pageNoArray[index + 1] = newPageNo;
+}
+
+/**
+ * Because after split a non leaf node, the new node is like
+ *     7     |     9    |   11
+ *           |          |    \
+ *          [7, 9)    [9,11)  [11,+)
+ * So it's a little different from above insertToNonLeaf()
+ * @param currNonLeafNode
+ * @param index
+ * @param newIndex
+ * @param newPageNo
+ */
+template <class T>
+void BTreeIndex::insertToNewNonLeaf(NonLeafNode<T> *currNonLeafNode,
+                                    const int index, const T &newIndex,
+                                    const PageId newPageNo,
+                                    const std::uint32_t newCount) {
+  const size_t len = currNonLeafNode->keyNum - index;
+
+  // shift elements from the index
+  memmove(&currNonLeafNode->keyArray[index + 1],
+          &currNonLeafNode->keyArray[index], len * sizeof(T));
+  memmove(&currNonLeafNode->pageNoArray[index + 1],
+          &currNonLeafNode->pageNoArray[index], len * sizeof(PageId));
+  count_move(currNonLeafNode, index + 1, currNonLeafNode, index, len,
+             this->countLayout);
+  count_set(currNonLeafNode, index, newCount, this->countLayout);
+
+  this->nodeOccupancy++;
+  currNonLeafNode->keyNum++;
+
+  // store the KV into this node
+  currNonLeafNode->keyArray[index] = newIndex;
+  currNonLeafNode->pageNoArray[index] = newPageNo;
+}
+
+/**
+ * for
+ *     7     |     9    |   11
+ *           |          |    \
+ *          [7, 9)    [9,11)  [11,+)
+ * convert to
+ *                 9    |   11
+ *            /         |    \
+ *          [7, 9)    [9,11)  [11,+)
+ * @param currNonLeafNode
+ * @return the smallest key(the parent needs)
+ */
+template <class T>
+T BTreeIndex::deleteNewKeyNonLeaf(NonLeafNode<T> *currNonLeafNode) {
+  currNonLeafNode->keyNum--;
+  this->nodeOccupancy--;
+  T key = currNonLeafNode->keyArray[0];
+  memmove(&currNonLeafNode->keyArray[0], &currNonLeafNode->keyArray[1],
+          (currNonLeafNode->keyNum) * sizeof(T));
+  memset(&currNonLeafNode->keyArray[currNonLeafNode->keyNum], 0, sizeof(T));
+  return key;
+}
+
+/**
+ * Split a leaf node into 2 parts
+ *
+ * @param node
+ * @param newNode
+ * @param leftLen
+ */
+template <class T>
+void BTreeIndex::splitLeaf(LeafNode<T> *node, LeafNode<T> *newNode,
+                           PageId newPageNo, const int leftLen) {
+  const size_t rightLen = node->keyNum - leftLen;
+
+  // the inline posting lists follow their entries
+  std::vector<std::vector<unsigned char> > lists;
+  if (this->leafPostings) {
+    inline_detach(node, lists);
+  }
+
+  // adjust keyNum
+  node->keyNum = leftLen;
+  newNode->keyNum = rightLen;
+
+  // move elements from old node to new node
+  memcpy(newNode->keyArray, &node->keyArray[leftLen], rightLen * sizeof(T));
+  memcpy(newNode->ridArray, &node->ridArray[leftLen],
+         rightLen * sizeof(RecordId));
+  payload_move(newNode, 0, node, leftLen, rightLen, this->payloadLayout);
+
+  // clear the space of removed elements
+  memset(&node->keyArray[leftLen], 0, rightLen * sizeof(T));
+  memset(&node->ridArray[leftLen], 0, rightLen * sizeof(RecordId));
+  if (this->leafPostings) {
+    inline_attach(node, lists);
+    inline_attach(newNode, lists);
+  }
+
+  // set rightSibPageNo
+  newNode->rightSibPageNo = node->rightSibPageNo;
+  node->rightSibPageNo = newPageNo;
+}
+
+/**
+ * Split a non leaf node into 2 parts
+ * from
+ *     1     |     3    |     5    |   7   |   9    |   11
+ *    /      |          |          |       |        |     \
+ *  (-,1)   [1, 3)    [3,5)       [5,7)   [7,9)    [9,11)  [11,+)
+ *  to
+ *     1     |     3    |   5
+ *    /      |          |    \
+ *  (-,1)   [1, 3)    [3,5)  [5,+)
+ * and
+ *     7     |     9    |   11
+ *           |          |    \
+ *          [7, 9)    [9,11)  [11,+)
+ * @param node
+ * @param newNode
+ * @param leftLen
+ */
+template <class T>
+void BTreeIndex::splitNonLeaf(NonLeafNode<T> *node, NonLeafNode<T> *newNode,
+                              const int leftLen) {
+  const size_t rightLen = node->keyNum - leftLen;
+
+  // adjust keyNum
+  node->keyNum = leftLen;
+  newNode->keyNum = rightLen;
+
+  // move elements from old node to new node
+  memcpy(newNode->keyArray, &node->keyArray[leftLen], rightLen * sizeof(T));
+  memcpy(newNode->pageNoArray, &node->pageNoArray[leftLen + 1],
+         rightLen * sizeof(PageId));
+  count_move(newNode, 0, node, leftLen + 1, rightLen, this->countLayout);
+
+  newNode->level = node->level;
+
+  // clear the space of removed elements
+  memset(&node->keyArray[leftLen], 0, rightLen * sizeof(T));
+  memset(&node->pageNoArray[leftLen + 1], 0, rightLen * sizeof(PageId));
+}
+
+/**
+ * When need to split the root, alloc a new page as new root and finish
+ * related settings
+ *
+ * @param key    new parent key
+ * @param left   smaller one
+ * @param right	 larger one
+ */
+template <class T>
+void BTreeIndex::splitRoot(const T &key, const PageId left,
+                           const PageId right) {
+  // alloc a new page for root
+  PageId newRootPageId;
+  NonLeafNode<T> *newRoot = allocNode<NonLeafNode<T> >(newRootPageId);
+
+  // set newRoot
+  newRoot->keyArray[0] = key;
+  newRoot->pageNoArray[0] = left;
+  newRoot->pageNoArray[1] = right;
+  newRoot->keyNum = 1;
+  this->nodeOccupancy++;
+
+  // set level
+  newRoot->level = (this->rootPageNum == this->initialRootPageNum);
+  if (this->countedTree) {
+    count_set(newRoot, 0, nodeCount<T>(left, newRoot->level),
+              this->countLayout);
+    count_set(newRoot, 1, nodeCount<T>(right, newRoot->level),
+              this->countLayout);
+  }
+
+  // unpin the root page
+  bufMgr->unPinPage(file, newRootPageId, true);
+  this->rootPageNum = newRootPageId;
+  this->height++;
+  innerNodeChanged((NonLeafNode<T> *)NULL);
+
+  // address change of root page
+  writeRootToMeta();
+}
+
+/**
+ * When we can make sure we want to insert a KV to a leaf node
+ *
+ * @param currPageNo
+ * @param key
+ * @param rid
+ * @param newPageNo
+ * @param newIndex
+ */
+template <class T>
+void BTreeIndex::handleLeafInsertion(const PageId currPageNo, const T &key,
+                                     const RecordId rid,
+                                     const unsigned char *payload,
+                                     PageId &newPageNo, T &newIndex) {
+  Page *page;
+  bufMgr->readPage(file, currPageNo, page, ACCESS_INDEX_LEAF);
+  LeafNode<T> *currLeafNode = (LeafNode<T> *)page;
+
+  if constexpr (KeyTraits<T>::TYPE == INTEGER) {
+    if (leaf_compressed(currLeafNode)) {
+      CompressedLeafInt *leafNode = (CompressedLeafInt *)page;
+      newPageNo = 0;
+      if (!insertToCompressedLeaf(leafNode, key, rid)) {
+        const PageId nextPageNo = leafNode->rightSibPageNo;
+        splitCompressedLeaf(leafNode, key, rid, newPageNo, newIndex);
+        bufMgr->unPinPage(file, newPageNo, true);
+        relinkLeaf(currPageNo, nextPageNo, newPageNo);
+        relinkLeaf(newPageNo, 0, nextPageNo);
+      }
+      bufMgr->unPinPage(file, currPageNo, true);
+      return;
+    }
+  }
+
+  // We are sure it is a LeafNode
+  int index = findIndexInLeaf(currLeafNode, key);
+  // the key goes into a posting list, or not full, insert directly
+  if (insertToPostingList(currLeafNode, index, key, rid)) {
+    bufMgr->unPinPage(file, currPageNo, true);
+    newPageNo = 0;
+    return;
+  }
+  if (leafSlots(currLeafNode) < this->payloadLayout.capacity) {
+    insertToLeaf(currLeafNode, index, key, rid, payload);
+    bufMgr->unPinPage(file, currPageNo, true);
+    newPageNo = 0;
+    return;
+  }
+
+  // allocate a new LeafNode page
+  LeafNode<T> *newNode = allocNode<LeafNode<T> >(newPageNo);
+  // full, prepare to split this leaf node so that the left node ends up
+  // with half of the entries, rounded up, after the new one is inserted
+  const int half = (currLeafNode->keyNum + 2) / 2;
+  bool insertToLeft = index < half;
+  int leftLen = half - insertToLeft;
+
+  // a key after every other of the last leaf is likely an append of
+  // increasing keys, which would leave every leaf half empty: keep the full
+  // leaf and start the new one with the key
+  const bool append =
+      index == currLeafNode->keyNum && currLeafNode->rightSibPageNo == 0;
+  if (append) {
+    leftLen = currLeafNode->keyNum;
+  }
+
+  // if full size = 7 and insert index < 4, then split into 3 and 4
+  // if full size = 7 and insert index >= 4, then split into 4 and 3
+  // if full size = 8 and insert index < 5, then split into 4 and 4
+  // if full size = 8 and insert index >= 5, then split into 5 and 3
+  splitLeaf(currLeafNode, newNode, newPageNo, leftLen);
+  relinkLeaf(currPageNo, newNode->rightSibPageNo, newPageNo);
+  relinkLeaf(newPageNo, 0, newNode->rightSibPageNo);
+
+  // insert the key and record id to the node, into a posting list that now
+  // has room to grow
+  LeafNode<T> *target = insertToLeft ? currLeafNode : newNode;
+  const int targetIndex = insertToLeft ? index : index - leftLen;
+  const bool posted = insertToPostingList(target, targetIndex, key, rid);
+  if (!posted) {
+    insertToLeaf(target, targetIndex, key, rid, payload);
+  }
+
+  assert(append || posted ||
+         (currLeafNode->keyNum - newNode->keyNum <= 1 &&
+          currLeafNode->keyNum - newNode->keyNum >= -1));
+
+  // set the return value
+  newIndex = newNode->keyArray[0];
+
+  // unpin the new node and the original node
+  bufMgr->unPinPage(file, currPageNo, true);
+  bufMgr->unPinPage(file, newPageNo, true);
+}
+
+/**
+ * recursive call until leaf nodes
+ *
+ * @param currPageNo page id of the page that stores the root node of the
+ *        subtree.
+ * @param key the key of the key-record pair to be inserted
+ * @param rid the record ID of the key-record pair to be inserted
+ * @param newPageNo a pointer to an integer value to be stored in the parent
+ * node if the insertion requires a split in the current level
+ * @param isLeaf whether this node is leaf
+ * @param newIndex the page number of the newly created node if a split occurs,
+ * or 0 otherwise.
+ */
+template <class T>
+void BTreeIndex::recursiveInsert(const PageId currPageNo, const T &key,
+                                 const RecordId rid,
+                                 const unsigned char *payload,
+                                 PageId &newPageNo, T &newIndex, bool isLeaf,
+                                 bool rightmost) {
+  // if leaf, just call handleLeafInsertion
+  if (isLeaf) {
+    handleLeafInsertion(currPageNo, key, rid, payload, newPageNo, newIndex);
+    return;
+  }
+
+  // get the current page, it must be a non leaf node
+  Page *page;
+  bufMgr->readPage(file, currPageNo, page, ACCESS_INDEX_INNER);
+  NonLeafNode<T> *currNonLeafNode = (NonLeafNode<T> *)page;
+
+  // find the node to be inserted and recursive call
+  int childIndex = findIndexInNonLeaf(currNonLeafNode, key);
+  PageId nodeBeInserted = currNonLeafNode->pageNoArray[childIndex];
+  recursiveInsert(nodeBeInserted, key, rid, payload, newPageNo, newIndex,
+                  isLevelOneNode(currNonLeafNode),
+                  rightmost && childIndex == currNonLeafNode->keyNum);
+
+  // no split in child, the child has one more entry
+  const std::uint32_t childCount =
+      count_get(currNonLeafNode, childIndex, this->countLayout) + 1;
+  if (newPageNo == 0) {
+    count_set(currNonLeafNode, childIndex, childCount, this->countLayout);
+    bufMgr->unPinPage(file, currPageNo, this->countedTree);
+    return;
+  }
+  innerNodeChanged(currNonLeafNode);
+
+  // split happened in child, the new node goes right after it and takes
+  // some of its entries; if this page is not full just insert and return
+  const std::uint32_t newCount =
+      this->countedTree
+          ? nodeCount<T>(newPageNo, isLevelOneNode(currNonLeafNode))
+          : 0;
+  count_set(currNonLeafNode, childIndex, childCount - newCount,
+            this->countLayout);
+  int index = childIndex;
+  if (currNonLeafNode->keyNum < this->countLayout.capacity) {
+    insertToNonLeaf(currNonLeafNode, index, newIndex, newPageNo, newCount);
+    bufMgr->unPinPage(file, currPageNo, true);
+    newPageNo = 0;
+    return;
+  }
+
+  // this page is also full, allocate a new NonLeafNode
+  PageId newNonLeafPage;
+  NonLeafNode<T> *newNode = allocNode<NonLeafNode<T> >(newNonLeafPage);
+
+  // need split this page, tell parent through
+  // newPageNo & newIndex, the left page keeps half of the keys rounded up
+  const int half = (this->countLayout.capacity + 2) / 2;
+  bool insertToLeft = index < half;
+  int leftLen = half - insertToLeft;
+
+  // the last child of the last node split, as when leaves are appended:
+  // the new node only takes the last child and the new one
+  const bool append = rightmost && index == currNonLeafNode->keyNum;
+  if (append) {
+    leftLen = currNonLeafNode->keyNum - 1;
+  }
+
+  // split the node to currNonLeafNode and newNode
+  splitNonLeaf(currNonLeafNode, newNode, leftLen);
+
+  // insert key and record id to the right node
+  if (insertToLeft) {
+    insertToNonLeaf(currNonLeafNode, index, newIndex, newPageNo, newCount);
+  } else {
+    insertToNewNonLeaf(newNode, index - leftLen, newIndex, newPageNo,
+                       newCount);
+  }
+
+  assert(append || (currNonLeafNode->keyNum - newNode->keyNum <= 1 &&
+                     currNonLeafNode->keyNum - newNode->keyNum >= -1));
+
+  // new node is illeagle now, so adjust it
+  newIndex = deleteNewKeyNonLeaf(newNode);
+  newPageNo = newNonLeafPage;
+
+  // unpin the new node and the currPageNo node
+  bufMgr->unPinPage(file, currPageNo, true);
+  bufMgr->unPinPage(file, newPageNo, true);
+}
+
+// -----------------------------------------------------------------------------
+// Posting lists
+// -----------------------------------------------------------------------------
+
+PageId BTreeIndex::createPostingList(const std::vector<std::uint64_t> &ids) {
+  PageId headPageNo;
+  PostingPage *head = allocNode<PostingPage>(headPageNo);
+  std::size_t next = posting_fill(head, ids, 0, ids.size());
+  head->lastPageNo = headPageNo;
+
+  // the ids that do not fit go to pages linked after the first
+  PageId tailPageNo = headPageNo;
+  PostingPage *tail = head;
+  while (next < ids.size()) {
+    PageId pageNo;
+    PostingPage *page = allocNode<PostingPage>(pageNo);
+    next = posting_fill(page, ids, next, ids.size());
+    tail->nextPageNo = pageNo;
+    if (tail != head) {
+      bufMgr->unPinPage(file, tailPageNo, true);
+    }
+    tailPageNo = pageNo;
+    tail = page;
+  }
+  head->lastPageNo = tailPageNo;
+  if (tail != head) {
+    bufMgr->unPinPage(file, tailPageNo, true);
+  }
+  bufMgr->unPinPage(file, headPageNo, true);
+  return headPageNo;
+}
+
+void BTreeIndex::addToPostingList(const PageId headPageNo, const RecordId rid) {
+  const std::uint64_t id = posting_id(rid);
+  Page *page;
+  bufMgr->readPage(file, headPageNo, page, ACCESS_INDEX_LEAF);
+  PostingPage *head = (PostingPage *)page;
+
+  // ids mostly come in the order of a scan of the relation: append
+  const PageId tailPageNo = head->lastPageNo;
+  PostingPage *tail = head;
+  if (tailPageNo != headPageNo) {
+    bufMgr->readPage(file, tailPageNo, page, ACCESS_INDEX_LEAF);
+    tail = (PostingPage *)page;
+  }
+  if (id >= tail->lastId) {
+    if (!posting_append(tail, id)) {
+      PageId newPageNo;
+      PostingPage *newPage = allocNode<PostingPage>(newPageNo);
+      posting_append(newPage, id);
+      tail->nextPageNo = newPageNo;
+      head->lastPageNo = newPageNo;
+      bufMgr->unPinPage(file, newPageNo, true);
+    }
+    if (tail != head) {
+      bufMgr->unPinPage(file, tailPageNo, true);
+    }
+    bufMgr->unPinPage(file, headPageNo, true);
+    return;
+  }
+  if (tail != head) {
+    bufMgr->unPinPage(file, tailPageNo, false);
+  }
+
+  // insert into the first page whose last id is not smaller
+  PageId pageNo = headPageNo;
+  PostingPage *curr = head;
+  while (curr->lastId < id) {
+    const PageId next = curr->nextPageNo;
+    if (curr != head) {
+      bufMgr->unPinPage(file, pageNo, false);
+    }
+    bufMgr->readPage(file, next, page, ACCESS_INDEX_LEAF);
+    pageNo = next;
+    curr = (PostingPage *)page;
+  }
+  std::vector<std::uint64_t> ids;
+  posting_decode(curr, ids);
+  ids.insert(std::upper_bound(ids.begin(), ids.end(), id), id);
+  if (posting_fill(curr, ids, 0, ids.size()) < ids.size()) {
+    // full: the second half of the ids goes to a new page after it
+    PageId newPageNo;
+    PostingPage *newPage = allocNode<PostingPage>(newPageNo);
+    posting_fill(curr, ids, 0, ids.size() / 2);
+    posting_fill(newPage, ids, ids.size() / 2, ids.size());
+    newPage->nextPageNo = curr->nextPageNo;
+    curr->nextPageNo = newPageNo;
+    if (head->lastPageNo == pageNo) {
+      head->lastPageNo = newPageNo;
+    }
+    bufMgr->unPinPage(file, newPageNo, true);
+  }
+  if (curr != head) {
+    bufMgr->unPinPage(file, pageNo, true);
+  }
+  bufMgr->unPinPage(file, headPageNo, true);
+}
+
+bool BTreeIndex::removeFromPostingList(const PageId headPageNo,
+                                       const RecordId rid, bool &empty) {
+  const std::uint64_t id = posting_id(rid);
+  empty = false;
+  Page *page;
+  bufMgr->readPage(file, headPageNo, page, ACCESS_INDEX_LEAF);
+  PostingPage *head = (PostingPage *)page;
+
+  // the id can only be on the first page whose last id is not smaller
+  PageId prevPageNo = 0, pageNo = headPageNo;
+  PostingPage *prev = NULL, *curr = head;
+  while (curr->lastId < id && curr->nextPageNo != 0) {
+    if (prev != NULL && prev != head) {
+      bufMgr->unPinPage(file, prevPageNo, false);
+    }
+    prevPageNo = pageNo;
+    prev = curr;
+    pageNo = curr->nextPageNo;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    curr = (PostingPage *)page;
+  }
+
+  std::vector<std::uint64_t> ids;
+  bool found = false;
+  if (curr->firstId <= id && id <= curr->lastId) {
+    posting_decode(curr, ids);
+    std::vector<std::uint64_t>::iterator it =
+        std::lower_bound(ids.begin(), ids.end(), id);
+    found = it != ids.end() && *it == id;
+    if (found) {
+      ids.erase(it);
+    }
+  }
+  if (!found || !ids.empty()) {
+    // taking an id out never makes the others longer
+    if (found) {
+      posting_fill(curr, ids, 0, ids.size());
+    }
+    if (curr != head) {
+      bufMgr->unPinPage(file, pageNo, found);
+    }
+    if (prev != NULL && prev != head) {
+      bufMgr->unPinPage(file, prevPageNo, false);
+    }
+    bufMgr->unPinPage(file, headPageNo, found);
+    return found;
+  }
+
+  // the page is left empty
+  PageId freedPageNo = pageNo;
+  if (curr == head) {
+    const PageId next = head->nextPageNo;
+    if (next == 0) {
+      empty = true;
+    } else {
+      // the first page stays where the leaf entry points: the second one
+      // moves into it
+      const PageId lastPageNo = head->lastPageNo;
+      bufMgr->readPage(file, next, page, ACCESS_INDEX_LEAF);
+      memcpy(head, page, sizeof(PostingPage));
+      head->lastPageNo = lastPageNo == next ? headPageNo : lastPageNo;
+      bufMgr->unPinPage(file, next, false);
+      freedPageNo = next;
+    }
+  } else {
+    prev->nextPageNo = curr->nextPageNo;
+    if (head->lastPageNo == pageNo) {
+      head->lastPageNo = prevPageNo;
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    if (prev != head) {
+      bufMgr->unPinPage(file, prevPageNo, true);
+    }
+  }
+  bufMgr->unPinPage(file, headPageNo, true);
+  disposeNode<PostingPage>(freedPageNo);
+  return true;
+}
+
+void BTreeIndex::readPostingList(const PageId headPageNo,
+                                 std::vector<RecordId> &out) {
+  PageId pageNo = headPageNo;
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    const PostingPage *curr = (const PostingPage *)page;
+    posting_read(curr, out);
+    const PageId next = curr->nextPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = next;
+  }
+}
+
+void BTreeIndex::freePostingList(PageId pageNo) {
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    const PageId next = ((const PostingPage *)page)->nextPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    disposeNode<PostingPage>(pageNo);
+    pageNo = next;
+  }
+}
+
+template <class T>
+int BTreeIndex::leafSlots(const LeafNode<T> *leafNode) {
+  if (!this->leafPostings) {
+    return leafNode->keyNum;
+  }
+  return leafNode->keyNum + inline_slots(inline_heap_size(leafNode));
+}
+
+template <class T>
+bool BTreeIndex::addToInlineList(LeafNode<T> *leafNode, const int i,
+                                 const RecordId rid) {
+  const int heap = inline_heap_size(leafNode);
+  const int offset = inline_offset(leafNode->ridArray[i]);
+  const int len = inline_length(leafNode->ridArray[i]);
+  unsigned char *end = inline_heap_end(leafNode);
+  const std::uint64_t id = posting_id(rid);
+  std::uint64_t lastId;
+  memcpy(&lastId, end - offset, INLINEHEADER);
+
+  // ids mostly come in the order of a scan of the relation: append, else
+  // write the list again
+  unsigned char delta[20];
+  int deltaLen = 0;
+  std::vector<unsigned char> list;
+  if (id >= lastId) {
+    deltaLen = inline_varints(lastId, id, delta);
+  } else {
+    std::vector<std::uint64_t> ids;
+    inline_decode(end - offset, len, ids);
+    ids.insert(std::upper_bound(ids.begin(), ids.end(), id), id);
+    inline_encode(ids, list);
+  }
+  const int newLen = list.empty() ? len + deltaLen : (int)list.size();
+  const bool room = leafNode->keyNum + inline_slots(heap - len + newLen) <=
+                    this->payloadLayout.capacity;
+
+  // a list that no longer fits in its leaf moves to posting pages, unless it
+  // is small enough that splitting the leaf makes room
+  if (newLen > inline_max<T>() || (!room && 2 * newLen > inline_max<T>())) {
+    std::vector<std::uint64_t> ids;
+    inline_decode(end - offset, len, ids);
+    ids.insert(std::upper_bound(ids.begin(), ids.end(), id), id);
+    inline_drop(leafNode, i, heap);
+    leafNode->ridArray[i].page_number = createPostingList(ids);
+    leafNode->ridArray[i].slot_number = POSTINGLISTSLOT;
+    return true;
+  }
+  if (!room) {
+    return false;
+  }
+  if (!list.empty()) {
+    inline_drop(leafNode, i, heap);
+    inline_put(leafNode, i, list.data(), list.size(), heap - len);
+    return true;
+  }
+
+  // the list and those further from the end move down by the bytes of the
+  // new id, which go after the others
+  memmove(end - heap - deltaLen, end - heap, heap - offset + len);
+  memcpy(end - offset + len - deltaLen, delta, deltaLen);
+  memcpy(end - offset - deltaLen, &id, INLINEHEADER);
+  for (int k = 0; k < leafNode->keyNum; k++) {
+    const RecordId entry = leafNode->ridArray[k];
+    if (inline_is(entry) && inline_offset(entry) >= offset) {
+      leafNode->ridArray[k] = inline_rid(inline_offset(entry) + deltaLen,
+                                         inline_length(entry) +
+                                             (k == i ? deltaLen : 0));
+    }
+  }
+  return true;
+}
+
+template <class T>
+bool BTreeIndex::removeFromInlineList(LeafNode<T> *leafNode, const int i,
+                                      const RecordId rid, bool &empty) {
+  const RecordId entry = leafNode->ridArray[i];
+  const int len = inline_length(entry);
+  std::vector<std::uint64_t> ids;
+  inline_decode(inline_bytes(leafNode, entry), len, ids);
+  std::vector<std::uint64_t>::iterator it =
+      std::lower_bound(ids.begin(), ids.end(), posting_id(rid));
+  empty = false;
+  if (it == ids.end() || *it != posting_id(rid)) {
+    return false;
+  }
+  ids.erase(it);
+
+  // taking an id out never makes the others longer
+  const int heap = inline_heap_size(leafNode);
+  inline_drop(leafNode, i, heap);
+  empty = ids.empty();
+  if (!empty) {
+    std::vector<unsigned char> list;
+    inline_encode(ids, list);
+    inline_put(leafNode, i, list.data(), list.size(), heap - len);
+  }
+  return true;
+}
+
+template <class L>
+RecordId BTreeIndex::firstRecordId(const L *leafNode, const int i) {
+  const RecordId entry = leaf_rid(leafNode, i);
+  if (!isPostingList(entry)) {
+    return entry;
+  }
+  if constexpr (!std::is_same<L, CompressedLeafInt>::value) {
+    if (inline_is(entry)) {
+      std::uint64_t id = 0;
+      inline_unvarints(inline_bytes(leafNode, entry) + INLINEHEADER, id);
+      return posting_rid(id);
+    }
+  }
+  Page *page;
+  bufMgr->readPage(file, entry.page_number, page, ACCESS_INDEX_LEAF);
+  const RecordId rid = posting_rid(((const PostingPage *)page)->firstId);
+  bufMgr->unPinPage(file, entry.page_number, false);
+  return rid;
+}
+
+template <class T>
+std::size_t BTreeIndex::copyLeafEntries(const LeafNode<T> *leafNode, int from,
+                                        const int to,
+                                        std::vector<RecordId> &out) {
+  const std::size_t size = out.size();
+  while (from < to) {
+    // runs of plain entries are copied at once
+    int k = from;
+    while (k < to && !isPostingList(leafNode->ridArray[k])) {
+      k++;
+    }
+    out.insert(out.end(), leafNode->ridArray + from, leafNode->ridArray + k);
+    if (k < to) {
+      const RecordId entry = leafNode->ridArray[k];
+      if (inline_is(entry)) {
+        inline_read(inline_bytes(leafNode, entry), inline_length(entry), out);
+      } else {
+        readPostingList(entry.page_number, out);
+      }
+      k++;
+    }
+    from = k;
+  }
+  return out.size() - size;
+}
+
+template <class T>
+bool BTreeIndex::insertToPostingList(LeafNode<T> *leafNode, const int index,
+                                     const T &key, const RecordId rid) {
+  if (index == 0 || leafNode->keyArray[index - 1] != key) {
+    return false;
+  }
+  if (inline_is(leafNode->ridArray[index - 1])) {
+    return addToInlineList(leafNode, index - 1, rid);
+  }
+  if (isPostingList(leafNode->ridArray[index - 1])) {
+    addToPostingList(leafNode->ridArray[index - 1].page_number, rid);
+    return true;
+  }
+  if (!this->postingLists) {
+    return false;
+  }
+  const int lo = keyLowerBound(leafNode->keyArray, index, key);
+  if (index - lo + 1 < POSTINGLISTMIN) {
+    return false;
+  }
+
+  // the entries of key before index become one posting list entry
+  std::vector<std::uint64_t> ids;
+  int heap = inline_heap_size(leafNode);
+  for (int i = lo; i < index; i++) {
+    const RecordId entry = leafNode->ridArray[i];
+    if (inline_is(entry)) {
+      // a list that did not fit where it was
+      inline_decode(inline_bytes(leafNode, entry), inline_length(entry), ids);
+      inline_drop(leafNode, i, heap);
+      heap -= inline_length(entry);
+    } else if (isPostingList(entry)) {
+      // a list merged in from a sibling leaf
+      std::vector<RecordId> rids;
+      readPostingList(leafNode->ridArray[i].page_number, rids);
+      for (const RecordId &r : rids) {
+        ids.push_back(posting_id(r));
+      }
+      freePostingList(leafNode->ridArray[i].page_number);
+    } else {
+      ids.push_back(posting_id(leafNode->ridArray[i]));
+    }
+  }
+  ids.push_back(posting_id(rid));
+  std::sort(ids.begin(), ids.end());
+
+  const size_t len = leafNode->keyNum - index;
+  memmove(&leafNode->keyArray[lo + 1], &leafNode->keyArray[index],
+          len * sizeof(T));
+  memmove(&leafNode->ridArray[lo + 1], &leafNode->ridArray[index],
+          len * sizeof(RecordId));
+  this->leafOccupancy -= index - lo - 1;
+  leafNode->keyNum -= index - lo - 1;
+
+  // the list stays in the leaf if it fits there
+  std::vector<unsigned char> list;
+  inline_encode(ids, list);
+  if ((int)list.size() <= inline_max<T>() &&
+      leafNode->keyNum + inline_slots(heap + (int)list.size()) <=
+          this->payloadLayout.capacity) {
+    inline_put(leafNode, lo, list.data(), list.size(), heap);
+  } else {
+    leafNode->ridArray[lo].page_number = createPostingList(ids);
+    leafNode->ridArray[lo].slot_number = POSTINGLISTSLOT;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Compressed leaves
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::insertToCompressedLeaf(CompressedLeafInt *leafNode,
+                                        const int key, const RecordId rid) {
+  const int n = leafNode->numEntries;
+  const int index = cleaf_search<true>(leafNode, 0, n, key);
+  if (cleaf_insert(leafNode, index, key, rid)) {
+    this->leafOccupancy++;
+    return true;
+  }
+
+  int keys[COMPRESSEDLEAFSIZE + 1];
+  RecordId rids[COMPRESSEDLEAFSIZE + 1];
+  cleaf_keys(leafNode, 0, n, keys);
+  cleaf_rids(leafNode, 0, n, rids);
+  memmove(&keys[index + 1], &keys[index], (n - index) * sizeof(int));
+  memmove(&rids[index + 1], &rids[index], (n - index) * sizeof(RecordId));
+  keys[index] = key;
+  rids[index] = rid;
+  if (!cleaf_encode(leafNode, keys, rids, n + 1)) {
+    return false;
+  }
+  this->leafOccupancy++;
+  return true;
+}
+
+void BTreeIndex::splitCompressedLeaf(CompressedLeafInt *leafNode,
+                                     const int key, const RecordId rid,
+                                     PageId &newPageNo, int &newIndex) {
+  const int n = leafNode->numEntries;
+  const int index = cleaf_search<true>(leafNode, 0, n, key);
+  int keys[COMPRESSEDLEAFSIZE + 1];
+  RecordId rids[COMPRESSEDLEAFSIZE + 1];
+  cleaf_keys(leafNode, 0, n, keys);
+  cleaf_rids(leafNode, 0, n, rids);
+  memmove(&keys[index + 1], &keys[index], (n - index) * sizeof(int));
+  memmove(&rids[index + 1], &rids[index], (n - index) * sizeof(RecordId));
+  keys[index] = key;
+  rids[index] = rid;
+
+  // the left leaf keeps half of the entries rounded up, or all old ones if
+  // this is an append to the last leaf
+  int leftLen = (n + 2) / 2;
+  if (index == n && leafNode->rightSibPageNo == 0) {
+    leftLen = n;
+  }
+  CompressedLeafInt *newNode = allocNode<CompressedLeafInt>(newPageNo);
+  const bool packed =
+      cleaf_encode(newNode, keys + leftLen, rids + leftLen, n + 1 - leftLen) &&
+      cleaf_encode(leafNode, keys, rids, leftLen);
+  assert(packed);
+  (void)packed;
+
+  newNode->rightSibPageNo = leafNode->rightSibPageNo;
+  leafNode->rightSibPageNo = newPageNo;
+  this->leafOccupancy++;
+  newIndex = keys[leftLen];
+}
+
+bool BTreeIndex::deleteFromCompressedLeaf(CompressedLeafInt *leafNode,
+                                          const int key, const RecordId rid) {
+  const int n = leafNode->numEntries;
+  int i = cleaf_search<false>(leafNode, 0, n, key);
+  while (i < n && cleaf_key(leafNode, i) == key &&
+         !(cleaf_rid(leafNode, i) == rid)) {
+    i++;
+  }
+  if (i == n || cleaf_key(leafNode, i) != key) {
+    return false;
+  }
+
+  // fewer entries never need wider fields, so the rest always fits
+  int keys[COMPRESSEDLEAFSIZE];
+  RecordId rids[COMPRESSEDLEAFSIZE];
+  cleaf_keys(leafNode, 0, n, keys);
+  cleaf_rids(leafNode, 0, n, rids);
+  memmove(&keys[i], &keys[i + 1], (n - i - 1) * sizeof(int));
+  memmove(&rids[i], &rids[i + 1], (n - i - 1) * sizeof(RecordId));
+  const bool packed = cleaf_encode(leafNode, keys, rids, n - 1);
+  assert(packed);
+  (void)packed;
+  this->leafOccupancy--;
+  return true;
+}
+
+std::size_t BTreeIndex::copyLeafEntries(const CompressedLeafInt *leafNode,
+                                        int from, const int to,
+                                        std::vector<RecordId> &out) {
+  if (to <= from) {
+    return 0;
+  }
+  const std::size_t size = out.size();
+  out.resize(size + (to - from));
+  cleaf_rids(leafNode, from, to - from, out.data() + size);
+  return to - from;
+}
+
+void BTreeIndex::packCompressedLeaves(ExternalSort &sorter,
+                                      const std::size_t total,
+                                      const BTreeOptions &options,
+                                      std::vector<PageKeyPair<int> > &level,
+                                      std::vector<std::uint32_t> &counts) {
+  // a leaf takes entries as long as they fit in the fill factor of its
+  // entries and of its bytes
+  const std::size_t maxEntries =
+      std::max(1, (int)(COMPRESSEDLEAFSIZE * options.fillFactor));
+  const std::size_t maxBits =
+      (std::size_t)(COMPRESSEDLEAFBYTES * 8 * options.fillFactor);
+  std::vector<int> keys;
+  std::vector<RecordId> rids;
+  std::string record;
+  RIDKeyPair<int> entry;
+  bool pending = false;
+  std::size_t numRead = 0;
+  PageKeyPair<int> child;
+  PageId prevPageNo = 0;
+  CompressedLeafInt *prev = NULL;
+  int lastKey = 0;
+  std::int64_t distinct = 0;
+  while (level.empty() || pending || numRead < total) {
+    keys.clear();
+    rids.clear();
+    PageId minPage = 0, maxPage = 0;
+    SlotId maxSlot = 0;
+    while (pending || numRead < total) {
+      if (!pending) {
+        sorter.next(record);
+        memcpy((void *)&entry, record.data(), sizeof(entry));
+        distinct += numRead == 0 || entry.key != lastKey;
+        lastKey = entry.key;
+        this->bloom.add(key_hash(entry.key));
+        numRead++;
+        pending = true;
+      }
+      const PageId page = entry.rid.page_number;
+      if (!keys.empty()) {
+        const std::size_t width =
+            bitsFor((std::uint32_t)entry.key - (std::uint32_t)keys[0]) +
+            bitsFor(std::max(maxPage, page) - std::min(minPage, page)) +
+            bitsFor(std::max(maxSlot, entry.rid.slot_number));
+        if (keys.size() + 1 > maxEntries ||
+            (keys.size() + 1) * width > maxBits) {
+          break;
+        }
+      }
+      minPage = keys.empty() ? page : std::min(minPage, page);
+      maxPage = keys.empty() ? page : std::max(maxPage, page);
+      maxSlot = std::max(maxSlot, entry.rid.slot_number);
+      keys.push_back(entry.key);
+      rids.push_back(entry.rid);
+      pending = false;
+    }
+
+    PageId pageNo;
+    CompressedLeafInt *leaf = allocNode<CompressedLeafInt>(pageNo);
+    const bool packed =
+        cleaf_encode(leaf, keys.data(), rids.data(), keys.size());
+    assert(packed);
+    (void)packed;
+    this->leafOccupancy += keys.size();
+
+    child.set(pageNo, keys.empty() ? 0 : keys[0]);
+    level.push_back(child);
+    counts.push_back(keys.size());
+    if (prev != NULL) {
+      prev->rightSibPageNo = pageNo;
+      bufMgr->unPinPage(file, prevPageNo, true);
+      relinkLeaf(prevPageNo, 0, pageNo);
+    }
+    prev = leaf;
+    prevPageNo = pageNo;
+  }
+  bufMgr->unPinPage(file, prevPageNo, true);
+  this->analyzedDistinct += distinct;
+}
+
+/**
+ * Insert a new entry using the pair <value,rid>.
+ * Start from root to recursively find out the leaf to insert the entry in. The
+ *insertion may cause splitting of leaf node. This splitting will require
+ *addition of new leaf page number entry into the parent non-leaf, which may
+ *in-turn get split. This may continue all the way upto the root causing the
+ *root to get split. If root gets split, metapage needs to be changed
+ *accordingly. Make sure to unpin pages as soon as you can.
+ * @param key			Key to insert, pointer to integer/double/char
+ *string
+ * @param rid			Record ID of a record whose entry is getting
+ *inserted into the index.
+ **/
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
+  insertEntry(key, rid, NULL);
+}
+
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid,
+                                   const void *payload) {
+  const unsigned char *bytes = (const unsigned char *)payload;
+  if (this->insertBufferEntries > 0) {
+    switch (attributeType) {
+      case INTEGER:
+        bufferKey(key_of<int>(key), rid, bytes);
+        break;
+      case DOUBLE:
+        bufferKey(key_of<double>(key), rid, bytes);
+        break;
+      case STRING:
+        bufferKey(key_of<StringKey>(key), rid, bytes);
+        break;
+    }
+    return;
+  }
+  switch (attributeType) {
+    case INTEGER:
+      insertKey(key_of<int>(key), rid, bytes);
+      break;
+    case DOUBLE:
+      insertKey(key_of<double>(key), rid, bytes);
+      break;
+    case STRING:
+      insertKey(key_of<StringKey>(key), rid, bytes);
+      break;
+  }
+}
+
+template <class T>
+void BTreeIndex::insertKey(const T &key, const RecordId rid,
+                           const unsigned char *payload) {
+  // every insert into a counted tree changes the counts on its path
+  if (!this->countedTree) {
+    // the non-leaf nodes do not change while treeLatch is shared, so only the
+    // leaf needs a latch; a full leaf is split under the exclusive treeLatch
+    std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+    // the key goes into the filter before a lookup can find its entry
+    this->bloom.add(key_hash(key));
+    const bool toRightmost =
+        this->rightmostLeafNum != 0 &&
+        (!this->rightmostBounded || !(key < rightmostFence((T *)NULL)));
+    const PageId leafPageNo =
+        toRightmost ? this->rightmostLeafNum : getLeafPage(key, GT);
+    Page *page;
+    bufMgr->readPage(file, leafPageNo, page, ACCESS_INDEX_LEAF);
+    LeafNode<T> *leafNode = (LeafNode<T> *)page;
+    std::unique_lock<std::shared_mutex> leafGuard(
+        leafLatches.latch(leafPageNo));
+    bool done = false;
+    bool compressed = false;
+    if constexpr (KeyTraits<T>::TYPE == INTEGER) {
+      compressed = leaf_compressed(leafNode);
+      if (compressed) {
+        done = insertToCompressedLeaf((CompressedLeafInt *)page, key, rid);
+      }
+    }
+    if (!compressed) {
+      const int index = findIndexInLeaf(leafNode, key);
+      done = insertToPostingList(leafNode, index, key, rid);
+      if (!done && leafSlots(leafNode) < this->payloadLayout.capacity) {
+        insertToLeaf(leafNode, index, key, rid, payload);
+        done = true;
+      }
+    }
+    leafGuard.unlock();
+    bufMgr->unPinPage(file, leafPageNo, done);
+    if (done) {
+      this->entryCount++;
+      return;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> treeGuard(treeLatch);
+  this->bloom.add(key_hash(key));
+  // start recursive call
+  PageId newPageNo = 0;
+  T newIndex;
+  recursiveInsert(this->rootPageNum, key, rid, payload, newPageNo, newIndex,
+                  this->rootPageNum == this->initialRootPageNum, true);
+
+  // check whether need to split root
+  if (newPageNo != 0) {
+    splitRoot(newIndex, this->rootPageNum, newPageNo);
+  }
+  findRightmostLeaf<T>();
+  this->entryCount++;
+  if (this->bloomRate > 0 &&
+      (std::uint64_t)this->entryCount > this->bloom.getCapacity()) {
+    rebuildBloom<T>();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::flushInserts
+// -----------------------------------------------------------------------------
+
+/**
+ * An entry copied out of an insert buffer: its key, record id and payload.
+ */
+template <class T>
+using BufferedEntry =
+    std::pair<T, std::pair<RecordId, std::vector<unsigned char> > >;
+
+/**
+ * Whether a key is in the range of a scan of (lowVal, lowOp, highVal,
+ * highOp) on the side of the high value, which is open if it is NULL.
+ */
+template <class T>
+bool buffer_below(const T &key, const T *highVal, const Operator highOp){
+    return highVal == NULL || key < *highVal ||
+           (highOp == LTE && key == *highVal);
+}
+
+/**
+ * The first entry of a shard of an insert buffer in the range of a scan on
+ * the side of the low value, which is open if it is NULL.
+ */
+template <class M, class T>
+typename M::const_iterator buffer_first(const M &entries, const T *lowVal,
+                                        const Operator lowOp){
+    if (lowVal == NULL) {
+        return entries.begin();
+    }
+    return lowOp == GT ? entries.upper_bound(*lowVal)
+                       : entries.lower_bound(*lowVal);
+}
+
+/**
+ * Number of entries of an insert buffer in the range of a scan of (lowVal,
+ * lowOp, highVal, highOp), where a NULL value leaves that end open. Called
+ * with insertBufferLatch held.
+ */
+template <class T>
+std::size_t buffer_count(InsertBuffer<T> &buffer, const T *lowVal,
+                         const Operator lowOp, const T *highVal,
+                         const Operator highOp){
+    if (buffer.numEntries == 0) {
+        return 0;
+    }
+    std::size_t count = 0;
+    for (typename InsertBuffer<T>::Shard &shard : buffer.shards) {
+        std::lock_guard<std::mutex> shardGuard(shard.latch);
+        for (auto it = buffer_first(shard.entries, lowVal, lowOp);
+             it != shard.entries.end() &&
+             buffer_below(it->first, highVal, highOp);
+             ++it) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Appends the entries of an insert buffer in the range of a scan, as for
+ * buffer_count(), to out in the order a scan returns them: by key, and those
+ * of one key in the order they were inserted. Called with insertBufferLatch
+ * held.
+ */
+template <class T>
+void buffer_copy(InsertBuffer<T> &buffer, const T *lowVal,
+                 const Operator lowOp, const T *highVal,
+                 const Operator highOp,
+                 std::vector<BufferedEntry<T> > &out){
+    if (buffer.numEntries == 0) {
+        return;
+    }
+    const std::size_t first = out.size();
+    for (typename InsertBuffer<T>::Shard &shard : buffer.shards) {
+        std::lock_guard<std::mutex> shardGuard(shard.latch);
+        for (auto it = buffer_first(shard.entries, lowVal, lowOp);
+             it != shard.entries.end() &&
+             buffer_below(it->first, highVal, highOp);
+             ++it) {
+            out.emplace_back(it->first, it->second);
+        }
+    }
+    // the entries of a key are all in one shard
+    std::stable_sort(out.begin() + first, out.end(),
+                     [](const BufferedEntry<T> &a, const BufferedEntry<T> &b) {
+                       return a.first < b.first;
+                     });
+}
+
+template <class T>
+void BTreeIndex::bufferKey(const T &key, const RecordId rid,
+                           const unsigned char *payload) {
+  InsertBuffer<T> &buffer = insertBuffer((T *)NULL);
+  std::vector<unsigned char> bytes;
+  if (this->payloadLength > 0 && payload != NULL) {
+    bytes.assign(payload, payload + this->payloadLength);
+  }
+  std::size_t numEntries;
+  {
+    std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+    typename InsertBuffer<T>::Shard &shard = buffer.shardOf(key);
+    std::lock_guard<std::mutex> shardGuard(shard.latch);
+    shard.entries.emplace(key, std::make_pair(rid, std::move(bytes)));
+    numEntries = ++buffer.numEntries;
+  }
+  if (numEntries < this->insertBufferEntries) {
+    return;
+  }
+  std::unique_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  // another insert may have flushed it in the meantime
+  if (buffer.numEntries >= this->insertBufferEntries) {
+    flushInsertBuffer<T>();
+  }
+}
+
+template <class T>
+bool BTreeIndex::unbufferKey(const T &key, const RecordId rid) {
+  InsertBuffer<T> &buffer = insertBuffer((T *)NULL);
+  typename InsertBuffer<T>::Shard &shard = buffer.shardOf(key);
+  std::lock_guard<std::mutex> shardGuard(shard.latch);
+  auto range = shard.entries.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.first == rid) {
+      shard.entries.erase(it);
+      buffer.numEntries--;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * The entries go in in key order, so the entries of a leaf are inserted one
+ * after another while it is the page last used, and the leaf is read and
+ * written back once for all of them however small the BufMgr is. The entries
+ * of a key are all in one shard, so the stable sort keeps them in the order
+ * they were inserted.
+ */
+template <class T>
+void BTreeIndex::flushInsertBuffer() {
+  InsertBuffer<T> &buffer = insertBuffer((T *)NULL);
+  typedef typename decltype(InsertBuffer<T>::Shard::entries)::value_type Entry;
+  std::vector<const Entry *> entries;
+  entries.reserve(buffer.numEntries);
+  for (typename InsertBuffer<T>::Shard &shard : buffer.shards) {
+    for (const Entry &entry : shard.entries) {
+      entries.push_back(&entry);
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry *a, const Entry *b) {
+                     return a->first < b->first;
+                   });
+  for (const Entry *entry : entries) {
+    const std::vector<unsigned char> &payload = entry->second.second;
+    insertKey(entry->first, entry->second.first,
+              payload.empty() ? NULL : payload.data());
+  }
+  for (typename InsertBuffer<T>::Shard &shard : buffer.shards) {
+    shard.entries.clear();
+  }
+  buffer.numEntries = 0;
+}
+
+const void BTreeIndex::flushInserts() {
+  if (this->insertBufferEntries == 0) {
+    return;
+  }
+  std::unique_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  switch (attributeType) {
+    case INTEGER:
+      flushInsertBuffer<int>();
+      break;
+    case DOUBLE:
+      flushInsertBuffer<double>();
+      break;
+    case STRING:
+      flushInsertBuffer<StringKey>();
+      break;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+const bool BTreeIndex::deleteEntry(const void *key, const RecordId rid) {
+  // an entry still in the insert buffer only has to be taken out of it, and
+  // no flush moves it into the tree until the tree is searched
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch,
+                                                  std::defer_lock);
+  if (this->insertBufferEntries > 0) {
+    bufferGuard.lock();
+    bool buffered = false;
+    switch (attributeType) {
+      case INTEGER:
+        buffered = unbufferKey(key_of<int>(key), rid);
+        break;
+      case DOUBLE:
+        buffered = unbufferKey(key_of<double>(key), rid);
+        break;
+      case STRING:
+        buffered = unbufferKey(key_of<StringKey>(key), rid);
+        break;
+    }
+    if (buffered) {
+      return true;
+    }
+  }
+  // a delete may merge nodes anywhere on its path
+  std::unique_lock<std::shared_mutex> treeGuard(treeLatch);
+  this->structureVersion++;
+  bool found = false;
+  switch (attributeType) {
+    case INTEGER:
+      found = deleteKey(key_of<int>(key), rid);
+      break;
+    case DOUBLE:
+      found = deleteKey(key_of<double>(key), rid);
+      break;
+    case STRING:
+      found = deleteKey(key_of<StringKey>(key), rid);
+      break;
+  }
+  if (found) {
+    this->entryCount--;
+  }
+  if (this->rightmostLeafNum == 0) {
+    cacheRightmostLeaf();
+  }
+  return found;
+}
+
+template <class T>
+bool BTreeIndex::deleteKey(const T &key, const RecordId rid) {
+  const bool rootIsLeaf = this->rootPageNum == this->initialRootPageNum;
+  bool underflow = false;
+  const bool found =
+      recursiveDelete(this->rootPageNum, key, rid, rootIsLeaf, underflow);
+  if (!found || rootIsLeaf) {
+    return found;
+  }
+
+  // a root left with a single child is replaced by the child
+  Page *page;
+  bufMgr->readPage(file, this->rootPageNum, page, ACCESS_INDEX_INNER);
+  NonLeafNode<T> *root = (NonLeafNode<T> *)page;
+  if (root->keyNum > 0) {
+    bufMgr->unPinPage(file, this->rootPageNum, false);
+    return true;
+  }
+  const PageId oldRootPageNum = this->rootPageNum;
+  this->rootPageNum = root->pageNoArray[0];
+  this->rightmostLeafNum = 0;
+  if (isLevelOneNode(root)) {
+    // merges keep the left page, so the last leaf is the initial root
+    this->initialRootPageNum = this->rootPageNum;
+  }
+  bufMgr->unPinPage(file, oldRootPageNum, false);
+  disposeNode<NonLeafNode<T> >(oldRootPageNum);
+  this->height--;
+  innerNodeChanged((NonLeafNode<T> *)NULL);
+  writeRootToMeta();
+  return true;
+}
+
+template <class T>
+bool BTreeIndex::recursiveDelete(const PageId currPageNo, const T &key,
+                                 const RecordId rid, const bool isLeaf,
+                                 bool &underflow) {
+  Page *page;
+  if (isLeaf) {
+    bufMgr->readPage(file, currPageNo, page, ACCESS_INDEX_LEAF);
+    LeafNode<T> *leafNode = (LeafNode<T> *)page;
+    if constexpr (KeyTraits<T>::TYPE == INTEGER) {
+      if (leaf_compressed(leafNode)) {
+        // a compressed leaf is only merged away once it is empty
+        CompressedLeafInt *compressedNode = (CompressedLeafInt *)page;
+        const bool found = deleteFromCompressedLeaf(compressedNode, key, rid);
+        underflow = compressedNode->numEntries == 0;
+        bufMgr->unPinPage(file, currPageNo, found);
+        return found;
+      }
+    }
+    const int lo = keyLowerBound(leafNode->keyArray, leafNode->keyNum, key);
+    for (int i = lo; i < leafNode->keyNum && leafNode->keyArray[i] == key;
+         i++) {
+      bool remove = leafNode->ridArray[i] == rid;
+      if (!remove && isPostingList(leafNode->ridArray[i])) {
+        const bool inLeaf = inline_is(leafNode->ridArray[i]);
+        bool empty;
+        if (inLeaf ? removeFromInlineList(leafNode, i, rid, empty)
+                   : removeFromPostingList(leafNode->ridArray[i].page_number,
+                                           rid, empty)) {
+          if (!empty) {
+            bufMgr->unPinPage(file, currPageNo, inLeaf);
+            return true;
+          }
+          // the entry of the list goes too
+          remove = true;
+        }
+      }
+      if (remove) {
+        const size_t len = leafNode->keyNum - i - 1;
+        memmove(&leafNode->keyArray[i], &leafNode->keyArray[i + 1],
+                len * sizeof(T));
+        memmove(&leafNode->ridArray[i], &leafNode->ridArray[i + 1],
+                len * sizeof(RecordId));
+        payload_move(leafNode, i, leafNode, i + 1, len, this->payloadLayout);
+        leafNode->keyNum--;
+        this->leafOccupancy--;
+        underflow = leafSlots(leafNode) < this->payloadLayout.capacity / 2;
+        bufMgr->unPinPage(file, currPageNo, true);
+        return true;
+      }
+    }
+    bufMgr->unPinPage(file, currPageNo, false);
+    return false;
+  }
+
+  bufMgr->readPage(file, currPageNo, page, ACCESS_INDEX_INNER);
+  NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+
+  // entries equal to key may be in any child from the one left of the first
+  // separator equal to key to the one right of the last
+  const int lo = keyLowerBound(node->keyArray, node->keyNum, key);
+  const int hi =
+      lo + keyUpperBound(node->keyArray + lo, node->keyNum - lo, key);
+  for (int i = lo; i <= hi; i++) {
+    bool childUnderflow = false;
+    if (!recursiveDelete(node->pageNoArray[i], key, rid, isLevelOneNode(node),
+                         childUnderflow)) {
+      continue;
+    }
+    count_set(node, i, count_get(node, i, this->countLayout) - 1,
+              this->countLayout);
+    if (childUnderflow && node->keyNum > 0) {
+      // a separator moves or goes away
+      this->rightmostLeafNum = 0;
+      innerNodeChanged(node);
+      if (isLevelOneNode(node)) {
+        rebalanceLeaf(node, i);
+      } else {
+        rebalanceNonLeaf(node, i);
+      }
+    }
+    underflow = node->keyNum < this->countLayout.capacity / 2;
+    bufMgr->unPinPage(file, currPageNo, childUnderflow || this->countedTree);
+    return true;
+  }
+  bufMgr->unPinPage(file, currPageNo, false);
+  return false;
+}
+
+template <class T>
+void BTreeIndex::removeFromNonLeaf(NonLeafNode<T> *node, const int index) {
+  const size_t len = node->keyNum - index - 1;
+  memmove(&node->keyArray[index], &node->keyArray[index + 1],
+          len * sizeof(T));
+  memmove(&node->pageNoArray[index + 1], &node->pageNoArray[index + 2],
+          len * sizeof(PageId));
+  count_move(node, index + 1, node, index + 2, len, this->countLayout);
+  node->keyNum--;
+  this->nodeOccupancy--;
+}
+
+template <class T>
+void BTreeIndex::rebalanceLeaf(NonLeafNode<T> *parent, const int index) {
+  // the underflowed child and its left sibling, or its right one if it is
+  // the first child
+  const int sep = index > 0 ? index - 1 : index;
+  const PageId leftPageNo = parent->pageNoArray[sep];
+  const PageId rightPageNo = parent->pageNoArray[sep + 1];
+  Page *page;
+  bufMgr->readPage(file, leftPageNo, page, ACCESS_INDEX_LEAF);
+  LeafNode<T> *left = (LeafNode<T> *)page;
+  bufMgr->readPage(file, rightPageNo, page, ACCESS_INDEX_LEAF);
+  LeafNode<T> *right = (LeafNode<T> *)page;
+
+  if (leaf_compressed(left) || leaf_compressed(right)) {
+    // entries do not move between a compressed leaf and another leaf, an
+    // empty one of the two goes and the left page stays where the leaf
+    // before it points
+    const bool leftEmpty = leaf_compressed(left)
+                               ? ((CompressedLeafInt *)left)->numEntries == 0
+                               : left->keyNum == 0;
+    const bool rightEmpty = leaf_compressed(right)
+                                ? ((CompressedLeafInt *)right)->numEntries == 0
+                                : right->keyNum == 0;
+    const PageId nextPageNo = right->rightSibPageNo;
+    if (leftEmpty) {
+      memcpy((void *)left, right, Page::SIZE);
+    } else if (rightEmpty) {
+      left->rightSibPageNo = right->rightSibPageNo;
+    }
+    if (leftEmpty || rightEmpty) {
+      count_set(parent, sep, count_sum(parent, sep, sep + 2, this->countLayout),
+                this->countLayout);
+      removeFromNonLeaf(parent, sep);
+      relinkLeaf(leftPageNo, rightPageNo, nextPageNo);
+      relinkLeaf(rightPageNo, nextPageNo, 0);
+      bufMgr->unPinPage(file, leftPageNo, true);
+      bufMgr->unPinPage(file, rightPageNo, false);
+      disposeNode<LeafNode<T> >(rightPageNo);
+    } else {
+      bufMgr->unPinPage(file, leftPageNo, false);
+      bufMgr->unPinPage(file, rightPageNo, false);
+    }
+    return;
+  }
+
+  // the inline posting lists follow their entries, and the leaves have to
+  // have room for them
+  const int total = left->keyNum + right->keyNum;
+  const int leftLen = (total + 1) / 2;
+  int heap = 0, leftHeap = 0;
+  std::vector<std::vector<unsigned char> > lists;
+  if (this->leafPostings) {
+    for (int k = 0; k < total; k++) {
+      const RecordId rid = k < left->keyNum ? left->ridArray[k]
+                                            : right->ridArray[k - left->keyNum];
+      if (inline_is(rid)) {
+        heap += inline_length(rid);
+        leftHeap += k < leftLen ? inline_length(rid) : 0;
+      }
+    }
+  }
+  const int capacity = this->payloadLayout.capacity;
+  const bool merge = total + inline_slots(heap) <= capacity;
+  if (!merge && (leftLen + inline_slots(leftHeap) > capacity ||
+                 total - leftLen + inline_slots(heap - leftHeap) > capacity)) {
+    // the entries cannot be spread evenly, the leaves stay as they are
+    bufMgr->unPinPage(file, leftPageNo, false);
+    bufMgr->unPinPage(file, rightPageNo, false);
+    return;
+  }
+  if (this->leafPostings) {
+    inline_detach(left, lists);
+    inline_detach(right, lists);
+  }
+
+  if (merge) {
+    // merge right into left and free right
+    memcpy(&left->keyArray[left->keyNum], right->keyArray,
+           right->keyNum * sizeof(T));
+    memcpy(&left->ridArray[left->keyNum], right->ridArray,
+           right->keyNum * sizeof(RecordId));
+    payload_move(left, left->keyNum, right, 0, right->keyNum,
+                 this->payloadLayout);
+    left->keyNum = total;
+    left->rightSibPageNo = right->rightSibPageNo;
+    if (this->leafPostings) {
+      inline_attach(left, lists);
+    }
+    count_set(parent, sep, total, this->countLayout);
+    removeFromNonLeaf(parent, sep);
+    relinkLeaf(leftPageNo, rightPageNo, left->rightSibPageNo);
+    relinkLeaf(rightPageNo, left->rightSibPageNo, 0);
+
+    bufMgr->unPinPage(file, leftPageNo, true);
+    bufMgr->unPinPage(file, rightPageNo, false);
+    disposeNode<LeafNode<T> >(rightPageNo);
+    return;
+  }
+
+  // spread the entries of both evenly
+  if (left->keyNum < leftLen) {
+    const int m = leftLen - left->keyNum;
+    memcpy(&left->keyArray[left->keyNum], right->keyArray, m * sizeof(T));
+    memcpy(&left->ridArray[left->keyNum], right->ridArray,
+           m * sizeof(RecordId));
+    memmove(right->keyArray, &right->keyArray[m],
+            (right->keyNum - m) * sizeof(T));
+    memmove(right->ridArray, &right->ridArray[m],
+            (right->keyNum - m) * sizeof(RecordId));
+    payload_move(left, left->keyNum, right, 0, m, this->payloadLayout);
+    payload_move(right, 0, right, m, right->keyNum - m, this->payloadLayout);
+  } else {
+    const int m = left->keyNum - leftLen;
+    memmove(&right->keyArray[m], right->keyArray, right->keyNum * sizeof(T));
+    memmove(&right->ridArray[m], right->ridArray,
+            right->keyNum * sizeof(RecordId));
+    memcpy(right->keyArray, &left->keyArray[leftLen], m * sizeof(T));
+    memcpy(right->ridArray, &left->ridArray[leftLen], m * sizeof(RecordId));
+    payload_move(right, m, right, 0, right->keyNum, this->payloadLayout);
+    payload_move(right, 0, left, leftLen, m, this->payloadLayout);
+  }
+  left->keyNum = leftLen;
+  right->keyNum = total - leftLen;
+  if (this->leafPostings) {
+    inline_attach(left, lists);
+    inline_attach(right, lists);
+  }
+  parent->keyArray[sep] = right->keyArray[0];
+  count_set(parent, sep, leftLen, this->countLayout);
+  count_set(parent, sep + 1, total - leftLen, this->countLayout);
+
+  bufMgr->unPinPage(file, leftPageNo, true);
+  bufMgr->unPinPage(file, rightPageNo, true);
+}
+
+template <class T>
+void BTreeIndex::rebalanceNonLeaf(NonLeafNode<T> *parent, const int index) {
+  const int sep = index > 0 ? index - 1 : index;
+  const PageId leftPageNo = parent->pageNoArray[sep];
+  const PageId rightPageNo = parent->pageNoArray[sep + 1];
+  Page *page;
+  bufMgr->readPage(file, leftPageNo, page, ACCESS_INDEX_INNER);
+  NonLeafNode<T> *left = (NonLeafNode<T> *)page;
+  bufMgr->readPage(file, rightPageNo, page, ACCESS_INDEX_INNER);
+  NonLeafNode<T> *right = (NonLeafNode<T> *)page;
+
+  // the separator in parent moves down between the keys of the two
+  const int total = left->keyNum + right->keyNum;
+  if (total + 1 <= this->countLayout.capacity) {
+    // merge right into left and free right
+    left->keyArray[left->keyNum] = parent->keyArray[sep];
+    memcpy(&left->keyArray[left->keyNum + 1], right->keyArray,
+           right->keyNum * sizeof(T));
+    memcpy(&left->pageNoArray[left->keyNum + 1], right->pageNoArray,
+           (right->keyNum + 1) * sizeof(PageId));
+    count_move(left, left->keyNum + 1, right, 0, right->keyNum + 1,
+               this->countLayout);
+    left->keyNum = total + 1;
+    this->nodeOccupancy++;
+    count_set(parent, sep, count_sum(parent, sep, sep + 2, this->countLayout),
+              this->countLayout);
+    removeFromNonLeaf(parent, sep);
+
+    bufMgr->unPinPage(file, leftPageNo, true);
+    bufMgr->unPinPage(file, rightPageNo, false);
+    disposeNode<NonLeafNode<T> >(rightPageNo);
+    return;
+  }
+
+  // rotate keys through the separator until both hold half of them; moved
+  // is the number of entries under the children that go from right to left,
+  // modulo 2^32 as the counts are
+  const int leftLen = total / 2;
+  std::uint32_t moved;
+  if (left->keyNum < leftLen) {
+    const int m = leftLen - left->keyNum;
+    left->keyArray[left->keyNum] = parent->keyArray[sep];
+    memcpy(&left->keyArray[left->keyNum + 1], right->keyArray,
+           (m - 1) * sizeof(T));
+    memcpy(&left->pageNoArray[left->keyNum + 1], right->pageNoArray,
+           m * sizeof(PageId));
+    moved = count_sum(right, 0, m, this->countLayout);
+    count_move(left, left->keyNum + 1, right, 0, m, this->countLayout);
+    parent->keyArray[sep] = right->keyArray[m - 1];
+    memmove(right->keyArray, &right->keyArray[m],
+            (right->keyNum - m) * sizeof(T));
+    memmove(right->pageNoArray, &right->pageNoArray[m],
+            (right->keyNum - m + 1) * sizeof(PageId));
+    count_move(right, 0, right, m, right->keyNum - m + 1, this->countLayout);
+    left->keyNum += m;
+    right->keyNum -= m;
+  } else {
+    const int m = left->keyNum - leftLen;
+    memmove(&right->keyArray[m], right->keyArray, right->keyNum * sizeof(T));
+    memmove(&right->pageNoArray[m], right->pageNoArray,
+            (right->keyNum + 1) * sizeof(PageId));
+    count_move(right, m, right, 0, right->keyNum + 1, this->countLayout);
+    right->keyArray[m - 1] = parent->keyArray[sep];
+    memcpy(right->keyArray, &left->keyArray[leftLen + 1],
+           (m - 1) * sizeof(T));
+    memcpy(right->pageNoArray, &left->pageNoArray[leftLen + 1],
+           m * sizeof(PageId));
+    moved = -count_sum(left, leftLen + 1, left->keyNum + 1, this->countLayout);
+    count_move(right, 0, left, leftLen + 1, m, this->countLayout);
+    parent->keyArray[sep] = left->keyArray[leftLen];
+    left->keyNum -= m;
+    right->keyNum += m;
+  }
+  count_set(parent, sep, count_get(parent, sep, this->countLayout) + moved,
+            this->countLayout);
+  count_set(parent, sep + 1,
+            count_get(parent, sep + 1, this->countLayout) - moved,
+            this->countLayout);
+
+  bufMgr->unPinPage(file, leftPageNo, true);
+  bufMgr->unPinPage(file, rightPageNo, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+const std::optional<RecordId> BTreeIndex::lookup(const void *key) {
+  switch (attributeType) {
+    case INTEGER:
+      return lookupKey(key_of<int>(key));
+    case DOUBLE:
+      return lookupKey(key_of<double>(key));
+    case STRING:
+      return lookupKey(key_of<StringKey>(key));
+  }
+  return std::nullopt;
+}
+
+/**
+ * Buffered entries go into the leaves after those already there, so the
+ * buffer is searched only if the tree holds no entry with the key. It is
+ * latched first so that no flush moves entries between the two searches.
+ */
+template <class T>
+std::optional<RecordId> BTreeIndex::lookupKey(const T &key) {
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch,
+                                                  std::defer_lock);
+  if (this->insertBufferEntries > 0) {
+    bufferGuard.lock();
+  }
+  {
+    std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+    if (!bloomExcludes(key)) {
+      const std::optional<RecordId> found =
+          findInLeaves(getLeafPage(key, GTE), key);
+      if (found || this->insertBufferEntries == 0) {
+        return found;
+      }
+    }
+  }
+  typename InsertBuffer<T>::Shard &shard = insertBuffer((T *)NULL).shardOf(key);
+  std::lock_guard<std::mutex> shardGuard(shard.latch);
+  const auto it = shard.entries.lower_bound(key);
+  if (it != shard.entries.end() && it->first == key) {
+    return it->second.first;
+  }
+  return std::nullopt;
+}
+
+template <class T>
+std::optional<RecordId> BTreeIndex::findInLeaves(PageId leafPageNo,
+                                                 const T &key) {
+  while (true) {
+    Page *page;
+    bufMgr->readPage(file, leafPageNo, page, ACCESS_INDEX_LEAF);
+    std::shared_lock<std::shared_mutex> leafGuard(
+        leafLatches.latch(leafPageNo));
+
+    PageId rightNo;
+    bool inLeaf;
+    std::optional<RecordId> found;
+    with_leaf<T>(page, [&](const auto *leafNode) {
+      const int n = leaf_size(leafNode);
+      const int i = leaf_lower_bound(leafNode, 0, n, key);
+      rightNo = leafNode->rightSibPageNo;
+      // the first key at or after key may be in the next leaf
+      inLeaf = i < n;
+      if (inLeaf && leaf_key(leafNode, i) == key) {
+        found = firstRecordId(leafNode, i);
+      }
+    });
+    leafGuard.unlock();
+    bufMgr->unPinPage(file, leafPageNo, false);
+    if (inLeaf || rightNo == 0) {
+      return found;
+    }
+    leafPageNo = rightNo;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookupAll
+// -----------------------------------------------------------------------------
+
+const std::size_t BTreeIndex::lookupAll(const void *key,
+                                        std::vector<RecordId> &outRids) {
+  switch (attributeType) {
+    case INTEGER:
+      return lookupAllKey(key_of<int>(key), outRids);
+    case DOUBLE:
+      return lookupAllKey(key_of<double>(key), outRids);
+    case STRING:
+      return lookupAllKey(key_of<StringKey>(key), outRids);
+  }
+  return 0;
+}
+
+template <class T>
+std::size_t BTreeIndex::lookupAllKey(const T &key,
+                                     std::vector<RecordId> &outRids) {
+  if (this->insertBufferEntries == 0) {
+    return lookupLeafEntries(key, outRids);
+  }
+  // buffered entries follow those in the leaves in index order
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::size_t numFound = lookupLeafEntries(key, outRids);
+  typename InsertBuffer<T>::Shard &shard = insertBuffer((T *)NULL).shardOf(key);
+  std::lock_guard<std::mutex> shardGuard(shard.latch);
+  const auto range = shard.entries.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    outRids.push_back(it->second.first);
+    numFound++;
+  }
+  return numFound;
+}
+
+template <class T>
+std::size_t BTreeIndex::lookupLeafEntries(const T &key,
+                                          std::vector<RecordId> &outRids) {
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  if (bloomExcludes(key)) {
+    return 0;
+  }
+  PageId leafPageNo = getLeafPage(key, GTE);
+  std::size_t numFound = 0;
+  while (leafPageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, leafPageNo, page, ACCESS_INDEX_LEAF);
+    std::shared_lock<std::shared_mutex> leafGuard(
+        leafLatches.latch(leafPageNo));
+
+    PageId rightNo;
+    with_leaf<T>(page, [&](const auto *leafNode) {
+      const int n = leaf_size(leafNode);
+      const int i = leaf_lower_bound(leafNode, 0, n, key);
+      const int end = leaf_upper_bound(leafNode, i, n, key);
+      numFound += copyLeafEntries(leafNode, i, end, outRids);
+      // the run of equal keys may go on in the next leaf
+      rightNo = end == n ? leafNode->rightSibPageNo : 0;
+    });
+    leafGuard.unlock();
+    bufMgr->unPinPage(file, leafPageNo, false);
+    leafPageNo = rightNo;
+  }
+  return numFound;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::multiGet
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::multiGet(const void *const keys[],
+                                const std::size_t numKeys,
+                                std::optional<RecordId> outRids[]) {
+  switch (attributeType) {
+    case INTEGER:
+      multiGetKeys<int>(keys, numKeys, outRids);
+      break;
+    case DOUBLE:
+      multiGetKeys<double>(keys, numKeys, outRids);
+      break;
+    case STRING:
+      multiGetKeys<StringKey>(keys, numKeys, outRids);
+      break;
+  }
+}
+
+template <class T>
+void BTreeIndex::multiGetKeys(const void *const keys[],
+                              const std::size_t numKeys,
+                              std::optional<RecordId> outRids[]) {
+  std::vector<T> probeKeys;
+  probeKeys.reserve(numKeys);
+  for (std::size_t k = 0; k < numKeys; k++) {
+    probeKeys.push_back(key_of<T>(keys[k]));
+  }
+  std::vector<std::size_t> order(numKeys);
+  for (std::size_t k = 0; k < numKeys; k++) {
+    order[k] = k;
+  }
+  std::sort(order.begin(), order.end(),
+            [&probeKeys](const std::size_t a, const std::size_t b) {
+              return probeKeys[a] < probeKeys[b];
+            });
+
+  // The non-leaf nodes from the root to the current leaf stay pinned. Each
+  // covers the keys up to its upper separator, if it has one; a probe climbs
+  // only as far as the first node that covers it and descends from there.
+  struct PathNode {
+    PageId pageNo;
+    const NonLeafNode<T> *node;
+    bool bounded;
+    T upper;
+  };
+  std::vector<PathNode> path;
+  PageId leafPageNo = 0;
+  const Page *leafNode = NULL;
+  bool leafBounded = false;
+  T leafUpper = T();
+  std::shared_lock<std::shared_mutex> leafGuard;
+
+  // keys the tree does not hold are looked for in the insert buffer after
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch,
+                                                  std::defer_lock);
+  if (this->insertBufferEntries > 0) {
+    bufferGuard.lock();
+  }
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  // keys that the filter rules out need no descent
+  std::size_t numProbes = 0;
+  for (const std::size_t k : order) {
+    if (bloomExcludes(probeKeys[k])) {
+      outRids[k] = std::nullopt;
+    } else {
+      order[numProbes++] = k;
+    }
+  }
+  order.resize(numProbes);
+  for (const std::size_t k : order) {
+    const T &key = probeKeys[k];
+    if (leafNode == NULL || (leafBounded && leafUpper < key)) {
+      if (leafNode != NULL) {
+        leafGuard.unlock();
+        bufMgr->unPinPage(file, leafPageNo, false);
+      }
+      while (!path.empty() && path.back().bounded && path.back().upper < key) {
+        bufMgr->unPinPage(file, path.back().pageNo, false);
+        path.pop_back();
+      }
+
+      if (this->rootPageNum == this->initialRootPageNum) {
+        // the root is still a leaf
+        leafPageNo = this->rootPageNum;
+        leafBounded = false;
+      } else {
+        if (path.empty()) {
+          Page *page;
+          bufMgr->readPage(file, this->rootPageNum, page, ACCESS_INDEX_INNER);
+          path.push_back(
+              {this->rootPageNum, (const NonLeafNode<T> *)page, false, T()});
+        }
+        while (true) {
+          const PathNode &parent = path.back();
+          const NonLeafNode<T> *node = parent.node;
+          // a leaf may hold keys equal to the separator on its right
+          const int sep = keyLowerBound(node->keyArray, node->keyNum, key);
+          const PageId next = node->pageNoArray[sep];
+          const bool bounded = sep < node->keyNum || parent.bounded;
+          const T &upper =
+              sep < node->keyNum ? node->keyArray[sep] : parent.upper;
+          if (isLevelOneNode(node)) {
+            leafPageNo = next;
+            leafBounded = bounded;
+            leafUpper = upper;
+            break;
+          }
+          Page *page;
+          bufMgr->readPage(file, next, page, ACCESS_INDEX_INNER);
+          path.push_back({next, (const NonLeafNode<T> *)page, bounded, upper});
+        }
+      }
+
+      Page *page;
+      bufMgr->readPage(file, leafPageNo, page, ACCESS_INDEX_LEAF);
+      leafNode = page;
+      leafGuard = std::shared_lock<std::shared_mutex>(
+          leafLatches.latch(leafPageNo));
+    }
+
+    with_leaf<T>(leafNode, [&](const auto *leaf) {
+      const int n = leaf_size(leaf);
+      const int i = leaf_lower_bound(leaf, 0, n, key);
+      if (i < n) {
+        outRids[k] = leaf_key(leaf, i) == key
+                         ? std::optional<RecordId>(
+                               firstRecordId(leaf, i))
+                         : std::nullopt;
+      } else if (leaf->rightSibPageNo != 0) {
+        // the first key at or after key is in a leaf further right
+        outRids[k] = findInLeaves(leaf->rightSibPageNo, key);
+      } else {
+        outRids[k] = std::nullopt;
+      }
+    });
+  }
+
+  if (leafNode != NULL) {
+    leafGuard.unlock();
+    bufMgr->unPinPage(file, leafPageNo, false);
+  }
+  for (const PathNode &node : path) {
+    bufMgr->unPinPage(file, node.pageNo, false);
+  }
+  if (this->insertBufferEntries > 0) {
+    InsertBuffer<T> &buffer = insertBuffer((T *)NULL);
+    for (std::size_t k = 0; k < numKeys; k++) {
+      if (outRids[k]) {
+        continue;
+      }
+      typename InsertBuffer<T>::Shard &shard = buffer.shardOf(probeKeys[k]);
+      std::lock_guard<std::mutex> shardGuard(shard.latch);
+      const auto it = shard.entries.lower_bound(probeKeys[k]);
+      if (it != shard.entries.end() && it->first == probeKeys[k]) {
+        outRids[k] = it->second.first;
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countRange
+// -----------------------------------------------------------------------------
+
+template <class T>
+std::uint32_t BTreeIndex::nodeCount(const PageId pageNo, const bool isLeaf) {
+  Page *page;
+  std::uint32_t count = 0;
+  if (isLeaf) {
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    with_leaf<T>(page, [&](const auto *leafNode) {
+      count = leaf_size(leafNode);
+    });
+  } else {
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_INNER);
+    const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+    count = count_sum(node, 0, node->keyNum + 1, this->countLayout);
+  }
+  bufMgr->unPinPage(file, pageNo, false);
+  return count;
+}
+
+const std::size_t BTreeIndex::countRange(const void *lowVal,
+                                         const Operator lowOp,
+                                         const void *highVal,
+                                         const Operator highOp) {
+  if (!this->countedTree) {
+    throw NotCountedTreeException();
+  }
+  if ((lowOp != GT && lowOp != GTE) || (highOp != LT && highOp != LTE)) {
+    throw BadOpcodesException();
+  }
+  switch (attributeType) {
+    case INTEGER:
+      return countRangeKeys(key_of<int>(lowVal), lowOp, key_of<int>(highVal),
+                            highOp);
+    case DOUBLE:
+      return countRangeKeys(key_of<double>(lowVal), lowOp,
+                            key_of<double>(highVal), highOp);
+    case STRING:
+      return countRangeKeys(key_of<StringKey>(lowVal), lowOp,
+                            key_of<StringKey>(highVal), highOp);
   }
+  return 0;
+}
 
-  // allocate a new LeafNode page
-  LeafNodeInt *newNode = allocNode<LeafNodeInt>(newPageNo);
-  // full, prepare to split this leaf node
-  const int middle = INTARRAYLEAFSIZE / 2;
-  bool insertToLeft = index < middle;
-
-  // if full size = 7 and insert index < 3, then split into 3 and 4
-  // if full size = 7 and insert index >= 3, then split into 4 and 3
-  // if full size = 8 and insert index < 4, then split into 4 and 4
-  // if full size = 8 and insert index >= 4, then split into 5 and 3
-  splitLeaf(currLeafNode, newNode, newPageNo, middle + (!insertToLeft));
-
-  // insert the key and record id to the node
-  if (insertToLeft) {
-    insertToLeaf(currLeafNode, index, key, rid);
-  } else {
-    insertToLeaf(newNode, index - (middle + (!insertToLeft)), key, rid);
+template <class T>
+std::size_t BTreeIndex::countRangeKeys(const T &lowVal, const Operator lowOp,
+                                       const T &highVal,
+                                       const Operator highOp) {
+  if (highVal < lowVal) {
+    throw BadScanrangeException();
   }
+  // both ranks are taken at once so that no insert comes between them, and
+  // the buffered entries are counted where they are so that no flush does
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  const std::size_t before = rankKey(lowVal, lowOp == GT);
+  const std::size_t upTo = rankKey(highVal, highOp == LTE);
+  return (upTo > before ? upTo - before : 0) +
+         buffer_count(insertBuffer((T *)NULL), &lowVal, lowOp, &highVal,
+                      highOp);
+}
 
-  assert(currLeafNode->keyNum - newNode->keyNum <= 1 &&
-         currLeafNode->keyNum - newNode->keyNum >= -1);
-
-  // set the return value
-  newIndex = newNode->keyArray[0];
+const std::size_t BTreeIndex::rank(const void *key) {
+  if (!this->countedTree) {
+    throw NotCountedTreeException();
+  }
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  switch (attributeType) {
+    case INTEGER:
+      return rankWithBuffer(key_of<int>(key));
+    case DOUBLE:
+      return rankWithBuffer(key_of<double>(key));
+    case STRING:
+      return rankWithBuffer(key_of<StringKey>(key));
+  }
+  return 0;
+}
 
-  // unpin the new node and the original node
-  bufMgr->unPinPage(file, currPageNo, true);
-  bufMgr->unPinPage(file, newPageNo, true);
+template <class T>
+std::size_t BTreeIndex::rankWithBuffer(const T &key) {
+  return rankKey(key, false) +
+         buffer_count(insertBuffer((T *)NULL), (const T *)NULL, GTE, &key,
+                      LT);
 }
+
 /**
- * recursive call until leaf nodes
- *
- * @param currPageNo page id of the page that stores the root node of the
- *        subtree.
- * @param key the key of the key-record pair to be inserted
- * @param rid the record ID of the key-record pair to be inserted
- * @param newPageNo a pointer to an integer value to be stored in the parent
- * node if the insertion requires a split in the current level
- * @param isLeaf whether this node is leaf
- * @param newIndex the page number of the newly created node if a split occurs,
- * or 0 otherwise.
+ * The entries under the children left of the one that holds the place of key
+ * come before it. Leaves of a counted tree only change under the exclusive
+ * treeLatch, so they are read without their latches.
  */
-void BTreeIndex::recursiveInsert(const PageId currPageNo, const void *key,
-                                 const RecordId rid, PageId &newPageNo,
-                                 int &newIndex, bool isLeaf) {
-  // if leaf, just call handleLeafInsertion
-  if (isLeaf) {
-    handleLeafInsertion(currPageNo, key, rid, newPageNo, newIndex);
-    return;
+template <class T>
+std::size_t BTreeIndex::rankKey(const T &key, const bool orEqual) {
+  std::size_t rank = 0;
+  PageId pageNo = this->rootPageNum;
+  bool isLeaf = pageNo == this->initialRootPageNum;
+  Page *page;
+  while (!isLeaf) {
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_INNER);
+    const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+    // a child holds no key greater than the separator on its right
+    const int i = orEqual ? keyUpperBound(node->keyArray, node->keyNum, key)
+                          : keyLowerBound(node->keyArray, node->keyNum, key);
+    rank += count_sum(node, 0, i, this->countLayout);
+    const PageId next = node->pageNoArray[i];
+    isLeaf = isLevelOneNode(node);
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = next;
   }
 
-  // get the current page, it must be a non leaf node
-  Page *page;
-  bufMgr->readPage(file, currPageNo, page);
-  NonLeafNodeInt *currNonLeafNode = (NonLeafNodeInt *)page;
+  bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+  with_leaf<T>(page, [&](const auto *leafNode) {
+    const int n = leaf_size(leafNode);
+    rank += orEqual ? leaf_upper_bound(leafNode, 0, n, key)
+                    : leaf_lower_bound(leafNode, 0, n, key);
+  });
+  bufMgr->unPinPage(file, pageNo, false);
+  return rank;
+}
 
-  // find the node to be inserted and recursive call
-  int childIndex = findIndexInNonLeaf(currNonLeafNode, key);
-  PageId nodeBeInserted = currNonLeafNode->pageNoArray[childIndex];
-  recursiveInsert(nodeBeInserted, key, rid, newPageNo, newIndex,
-                  isLevelOneNode(currNonLeafNode));
+const std::optional<RecordId> BTreeIndex::select(const std::size_t k,
+                                                 void *outKey) {
+  if (!this->countedTree) {
+    throw NotCountedTreeException();
+  }
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  switch (attributeType) {
+    case INTEGER:
+      return selectWithBuffer<int>(k, outKey);
+    case DOUBLE:
+      return selectWithBuffer<double>(k, outKey);
+    case STRING:
+      return selectWithBuffer<StringKey>(k, outKey);
+  }
+  return std::nullopt;
+}
 
-  // no split in child
-  if (newPageNo == 0) {
-    bufMgr->unPinPage(file, currPageNo, true);
-    newIndex = -1;
-    return;
+/**
+ * A buffered entry comes after the entries of the tree with keys up to its
+ * own, as in a scan, so buffered entry j is at position j plus their number,
+ * which grows with j. The buffered entries before position k are found by
+ * bisection, and if none of them is at k, entry k is the one of the tree
+ * after all but those.
+ */
+template <class T>
+std::optional<RecordId> BTreeIndex::selectWithBuffer(const std::size_t k,
+                                                     void *outKey) {
+  std::vector<BufferedEntry<T> > buffered;
+  buffer_copy(insertBuffer((T *)NULL), (const T *)NULL, GTE, (const T *)NULL,
+              LTE, buffered);
+  std::size_t before = 0, after = buffered.size();
+  while (before < after) {
+    const std::size_t mid = before + (after - before) / 2;
+    if (mid + rankKey(buffered[mid].first, true) < k) {
+      before = mid + 1;
+    } else {
+      after = mid;
+    }
+  }
+  if (before < buffered.size() &&
+      before + rankKey(buffered[before].first, true) == k) {
+    key_get(buffered[before].first, outKey);
+    return buffered[before].second.first;
   }
+  return selectKey<T>(k - before, outKey);
+}
 
-  // split happened in child, need to insert new key and corresponding pageNO
-  // into current page not full just return
-  int index = findIndexInNonLeaf(currNonLeafNode, (void *)(&newIndex));
-  if (currNonLeafNode->keyNum < INTARRAYNONLEAFSIZE) {
-    assert(index != -1);
-    insertToNonLeaf(currNonLeafNode, index, newIndex, newPageNo);
-    bufMgr->unPinPage(file, currPageNo, true);
-    newPageNo = 0;
-    newIndex = -1;
-    return;
+template <class T>
+std::optional<RecordId> BTreeIndex::selectKey(std::size_t k, void *outKey) {
+  // skip the entries of the children before the one that holds entry k
+  PageId pageNo = this->rootPageNum;
+  bool isLeaf = pageNo == this->initialRootPageNum;
+  Page *page;
+  while (!isLeaf) {
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_INNER);
+    const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+    int i = 0;
+    for (; i < node->keyNum; i++) {
+      const std::uint32_t count = count_get(node, i, this->countLayout);
+      if (k < count) {
+        break;
+      }
+      k -= count;
+    }
+    const PageId next = node->pageNoArray[i];
+    isLeaf = isLevelOneNode(node);
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = next;
   }
 
-  // this page is also full, allocate a new NonLeafNode
-  PageId newNonLeafPage;
-  NonLeafNodeInt *newNode = allocNode<NonLeafNodeInt>(newNonLeafPage);
+  std::optional<RecordId> found;
+  bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+  with_leaf<T>(page, [&](const auto *leafNode) {
+    if (k < (std::size_t)leaf_size(leafNode)) {
+      key_get(leaf_key(leafNode, k), outKey);
+      found = leaf_rid(leafNode, k);
+    }
+  });
+  bufMgr->unPinPage(file, pageNo, false);
+  return found;
+}
 
-  // need split this page, tell parent through
-  // newPageNo & newIndex the middle index for spliting the page
-  const int middle = INTARRAYNONLEAFSIZE / 2;
-  bool insertToLeft = index < middle;
+const std::size_t BTreeIndex::numEntries() {
+  if (!this->countedTree) {
+    throw NotCountedTreeException();
+  }
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  const bool rootIsLeaf = this->rootPageNum == this->initialRootPageNum;
+  switch (attributeType) {
+    case INTEGER:
+      return nodeCount<int>(this->rootPageNum, rootIsLeaf) +
+             insertBufferInt.numEntries;
+    case DOUBLE:
+      return nodeCount<double>(this->rootPageNum, rootIsLeaf) +
+             insertBufferDouble.numEntries;
+    case STRING:
+      return nodeCount<StringKey>(this->rootPageNum, rootIsLeaf) +
+             insertBufferString.numEntries;
+  }
+  return 0;
+}
 
-  // split the node to currNonLeafNode and newNode
-  splitNonLeaf(currNonLeafNode, newNode, middle + (!insertToLeft));
+// -----------------------------------------------------------------------------
+// BTreeIndex::bloomExcludes
+// -----------------------------------------------------------------------------
 
-  // insert key and record id to the right node
-  if (insertToLeft) {
-    insertToNonLeaf(currNonLeafNode, index, newIndex, newPageNo);
-  } else {
-    insertToNewNonLeaf(newNode, index - (middle + (!insertToLeft)), newIndex,
-                       newPageNo);
+template <class T>
+bool BTreeIndex::bloomExcludes(const T &key) {
+  return this->bloomRate > 0 && !this->bloom.mayContain(key_hash(key));
+}
+
+template <class T>
+void BTreeIndex::rebuildBloom() {
+  this->bloom.reset(2 * std::max<std::int64_t>(this->entryCount, 1),
+                    this->bloomRate);
+  PageId pageNo = firstLeafPage<T>();
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    PageId next = 0;
+    with_leaf<T>(page, [&](const auto *leafNode) {
+      const int n = leaf_size(leafNode);
+      for (int i = 0; i < n; i++) {
+        this->bloom.add(key_hash((T)leaf_key(leafNode, i)));
+      }
+      next = leafNode->rightSibPageNo;
+    });
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = next;
   }
-  // printNode(newNode);
+}
 
-  assert(currNonLeafNode->keyNum - newNode->keyNum <= 1 &&
-         currNonLeafNode->keyNum - newNode->keyNum >= -1);
+void BTreeIndex::saveBloom() {
+  const std::string name = bloomFileName(file->filename());
+  if (File::exists(name)) {
+    File::remove(name);
+  }
+  // the index records the new version once the filter is written
+  this->bloomVersion++;
+  BlobFile bloomFile(name, true, file->ioMode());
+  PageId versionPageNo;
+  Page *versionPage;
+  bufMgr->allocPage(&bloomFile, versionPageNo, versionPage);
+  *(std::uint64_t *)versionPage = this->bloomVersion;
+  bufMgr->unPinPage(&bloomFile, versionPageNo, true);
+  this->bloom.save(&bloomFile, bufMgr);
+}
 
-  // new node is illeagle now, so adjust it
-  newIndex = deleteNewKeyNonLeaf(newNode);
-  newPageNo = newNonLeafPage;
+bool BTreeIndex::loadBloom(const std::uint64_t capacity,
+                           const std::uint32_t numBlocks, const int numHashes) {
+  const std::string name = bloomFileName(file->filename());
+  if (!File::exists(name)) {
+    return false;
+  }
+  bool loaded;
+  {
+    BlobFile bloomFile(name, false, file->ioMode());
+    const PageId versionPageNo = bloomFile.getFirstPageNo();
+    Page *versionPage;
+    bufMgr->readPage(&bloomFile, versionPageNo, versionPage);
+    loaded = this->bloomVersion != 0 &&
+             *(const std::uint64_t *)versionPage == this->bloomVersion;
+    bufMgr->unPinPage(&bloomFile, versionPageNo, false);
+    if (loaded) {
+      this->bloom.load(&bloomFile, bufMgr, capacity, numBlocks, numHashes,
+                       versionPageNo + 1);
+    }
+    bufMgr->flushFile(&bloomFile);
+  }
+  // the filter misses the keys inserted from now on until it is saved again
+  File::remove(name);
+  return loaded;
+}
 
-  // unpin the new node and the currPageNo node
-  bufMgr->unPinPage(file, currPageNo, true);
-  bufMgr->unPinPage(file, newPageNo, true);
+std::string BTreeIndex::bloomFileName(const std::string &indexName) {
+  return indexName + ".bloom";
 }
 
-/**
- * Insert a new entry using the pair <value,rid>.
- * Start from root to recursively find out the leaf to insert the entry in. The
- *insertion may cause splitting of leaf node. This splitting will require
- *addition of new leaf page number entry into the parent non-leaf, which may
- *in-turn get split. This may continue all the way upto the root causing the
- *root to get split. If root gets split, metapage needs to be changed
- *accordingly. Make sure to unpin pages as soon as you can.
- * @param key			Key to insert, pointer to integer/double/char
- *string
- * @param rid			Record ID of a record whose entry is getting
- *inserted into the index.
- **/
+template <class T>
+PageId BTreeIndex::firstLeafPage() {
+  PageId pageNo = this->rootPageNum;
+  if (pageNo == this->initialRootPageNum) {
+    return pageNo;
+  }
+  while (true) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_INNER);
+    const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+    const PageId child = node->pageNoArray[0];
+    const bool levelOne = isLevelOneNode(node);
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = child;
+    if (levelOne) {
+      return pageNo;
+    }
+  }
+}
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertEntry
+// BTreeIndex::stats
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
-  // start recursive call
-  PageId newPageNo = 0;
-  int newIndex;
-  recursiveInsert(this->rootPageNum, key, rid, newPageNo, newIndex,
-                  this->rootPageNum == this->initialRootPageNum);
+const IndexStats BTreeIndex::stats() {
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  IndexStats result;
+  result.height = this->height;
+  result.leafPages = this->leafPages;
+  result.nonLeafPages = this->nonLeafPages;
+  result.postingPages = this->postingPages;
+  result.numEntries = this->entryCount + insertBufferInt.numEntries +
+                      insertBufferDouble.numEntries +
+                      insertBufferString.numEntries;
+  result.leafFill =
+      result.leafPages > 0 && this->leafCapacity > 0
+          ? (double)this->leafOccupancy /
+                (result.leafPages * this->leafCapacity)
+          : 0;
+  result.nonLeafFill =
+      result.nonLeafPages > 0
+          ? (double)this->nodeOccupancy /
+                (result.nonLeafPages * this->countLayout.capacity)
+          : 0;
+  // without a count every entry is taken to have a key of its own
+  const std::int64_t analyzed = this->analyzedEntries;
+  result.distinctKeys =
+      analyzed > 0 ? std::llround((double)result.numEntries *
+                                  this->analyzedDistinct / analyzed)
+                   : result.numEntries;
+  result.leafContiguity =
+      result.leafPages > 1
+          ? (double)this->contiguousLinks / (result.leafPages - 1)
+          : 1;
+  return result;
+}
 
-  // check whether need to split root
-  if (newPageNo != 0) {
-    splitRoot(newIndex, this->rootPageNum, newPageNo);
+const IndexStats BTreeIndex::analyze() {
+  // the buffered entries are left where they are, and stats() counts them
+  // with those of the tree
+  {
+    std::unique_lock<std::shared_mutex> treeGuard(treeLatch);
+    switch (attributeType) {
+      case INTEGER:
+        analyzeTree<int>();
+        break;
+      case DOUBLE:
+        analyzeTree<double>();
+        break;
+      case STRING:
+        analyzeTree<StringKey>();
+        break;
+    }
+    writeRootToMeta();
+  }
+  return stats();
+}
+
+template <class T>
+void BTreeIndex::analyzeTree() {
+  // the non-leaf nodes a level at a time from the root, which ends with the
+  // first leaf
+  std::int64_t levels = 1;
+  std::int64_t nonLeaves = 0;
+  std::int64_t keys = 0;
+  PageId pageNo = this->rootPageNum;
+  if (this->rootPageNum != this->initialRootPageNum) {
+    std::vector<PageId> level(1, this->rootPageNum);
+    bool levelOne = false;
+    while (!levelOne) {
+      std::vector<PageId> children;
+      for (const PageId nodePageNo : level) {
+        Page *page;
+        bufMgr->readPage(file, nodePageNo, page, ACCESS_INDEX_INNER);
+        const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+        children.insert(children.end(), node->pageNoArray,
+                        node->pageNoArray + node->keyNum + 1);
+        keys += node->keyNum;
+        levelOne = isLevelOneNode(node);
+        bufMgr->unPinPage(file, nodePageNo, false);
+      }
+      nonLeaves += level.size();
+      levels++;
+      level.swap(children);
+    }
+    pageNo = level[0];
+  }
+
+  // the leaves left to right, with the posting lists of their entries
+  std::int64_t leaves = 0;
+  std::int64_t slots = 0;
+  std::int64_t entries = 0;
+  std::int64_t postings = 0;
+  std::int64_t links = 0;
+  std::int64_t distinct = 0;
+  T lastKey{};
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    if (leaves == 0) {
+      this->leafCapacity = leaf_compressed((const LeafNode<T> *)page)
+                               ? COMPRESSEDLEAFSIZE
+                               : this->payloadLayout.capacity;
+    }
+    PageId next = 0;
+    with_leaf<T>(page, [&](const auto *leafNode) {
+      const int n = leaf_size(leafNode);
+      for (int i = 0; i < n; i++) {
+        const T key = leaf_key(leafNode, i);
+        distinct += entries == 0 || key != lastKey;
+        lastKey = key;
+        const RecordId rid = leaf_rid(leafNode, i);
+        if (!isPostingList(rid)) {
+          entries++;
+          continue;
+        }
+        if constexpr (!std::is_same<std::decay_t<decltype(*leafNode)>,
+                                    CompressedLeafInt>::value) {
+          if (inline_is(rid)) {
+            entries += inline_count(inline_bytes(leafNode, rid),
+                                    inline_length(rid));
+            continue;
+          }
+        }
+        PageId postingPageNo = rid.page_number;
+        while (postingPageNo != 0) {
+          Page *posting;
+          bufMgr->readPage(file, postingPageNo, posting, ACCESS_INDEX_LEAF);
+          entries += ((const PostingPage *)posting)->count;
+          const PageId nextPosting = ((const PostingPage *)posting)->nextPageNo;
+          bufMgr->unPinPage(file, postingPageNo, false);
+          postings++;
+          postingPageNo = nextPosting;
+        }
+      }
+      slots += n;
+      next = leafNode->rightSibPageNo;
+    });
+    bufMgr->unPinPage(file, pageNo, false);
+    leaves++;
+    links += next == pageNo + 1;
+    pageNo = next;
   }
+
+  this->height = levels;
+  this->leafPages = leaves;
+  this->nonLeafPages = nonLeaves;
+  this->postingPages = postings;
+  this->entryCount = entries;
+  this->leafOccupancy = slots;
+  this->nodeOccupancy = keys;
+  this->contiguousLinks = links;
+  this->analyzedEntries = entries;
+  this->analyzedDistinct = distinct;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::startScan
+// IndexScanCursor::IndexScanCursor
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::startScan(const void *lowValParm,
+IndexScanCursor::IndexScanCursor(BTreeIndex *indexIn, const void *lowValParm,
                                  const Operator lowOpParm,
                                  const void *highValParm,
                                  const Operator highOpParm) {
@@ -623,129 +4309,446 @@ const void BTreeIndex::startScan(const void *lowValParm,
       (highOpParm != LT && highOpParm != LTE)) {
     throw BadOpcodesException();
   }
-  // load low value and high value
-  // assumption: integer input
-  this->lowValInt = *((int *)lowValParm);
-  this->highValInt = *((int *)highValParm);
+  this->index = indexIn;
   this->lowOp = lowOpParm;
   this->highOp = highOpParm;
+  this->nextEntry = 0;
+  this->currentPageNum = 0;
+  this->nextLeafNum = 0;
+  this->scanAtEnd = false;
+  this->scanVersion = 0;
+  this->lastKeyCount = 0;
+  this->scanSkip = 0;
 
-  if (this->lowValInt > highValInt) {
-    this->lowValInt = 0;
-    this->highValInt = 0;
-    throw BadScanrangeException();
+  switch (index->attributeType) {
+    case INTEGER:
+      index->startScanKeys(*this, key_of<int>(lowValParm),
+                           key_of<int>(highValParm));
+      break;
+    case DOUBLE:
+      index->startScanKeys(*this, key_of<double>(lowValParm),
+                           key_of<double>(highValParm));
+      break;
+    case STRING:
+      index->startScanKeys(*this, key_of<StringKey>(lowValParm),
+                           key_of<StringKey>(highValParm));
+      break;
   }
-  // printTree();
+}
 
-  // search for the correct leaf page containing the record that is smaller or
-  // equal to lowValParm
-  this->currentPageNum = this->getLeafPage(this->lowValInt);
+// -----------------------------------------------------------------------------
+// IndexScanCursor::scanNext
+// -----------------------------------------------------------------------------
 
-  // this leaf page will get pinned until we are finished with this page
-  Page *leafPage;
-  bufMgr->readPage(this->file, this->currentPageNum, leafPage);
-  this->currentPageData = leafPage;
-  // printTree();
+void IndexScanCursor::scanNext(RecordId &outRid) {
+  while (this->nextEntry >= this->scanBuffer.size()) {
+    // the entries of the current leaf are used up
+    // switch to next node
+    if (!nextLeaf()) {
+      throw IndexScanCompletedException();
+    }
+  }
 
-  this->nextEntry = this->getFirstIndex();
-  this->scanExecuting = true;
+  outRid = this->scanBuffer[this->nextEntry];
+  this->nextEntry++;
 }
 
-const int BTreeIndex::getFirstIndex() {
-  struct LeafNodeInt *leafNode = (struct LeafNodeInt *)this->currentPageData;
-  for (int i = 0; i < leafNode->keyNum; i++) {
-    if (this->lowOp == GT) {
-      if (this->lowValInt < leafNode->keyArray[i]) {
-        return i;
-      }
-    } else {
-      if (this->lowValInt <= leafNode->keyArray[i]) {
-        return i;
-      }
+void IndexScanCursor::scanNext(RecordId &outRid, void *outPayload) {
+  scanNext(outRid);
+  const std::size_t length = index->payloadLength;
+  memcpy(outPayload, &this->payloadBuffer[(this->nextEntry - 1) * length],
+         length);
+}
+
+// -----------------------------------------------------------------------------
+// IndexScanCursor::scanNextBatch
+// -----------------------------------------------------------------------------
+
+std::size_t IndexScanCursor::scanNextBatch(RecordId *out,
+                                           const std::size_t max) {
+  std::size_t numOut = 0;
+  while (numOut < max) {
+    if (this->nextEntry >= this->scanBuffer.size() && !nextLeaf()) {
+      break;
+    }
+    const std::size_t n =
+        std::min(max - numOut, this->scanBuffer.size() - this->nextEntry);
+    std::copy(this->scanBuffer.begin() + this->nextEntry,
+              this->scanBuffer.begin() + this->nextEntry + n, out + numOut);
+    this->nextEntry += n;
+    numOut += n;
+  }
+  return numOut;
+}
+
+std::size_t IndexScanCursor::scanNextBatch(RecordId *out, void *outPayloads,
+                                           const std::size_t max) {
+  const std::size_t length = index->payloadLength;
+  unsigned char *payloads = (unsigned char *)outPayloads;
+  std::size_t numOut = 0;
+  while (numOut < max) {
+    if (this->nextEntry >= this->scanBuffer.size() && !nextLeaf()) {
+      break;
     }
+    const std::size_t n =
+        std::min(max - numOut, this->scanBuffer.size() - this->nextEntry);
+    std::copy(this->scanBuffer.begin() + this->nextEntry,
+              this->scanBuffer.begin() + this->nextEntry + n, out + numOut);
+    memcpy(payloads + numOut * length,
+           this->payloadBuffer.data() + this->nextEntry * length, n * length);
+    this->nextEntry += n;
+    numOut += n;
+  }
+  return numOut;
+}
+
+bool IndexScanCursor::nextLeaf() {
+  if (this->scanAtEnd) {
+    return false;
+  }
+  switch (index->attributeType) {
+    case INTEGER:
+      index->advanceScan<int>(*this);
+      break;
+    case DOUBLE:
+      index->advanceScan<double>(*this);
+      break;
+    case STRING:
+      index->advanceScan<StringKey>(*this);
+      break;
+  }
+  return true;
+}
+
+template <class T>
+void BTreeIndex::startScanKeys(IndexScanCursor &scan, const T &lowVal,
+                               const T &highVal) {
+  if (highVal < lowVal) {
+    throw BadScanrangeException();
+  }
+  scan.scanLowVal((T *)NULL) = lowVal;
+  scan.scanHighVal((T *)NULL) = highVal;
+
+  // search for the leaf page that holds the first entry at or after the low
+  // value
+  {
+    std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+    std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+    readScanLeaf<T>(scan, this->getLeafPage(lowVal, scan.lowOp), true);
+  }
+
+  // the first entry may be in one of the next leaves
+  while (scan.scanBuffer.empty() && !scan.scanAtEnd) {
+    advanceScan<T>(scan);
   }
-  return leafNode->keyNum;
+  if (scan.scanBuffer.empty()) {
+    throw NoSuchKeyFoundException();
+  }
+}
+
+template <class T, class L>
+const int BTreeIndex::getFirstIndex(IndexScanCursor &scan, const L *leafNode) {
+  const T &lowVal = scan.scanLowVal((T *)NULL);
+  if (scan.lowOp == GT) {
+    return leaf_upper_bound(leafNode, 0, leaf_size(leafNode), lowVal);
+  }
+  return leaf_lower_bound(leafNode, 0, leaf_size(leafNode), lowVal);
 }
 
-const PageId BTreeIndex::getLeafPage(const int key) {
-  PageId levelOnePageId = this->getLevelOnePage(this->rootPageNum, key);
-  Page *levelOnePage;
-  bufMgr->readPage(file, levelOnePageId, levelOnePage);
-  NonLeafNodeInt *node = (NonLeafNodeInt *)levelOnePage;
-  assert(node->level == 1);
+template <class T>
+const PageId BTreeIndex::getLeafPage(const T &key, const Operator op) {
+  PageId pageId = this->rootPageNum;
+  if (pageId == this->initialRootPageNum) {
+    // the root is still a leaf
+    return pageId;
+  }
+
+  if (this->cachedLevels > 0) {
+    // the cached levels are searched like the nodes, and the descent goes on
+    // in the pages below them
+    const InnerNodeCache<T> &cache = loadInnerCache<T>();
+    std::uint32_t node = 0;
+    for (int level = 0; level < cache.levels; level++) {
+      const std::uint32_t first = cache.keyStart[node];
+      const int n = cache.keyStart[node + 1] - first;
+      const T *keys = cache.keys.data() + first;
+      const int sep = op == GT ? keyUpperBound(keys, n, key)
+                               : keyLowerBound(keys, n, key);
+      node = cache.children[first + node + sep];
+    }
+    if (cache.leafChildren) {
+      return node;
+    }
+    pageId = node;
+  }
+
+  while (true) {
+    Page *page;
+    bufMgr->readPage(file, pageId, page, ACCESS_INDEX_INNER);
+    NonLeafNode<T> *node = (NonLeafNode<T> *)page;
 
-  for (int i = 0; i < node->keyNum; i++) {
-    if (key < node->keyArray[i]) {
-      PageId leafId = node->pageNoArray[i];
-      bufMgr->unPinPage(file, levelOnePageId, false);
-      return leafId;
+    // a leaf may hold keys equal to the separator on its right, so GTE has
+    // to start left of any separator equal to key
+    const int sep = op == GT
+                        ? keyUpperBound(node->keyArray, node->keyNum, key)
+                        : keyLowerBound(node->keyArray, node->keyNum, key);
+    PageId next = node->pageNoArray[sep];
+    bool levelOne = isLevelOneNode(node);
+    bufMgr->unPinPage(file, pageId, false);
+    if (levelOne) {
+      return next;
     }
+    pageId = next;
   }
-  PageId leafId = node->pageNoArray[node->keyNum];
-  bufMgr->unPinPage(file, levelOnePageId, false);
-  return leafId;
 }
 
-const PageId BTreeIndex::getLevelOnePage(const PageId prev, const int key) {
-  Page *prevPage;
-  bufMgr->readPage(file, prev, prevPage);
-  struct NonLeafNodeInt *prevNode = (struct NonLeafNodeInt *)prevPage;
+template <class T>
+const InnerNodeCache<T> &BTreeIndex::loadInnerCache() {
+  InnerNodeCache<T> &cache = innerCache((T *)NULL);
+  if (this->innerCacheValid.load(std::memory_order_acquire)) {
+    return cache;
+  }
+  std::lock_guard<std::mutex> guard(innerCacheMutex);
+  if (this->innerCacheValid.load(std::memory_order_acquire)) {
+    return cache;
+  }
+
+  // read the cached levels breadth first; the children of every level but
+  // the lowest are numbered as the nodes of the next one
+  cache.keys.clear();
+  cache.keyStart.clear();
+  cache.children.clear();
+  cache.levels = 0;
+  cache.leafChildren = false;
+  std::vector<PageId> level(1, this->rootPageNum);
+  std::uint32_t nextNode = 1;
+  while (true) {
+    std::vector<PageId> below;
+    const std::size_t firstChild = cache.children.size();
+    for (const PageId pageNo : level) {
+      Page *page;
+      bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_INNER);
+      const NonLeafNode<T> *node = (const NonLeafNode<T> *)page;
+      cache.keyStart.push_back(cache.keys.size());
+      cache.keys.insert(cache.keys.end(), node->keyArray,
+                        node->keyArray + node->keyNum);
+      cache.children.insert(cache.children.end(), node->pageNoArray,
+                            node->pageNoArray + node->keyNum + 1);
+      // all nodes of a level are at the same height
+      cache.leafChildren = isLevelOneNode(node);
+      bufMgr->unPinPage(file, pageNo, false);
+    }
+    cache.levels++;
+    if (cache.leafChildren || cache.levels == this->cachedLevels) {
+      break;
+    }
+    below.assign(cache.children.begin() + firstChild, cache.children.end());
+    for (std::size_t c = firstChild; c < cache.children.size(); c++) {
+      cache.children[c] = nextNode++;
+    }
+    level.swap(below);
+  }
+  cache.keyStart.push_back(cache.keys.size());
+  this->innerCacheValid.store(true, std::memory_order_release);
+  return cache;
+}
 
-  if (prevNode->level == 1) {
-    bufMgr->unPinPage(this->file, prev, false);
-    return prev;
+template <class T>
+void BTreeIndex::innerNodeChanged(const NonLeafNode<T> *node) {
+  // the nodes just above the leaves are only cached if every non-leaf level
+  // is
+  if (node == NULL || !isLevelOneNode(node) ||
+      this->cachedLevels >= this->height - 1) {
+    this->innerCacheValid.store(false, std::memory_order_relaxed);
   }
+}
+
+template <class T>
+void BTreeIndex::readScanLeaf(IndexScanCursor &scan, const PageId leafPageNo,
+                              const bool fromLow) {
+  Page *page;
+  bufMgr->readPage(this->file, leafPageNo, page, ACCESS_INDEX_LEAF);
+  std::shared_lock<std::shared_mutex> leafGuard(leafLatches.latch(leafPageNo));
+
+  with_leaf<T>(page, [&](const auto *leafNode) {
+    T &lastKey = scan.scanLowVal((T *)NULL);
+    const int n = leaf_size(leafNode);
+    const int i = fromLow ? getFirstIndex<T>(scan, leafNode) : 0;
+
+    // the entries before the first one past the high value are copied at once
+    const T &highVal = scan.scanHighVal((T *)NULL);
+    const int end = std::max(
+        i, scan.highOp == LT ? leaf_lower_bound(leafNode, 0, n, highVal)
+                             : leaf_upper_bound(leafNode, 0, n, highVal));
+    if (end < n) {
+      scan.scanAtEnd = true;
+    }
+    scan.scanBuffer.clear();
+    scan.payloadBuffer.clear();
+    scan.nextEntry = 0;
+
+    // the buffered entries from the last key returned on, or from the low
+    // value, that come before those of the last key copied from the leaf,
+    // which the next leaf may hold more of, or all up to the high value at
+    // the end of the scan
+    std::vector<BufferedEntry<T> > buffered;
+    const bool atEnd = end < n || leafNode->rightSibPageNo == 0;
+    if (this->insertBufferEntries > 0 && (atEnd || i < end)) {
+      const Operator fromOp = scan.lastKeyCount > 0 ? GTE : scan.lowOp;
+      if (atEnd) {
+        buffer_copy(insertBuffer((T *)NULL), &lastKey, fromOp, &highVal,
+                    scan.highOp, buffered);
+      } else {
+        const T upTo = leaf_key(leafNode, end - 1);
+        buffer_copy(insertBuffer((T *)NULL), &lastKey, fromOp, &upTo, LT,
+                    buffered);
+      }
+    }
+    // copies the entries [from, to) of the leaf with their payloads, and
+    // while merge allows it the buffered entries each after those of the
+    // leaf with keys up to its own
+    std::size_t b = 0;
+    auto copyMerged = [&](int from, const int to, const T *merge) {
+      std::size_t num = 0;
+      for (; b < buffered.size() &&
+             (merge == NULL || buffered[b].first < *merge);
+           b++) {
+        const int at = leaf_upper_bound(leafNode, from, to, buffered[b].first);
+        num += copyLeafEntries(leafNode, from, at, scan.scanBuffer);
+        payload_copy_out(leafNode, from, at, this->payloadLayout,
+                         scan.payloadBuffer);
+        from = at;
+        scan.scanBuffer.push_back(buffered[b].second.first);
+        if (this->payloadLength > 0) {
+          const std::vector<unsigned char> &payload = buffered[b].second.second;
+          scan.payloadBuffer.insert(scan.payloadBuffer.end(), payload.begin(),
+                                    payload.end());
+          scan.payloadBuffer.resize(scan.scanBuffer.size() *
+                                    this->payloadLength);
+        }
+      }
+      num += copyLeafEntries(leafNode, from, to, scan.scanBuffer);
+      payload_copy_out(leafNode, from, to, this->payloadLayout,
+                       scan.payloadBuffer);
+      return num;
+    };
 
-  for (int i = 0; i < prevNode->keyNum; i++) {
-    if (key < prevNode->keyArray[i]) {
-      PageId next = prevNode->pageNoArray[i];
-      bufMgr->unPinPage(this->file, prev, false);
-      return this->getLevelOnePage(next, key);
+    // after a new descent, skip the entries of the last key that were returned
+    int j = i;
+    std::size_t numNewOfLast = 0;
+    if (scan.scanSkip > 0) {
+      j = leaf_upper_bound(leafNode, i, end, lastKey);
+      const std::size_t num = copyLeafEntries(leafNode, i, j, scan.scanBuffer);
+      const std::size_t skipped = std::min(scan.scanSkip, num);
+      scan.scanBuffer.erase(scan.scanBuffer.begin(),
+                            scan.scanBuffer.begin() + skipped);
+      scan.scanSkip -= skipped;
+      numNewOfLast = num - skipped;
+      // a covering leaf has no posting lists, so these are the entries up to
+      // j that were not skipped
+      payload_copy_out(leafNode, j - (int)scan.scanBuffer.size(), j,
+                       this->payloadLayout, scan.payloadBuffer);
     }
+
+    // count the copied record ids of the last key, with its posting lists
+    if (j < end) {
+      const T key = leaf_key(leafNode, end - 1);
+      const int tail = leaf_lower_bound(leafNode, j, end, key);
+      copyMerged(j, tail, &key);
+      const std::size_t numEqual = copyMerged(tail, end, NULL);
+      if (scan.lastKeyCount > 0 && key == lastKey && tail == j) {
+        scan.lastKeyCount += numNewOfLast + numEqual;
+      } else {
+        lastKey = key;
+        scan.lastKeyCount = numEqual;
+      }
+    } else {
+      copyMerged(j, j, NULL);
+      scan.lastKeyCount += numNewOfLast;
+    }
+    scan.nextLeafNum = leafNode->rightSibPageNo;
+  });
+
+  scan.currentPageNum = leafPageNo;
+  if (scan.nextLeafNum == 0) {
+    scan.scanAtEnd = true;
+  }
+  scan.scanVersion = this->structureVersion;
+  leafGuard.unlock();
+  bufMgr->unPinPage(this->file, leafPageNo, false);
+}
+
+template <class T>
+void BTreeIndex::advanceScan(IndexScanCursor &scan) {
+  std::shared_lock<std::shared_mutex> bufferGuard(insertBufferLatch);
+  std::shared_lock<std::shared_mutex> treeGuard(treeLatch);
+  if (scan.scanVersion == this->structureVersion) {
+    // splits since the current leaf was read only moved entries it held
+    readScanLeaf<T>(scan, scan.nextLeafNum, false);
+    return;
+  }
+
+  // the next leaf may have been merged away: find the last entry copied from
+  // the root and go on after it
+  if (scan.lastKeyCount > 0) {
+    scan.lowOp = GTE;
+    scan.scanSkip = scan.lastKeyCount;
+  }
+  readScanLeaf<T>(scan, getLeafPage(scan.scanLowVal((T *)NULL), scan.lowOp),
+                  true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScan
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::startScan(const void *lowValParm,
+                                 const Operator lowOpParm,
+                                 const void *highValParm,
+                                 const Operator highOpParm) {
+  if (this->currentScan != NULL) {
+    endScan();
   }
-  PageId next = prevNode->pageNoArray[prevNode->keyNum];
-  bufMgr->unPinPage(this->file, prev, false);
-  return this->getLevelOnePage(next, key);
+  this->currentScan =
+      new IndexScanCursor(this, lowValParm, lowOpParm, highValParm, highOpParm);
 }
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::scanNext
 // -----------------------------------------------------------------------------
 
 const void BTreeIndex::scanNext(RecordId &outRid) {
-  if (this->scanExecuting == false) {
+  if (this->currentScan == NULL) {
     throw ScanNotInitializedException();
   }
-  // printTree();
-  struct LeafNodeInt *leafNode = (struct LeafNodeInt *)this->currentPageData;
-  if (this->nextEntry >= leafNode->keyNum) {
-    // nextEntry is at the end of the node
-    // switch to next node
-    PageId rightNo = leafNode->rightSibPageNo;
-    if (rightNo == 0) {
-      throw IndexScanCompletedException();
-    }
-    bufMgr->unPinPage(this->file, this->currentPageNum, false);
+  this->currentScan->scanNext(outRid);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatch
+// -----------------------------------------------------------------------------
 
-    Page *nextPage;
-    this->currentPageNum = rightNo;
-    bufMgr->readPage(this->file, this->currentPageNum, nextPage);
-    this->currentPageData = nextPage;
-    this->nextEntry = 0;
+const std::size_t BTreeIndex::scanNextBatch(RecordId *out,
+                                            const std::size_t max) {
+  if (this->currentScan == NULL) {
+    throw ScanNotInitializedException();
   }
-  // check if we reached higher bound
-  if (this->highOp == LT) {
-    if (leafNode->keyArray[this->nextEntry] >= this->highValInt) {
-      throw IndexScanCompletedException();
-    }
-  } else {
-    if (leafNode->keyArray[this->nextEntry] > this->highValInt) {
-      // this->endScan();
-      throw IndexScanCompletedException();
-    }
+  return this->currentScan->scanNextBatch(out, max);
+}
+
+const void BTreeIndex::scanNext(RecordId &outRid, void *outPayload) {
+  if (this->currentScan == NULL) {
+    throw ScanNotInitializedException();
   }
+  this->currentScan->scanNext(outRid, outPayload);
+}
 
-  outRid = leafNode->ridArray[this->nextEntry];
-  this->nextEntry++;
+const std::size_t BTreeIndex::scanNextBatch(RecordId *out, void *outPayloads,
+                                            const std::size_t max) {
+  if (this->currentScan == NULL) {
+    throw ScanNotInitializedException();
+  }
+  return this->currentScan->scanNextBatch(out, outPayloads, max);
 }
 
 // -----------------------------------------------------------------------------
@@ -753,56 +4756,87 @@ const void BTreeIndex::scanNext(RecordId &outRid) {
 // -----------------------------------------------------------------------------
 //
 const void BTreeIndex::endScan() {
-  if (this->scanExecuting == false) {
+  if (this->currentScan == NULL) {
     throw ScanNotInitializedException();
   }
-  bufMgr->unPinPage(this->file, this->currentPageNum, false);
-  this->nextEntry = 0;
-  this->scanExecuting = false;
-  this->currentPageData = NULL;
-  this->currentPageNum = 0;
-  this->lowValInt = 0;
-  this->highValInt = 0;
+  delete this->currentScan;
+  this->currentScan = NULL;
 }
 
 void BTreeIndex::printTree() {
   printf("---------------Tree--------------\n");
   printf("Root: [%d]\n", this->rootPageNum);
-  this->printTreeRecurs(0, this->rootPageNum,
-                        this->rootPageNum == initialRootPageNum);
+  const bool isleaf = this->rootPageNum == initialRootPageNum;
+  switch (attributeType) {
+    case INTEGER:
+      this->printTreeRecurs<int>(0, this->rootPageNum, isleaf);
+      break;
+    case DOUBLE:
+      this->printTreeRecurs<double>(0, this->rootPageNum, isleaf);
+      break;
+    case STRING:
+      this->printTreeRecurs<StringKey>(0, this->rootPageNum, isleaf);
+      break;
+  }
 }
 
+template <class T>
 void BTreeIndex::printTreeRecurs(int level, PageId pageId, bool isleaf) {
   Page *p;
-  bufMgr->readPage(file, pageId, p);
-  if (isleaf) {
-    LeafNodeInt *node = (LeafNodeInt *)p;
-    std::cout << "leaf node: min = " << node->keyArray[0]
-              << " max = " << node->keyArray[node->keyNum - 1]
-              << " next = " << node->rightSibPageNo << std::endl;
+  bufMgr->readPage(file, pageId, p,
+                   isleaf ? ACCESS_INDEX_LEAF : ACCESS_INDEX_INNER);
+  if (isleaf && leaf_compressed((LeafNode<T> *)p)) {
+    const CompressedLeafInt *node = (const CompressedLeafInt *)p;
+    if (node->numEntries > 0) {
+      std::cout << "compressed leaf node: min = " << cleaf_key(node, 0)
+                << " max = " << cleaf_key(node, node->numEntries - 1);
+    } else {
+      std::cout << "compressed leaf node: empty";
+    }
+    std::cout << " next = " << node->rightSibPageNo << std::endl;
+    std::cout << "numEntries = " << node->numEntries
+              << " bits = " << (int)node->keyBits << "+"
+              << (int)node->pageBits << "+" << (int)node->slotBits
+              << std::endl;
+    for (int i = 0; i < node->numEntries; i++) {
+      std::cout << cleaf_key(node, i) << " ";
+    }
+    std::cout << std::endl;
+  } else if (isleaf) {
+    LeafNode<T> *node = (LeafNode<T> *)p;
+    if (node->keyNum > 0) {
+      std::cout << "leaf node: min = " << node->keyArray[0]
+                << " max = " << node->keyArray[node->keyNum - 1];
+    } else {
+      std::cout << "leaf node: empty";
+    }
+    std::cout << " next = " << node->rightSibPageNo << std::endl;
     std::cout << "keyNum = " << node->keyNum << std::endl;
     for (int i = 0; i < node->keyNum; i++) {
       std::cout << node->keyArray[i] << " ";
     }
     std::cout << std::endl;
   } else {
-    NonLeafNodeInt *node = (NonLeafNodeInt *)p;
+    NonLeafNode<T> *node = (NonLeafNode<T> *)p;
     std::cout << "internal node:\n";
     for (int i = 0; i < node->keyNum; i++) {
       for (int j = 0; j < level; j++) std::cout << "--";
-      printf("key[%d] -> Page[%d]\n", node->keyArray[i], node->pageNoArray[i]);
-      this->printTreeRecurs(level + 1, node->pageNoArray[i], node->level == 1);
+      std::cout << "key[" << node->keyArray[i] << "] -> Page["
+                << node->pageNoArray[i] << "]" << std::endl;
+      this->printTreeRecurs<T>(level + 1, node->pageNoArray[i],
+                               node->level == 1);
     }
     for (int j = 0; j < level; j++) std::cout << "--";
     std::cout << "Page[" << node->pageNoArray[node->keyNum] << "]" << std::endl;
-    this->printTreeRecurs(level + 1, node->pageNoArray[node->keyNum],
-                          node->level == 1);
+    this->printTreeRecurs<T>(level + 1, node->pageNoArray[node->keyNum],
+                             node->level == 1);
     std::cout << "internal node end\n";
   }
   bufMgr->unPinPage(file, pageId, false);
 }
 
-void BTreeIndex::printNode(NonLeafNodeInt *newNode) {
+template <class T>
+void BTreeIndex::printNode(NonLeafNode<T> *newNode) {
   int rightLen = newNode->keyNum;
   for (int i = 0; i < rightLen; i++) {
     std::cout << newNode->keyArray[i] << " ";
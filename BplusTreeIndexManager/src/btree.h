@@ -8,11 +8,20 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "assert.h"
+#include "bloomfilter.h"
 #include "buffer.h"
 #include "file.h"
 #include "page.h"
@@ -36,6 +45,74 @@ enum Operator {
   GT   /* Greater Than */
 };
 
+/**
+ * @brief Number of characters of a STRING attribute that are used as its key.
+ */
+const int STRINGSIZE = 10;
+
+/**
+ * @brief Key of a STRING index: the first STRINGSIZE characters of the
+ * attribute, padded with '\0'. Keys compare like strncmp() over STRINGSIZE
+ * characters.
+ */
+struct StringKey {
+  char data[STRINGSIZE];
+};
+
+inline bool operator<(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) < 0;
+}
+inline bool operator>(const StringKey &a, const StringKey &b) { return b < a; }
+inline bool operator<=(const StringKey &a, const StringKey &b) {
+  return !(b < a);
+}
+inline bool operator>=(const StringKey &a, const StringKey &b) {
+  return !(a < b);
+}
+inline bool operator==(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) == 0;
+}
+inline bool operator!=(const StringKey &a, const StringKey &b) {
+  return !(a == b);
+}
+
+/**
+ * @brief Reads a key from an attribute value or from a key passed to the
+ * public methods of an index. STRING keys take the first STRINGSIZE
+ * characters.
+ */
+void key_set(int &key, const void *value);
+void key_set(double &key, const void *value);
+void key_set(StringKey &key, const void *value);
+
+/**
+ * @brief Hash of a key, every bit of which depends on every bit of the key.
+ * Keys that are equal hash the same.
+ */
+std::uint64_t key_hash(const int &key);
+std::uint64_t key_hash(const double &key);
+std::uint64_t key_hash(const StringKey &key);
+
+/**
+ * @brief Stores a relation name in the name field of a meta page, cut to
+ * leave room for the '\0' that ends it, and padded with '\0'.
+ */
+template <std::size_t N>
+void relation_name_set(char (&field)[N], const std::string &name) {
+  const std::size_t len = std::min(name.size(), N - 1);
+  memcpy(field, name.data(), len);
+  memset(field + len, 0, N - len);
+}
+
+/**
+ * @brief Whether the name field of a meta page holds the relation name, as
+ * relation_name_set() stores it.
+ */
+template <std::size_t N>
+bool relation_name_matches(const char (&field)[N], const std::string &name) {
+  return name.compare(0, N - 1, field) == 0;
+}
+
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
@@ -52,6 +129,66 @@ const int INTARRAYNONLEAFSIZE =
     (Page::SIZE - sizeof(int) - sizeof(PageId) - sizeof(int)) /
     (sizeof(int) + sizeof(PageId));
 
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                                  sibling ptr       n key rid
+const int DOUBLEARRAYLEAFSIZE = (Page::SIZE - sizeof(PageId) - sizeof(int)) /
+                                (sizeof(double) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                                                     level     extra pageNo n
+//                                                     key       pageNo
+const int DOUBLEARRAYNONLEAFSIZE =
+    (Page::SIZE - sizeof(int) - sizeof(PageId) - sizeof(int)) /
+    (sizeof(double) + sizeof(PageId));
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key.
+ */
+//                                                  sibling ptr       n key rid
+const int STRINGARRAYLEAFSIZE = (Page::SIZE - sizeof(PageId) - sizeof(int)) /
+                                (sizeof(StringKey) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for STRING key.
+ */
+//                                                     level     extra pageNo n
+//                                                     key       pageNo
+const int STRINGARRAYNONLEAFSIZE =
+    (Page::SIZE - sizeof(int) - sizeof(PageId) - sizeof(int)) /
+    (sizeof(StringKey) + sizeof(PageId));
+
+/**
+ * @brief Compile-time properties of each key type: the Datatype it indexes and
+ * the number of key slots in its nodes.
+ */
+template <class T>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int> {
+  static const Datatype TYPE = INTEGER;
+  static const int LEAFSIZE = INTARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = INTARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<double> {
+  static const Datatype TYPE = DOUBLE;
+  static const int LEAFSIZE = DOUBLEARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = DOUBLEARRAYNONLEAFSIZE;
+};
+
+template <>
+struct KeyTraits<StringKey> {
+  static const Datatype TYPE = STRING;
+  static const int LEAFSIZE = STRINGARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = STRINGARRAYNONLEAFSIZE;
+};
+
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to
  * functions that add to or make changes to the leaf node pages of the tree. Is
@@ -78,265 +215,1571 @@ class PageKeyPair {
  public:
   PageId pageNo;
   T key;
-  void set(int p, T k) {
+  void set(PageId p, T k) {
     pageNo = p;
     key = k;
   }
 };
 
-/**
- * @brief Overloaded operator to compare the key values of two rid-key pairs
- * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
- */
-template <class T>
-bool operator<(const RIDKeyPair<T> &r1, const RIDKeyPair<T> &r2) {
-  if (r1.key != r2.key)
-    return r1.key < r2.key;
-  else
-    return r1.rid.page_number < r2.rid.page_number;
-}
+/**
+ * @brief Overloaded operator to compare the key values of two rid-key pairs
+ * and if they are the same compares to see if the first pair has
+ * a smaller rid.
+ */
+template <class T>
+bool operator<(const RIDKeyPair<T> &r1, const RIDKeyPair<T> &r2) {
+  if (r1.key != r2.key)
+    return r1.key < r2.key;
+  else if (r1.rid.page_number != r2.rid.page_number)
+    return r1.rid.page_number < r2.rid.page_number;
+  else
+    return r1.rid.slot_number < r2.rid.slot_number;
+}
+
+/**
+ * @brief A fixed size attribute that a covering index copies from the record
+ * into its leaves with every key, at byteOffset in the record like
+ * attrByteOffset and length bytes long.
+ */
+struct PayloadColumn {
+  int byteOffset;
+  int length;
+};
+
+/**
+ * @brief Most payload columns of a covering index, and most bytes of the
+ * payload of an entry, which is the bytes of its columns one after another.
+ */
+const int MAXPAYLOADCOLUMNS = 8;
+const int MAXPAYLOADLENGTH = 256;
+
+/**
+ * @brief Counters of the shape of an index that every change keeps up to
+ * date, stored in its meta page so that they are read without walking the
+ * tree. See BTreeIndex::stats().
+ */
+struct IndexCounters {
+  /**
+   * Levels of the tree, 1 while the root is a leaf.
+   */
+  std::int64_t height;
+
+  /**
+   * Pages of leaves, of non-leaf nodes and of posting lists.
+   */
+  std::int64_t leafPages;
+  std::int64_t nonLeafPages;
+  std::int64_t postingPages;
+
+  /**
+   * Entries of the index, one for every record id in a leaf or posting list.
+   */
+  std::int64_t numEntries;
+
+  /**
+   * Entries in the leaves, a posting list taking one, and keys in the
+   * non-leaf nodes.
+   */
+  std::int64_t leafOccupancy;
+  std::int64_t nodeOccupancy;
+
+  /**
+   * Most entries of a leaf, which depends on the kind of its leaves.
+   */
+  std::int64_t leafCapacity;
+
+  /**
+   * Links between leaves from a page to the page numbered one after it.
+   */
+  std::int64_t contiguousLinks;
+
+  /**
+   * Entries and distinct keys when they were last counted, by a bulk load or
+   * BTreeIndex::analyze().
+   */
+  std::int64_t analyzedEntries;
+  std::int64_t analyzedDistinct;
+};
+
+/**
+ * @brief The meta page, which holds metadata for Index file, is always first
+ * page of the btree index file and is cast to the following structure to store
+ * or retrieve information from it. Contains the relation name for which the
+ * index is created, the byte offset of the key value on which the index is
+ * made, the type of the key and the page no of the root page. Root page starts
+ * as page 2 but since a split can occur at the root the root page may get moved
+ * up and get a new page no.
+ */
+struct IndexMetaInfo {
+  /**
+   * Name of base relation.
+   */
+  char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in
+   * pages.
+   */
+  int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+  Datatype attrType;
+
+  /**
+   * Page number of root page of the B+ Tree inside the file index file.
+   */
+  PageId rootPageNo;
+
+  /**
+   * page number of initial root page of B+ tree inside index file.
+   * if rootPageNum == initialRootPageNum, it's a leaf node
+   * else it's non leaf node
+   */
+  PageId initialRootPageNum;
+
+  /**
+   * Payload columns of a covering index, none for other indexes.
+   */
+  int numPayloadColumns;
+  PayloadColumn payloadColumns[MAXPAYLOADCOLUMNS];
+
+  /**
+   * Whether the non-leaf nodes count the entries under every child, see
+   * NonLeafCountLayout.
+   */
+  bool countedTree;
+
+  /**
+   * Shape of the index when its root last changed or it was last closed.
+   * Files written before they were kept hold zeros, and no index has 0 leaf
+   * pages.
+   */
+  IndexCounters counters;
+
+  /**
+   * Bloom filter of the keys, saved to BTreeIndex::bloomFileName(): its rate
+   * of false positives, 0 if the index has none, the number of keys it is
+   * sized for, its blocks and the bits a key sets.
+   */
+  double bloomRate;
+  std::uint64_t bloomCapacity;
+  std::uint32_t bloomBlocks;
+  int bloomHashes;
+
+  /**
+   * Version of the Bloom filter last saved, also written to the first page of
+   * its file. A file whose version differs is older or newer than the index
+   * and is not used. Files written before it was kept hold 0, which no saved
+   * filter has.
+   */
+  std::uint64_t bloomVersion;
+
+  /**
+   * Whether leaves may hold inline posting lists, see POSTINGINLINE, which is
+   * set once the index is opened with BTreeOptions::postingLists. Files
+   * written before it was kept hold false and have none.
+   */
+  bool leafPostings;
+};
+
+/*
+Each node is a page, so once we read the page in we just cast the pointer to the
+page to this struct and use it to access the parts These structures basically
+are the format in which the information is stored in the pages for the index
+file depending on what kind of node they are. The level memeber of each non leaf
+structure seen below is set to 1 if the nodes at this level are just above the
+leaf nodes. Otherwise set to 0.
+*/
+
+/**
+ * @brief Structure for all non-leaf nodes, for keys of type T.
+ */
+template <class T>
+struct NonLeafNode {
+  /**
+   * Level of the node in the tree.
+   */
+  int level;
+
+  /**
+   * Stores keys.
+   */
+  T keyArray[KeyTraits<T>::NONLEAFSIZE];
+
+  /**
+   * Stores page numbers of child pages which themselves are other non-leaf/leaf
+   * nodes in the tree.
+   */
+  PageId pageNoArray[KeyTraits<T>::NONLEAFSIZE + 1];
+
+  /**
+   * Number of keys in this node
+   */
+  int keyNum = 0;
+};
+
+/**
+ * @brief Structure for all leaf nodes, for keys of type T.
+ */
+template <class T>
+struct LeafNode {
+  /**
+   * Stores keys.
+   */
+  T keyArray[KeyTraits<T>::LEAFSIZE];
+
+  /**
+   * Stores RecordIds.
+   */
+  RecordId ridArray[KeyTraits<T>::LEAFSIZE];
+
+  /**
+   * Page number of the leaf on the right side.
+   * This linking of leaves allows to easily move from one leaf to the next leaf
+   * during index scan.
+   */
+  PageId rightSibPageNo;
+
+  /**
+   * Number of keys in this node
+   */
+  int keyNum = 0;
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ */
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ */
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+ */
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+ */
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ */
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+ */
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert(sizeof(LeafNodeInt) <= Page::SIZE &&
+                  sizeof(NonLeafNodeInt) <= Page::SIZE,
+              "INTEGER nodes must fit in a page");
+static_assert(sizeof(LeafNodeDouble) <= Page::SIZE &&
+                  sizeof(NonLeafNodeDouble) <= Page::SIZE,
+              "DOUBLE nodes must fit in a page");
+static_assert(sizeof(LeafNodeString) <= Page::SIZE &&
+                  sizeof(NonLeafNodeString) <= Page::SIZE,
+              "STRING nodes must fit in a page");
+
+/**
+ * @brief Slot number of the RecordId of a leaf entry that stands for a posting
+ * list of record ids with its key, which starts at the page given by the page
+ * number. No page of a relation holds that many records.
+ */
+const SlotId POSTINGLISTSLOT = 0xFFFF;
+
+/**
+ * @brief Bit of the page number of a posting list entry whose record ids are
+ * kept in its leaf instead of on posting pages. The record ids of such an
+ * inline list are stored as varints, after the whole last one, in the record
+ * id slots at the end of the leaf, and the other bits of the page number give
+ * where: 14 bits of the distance of the list from the end of the slots and 14
+ * bits of its length in bytes. No index has 2^31 pages, so no posting page
+ * number has the bit. A list moves to posting pages when it no longer fits in
+ * a leaf by itself.
+ */
+const PageId POSTINGINLINE = 0x80000000;
+
+/**
+ * @brief Number of entries of one key in a leaf at which an insert moves them
+ * to a posting list, inline if it fits in the leaf.
+ */
+const int POSTINGLISTMIN = 16;
+
+/**
+ * @brief Number of bytes of record ids in a page of a posting list.
+ */
+//                                                   next, last pageNo
+//                                                   count, numBytes
+//                                                   first, last id
+const int POSTINGPAGEBYTES = Page::SIZE - 2 * sizeof(PageId) - 2 * sizeof(int) -
+                             2 * sizeof(std::uint64_t);
+
+/**
+ * @brief Structure for the pages of a posting list. The record ids of a list
+ * are kept sorted, packed as page_number << 16 | slot_number, and stored as
+ * varints of the difference to the id before them on the page; the first one
+ * is stored whole. A list is a chain of pages linked by nextPageNo, and the
+ * first page, which its leaf entry points to, never changes while the list
+ * exists.
+ */
+struct PostingPage {
+  /**
+   * Next page of the list, or 0 on the last one.
+   */
+  PageId nextPageNo;
+
+  /**
+   * Last page of the list. Only kept up to date on the first page, so that
+   * appends do not walk the chain.
+   */
+  PageId lastPageNo;
+
+  /**
+   * Number of record ids on this page.
+   */
+  int count;
+
+  /**
+   * Number of bytes of data in use.
+   */
+  int numBytes;
+
+  /**
+   * Packed first and last record id on this page.
+   */
+  std::uint64_t firstId;
+  std::uint64_t lastId;
+
+  /**
+   * The varints of the record ids.
+   */
+  unsigned char data[POSTINGPAGEBYTES];
+};
+
+static_assert(sizeof(PostingPage) <= Page::SIZE,
+              "posting list pages must fit in a page");
+
+/**
+ * @brief keyNum of a compressed leaf, which no LeafNode has.
+ */
+const int COMPRESSEDLEAF = -1;
+
+/**
+ * @brief Number of bytes of packed entries in a compressed leaf.
+ */
+//                                       numEntries, keyBase, pageBase
+//                                       keyBits, pageBits, slotBits, unused
+const int COMPRESSEDLEAFBYTES = offsetof(LeafNodeInt, rightSibPageNo) -
+                                2 * sizeof(int) - sizeof(PageId) - 4;
+
+/**
+ * @brief Largest number of entries in a compressed leaf. An entry takes at
+ * most 32 + 32 + 16 bits, so both halves of a split of one more entry than
+ * this fit, whatever bit widths their entries need.
+ */
+const int COMPRESSEDLEAFSIZE = 2 * (COMPRESSEDLEAFBYTES / 10) - 1;
+
+/**
+ * @brief Structure for the compressed leaf nodes of an INTEGER index. Entry i
+ * is packed at bit i * (keyBits + pageBits + slotBits) of data as its key
+ * less keyBase, the page number of its record id less pageBase and the slot
+ * number, in the fewest bits that hold them for every entry of the leaf. The
+ * sibling pointer and keyNum are where a LeafNodeInt keeps them, and keyNum
+ * is COMPRESSEDLEAF, which tells the two kinds of leaves apart. Compressed
+ * leaves hold no posting lists.
+ */
+struct CompressedLeafInt {
+  /**
+   * Number of entries in this node.
+   */
+  int numEntries;
+
+  /**
+   * Key the packed keys are offsets from, modulo 2^32: the first key when the
+   * leaf was last packed.
+   */
+  int keyBase;
+
+  /**
+   * Smallest page number of the record ids.
+   */
+  PageId pageBase;
+
+  /**
+   * Bits of the fields of an entry.
+   */
+  unsigned char keyBits;
+  unsigned char pageBits;
+  unsigned char slotBits;
+  unsigned char unused;
+
+  /**
+   * The packed entries.
+   */
+  unsigned char data[COMPRESSEDLEAFBYTES];
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+  PageId rightSibPageNo;
+
+  /**
+   * Always COMPRESSEDLEAF.
+   */
+  int keyNum;
+};
+
+static_assert(sizeof(CompressedLeafInt) == sizeof(LeafNodeInt) &&
+                  offsetof(CompressedLeafInt, rightSibPageNo) ==
+                      offsetof(LeafNodeInt, rightSibPageNo) &&
+                  offsetof(CompressedLeafInt, keyNum) ==
+                      offsetof(LeafNodeInt, keyNum),
+              "compressed leaves must keep keyNum where a LeafNodeInt does");
+
+/**
+ * @brief Where a covering index keeps the payloads in its leaves. A leaf holds
+ * up to capacity entries, fewer than KeyTraits<T>::LEAFSIZE, so the key and
+ * record id slots after the first capacity ones are free. The first keyPart
+ * bytes of the payload of entry i are at i * keyPart after the key slots in
+ * use and the other ridPart bytes at i * ridPart after the record id slots in
+ * use, so payloads move with two memmove()s like keys and record ids do.
+ */
+struct LeafPayloadLayout {
+  int capacity;
+  int keyPart;
+  int ridPart;
+};
+
+/**
+ * @brief Where the non-leaf nodes of a counted tree keep the number of leaf
+ * entries under each of their children. A node holds up to capacity keys,
+ * fewer than KeyTraits<T>::NONLEAFSIZE, and the count of child i, 32 bits, is
+ * split like a covering payload: its first keyPart bytes are at i * keyPart
+ * after the key slots in use and the other pageNoPart bytes at i * pageNoPart
+ * after the page number slots in use.
+ */
+struct NonLeafCountLayout {
+  int capacity;
+  int keyPart;
+  int pageNoPart;
+};
+
+/**
+ * @brief The top levels of the non-leaf nodes of a BTreeIndex, decoded into
+ * arrays, see BTreeOptions::cachedLevels. Node 0 is the root, and the nodes
+ * of every level follow those of the level above in key order. The keys of
+ * node n are keys[keyStart[n]] up to keys[keyStart[n + 1]] and its children
+ * start at children[keyStart[n] + n]. A child is the number of a node of the
+ * next level, or a page number on the lowest cached level.
+ */
+template <class T>
+struct InnerNodeCache {
+  std::vector<T> keys;
+  std::vector<std::uint32_t> keyStart;
+  std::vector<std::uint32_t> children;
+
+  /**
+   * Levels cached, and whether the children of the lowest one are leaves.
+   */
+  int levels = 0;
+  bool leafChildren = false;
+};
+
+/**
+ * @brief Inserts into a BTreeIndex that are not in its leaves yet, see
+ * BTreeOptions::insertBufferEntries. The entries are spread over SHARDS
+ * shards by the hash of their key, each with its own latch, so inserts and
+ * deletes of different keys seldom wait for each other. A shard keeps its
+ * entries by key, those of one key in the order they were inserted, each with
+ * its record id and its payload, empty for none.
+ */
+template <class T>
+struct InsertBuffer {
+  static const int SHARDS = 16;
+
+  struct Shard {
+    std::mutex latch;
+    std::multimap<T, std::pair<RecordId, std::vector<unsigned char> > >
+        entries;
+  };
+
+  Shard shards[SHARDS];
+
+  /**
+   * Entries in all of the shards.
+   */
+  std::atomic<std::size_t> numEntries{0};
+
+  /**
+   * The shard that holds the entries with the key.
+   */
+  Shard &shardOf(const T &key) { return shards[key_hash(key) % SHARDS]; }
+};
+
+/**
+ * @brief Settings for a BTreeIndex that are not part of the index itself and
+ * so are not stored in its meta page.
+ */
+struct BTreeOptions {
+  /**
+   * Mode the index file, and the relation while the index is built from it,
+   * are read and written with.  IO_DIRECT keeps their pages out of the
+   * operating system page cache, so they are only cached in the BufMgr.
+   */
+  FileIOMode ioMode = IO_BUFFERED;
+
+  /**
+   * Build a new index bottom-up from the sorted entries of the relation
+   * instead of inserting the entries one at a time.
+   */
+  bool bulkLoad = false;
+
+  /**
+   * Fraction of the slots of every node that a bulk load fills, in (0, 1].
+   * The free slots let later inserts go in without splitting.
+   */
+  double fillFactor = 1.0;
+
+  /**
+   * Bytes of entries that a bulk load sorts in memory. Larger relations are
+   * sorted with an ExternalSort in runs of this size, which are spilled to
+   * temporary files and merged.
+   */
+  std::size_t sortMemory = 64 << 20;
+
+  /**
+   * Move the entries of a key to a posting list once POSTINGLISTMIN of them
+   * are in one leaf. A list is kept in the leaf, with one copy of its key,
+   * until it outgrows it and moves to posting pages. Posting lists shrink an
+   * index on a column with many duplicates, so they are off unless asked for.
+   * An index reads posting lists whatever this is set to.
+   */
+  bool postingLists = false;
+
+  /**
+   * Give a new INTEGER index compressed leaves, see CompressedLeafInt, which
+   * hold up to COMPRESSEDLEAFSIZE entries instead of INTARRAYLEAFSIZE. Leaves
+   * split from compressed ones are compressed too, and an index reads either
+   * kind whatever this is set to.
+   */
+  bool compressLeaves = false;
+
+  /**
+   * Make a new index a counted tree, whose non-leaf nodes hold fewer keys and
+   * the number of entries under each child, so that countRange(), rank() and
+   * select() read one node per level. Inserts then always descend from the
+   * root, and posting lists are not used. An index file keeps the kind it was
+   * created as, which is stored in its meta page.
+   */
+  bool countedTree = false;
+
+  /**
+   * Threads a bulk load scans the relation, sorts its entries and writes the
+   * nodes with, 0 for one per core. The relation is scanned in as many ranges
+   * of pages at once, and its entries are split by key, at keys sampled from
+   * it, over as many sorts that share sortMemory, each of which writes the
+   * leaves of its keys. A build with any other number than 1 is a bulk load.
+   */
+  int buildThreads = 1;
+
+  /**
+   * Give a new index a Bloom filter of its keys with about this rate of
+   * false positives, 0 for none. lookup(), lookupAll() and multiGet() skip
+   * the descent for a key that the filter rules out. An index file keeps
+   * whether it has a filter, which is stored in its meta page.
+   */
+  double bloomFalsePositiveRate = 0;
+
+  /**
+   * Levels of non-leaf nodes, from the root down, that the index keeps
+   * decoded in memory, 0 for none. A descent searches them without reading
+   * their pages from the BufMgr, so scans cannot evict them. A change to a
+   * cached node drops the cache and the next descent builds it again. Every
+   * leaf split changes a node just above the leaves, so an index with many
+   * inserts should cache fewer levels than it has non-leaf levels.
+   */
+  int cachedLevels = 0;
+
+  /**
+   * Entries that inserts may keep in memory before they go into the leaves,
+   * 0 for none. Once the buffer is full its entries are inserted in key order,
+   * so each leaf is read and written once for all of its new entries instead
+   * of once for each. lookup(), lookupAll(), multiGet(), scans, countRange(),
+   * rank(), select() and numEntries() also search the buffer, where the
+   * entries of a key come after those in the leaves, and stats() counts its
+   * entries. Closing the index empties it. An index built by inserts from the
+   * relation goes through the buffer too.
+   */
+  std::size_t insertBufferEntries = 0;
+};
+
+/**
+ * @brief Statistics of the shape of an index, see BTreeIndex::stats().
+ */
+struct IndexStats {
+  /**
+   * Levels of the tree, 1 while the root is a leaf.
+   */
+  int height;
+
+  /**
+   * Pages of leaves, of non-leaf nodes and of posting lists.
+   */
+  std::int64_t leafPages;
+  std::int64_t nonLeafPages;
+  std::int64_t postingPages;
+
+  /**
+   * Entries of the index, one for every record id, counting those still in
+   * the insert buffer.
+   */
+  std::int64_t numEntries;
+
+  /**
+   * Average fraction of the entries of a leaf, and of the keys of a non-leaf
+   * node, that are in use.
+   */
+  double leafFill;
+  double nonLeafFill;
+
+  /**
+   * Distinct keys, counted by the last bulk load or analyze() and scaled by
+   * the entries added or removed since.
+   */
+  std::int64_t distinctKeys;
+
+  /**
+   * Fraction of the links between leaves that go to the page numbered one
+   * after, 1 if there is a single leaf. A scan over contiguous leaves reads
+   * the index file in order.
+   */
+  double leafContiguity;
+};
+
+class BTreeIndex;
+class ExternalSort;
+
+/**
+ * @brief Latches of the pages of an index, one per page number. A latch is
+ * created the first time its page is latched. Page numbers index a fixed
+ * directory of chunks of latches, so finding a latch never takes a lock.
+ * Pages past the capacity share the latch of a page below it.
+ */
+class PageLatchTable {
+ public:
+  PageLatchTable();
+  ~PageLatchTable();
+
+  /**
+   * Latch of the page, created if needed.
+   */
+  std::shared_mutex &latch(const PageId pageNo);
+
+ private:
+  static const std::size_t CHUNKSIZE = 4096;
+  static const std::size_t NUMCHUNKS = 4096;
+  std::atomic<std::shared_mutex *> chunks[NUMCHUNKS];
+};
+
+/**
+ * @brief A range scan of a BTreeIndex. Any number of cursors may be open on
+ * one index at once, each used by one thread at a time.
+ *
+ * The entries of each leaf that match are copied out of it, so a cursor
+ * keeps no page pinned or latched between calls, and entries inserted into a
+ * leaf after it was copied are not returned. The entries of the insert
+ * buffer are merged in by key as each leaf is copied, so a scan does not
+ * flush it. A cursor must be destroyed before its index.
+ */
+class IndexScanCursor {
+  friend class BTreeIndex;
+
+ public:
+  /**
+   * Begin a filtered scan of the index.  For instance, if the cursor is
+   * created with ("a",GT,"d",LTE) then it returns all entries with a value
+   * greater than "a" and less than or equal to "d".
+   * @param index   Index to scan
+   * @param lowVal	Low value of range, pointer to integer / double / char
+   *string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char
+   *string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   */
+  IndexScanCursor(BTreeIndex *index, const void *lowVal, const Operator lowOp,
+                  const void *highVal, const Operator highOp);
+
+  /**
+   * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   */
+  void scanNext(RecordId &outRid);
+
+  /**
+   * Fetch the record ids of the next index entries that match the scan, as
+   * many as there are up to max. Whole runs of entries are copied at once.
+   * @param out   Array of at least max record ids the entries are copied to
+   * @param max   Maximum number of entries to return
+   * @return number of entries copied, less than max only at the end of the
+   * scan, and 0 once all entries were returned
+   */
+  std::size_t scanNextBatch(RecordId *out, const std::size_t max);
+
+  /**
+   * Like scanNext(), and copies the payload of the entry of a covering index
+   * from its leaf, so that an index-only query need not read the record.
+   * @param outPayload  Set to the BTreeIndex::getPayloadLength() bytes of the
+   * payload
+   */
+  void scanNext(RecordId &outRid, void *outPayload);
+
+  /**
+   * Like scanNextBatch(), and copies the payloads of the entries of a
+   * covering index.
+   * @param outPayloads Array of at least max payloads, each
+   * BTreeIndex::getPayloadLength() bytes, the payloads are copied to
+   */
+  std::size_t scanNextBatch(RecordId *out, void *outPayloads,
+                            const std::size_t max);
+
+ private:
+  /**
+   * Refills scanBuffer from the next leaf.
+   * @return false if the scan has no more leaves
+   */
+  bool nextLeaf();
+
+  /**
+   * Index being scanned.
+   */
+  BTreeIndex *index;
+
+  /**
+   * Record ids of the entries of the current leaf that are in the range of
+   * the scan, and of the buffered ones merged in. They are copied out of the
+   * leaf so that no page stays pinned or latched between calls. Posting lists
+   * are read out whole, so the buffer grows with the longest list in the
+   * leaf.
+   */
+  std::vector<RecordId> scanBuffer;
+
+  /**
+   * Payloads of the entries of scanBuffer, one after another, if the index is
+   * a covering one.
+   */
+  std::vector<unsigned char> payloadBuffer;
+
+  /**
+   * Index of next entry to be scanned in scanBuffer.
+   */
+  std::size_t nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+  PageId currentPageNum;
+
+  /**
+   * Right sibling of the current page when it was read.
+   */
+  PageId nextLeafNum;
+
+  /**
+   * True if scanBuffer holds the last entries of the scan.
+   */
+  bool scanAtEnd;
+
+  /**
+   * structureVersion when the current page was read. If it changed, the right
+   * sibling may have been freed and the scan finds its place from the root.
+   */
+  std::uint64_t scanVersion;
+
+  /**
+   * Number of record ids copied so far whose key is the low value, counting
+   * those of posting lists. Once an entry was copied, the low value is the
+   * key of the last one.
+   */
+  std::size_t lastKeyCount;
+
+  /**
+   * Number of record ids with the low value that the scan still skips after
+   * finding its place from the root.
+   */
+  std::size_t scanSkip;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+  int lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+  double lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+  StringKey lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+  int highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+  double highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+  StringKey highValString;
+
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+  Operator lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+  Operator highOp;
+
+  /**
+   * Low and high value of the scan for keys of type T.
+   */
+  int &scanLowVal(const int *) { return lowValInt; }
+  double &scanLowVal(const double *) { return lowValDouble; }
+  StringKey &scanLowVal(const StringKey *) { return lowValString; }
+  int &scanHighVal(const int *) { return highValInt; }
+  double &scanHighVal(const double *) { return highValDouble; }
+  StringKey &scanHighVal(const StringKey *) { return highValString; }
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
+ * of a relation. startScan() runs one scan at a time; an IndexScanCursor
+ * runs any number of them.
+ * Header and non-leaf pages are read with ACCESS_INDEX_INNER and leaf pages
+ * with ACCESS_INDEX_LEAF, so BufMgr::routeAccess() can keep them in their own
+ * buffer pools.
+ *
+ * insertEntry(), deleteEntry() and lookup() may be called from many threads
+ * at once, and the scan may run in one of them. The shape of the tree is
+ * guarded by treeLatch: inserts take it shared and latch only the leaf they
+ * go into, and take it exclusive to split a full leaf. Deletes always take it
+ * exclusive. Readers take it shared and latch each leaf shared while they
+ * read it. An index with an insert buffer adds its entries to it with
+ * insertBufferLatch shared and only the latch of one shard, and takes
+ * insertBufferLatch exclusive to flush it.
+ */
+class BTreeIndex {
+  friend class IndexScanCursor;
+
+ private:
+  /**
+   * File object for the index file.
+   */
+  File *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+  PageId rootPageNum;
+
+  /**
+   * page number of initial root page of B+ tree inside index file.
+   * if rootPageNum == initialRootPageNum, it's a leaf node
+   * else it's non leaf node
+   */
+  PageId initialRootPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  // MEMBERS SPECIFIC TO BLOOM FILTERS
+
+  /**
+   * Rate of false positives of the Bloom filter, 0 if the index has none.
+   */
+  double bloomRate;
+
+  /**
+   * The filter of the keys of all entries, kept in memory while the index is
+   * open. It is sized for twice the entries when it is built, and built again
+   * twice as large once they outgrow it. It is saved when the index is closed,
+   * and its file is removed once it is loaded, so an index that is not closed
+   * leaves no filter that misses its later keys.
+   */
+  BloomFilter bloom;
+
+  /**
+   * Version of the Bloom filter last saved, see IndexMetaInfo::bloomVersion.
+   */
+  std::uint64_t bloomVersion;
+
+  /**
+   * Whether the Bloom filter rules out every entry with the key. The caller
+   * holds treeLatch.
+   */
+  template <class T>
+  bool bloomExcludes(const T &key);
+
+  /**
+   * Builds the Bloom filter from the keys in the leaves.
+   */
+  template <class T>
+  void rebuildBloom();
+
+  /**
+   * Writes the Bloom filter to a new file named bloomFileName(), after a page
+   * holding the next bloomVersion.
+   */
+  void saveBloom();
+
+  /**
+   * Reads the Bloom filter of the given shape from the file named
+   * bloomFileName() if its version is bloomVersion, and removes the file.
+   *
+   * @return whether the filter was read
+   */
+  bool loadBloom(const std::uint64_t capacity, const std::uint32_t numBlocks,
+                 const int numHashes);
+
+  /**
+   * Leftmost leaf of the tree.
+   */
+  template <class T>
+  PageId firstLeafPage();
+
+  // MEMBERS SPECIFIC TO STATISTICS, see IndexCounters
+
+  std::atomic<std::int64_t> height;
+  std::atomic<std::int64_t> leafPages;
+  std::atomic<std::int64_t> nonLeafPages;
+  std::atomic<std::int64_t> postingPages;
+  std::atomic<std::int64_t> entryCount;
+  std::atomic<std::int64_t> leafOccupancy;
+  std::atomic<std::int64_t> nodeOccupancy;
+  std::int64_t leafCapacity;
+  std::atomic<std::int64_t> contiguousLinks;
+  std::atomic<std::int64_t> analyzedEntries;
+  std::atomic<std::int64_t> analyzedDistinct;
+
+  /**
+   * Counter of the pages of the kind of node, NULL for the meta page.
+   */
+  std::atomic<std::int64_t> *pageCounter(const IndexMetaInfo *) {
+    return NULL;
+  }
+  template <class T>
+  std::atomic<std::int64_t> *pageCounter(const NonLeafNode<T> *) {
+    return &nonLeafPages;
+  }
+  template <class T>
+  std::atomic<std::int64_t> *pageCounter(const LeafNode<T> *) {
+    return &leafPages;
+  }
+  std::atomic<std::int64_t> *pageCounter(const CompressedLeafInt *) {
+    return &leafPages;
+  }
+  std::atomic<std::int64_t> *pageCounter(const PostingPage *) {
+    return &postingPages;
+  }
+
+  /**
+   * Counts the change of the right sibling of the leaf pageNo from oldSibling
+   * to newSibling in contiguousLinks, 0 being no sibling.
+   */
+  void relinkLeaf(const PageId pageNo, const PageId oldSibling,
+                  const PageId newSibling);
+
+  /**
+   * Copies the counters to or from those of the meta page.
+   */
+  void saveCounters(IndexCounters &counters);
+  void loadCounters(const IndexCounters &counters);
+
+  /**
+   * Counts the shape of the tree, see analyze().
+   */
+  template <class T>
+  void analyzeTree();
+
+  // MEMBERS SPECIFIC TO CONCURRENCY
+
+  /**
+   * Shared while the non-leaf nodes and the root are only read, exclusive
+   * while they change.
+   */
+  std::shared_mutex treeLatch;
+
+  /**
+   * Latches of the leaves, shared while a leaf is read and exclusive while an
+   * entry goes into it under a shared treeLatch.
+   */
+  PageLatchTable leafLatches;
+
+  /**
+   * Incremented under the exclusive treeLatch by every delete, which may free
+   * leaf pages.
+   */
+  std::uint64_t structureVersion;
+
+  // MEMBERS SPECIFIC TO APPENDS
+
+  /**
+   * The last leaf, or 0 if it has to be found again. Keys at or after the
+   * fence, the last separator on the path to it, go into it, so an insert of
+   * such a key skips the descent from the root. If the root is a leaf there is
+   * no fence. Changed only under the exclusive treeLatch: set after a split,
+   * and cleared by deletes that rebalance nodes, which may move the fence.
+   */
+  PageId rightmostLeafNum;
+  bool rightmostBounded;
+  int rightmostFenceInt;
+  double rightmostFenceDouble;
+  StringKey rightmostFenceString;
+
+  int &rightmostFence(const int *) { return rightmostFenceInt; }
+  double &rightmostFence(const double *) { return rightmostFenceDouble; }
+  StringKey &rightmostFence(const StringKey *) { return rightmostFenceString; }
+
+  /**
+   * Sets rightmostLeafNum and its fence by following the last child of every
+   * non-leaf node from the root.
+   */
+  void cacheRightmostLeaf();
+
+  template <class T>
+  void findRightmostLeaf();
+
+  // MEMBERS SPECIFIC TO THE INNER NODE CACHE
+
+  /**
+   * Levels of non-leaf nodes the cache holds at most, 0 for no cache.
+   */
+  int cachedLevels;
+
+  /**
+   * Whether the cache matches the tree. Cleared under the exclusive
+   * treeLatch when a cached node changes. The next descent builds the cache
+   * again under a shared treeLatch, holding innerCacheMutex.
+   */
+  std::atomic<bool> innerCacheValid;
+  std::mutex innerCacheMutex;
+  InnerNodeCache<int> innerCacheInt;
+  InnerNodeCache<double> innerCacheDouble;
+  InnerNodeCache<StringKey> innerCacheString;
+
+  InnerNodeCache<int> &innerCache(const int *) { return innerCacheInt; }
+  InnerNodeCache<double> &innerCache(const double *) {
+    return innerCacheDouble;
+  }
+  InnerNodeCache<StringKey> &innerCache(const StringKey *) {
+    return innerCacheString;
+  }
+
+  /**
+   * The cache, built first if it is not valid. Called under a shared
+   * treeLatch.
+   */
+  template <class T>
+  const InnerNodeCache<T> &loadInnerCache();
+
+  /**
+   * Drops the cache if it may hold the non-leaf node, which changed, or, for
+   * a null node, whatever changed.
+   */
+  template <class T>
+  void innerNodeChanged(const NonLeafNode<T> *node);
+
+  // MEMBERS SPECIFIC TO INSERT BUFFERING
+
+  /**
+   * Entries the buffer holds before it is flushed, 0 for no buffer.
+   */
+  std::size_t insertBufferEntries;
+
+  /**
+   * Held shared while entries are added to or removed from the buffer, each
+   * under the latch of its shard, or the buffer is searched along with the
+   * tree, and exclusive while it is flushed. It is taken before treeLatch.
+   */
+  std::shared_mutex insertBufferLatch;
+  InsertBuffer<int> insertBufferInt;
+  InsertBuffer<double> insertBufferDouble;
+  InsertBuffer<StringKey> insertBufferString;
+
+  InsertBuffer<int> &insertBuffer(const int *) { return insertBufferInt; }
+  InsertBuffer<double> &insertBuffer(const double *) {
+    return insertBufferDouble;
+  }
+  InsertBuffer<StringKey> &insertBuffer(const StringKey *) {
+    return insertBufferString;
+  }
+
+  /**
+   * Adds the entry to the buffer and flushes it once it is full. Takes
+   * insertBufferLatch.
+   */
+  template <class T>
+  void bufferKey(const T &key, const RecordId rid,
+                 const unsigned char *payload);
+
+  /**
+   * Removes the entry and its payload from the buffer. Called with
+   * insertBufferLatch held.
+   * @return whether the buffer held it
+   */
+  template <class T>
+  bool unbufferKey(const T &key, const RecordId rid);
+
+  /**
+   * Inserts the entries of all shards of the buffer into the tree in key
+   * order and empties it. Called with insertBufferLatch held exclusive.
+   */
+  template <class T>
+  void flushInsertBuffer();
+
+  // MEMBERS SPECIFIC TO COVERING INDEXES
+
+  /**
+   * Payload columns copied into the leaves with every key, none if the index
+   * is not a covering one, and the bytes of a payload.
+   */
+  std::vector<PayloadColumn> payloadColumns;
+  int payloadLength;
+
+  /**
+   * Capacity of the leaves and where their payloads are. Leaves of other
+   * indexes have KeyTraits<T>::LEAFSIZE entries and no payloads.
+   */
+  LeafPayloadLayout payloadLayout;
+
+  /**
+   * Copies the payload columns of a record into payload, one after another.
+   */
+  void copyPayload(const char *record, unsigned char *payload) const;
+
+  // MEMBERS SPECIFIC TO COUNTED TREES
 
-/**
- * @brief The meta page, which holds metadata for Index file, is always first
- * page of the btree index file and is cast to the following structure to store
- * or retrieve information from it. Contains the relation name for which the
- * index is created, the byte offset of the key value on which the index is
- * made, the type of the key and the page no of the root page. Root page starts
- * as page 2 but since a split can occur at the root the root page may get moved
- * up and get a new page no.
- */
-struct IndexMetaInfo {
   /**
-   * Name of base relation.
+   * Whether the index is a counted tree, and the capacity of the non-leaf
+   * nodes and where their counts are. Non-leaf nodes of other indexes have
+   * KeyTraits<T>::NONLEAFSIZE keys and no counts.
    */
-  char relationName[20];
+  bool countedTree;
+  NonLeafCountLayout countLayout;
 
   /**
-   * Offset of attribute, over which index is built, inside the record stored in
-   * pages.
+   * Number of leaf entries under a node, which is a leaf if isLeaf.
    */
-  int attrByteOffset;
+  template <class T>
+  std::uint32_t nodeCount(const PageId pageNo, const bool isLeaf);
 
   /**
-   * Type of the attribute over which index is built.
+   * Number of entries whose key is less than key, or less than or equal to
+   * it if orEqual. Must be called with treeLatch held.
    */
-  Datatype attrType;
+  template <class T>
+  std::size_t rankKey(const T &key, const bool orEqual);
+
+  template <class T>
+  std::size_t countRangeKeys(const T &lowVal, const Operator lowOp,
+                             const T &highVal, const Operator highOp);
 
   /**
-   * Page number of root page of the B+ Tree inside the file index file.
+   * Entry k of the tree alone, see select(). Must be called with treeLatch
+   * held.
    */
-  PageId rootPageNo;
+  template <class T>
+  std::optional<RecordId> selectKey(std::size_t k, void *outKey);
 
   /**
-   * page number of initial root page of B+ tree inside index file.
-   * if rootPageNum == initialRootPageNum, it's a leaf node
-   * else it's non leaf node
+   * rankKey() and selectKey() counting the entries of the insert buffer
+   * too, which come after those of the tree with the same key. Must be
+   * called with insertBufferLatch and treeLatch held.
    */
-  PageId initialRootPageNum;
-};
+  template <class T>
+  std::size_t rankWithBuffer(const T &key);
+  template <class T>
+  std::optional<RecordId> selectWithBuffer(const std::size_t k, void *outKey);
 
-/*
-Each node is a page, so once we read the page in we just cast the pointer to the
-page to this struct and use it to access the parts These structures basically
-are the format in which the information is stored in the pages for the index
-file depending on what kind of node they are. The level memeber of each non leaf
-structure seen below is set to 1 if the nodes at this level are just above the
-leaf nodes. Otherwise set to 0.
-*/
+  // MEMBERS SPECIFIC TO POSTING LISTS
 
-/**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
- */
-struct NonLeafNodeInt {
   /**
-   * Level of the node in the tree.
+   * Whether inserts move the entries of a key to a posting list, see
+   * BTreeOptions::postingLists.
    */
-  int level;
+  bool postingLists;
 
   /**
-   * Stores keys.
+   * Whether leaves may hold inline posting lists, see
+   * IndexMetaInfo::leafPostings. Only then is the room they take counted.
    */
-  int keyArray[INTARRAYNONLEAFSIZE];
+  bool leafPostings;
 
   /**
-   * Stores page numbers of child pages which themselves are other non-leaf/leaf
-   * nodes in the tree.
+   * Whether a leaf entry stands for a posting list, on posting pages or
+   * inline.
    */
-  PageId pageNoArray[INTARRAYNONLEAFSIZE + 1];
+  static bool isPostingList(const RecordId &rid) {
+    return rid.slot_number == POSTINGLISTSLOT;
+  }
 
   /**
-   * Number of keys in this node
+   * Writes sorted packed record ids to the pages of a new posting list.
+   * @return the first page of the list
    */
-  int keyNum = 0;
-};
+  PageId createPostingList(const std::vector<std::uint64_t> &ids);
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
- */
-struct LeafNodeInt {
   /**
-   * Stores keys.
+   * Adds a record id to the posting list that starts at headPageNo. An id
+   * after the last one is appended to the last page, others are inserted into
+   * the page that holds their place, which is split if it is full.
    */
-  int keyArray[INTARRAYLEAFSIZE];
+  void addToPostingList(const PageId headPageNo, const RecordId rid);
 
   /**
-   * Stores RecordIds.
+   * Removes a record id from a posting list. A page left empty is given back
+   * to the index file, the first one only with the whole list.
+   * @param empty set to whether the list was left empty and freed
+   * @return whether the list held the record id
    */
-  RecordId ridArray[INTARRAYLEAFSIZE];
+  bool removeFromPostingList(const PageId headPageNo, const RecordId rid,
+                             bool &empty);
 
   /**
-   * Page number of the leaf on the right side.
-   * This linking of leaves allows to easily move from one leaf to the next leaf
-   * during index scan.
+   * Gives all pages of a posting list back to the index file.
    */
-  PageId rightSibPageNo;
+  void freePostingList(PageId headPageNo);
 
   /**
-   * Number of keys in this node
+   * Appends the record ids of a posting list to out, in order.
    */
-  int keyNum = 0;
-};
+  void readPostingList(const PageId headPageNo, std::vector<RecordId> &out);
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
- * of a relation. This index supports only one scan at a time.
- */
-class BTreeIndex {
- private:
   /**
-   * File object for the index file.
+   * Slots of a leaf in use: its entries and those its inline posting lists
+   * take.
    */
-  File *file;
+  template <class T>
+  int leafSlots(const LeafNode<T> *leafNode);
 
   /**
-   * Buffer Manager Instance.
+   * Adds a record id to the inline posting list of entry i of a leaf. A list
+   * that grows too long for a leaf moves to posting pages.
+   * @return false, leaving the list as it was, if the leaf has no room for it
    */
-  BufMgr *bufMgr;
+  template <class T>
+  bool addToInlineList(LeafNode<T> *leafNode, const int i, const RecordId rid);
 
   /**
-   * Page number of meta page.
+   * Removes a record id from the inline posting list of entry i of a leaf.
+   * @param empty set to whether the list was left empty, and its bytes freed
+   * @return whether the list held the record id
    */
-  PageId headerPageNum;
+  template <class T>
+  bool removeFromInlineList(LeafNode<T> *leafNode, const int i,
+                            const RecordId rid, bool &empty);
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Returns the record id of entry i of a leaf, or the first one of the
+   * posting list it stands for.
    */
-  PageId rootPageNum;
+  template <class L>
+  RecordId firstRecordId(const L *leafNode, const int i);
 
   /**
-   * page number of initial root page of B+ tree inside index file.
-   * if rootPageNum == initialRootPageNum, it's a leaf node
-   * else it's non leaf node
+   * Appends the record ids of the leaf entries [from, to) to out, with the
+   * posting lists among them read out.
+   * @return number of record ids appended
    */
-  PageId initialRootPageNum;
+  template <class T>
+  std::size_t copyLeafEntries(const LeafNode<T> *leafNode, int from,
+                              const int to, std::vector<RecordId> &out);
 
   /**
-   * Datatype of attribute over which index is built.
+   * Adds <key, rid> to the posting list that ends the entries of key in the
+   * leaf, or moves them to a new posting list if the leaf holds
+   * POSTINGLISTMIN - 1 of them, inline if it fits. The leaf is latched
+   * exclusively, which also guards its posting lists.
+   * @param index where key would be inserted into the leaf
+   * @return whether rid was added, else it has to go into the leaf
    */
-  Datatype attributeType;
+  template <class T>
+  bool insertToPostingList(LeafNode<T> *leafNode, const int index,
+                           const T &key, const RecordId rid);
+
+  // MEMBERS SPECIFIC TO COMPRESSED LEAVES
 
   /**
-   * Offset of attribute, over which index is built, inside records.
+   * Inserts <key, rid> into a compressed leaf: in place, moving the packed
+   * entries after it, if it fits in the bit widths of the leaf, else the leaf
+   * is packed again with it.
+   * @return false, leaving the leaf as it was, if it has to be split
    */
-  int attrByteOffset;
+  bool insertToCompressedLeaf(CompressedLeafInt *leafNode, const int key,
+                              const RecordId rid);
+
+  /**
+   * Splits a compressed leaf with <key, rid> inserted into it like
+   * handleLeafInsertion() splits a LeafNode. The new leaf is compressed and
+   * stays pinned.
+   */
+  void splitCompressedLeaf(CompressedLeafInt *leafNode, const int key,
+                           const RecordId rid, PageId &newPageNo,
+                           int &newIndex);
+
+  /**
+   * Removes <key, rid> from a compressed leaf.
+   * @return whether the leaf held it
+   */
+  bool deleteFromCompressedLeaf(CompressedLeafInt *leafNode, const int key,
+                                const RecordId rid);
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Appends the record ids of the entries [from, to) of a compressed leaf to
+   * out.
+   * @return number of record ids appended
    */
-  int leafOccupancy;
+  std::size_t copyLeafEntries(const CompressedLeafInt *leafNode, int from,
+                              const int to, std::vector<RecordId> &out);
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Writes the leaves of a bulk load as compressed leaves, each packed with
+   * entries of the sorter until it is filled to the fill factor, and adds
+   * their first keys and page numbers to level and their numbers of entries
+   * to counts.
    */
-  int nodeOccupancy;
+  void packCompressedLeaves(ExternalSort &sorter, const std::size_t total,
+                            const BTreeOptions &options,
+                            std::vector<PageKeyPair<int> > &level,
+                            std::vector<std::uint32_t> &counts);
 
   // MEMBERS SPECIFIC TO SCANNING
 
   /**
-   * True if an index scan has been started.
+   * The scan started with startScan(), or NULL if there is none.
    */
-  bool scanExecuting;
+  IndexScanCursor *currentScan;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Helper function that returns the pageId of the leaf page that holds the
+   * first entry after key, or at key if op is GTE
+   * @param key   the key to search for
+   * @param op    GT or GTE
+   * @return PageId of the leaf
    */
-  int nextEntry;
+  template <class T>
+  const PageId getLeafPage(const T &key, const Operator op);
 
   /**
-   * Page number of current page being scanned.
+   * Helper function to get the first index according to the low value and
+   * lowOp of a scan
+   * @param scan the scan
+   * @param leafNode the leaf to search, a LeafNode<T> or CompressedLeafInt
+   * @return index
    */
-  PageId currentPageNum;
+  template <class T, class L>
+  const int getFirstIndex(IndexScanCursor &scan, const L *leafNode);
 
   /**
-   * Current Page being scanned.
+   * Copies the entries of a leaf that are in the range of a scan into its
+   * scanBuffer, with those of the insert buffer that come before the last
+   * key copied, or up to the high value if the scan ends in the leaf. Must be
+   * called with insertBufferLatch and treeLatch held.
+   *
+   * @param scan the scan
+   * @param leafPageNo the leaf to read
+   * @param fromLow whether to start at the low value, else at the first entry
    */
-  Page *currentPageData;
+  template <class T>
+  void readScanLeaf(IndexScanCursor &scan, const PageId leafPageNo,
+                    const bool fromLow);
 
   /**
-   * Low INTEGER value for scan.
+   * Refills the scanBuffer of a scan from its next leaf.
    */
-  int lowValInt;
+  template <class T>
+  void advanceScan(IndexScanCursor &scan);
+
 
   /**
-   * Low DOUBLE value for scan.
+   * The typed parts of the public methods. The public methods switch on
+   * attributeType once and call these, so that no comparison inside the tree
+   * has to look at the type again.
    */
-  double lowValDouble;
+  template <class T>
+  void buildIndex(const std::string &relationName,
+                  const BTreeOptions &options);
 
   /**
-   * Low STRING value for scan.
+   * Build the tree bottom-up from the sorted entries of the relation: packed
+   * leaves are written left to right, then every level of non-leaf nodes
+   * above them.
    */
-  std::string lowValString;
+  template <class T>
+  void bulkLoad(const std::string &relationName, const BTreeOptions &options);
 
   /**
-   * High INTEGER value for scan.
+   * Entries of a sample of the pages of the relation, of which a bulk load
+   * sends the entries less than splitters[0] to its first sort, the entries
+   * from splitters[i - 1] to before splitters[i] to sort i, and the others to
+   * the last one. Fewer than numParts - 1 if the relation is empty.
    */
-  int highValInt;
+  template <class T>
+  std::vector<RIDKeyPair<T> > sampleSplitters(const std::string &relationName,
+                                              const PageId numPages,
+                                              const int numParts,
+                                              const BTreeOptions &options);
 
   /**
-   * High DOUBLE value for scan.
+   * Writes the leaves of a bulk load with the total entries of the sorter,
+   * spread evenly over the fewest leaves that the fill factor allows, and
+   * adds their first keys and page numbers to level and their numbers of
+   * entries to counts.
    */
-  double highValDouble;
+  template <class T>
+  void packLeaves(ExternalSort &sorter, const std::size_t total,
+                  const BTreeOptions &options,
+                  std::vector<PageKeyPair<T> > &level,
+                  std::vector<std::uint32_t> &counts);
 
   /**
-   * High STRING value for scan.
+   * Writes nodes from to to - 1 of the parents.size() non-leaf nodes that a
+   * bulk load puts above the children of level, and sets their entries of
+   * parents and parentCounts.
+   * @return number of keys of the nodes
    */
-  std::string highValString;
+  template <class T>
+  int packNonLeaves(const std::vector<PageKeyPair<T> > &level,
+                    const std::vector<std::uint32_t> &counts,
+                    const bool levelOne, const std::size_t from,
+                    const std::size_t to,
+                    std::vector<PageKeyPair<T> > &parents,
+                    std::vector<std::uint32_t> &parentCounts);
 
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * Insert <key, rid>, with the payload of a covering index, which is NULL
+   * for a payload of zeros.
    */
-  Operator lowOp;
+  template <class T>
+  void insertKey(const T &key, const RecordId rid,
+                 const unsigned char *payload);
+
+  template <class T>
+  std::optional<RecordId> lookupKey(const T &key);
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Find the first entry with the given key, reading leafPageNo and the
+   * leaves to its right as long as they hold only smaller keys. The caller
+   * holds treeLatch.
    */
-  Operator highOp;
+  template <class T>
+  std::optional<RecordId> findInLeaves(PageId leafPageNo, const T &key);
+
+  template <class T>
+  std::size_t lookupAllKey(const T &key, std::vector<RecordId> &outRids);
 
   /**
-   * Helper function that returns the pageId of leaf page that contains the
-   * parameter key
-   * @param key   the key to search for
-   * @return PageId that contains the key
+   * Entries with the key in the leaves, without those in the insert buffer.
    */
-  const PageId getLeafPage(const int key);
+  template <class T>
+  std::size_t lookupLeafEntries(const T &key, std::vector<RecordId> &outRids);
+
+  template <class T>
+  void multiGetKeys(const void *const keys[], const std::size_t numKeys,
+                    std::optional<RecordId> outRids[]);
+
+  template <class T>
+  bool deleteKey(const T &key, const RecordId rid);
 
   /**
-   * Helper function to find the internal page with level one corresponding to
-   * the key
-   * @param key the key to search for
-   * @return the page with level one corresponding to the key
+   * Delete the entry <key,rid> from the subtree rooted at currPageNo.
+   *
+   * @param currPageNo page id of the root of the subtree
+   * @param key the key of the entry
+   * @param rid the record id of the entry
+   * @param isLeaf whether currPageNo is a leaf
+   * @param underflow set to whether the node holds less than half of its
+   * slots after the delete
+   * @return whether the entry was found
    */
-  const PageId getLevelOnePage(const PageId prev, const int key);
+  template <class T>
+  bool recursiveDelete(const PageId currPageNo, const T &key,
+                       const RecordId rid, const bool isLeaf, bool &underflow);
 
   /**
-   * Helper function to get the first index according to lowValInt and lowOp
-   * Assumptions of this function:
-   *    currentPageData is set
-   *    lowVal and lowOp is set
-   * @return index
+   * The child at index of parent has underflowed: borrow entries from a
+   * sibling of it or, if the two fit in one node, merge them and free the
+   * right one.
+   *
+   * @param parent non leaf node holding the child
+   * @param index index of the child in parent
+   */
+  template <class T>
+  void rebalanceLeaf(NonLeafNode<T> *parent, const int index);
+
+  template <class T>
+  void rebalanceNonLeaf(NonLeafNode<T> *parent, const int index);
+
+  /**
+   * Remove the key at index and the page number right of it from a non leaf
+   * node.
+   */
+  template <class T>
+  void removeFromNonLeaf(NonLeafNode<T> *node, const int index);
+
+  /**
+   * Store the root and initial root page numbers, and the counters of the
+   * shape of the tree, in the meta page.
    */
-  const int getFirstIndex();
+  void writeRootToMeta();
+
+  template <class T>
+  void startScanKeys(IndexScanCursor &scan, const T &lowVal, const T &highVal);
+
+  template <class T>
+  void printTreeRecurs(int level, PageId pageId, bool isleaf);
 
  public:
   /**
@@ -353,6 +1796,7 @@ class BTreeIndex {
    * be built, in the record
    * @param attrType						Datatype of attribute over which index is
    * built
+   * @param options             Settings that are not stored in the index
    * @throws  BadIndexInfoException     If the index file already exists for the
    * corresponding attribute, but values in metapage(relationName, attribute
    * byte offset, attribute type etc.) do not match with values received through
@@ -360,7 +1804,27 @@ class BTreeIndex {
    */
   BTreeIndex(const std::string &relationName, std::string &outIndexName,
              BufMgr *bufMgrIn, const int attrByteOffset,
-             const Datatype attrType);
+             const Datatype attrType,
+             const BTreeOptions &options = BTreeOptions());
+
+  /**
+   * BTreeIndex Constructor of a covering index, which also copies the given
+   * columns of every record into its leaf entry, so that a scan returns them
+   * with the record ids, see IndexScanCursor::scanNextBatch(). Its leaves
+   * hold fewer entries and no posting lists, and options.compressLeaves is
+   * ignored. The columns are stored in the meta page and must match when the
+   * index file is opened again.
+   *
+   * @param payloadColumns  Columns of the payload, at most MAXPAYLOADCOLUMNS
+   * of together at most MAXPAYLOADLENGTH bytes
+   * @throws  BadIndexInfoException If the index file exists with other
+   * metadata, or the payload is too large
+   */
+  BTreeIndex(const std::string &relationName, std::string &outIndexName,
+             BufMgr *bufMgrIn, const int attrByteOffset,
+             const Datatype attrType,
+             const std::vector<PayloadColumn> &payloadColumns,
+             const BTreeOptions &options = BTreeOptions());
 
   /**
    * BTreeIndex Destructor.
@@ -372,28 +1836,38 @@ class BTreeIndex {
   ~BTreeIndex();
 
   /**
-   * Allocate a NonLeafNodeInt or LeafNodeInt
+   * Allocate a NonLeafNode or LeafNode
    *
    * @param newPageId page id used to contain allocated page id
-   * @return newNode NonLeafNodeInt or LeafNodeInt
+   * @return newNode NonLeafNode or LeafNode
    */
-  template <class T>
-  T *allocNode(PageId &newPageId);
+  template <class N>
+  N *allocNode(PageId &newPageId);
+
+  /**
+   * Gives the page of a node of kind N back to the index file.
+   */
+  template <class N>
+  void disposeNode(const PageId pageNo);
 
   /**
    * @param  page given NonLeafNode
    * @return whether it is a non leaf node just above the leaf node
    */
-  bool isLevelOneNode(const NonLeafNodeInt *page);
+  template <class T>
+  bool isLevelOneNode(const NonLeafNode<T> *page);
 
   /**
-   * find where the given key should be inserted in to this non leaf node
+   * Find the child of this non leaf node that key belongs to: the first
+   * child whose separator is larger than key.
+   * For 1 3 5 7 and key = 3 return 2
    *
    * @param nonLeafNode
    * @param key
    * @return loc
    */
-  int findIndexInNonLeaf(const NonLeafNodeInt *nonLeafNode, const void *key);
+  template <class T>
+  int findIndexInNonLeaf(const NonLeafNode<T> *nonLeafNode, const T &key);
 
   /**
    * Given a key, find index of the first element that larger than it
@@ -404,7 +1878,8 @@ class BTreeIndex {
    * @param key
    * @return loc
    */
-  int findIndexInLeaf(const LeafNodeInt *LeafNode, const void *key);
+  template <class T>
+  int findIndexInLeaf(const LeafNode<T> *leafNode, const T &key);
 
   /**
    * recursive call until leaf nodes
@@ -418,10 +1893,13 @@ class BTreeIndex {
    * @param isLeaf whether this node is leaf
    * @param newIndex the page number of the newly created node if a split
    * occurs, or 0 otherwise.
+   * @param rightmost whether this node is the last one of its level
    */
-  void recursiveInsert(const PageId currPageNo, const void *key,
-                       const RecordId rid, PageId &newPageNo, int &newIndex,
-                       bool isLeaf);
+  template <class T>
+  void recursiveInsert(const PageId currPageNo, const T &key,
+                       const RecordId rid, const unsigned char *payload,
+                       PageId &newPageNo, T &newIndex, bool isLeaf,
+                       bool rightmost);
 
   /**
    * When we can make sure we want to insert a KV to a leaf node call it to
@@ -433,9 +1911,10 @@ class BTreeIndex {
    * @param newPageNo
    * @param newIndex
    */
-  void handleLeafInsertion(const PageId currPageNo, const void *key,
-                           const RecordId rid, PageId &newPageNo,
-                           int &newIndex);
+  template <class T>
+  void handleLeafInsertion(const PageId currPageNo, const T &key,
+                           const RecordId rid, const unsigned char *payload,
+                           PageId &newPageNo, T &newIndex);
 
   /**
    * Split a leaf node into 2 parts
@@ -444,7 +1923,8 @@ class BTreeIndex {
    * @param newNode
    * @param leftLen
    */
-  void splitLeaf(LeafNodeInt *node, LeafNodeInt *newNode, PageId newPageNo,
+  template <class T>
+  void splitLeaf(LeafNode<T> *node, LeafNode<T> *newNode, PageId newPageNo,
                  const int leftLen);
 
   /**
@@ -453,7 +1933,8 @@ class BTreeIndex {
    * @param newNode
    * @param leftLen
    */
-  void splitNonLeaf(NonLeafNodeInt *node, NonLeafNodeInt *newNode,
+  template <class T>
+  void splitNonLeaf(NonLeafNode<T> *node, NonLeafNode<T> *newNode,
                     const int leftLen);
 
   /**
@@ -464,7 +1945,8 @@ class BTreeIndex {
    * @param left   smaller one
    * @param right	 larger one
    */
-  void splitRoot(const int key, const PageId left, const PageId right);
+  template <class T>
+  void splitRoot(const T &key, const PageId left, const PageId right);
 
   /**
    * insert the given key and rid to the index in this leaf node
@@ -473,9 +1955,11 @@ class BTreeIndex {
    * @param index
    * @param key
    * @param rid
+   * @param payload payload of a covering index, or NULL for zeros
    */
-  void insertToLeaf(LeafNodeInt *leafNode, const int index, const void *key,
-                    const RecordId rid);
+  template <class T>
+  void insertToLeaf(LeafNode<T> *leafNode, const int index, const T &key,
+                    const RecordId rid, const unsigned char *payload);
 
   /**
    * Insert the given key and page number to the index in this non leaf node
@@ -483,9 +1967,12 @@ class BTreeIndex {
    * @param index
    * @param newIndex
    * @param newPageNo
+   * @param newCount entries under the new page, in a counted tree
    */
-  void insertToNonLeaf(NonLeafNodeInt *currNonLeafNode, const int index,
-                       const int newIndex, const PageId newPageNo);
+  template <class T>
+  void insertToNonLeaf(NonLeafNode<T> *currNonLeafNode, const int index,
+                       const T &newIndex, const PageId newPageNo,
+                       const std::uint32_t newCount);
 
   /**
    * Insert the given key and page number to the index in this newly splitted
@@ -494,16 +1981,20 @@ class BTreeIndex {
    * @param index
    * @param newIndex
    * @param newPageNo
+   * @param newCount entries under the new page, in a counted tree
    */
-  void insertToNewNonLeaf(NonLeafNodeInt *currNonLeafNode, const int index,
-                          const int newIndex, const PageId newPageNo);
+  template <class T>
+  void insertToNewNonLeaf(NonLeafNode<T> *currNonLeafNode, const int index,
+                          const T &newIndex, const PageId newPageNo,
+                          const std::uint32_t newCount);
 
   /**
    * delete the smallest key in non leaf node
    * @param currNonLeafNode
    * @return the smallest key(the parent needs)
    */
-  int deleteNewKeyNonLeaf(NonLeafNodeInt *currNonLeafNode);
+  template <class T>
+  T deleteNewKeyNonLeaf(NonLeafNode<T> *currNonLeafNode);
 
   /**
    * Insert a new entry using the pair <value,rid>.
@@ -520,14 +2011,134 @@ class BTreeIndex {
    **/
   const void insertEntry(const void *key, const RecordId rid);
 
+  /**
+   * Insert <key, rid> into a covering index with its payload. insertEntry()
+   * without one inserts a payload of zeros.
+   * @param payload	getPayloadLength() bytes, the payload columns of the
+   *record one after another
+   **/
+  const void insertEntry(const void *key, const RecordId rid,
+                         const void *payload);
+
+  /**
+   * Insert the entries held by the insert buffer into the leaves, see
+   * BTreeOptions::insertBufferEntries. Does nothing for an index without one.
+   **/
+  const void flushInserts();
+
+  /**
+   * Bytes of the payload of an entry, 0 if the index is not a covering one.
+   */
+  std::size_t getPayloadLength() const { return payloadLength; }
+
+  /**
+   * Delete the entry <key,rid>. A node left with less than half of its slots
+   * in use borrows entries from a sibling, or is merged with it, and the
+   * emptied page is given back to the index file. A root left with a single
+   * child is replaced by the child. A scan in progress goes on with the
+   * entries that are left.
+   * @param key			Key of the entry, pointer to integer/double/char
+   *string
+   * @param rid			Record ID of the entry
+   * @return whether the index held the entry
+   **/
+  const bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Find an entry with the given key. Unlike a scan, many threads may look up
+   * keys at once.
+   * @param key			Key to look for, pointer to integer/double/char
+   *string
+   * @return Record ID of the first entry with the key, if the index holds it
+   **/
+  const std::optional<RecordId> lookup(const void *key);
+
+  /**
+   * Find all entries with the given key.
+   * @param key			Key to look for, pointer to integer/double/char
+   *string
+   * @param outRids	Record IDs of the entries are appended to this, in index
+   *order
+   * @return number of entries found
+   **/
+  const std::size_t lookupAll(const void *key, std::vector<RecordId> &outRids);
+
+  /**
+   * Look up many keys at once, as lookup() does for each. The keys are probed
+   * in sorted order and neighboring keys share the path from the root: a probe
+   * only climbs back to the lowest non-leaf node whose range holds its key,
+   * and keys in the same leaf need no descent at all. The non-leaf nodes of
+   * the path stay pinned and treeLatch is held shared until all keys are done.
+   * @param keys		Array of numKeys keys, each a pointer to integer/double/char
+   *string
+   * @param numKeys	Number of keys
+   * @param outRids	Array of numKeys results: outRids[k] is the Record ID of the
+   *first entry with keys[k], if the index holds it
+   **/
+  const void multiGet(const void *const keys[], const std::size_t numKeys,
+                      std::optional<RecordId> outRids[]);
+
+  /**
+   * Count the entries in a range, as a scan of (lowVal, lowOp, highVal,
+   * highOp) would return them, reading one node per level of a counted tree.
+   * @throws  NotCountedTreeException If the index is not a counted tree.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   **/
+  const std::size_t countRange(const void *lowVal, const Operator lowOp,
+                               const void *highVal, const Operator highOp);
+
+  /**
+   * Number of entries whose key is less than the given one, which is the
+   * position in index order of the first entry with the key if there is one.
+   * @throws  NotCountedTreeException If the index is not a counted tree.
+   **/
+  const std::size_t rank(const void *key);
+
+  /**
+   * Find the entry at position k in index order, counting from 0, so that
+   * select(numEntries() / 2) is a median.
+   * @param outKey	Set to the key of the entry, an integer/double or
+   *STRINGSIZE chars
+   * @return Record ID of the entry, if the index holds more than k entries
+   * @throws  NotCountedTreeException If the index is not a counted tree.
+   **/
+  const std::optional<RecordId> select(const std::size_t k, void *outKey);
+
+  /**
+   * Number of entries of a counted tree.
+   * @throws  NotCountedTreeException If the index is not a counted tree.
+   **/
+  const std::size_t numEntries();
+
+  /**
+   * Statistics of the shape of the index, from counters that every change
+   * keeps up to date, so no page is read. The counters are stored in the meta
+   * page whenever the root changes and when the index is closed; an index
+   * file written before they were kept is analyzed when it is opened.
+   **/
+  const IndexStats stats();
+
+  /**
+   * Counts the shape of the index by reading every page of the tree, sets
+   * the counters to it and returns stats(). Blocks inserts and deletes while
+   * it runs.
+   **/
+  const IndexStats analyze();
+
+  /**
+   * Name of the file the Bloom filter of the index file indexName is saved
+   * to.
+   **/
+  static std::string bloomFileName(const std::string &indexName);
+
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called
    * using ("a",GT,"d",LTE) then we should seek all entries with a value
    * greater than "a" and less than or equal to "d".
    * If another scan is already executing, that needs to be ended here.
-   * Set up all the variables for scan. Start from root to find out the leaf
-   *page that contains the first RecordID that satisfies the scan parameters.
-   *Keep that page pinned in the buffer pool.
+   * The scan is an IndexScanCursor owned by the index, see there.
    * @param lowVal	Low value of range, pointer to integer / double / char
    *string
    * @param lowOp		Low operator (GT/GTE)
@@ -547,8 +2158,7 @@ class BTreeIndex {
    * Fetch the record id of the next index entry that matches the scan.
    * Return the next record from current page being scanned. If current page has
    *been scanned to its entirety, move on to the right sibling of current page,
-   *if any exists, to start scanning that page. Make sure to unpin any pages
-   *that are no longer required.
+   *if any exists, to start scanning that page.
    * @param outRid	RecordId of next record found that satisfies the scan
    *criteria returned in this
    * @throws ScanNotInitializedException If no scan has been initialized.
@@ -558,8 +2168,26 @@ class BTreeIndex {
   const void scanNext(RecordId &outRid);  // returned record id
 
   /**
-   * Terminate the current scan. Unpin any pinned pages. Reset scan specific
-   *variables.
+   * Fetch the record ids of the next index entries that match the scan, see
+   * IndexScanCursor::scanNextBatch().
+   * @param out   Array of at least max record ids the entries are copied to
+   * @param max   Maximum number of entries to return
+   * @return number of entries copied, 0 once all entries were returned
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  const std::size_t scanNextBatch(RecordId *out, const std::size_t max);
+
+  /**
+   * scanNext() and scanNextBatch() that also copy the payloads of a covering
+   * index, see IndexScanCursor.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  const void scanNext(RecordId &outRid, void *outPayload);
+  const std::size_t scanNextBatch(RecordId *out, void *outPayloads,
+                                  const std::size_t max);
+
+  /**
+   * Terminate the current scan. Reset scan specific variables.
    * @throws ScanNotInitializedException If no scan has been initialized.
    **/
   const void endScan();
@@ -569,15 +2197,11 @@ class BTreeIndex {
    */
   void printTree();
 
-  /**
-   * prints the structure of b+ tree level by level and recursively
-   */
-  void printTreeRecurs(int level, PageId, bool);
-
   /**
    * prints the structure of current b+ node
    */
-  void printNode(NonLeafNodeInt *node);
+  template <class T>
+  void printNode(NonLeafNode<T> *node);
 };
 
 }  // namespace badgerdb
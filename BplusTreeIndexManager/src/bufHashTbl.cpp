@@ -15,16 +15,16 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+int BufHashTbl::hash(const File* file, const PageId pageNo, const int size)
 {
   int tmp, value;
   tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+  value = (tmp + pageNo) % size;
   return value;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+	: HTSIZE(htSize), OLDHTSIZE(0), oldHt(NULL), rehashPos(0)
 {
   // allocate an array of pointers to hashBuckets
   ht = new hashBucket* [htSize];
@@ -43,11 +43,65 @@ BufHashTbl::~BufHashTbl()
     }
   }
   delete [] ht;
+
+  for(int i = rehashPos; oldHt && i < OLDHTSIZE; i++) {
+    while (oldHt[i]) {
+      hashBucket* tmpBuf = oldHt[i];
+      oldHt[i] = oldHt[i]->next;
+      delete tmpBuf;
+    }
+  }
+  delete [] oldHt;
+}
+
+void BufHashTbl::rehashStep()
+{
+  if (!oldHt)
+    return;
+
+  for (int moved = 0; moved < REHASH_STEP && rehashPos < OLDHTSIZE; moved++, rehashPos++) {
+    while (oldHt[rehashPos]) {
+      hashBucket* tmpBuc = oldHt[rehashPos];
+      oldHt[rehashPos] = tmpBuc->next;
+
+      int index = hash(tmpBuc->file, tmpBuc->pageNo, HTSIZE);
+      tmpBuc->next = ht[index];
+      ht[index] = tmpBuc;
+    }
+  }
+
+  if (rehashPos == OLDHTSIZE) {
+    delete [] oldHt;
+    oldHt = NULL;
+    OLDHTSIZE = 0;
+    rehashPos = 0;
+  }
+}
+
+void BufHashTbl::resize(const int htSize)
+{
+  // finish the previous rehash so that there are never more than two tables
+  while (oldHt)
+    rehashStep();
+
+  if (htSize == HTSIZE)
+    return;
+
+  oldHt = ht;
+  OLDHTSIZE = HTSIZE;
+  rehashPos = 0;
+
+  ht = new hashBucket* [htSize];
+  HTSIZE = htSize;
+  for(int i=0; i < HTSIZE; i++)
+    ht[i] = NULL;
 }
 
 void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
 {
-  int index = hash(file, pageNo);
+  rehashStep();
+
+  int index = hash(file, pageNo, HTSIZE);
 
   hashBucket* tmpBuc = ht[index];
   while (tmpBuc) {
@@ -56,6 +110,14 @@ void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId fra
     tmpBuc = tmpBuc->next;
   }
 
+  // the entry may also still be waiting in the old table
+  tmpBuc = oldHt ? oldHt[hash(file, pageNo, OLDHTSIZE)] : NULL;
+  while (tmpBuc) {
+    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
+    tmpBuc = tmpBuc->next;
+  }
+
   tmpBuc = new hashBucket;
   if (!tmpBuc)
   	throw HashTableException();
@@ -69,7 +131,9 @@ void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId fra
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
+  rehashStep();
+
+  int index = hash(file, pageNo, HTSIZE);
   hashBucket* tmpBuc = ht[index];
   while (tmpBuc) {
     if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
@@ -80,31 +144,49 @@ void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
     tmpBuc = tmpBuc->next;
   }
 
+  tmpBuc = oldHt ? oldHt[hash(file, pageNo, OLDHTSIZE)] : NULL;
+  while (tmpBuc) {
+    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+    {
+      frameNo = tmpBuc->frameNo;
+      return;
+    }
+    tmpBuc = tmpBuc->next;
+  }
+
   throw HashNotFoundException(file->filename(), pageNo);
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  rehashStep();
 
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
+  hashBucket** tables[2] = {ht, oldHt};
+  int sizes[2] = {HTSIZE, OLDHTSIZE};
 
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  for (int t = 0; t < 2 && tables[t]; t++)
+  {
+    int index = hash(file, pageNo, sizes[t]);
+    hashBucket* tmpBuc = tables[t][index];
+    hashBucket* prevBuc = NULL;
+
+    while (tmpBuc)
+    {
+      if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+      {
+        if(prevBuc) 
+          prevBuc->next = tmpBuc->next;
+        else
+          tables[t][index] = tmpBuc->next;
+
+        delete tmpBuc;
+        return;
+      }
+      else
+      {
+        prevBuc = tmpBuc;
+        tmpBuc = tmpBuc->next;
+      }
     }
   }
 
@@ -55,13 +55,40 @@ class BufHashTbl
   hashBucket**  ht;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * Size of the table being drained by an in-progress rehash, 0 if none
+	 */
+  int OLDHTSIZE;
+
+	/**
+	 * Table being drained by an in-progress rehash, NULL if none
+	 */
+  hashBucket**  oldHt;
+
+	/**
+	 * Next bucket of oldHt that has not been moved into ht yet
+	 */
+  int rehashPos;
+
+	/**
+	 * Number of old buckets moved into the new table by every operation while a rehash is in progress
+	 */
+  static const int REHASH_STEP = 4;
+
+	/**
+	 * returns hash value between 0 and size-1 computed using file and pageNo
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
+	 * @param size  	Number of buckets of the table the value is computed for
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  int	 hash(const File* file, const PageId pageNo, const int size);
+
+	/**
+	 * Move up to REHASH_STEP buckets of the old table into the current one.
+	 * Frees the old table once it has been drained.
+	 */
+  void rehashStep();
 
  public:
 	/**
@@ -104,6 +131,15 @@ class BufHashTbl
    * @throws HashNotFoundException if the page entry is not found in the hash table 
 	 */
   void remove(const File* file, const PageId pageNo);  
+
+	/**
+   * Change the number of buckets of the hash table. Entries are not moved here: the old table is
+   * drained a few buckets at a time by the following insert, lookup and remove calls, so resizing
+   * costs O(1) up front. A rehash still in progress is completed before a new one is started.
+	 *
+	 * @param htSize 	New number of buckets
+	 */
+  void resize(const int htSize);
 };
 
 }
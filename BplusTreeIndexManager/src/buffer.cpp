@@ -5,14 +5,17 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
+#include <thread>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
-#include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/pool_not_found_exception.h"
+#include "exceptions/badgerdb_exception.h"
 
 namespace badgerdb { 
 
@@ -22,18 +25,26 @@ namespace badgerdb {
 
 BufMgr::BufMgr(std::uint32_t bufs)
 	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+  if (bufs == 0 || bufs > MAXFRAMES)
+    throw BufferExceededException();
 
-  for (FrameId i = 0; i < bufs; i++) 
+  chunks = new FrameChunk*[MAXFRAMES / FRAMECHUNK]();
+  for (numChunks = 0; numChunks < chunksFor(bufs); numChunks++)
   {
-  	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+    chunks[numChunks] = new FrameChunk;
+    for (FrameId i = 0; i < FRAMECHUNK; i++)
+      chunks[numChunks]->descs[i].frameNo = numChunks * FRAMECHUNK + i;
   }
+  liveFrames = bufs;
 
-  bufPool = new Page[bufs];
+  int htsize = partitionTableSize(bufs);
+  for (int i = 0; i < NUMPARTITIONS; i++)
+    partitions[i].table = new BufHashTbl (htsize);  // allocate the buffer hash tables
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  BufPool defaultPool = {"default", 0 /* quota */, 0 /* reserved */, 0 /* used */};
+  pools.push_back(defaultPool);
+  for (int i = 0; i < NUM_ACCESS_KINDS; i++)
+    accessRoutes[i] = DEFAULT_POOL;
 
   clockHand = bufs - 1;
 }
@@ -41,112 +52,419 @@ BufMgr::BufMgr(std::uint32_t bufs)
 
 BufMgr::~BufMgr() {
   //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
+  for (std::uint32_t i = 0; i < liveFrames; i++) 
   {
-  	BufDesc* tmpbuf = &bufDescTable[i];
+  	BufDesc* tmpbuf = &desc(i);
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			tmpbuf->file->writePage(tmpbuf->pageNo, *framePage(i));
   	}
   }
 
-  delete [] bufDescTable;
-  delete [] bufPool;
+  for (std::uint32_t i = 0; i < numChunks; i++)
+    delete chunks[i];
+  delete [] chunks;
+  for (int i = 0; i < NUMPARTITIONS; i++)
+    delete partitions[i].table;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocBuf(std::unique_lock<std::mutex>& clockGuard, FrameId & frame, const PoolId pool) 
 {
   // perform first part of clock algorithm to search for 
   // open buffer frame
-  // Assumes non-concurrent access to buffer manager
   std::uint32_t numScanned = 0;
   bool found = 0;
+  FrameId frameNo = 0;
 
   while (numScanned < 2*numBufs)	//Need to scn twice
   {
+    // a pool at its quota may only replace its own pages
+    const bool ownOnly = pools[pool].quota != 0 && pools[pool].used >= pools[pool].quota;
+
     // advance the clock
     advanceClock();
     numScanned++;
+    frameNo = clockHand;
+    BufDesc* tmpbuf = &desc(frameNo);
+
+    // frames claimed by another thread are about to hold a page
+    if (tmpbuf->claimed)
+      continue;
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    // if free, use frame
+    if (tmpbuf->file == NULL)
     {
+      if (ownOnly)
+        continue;
+      found = true;
       break;
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    BufPartition& part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+    std::unique_lock<std::mutex> guard(part.latch);
+
+    // a failed read leaves the frame to the threads that waited for it until they let go of it
+    if (! tmpbuf->valid)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
-      {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
-      }
+      if (tmpbuf->pinCnt > 0 || ownOnly)
+        continue;
+      tmpbuf->Clear();
+      found = true;
+      break;
     }
-    else
+
+    if (ownOnly && tmpbuf->pool != pool)
+      continue;
+
+    // leave another pool the frames reserved for it
+    const BufPool& owner = pools[tmpbuf->pool];
+    if (tmpbuf->pool != pool && owner.used <= owner.reserved)
+      continue;
+
+    // is valid, check referenced bit
+    if (tmpbuf->refbit)
     {
       // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      clockStats.accesses++;
+      tmpbuf->refbit = false;
+      continue;
     }
+
+    // check to see if someone has it pinned or is writing it
+    if (tmpbuf->pinCnt > 0 || tmpbuf->writing)
+      continue;
+
+    // flush any existing changes to disk if necessary, without holding any lock
+    if (tmpbuf->dirty)
+    {
+      File* file = tmpbuf->file;
+      const PageId pageNo = tmpbuf->pageNo;
+      tmpbuf->writing = true;
+      tmpbuf->dirty = false;
+      part.stats.diskwrites++;
+      guard.unlock();
+      clockGuard.unlock();
+      try
+      {
+        file->writePage(pageNo, *framePage(frameNo));
+      }
+      catch(...)
+      {
+        guard.lock();
+        tmpbuf->writing = false;
+        tmpbuf->dirty = true;
+        part.ioDone.notify_all();
+        guard.unlock();
+        clockGuard.lock();
+        throw;
+      }
+      clockGuard.lock();
+      guard.lock();
+      tmpbuf->writing = false;
+      part.ioDone.notify_all();
+
+      // the pool may have shrunk past the frame, or the page been used again, meanwhile
+      if (frameNo >= numBufs || tmpbuf->dirty || tmpbuf->pinCnt > 0 || tmpbuf->refbit)
+        continue;
+    }
+
+    // hasn't been referenced and is not pinned, use it
+    // remove previous entry from hash table
+    part.table->remove(tmpbuf->file, tmpbuf->pageNo);
+    clearFrame(frameNo);
+    found = true;
+    break;
   }
   
   // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+  if (!found)
   {
     throw BufferExceededException();
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
-  {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
-  }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  // keep the frame for the caller until it publishes its page; the clock may have moved on while a page
+  // was written back
+  BufDesc* tmpbuf = &desc(frameNo);
+  tmpbuf->Clear();
+  tmpbuf->claimed = true;
+  tmpbuf->pool = pool;
+  pools[pool].used++;
 
   // return new frame number
-  frame = clockHand;
+  frame = frameNo;
 } // end allocBuf
 
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+void BufMgr::clearFrame(const FrameId frameNo)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  if (desc(frameNo).valid || desc(frameNo).claimed)
+    pools[desc(frameNo).pool].used--;
+  desc(frameNo).Clear();
+}
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
-  }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+void BufMgr::failLoad(const FrameId frameNo)
+{
+  std::lock_guard<std::mutex> clockGuard(clockMutex);
+  BufDesc* tmpbuf = &desc(frameNo);
+  BufPartition& part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+  std::lock_guard<std::mutex> guard(part.latch);
+  part.table->remove(tmpbuf->file, tmpbuf->pageNo);
+  pools[tmpbuf->pool].used--;
+
+  // file and pageNo stay, so the waiters drop their pins under the same partition latch
+  tmpbuf->valid = false;
+  tmpbuf->loading = false;
+  tmpbuf->dirty = false;
+  tmpbuf->pinCnt--;
+  part.ioDone.notify_all();
+}
+
+PoolId BufMgr::poolFor(const File* file, const BufAccess access) const
+{
+  std::map<const File*, PoolId>::const_iterator it = filePools.find(file);
+  if (it != filePools.end())
+    return it->second;
+  return accessRoutes[access];
+}
+
+FrameId BufMgr::pinPage(File* file, const PageId pageNo, const BufAccess access)
+{
+  BufPartition& part = partitionOf(file, pageNo);
+  std::unique_lock<std::mutex> guard(part.latch);
+  part.stats.pagereads++;
+  while (true)
   {
+    // check to see if it is already in the buffer pool
+    FrameId frameNo = 0;
+    try
+    {
+      part.table->lookup(file, pageNo, frameNo);
+
+      // set the referenced bit
+      BufDesc* tmpbuf = &desc(frameNo);
+      tmpbuf->refbit = true;
+      tmpbuf->pinCnt++;
+      part.ioDone.wait(guard, [tmpbuf] { return !tmpbuf->loading && !tmpbuf->writing; });
+      if (tmpbuf->valid)
+        return frameNo;
+
+      // reading it in failed in another thread, try again
+      tmpbuf->pinCnt--;
+      continue;
+    }
+    catch(HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+    {
+    }
+
     // alloc a new frame
-    allocBuf(frameNo);
+    guard.unlock();
+    std::unique_lock<std::mutex> clockGuard(clockMutex);
+    allocBuf(clockGuard, frameNo, poolFor(file, access));
+    guard.lock();
+
+    FrameId cached = 0;
+    try
+    {
+      // another thread read the page in meanwhile
+      part.table->lookup(file, pageNo, cached);
+      clearFrame(frameNo);
+      continue;
+    }
+    catch(HashNotFoundException &e)
+    {
+    }
+
+    // publish the frame, so that others wait for this read instead of starting their own
+    BufDesc* tmpbuf = &desc(frameNo);
+    tmpbuf->Set(file, pageNo);
+    tmpbuf->loading = true;
+    part.table->insert(file, pageNo, frameNo);
+    guard.unlock();
+    clockGuard.unlock();
 
     // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+    try
+    {
+      *framePage(frameNo) = file->readPage(pageNo);
+    }
+    catch(...)
+    {
+      failLoad(frameNo);
+      throw;
+    }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    guard.lock();
+    part.stats.diskreads++;
+    tmpbuf->loading = false;
+    part.ioDone.notify_all();
+    return frameNo;
+  }
+}
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, const BufAccess access)
+{
+  page = framePage(pinPage(file, pageNo, access));
+}
+
+
+void BufMgr::readPages(const std::vector<PageRef>& refs, std::vector<Page*>& pages,
+                       const BufAccess access)
+{
+  pages.assign(refs.size(), NULL);
+  std::vector<FrameId> frames(refs.size());
+
+  // pin the pages that are cached already
+  std::vector<std::size_t> misses;
+  std::vector<FrameId> pinned;
+  for (std::size_t i = 0; i < refs.size(); i++)
+  {
+    BufPartition& part = partitionOf(refs[i].file, refs[i].pageNo);
+    std::lock_guard<std::mutex> guard(part.latch);
+    part.stats.pagereads++;
+    try
+    {
+      part.table->lookup(refs[i].file, refs[i].pageNo, frames[i]);
+      desc(frames[i]).refbit = true;
+      desc(frames[i]).pinCnt++;
+      pinned.push_back(frames[i]);
+    }
+    catch(HashNotFoundException &e)
+    {
+      misses.push_back(i);
+    }
+  }
+
+  // order the misses so that consecutive pages of a file end up next to each other
+  std::sort(misses.begin(), misses.end(), [&refs](std::size_t a, std::size_t b) {
+    if (refs[a].file != refs[b].file)
+      return refs[a].file < refs[b].file;
+    return refs[a].pageNo < refs[b].pageNo;
+  });
+
+  std::vector<FrameId> fetched;
+  try
+  {
+    // allocate and publish a frame for every missing page before reading any of them, so that the frames
+    // allocated first cannot be taken again by the ones allocated later
+    std::unique_lock<std::mutex> clockGuard(clockMutex);
+    for (std::size_t k = 0; k < misses.size(); k++)
+    {
+      const PageRef& ref = refs[misses[k]];
+      BufPartition& part = partitionOf(ref.file, ref.pageNo);
+      if (k > 0 && refs[misses[k - 1]].file == ref.file && refs[misses[k - 1]].pageNo == ref.pageNo)
+      {
+        // requested again in the same batch
+        std::lock_guard<std::mutex> guard(part.latch);
+        frames[misses[k]] = frames[misses[k - 1]];
+        desc(frames[misses[k]]).pinCnt++;
+        pinned.push_back(frames[misses[k]]);
+        continue;
+      }
+
+      FrameId frameNo;
+      allocBuf(clockGuard, frameNo, poolFor(ref.file, access));
+      std::lock_guard<std::mutex> guard(part.latch);
+      try
+      {
+        // read in by another thread meanwhile
+        part.table->lookup(ref.file, ref.pageNo, frames[misses[k]]);
+        clearFrame(frameNo);
+        desc(frames[misses[k]]).refbit = true;
+        desc(frames[misses[k]]).pinCnt++;
+        pinned.push_back(frames[misses[k]]);
+        continue;
+      }
+      catch(HashNotFoundException &e)
+      {
+      }
+
+      desc(frameNo).Set(ref.file, ref.pageNo);
+      desc(frameNo).loading = true;
+      part.table->insert(ref.file, ref.pageNo, frameNo);
+      fetched.push_back(frameNo);
+      frames[misses[k]] = frameNo;
+    }
+    clockGuard.unlock();
+
+    // read every run of consecutive pages with a single call; the frames are pinned and loading, so nobody
+    // changes their descriptors meanwhile
+    std::vector<Page*> run;
+    for (std::size_t first = 0; first < fetched.size(); )
+    {
+      const BufDesc& head = desc(fetched[first]);
+      std::size_t last = first + 1;
+      while (last < fetched.size() && desc(fetched[last]).file == head.file
+             && desc(fetched[last]).pageNo == head.pageNo + (last - first))
+        last++;
+
+      run.clear();
+      for (std::size_t k = first; k < last; k++)
+        run.push_back(framePage(fetched[k]));
+      head.file->readPages(head.pageNo, run.size(), &run[0]);
+
+      for (std::size_t k = first; k < last; k++)
+      {
+        BufPartition& part = partitionOf(desc(fetched[k]).file, desc(fetched[k]).pageNo);
+        std::lock_guard<std::mutex> guard(part.latch);
+        part.stats.diskreads++;
+        desc(fetched[k]).loading = false;
+        part.ioDone.notify_all();
+      }
+      first = last;
+    }
+
+    // wait for the pages other threads were reading or writing, and read again the ones they failed to read
+    for (std::size_t i = 0; i < refs.size(); i++)
+    {
+      BufPartition& part = partitionOf(refs[i].file, refs[i].pageNo);
+      std::unique_lock<std::mutex> guard(part.latch);
+      BufDesc* tmpbuf = &desc(frames[i]);
+      part.ioDone.wait(guard, [tmpbuf] { return !tmpbuf->loading && !tmpbuf->writing; });
+      if (tmpbuf->valid)
+      {
+        pages[i] = framePage(frames[i]);
+        continue;
+      }
+
+      tmpbuf->pinCnt--;
+      pinned.erase(std::find(pinned.begin(), pinned.end(), frames[i]));
+      guard.unlock();
+      frames[i] = pinPage(refs[i].file, refs[i].pageNo, access);
+      pinned.push_back(frames[i]);
+      pages[i] = framePage(frames[i]);
+    }
+  }
+  catch(...)
+  {
+    // release everything this call pinned and forget the frames it was reading into
+    for (std::size_t i = 0; i < pinned.size(); i++)
+    {
+      BufDesc* tmpbuf = &desc(pinned[i]);
+      BufPartition& part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+      std::lock_guard<std::mutex> guard(part.latch);
+      tmpbuf->pinCnt--;
+    }
+    for (std::size_t i = 0; i < fetched.size(); i++)
+    {
+      if (desc(fetched[i]).loading)
+      {
+        failLoad(fetched[i]);
+        continue;
+      }
+
+      std::lock_guard<std::mutex> clockGuard(clockMutex);
+      BufDesc* tmpbuf = &desc(fetched[i]);
+      BufPartition& part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+      std::lock_guard<std::mutex> guard(part.latch);
+      tmpbuf->pinCnt--;
+      if (tmpbuf->pinCnt == 0 && !tmpbuf->writing)
+      {
+        part.table->remove(tmpbuf->file, tmpbuf->pageNo);
+        clearFrame(fetched[i]);
+      }
+    }
+    pages.assign(refs.size(), NULL);
+    throw;
   }
 }
 
@@ -154,45 +472,112 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 void BufMgr::unPinPage(File* file, const PageId pageNo, 
 			     const bool dirty) 
 {
+  BufPartition& part = partitionOf(file, pageNo);
+  std::lock_guard<std::mutex> guard(part.latch);
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  part.table->lookup(file, pageNo, frameNo);
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true) desc(frameNo).dirty = dirty;
 
   // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0)
+  if (desc(frameNo).pinCnt == 0)
   {
   	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   }
-  else bufDescTable[frameNo].pinCnt--;
+  else desc(frameNo).pinCnt--;
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::evictFrame(const FrameId frameNo, const File* file)
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
-	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
+  BufDesc* tmpbuf = &desc(frameNo);
+  while (true)
+  {
+    std::unique_lock<std::mutex> clockGuard(clockMutex);
+    if (tmpbuf->claimed && file == NULL)
+    {
+      // its page is about to be published, evict that
+      clockGuard.unlock();
+      std::this_thread::yield();
+      continue;
+    }
+    if (tmpbuf->file == NULL || (file != NULL && tmpbuf->file != file))
+      return;
+
+    BufPartition& part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+    std::unique_lock<std::mutex> guard(part.latch);
+    if (tmpbuf->loading || tmpbuf->writing)
+    {
+      clockGuard.unlock();
+      part.ioDone.wait(guard, [tmpbuf] { return !tmpbuf->loading && !tmpbuf->writing; });
+      continue;
+    }
+
+    if (tmpbuf->valid == false)
+    {
+      // a failed read, wait for the threads that waited for it to let go of the frame
+      if (tmpbuf->pinCnt > 0)
       {
-        this->printSelf();
-        throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+        guard.unlock();
+        clockGuard.unlock();
+        std::this_thread::yield();
+        continue;
       }
+      tmpbuf->Clear();
+      return;
+    }
 
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-        tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
+    if (tmpbuf->pinCnt > 0)
+      throw PagePinnedException(tmpbuf->file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+    if (tmpbuf->dirty == true)
+    {
+      // write it back without holding any lock, then look at the frame again
+      File* dirtyFile = tmpbuf->file;
+      const PageId pageNo = tmpbuf->pageNo;
+      tmpbuf->writing = true;
+      tmpbuf->dirty = false;
+      part.stats.diskwrites++;
+      guard.unlock();
+      clockGuard.unlock();
+      try
+      {
+        dirtyFile->writePage(pageNo, *framePage(frameNo));
+      }
+      catch(...)
+      {
+        guard.lock();
+        tmpbuf->writing = false;
+        tmpbuf->dirty = true;
+        part.ioDone.notify_all();
+        throw;
+      }
+      guard.lock();
+      tmpbuf->writing = false;
+      part.ioDone.notify_all();
+      continue;
+    }
+
+    part.table->remove(tmpbuf->file, tmpbuf->pageNo);
+    clearFrame(frameNo);
+    return;
+  }
+}
+
+void BufMgr::flushFile(const File* file) 
+{
+  std::lock_guard<std::mutex> resizeGuard(resizeMutex);
+  for (std::uint32_t i = 0; i < liveFrames; i++)
+	{
+    try
+    {
+      evictFrame(i, file);
+    }
+    catch(PagePinnedException &e)
+    {
+      this->printSelf();
+      throw;
+    }
   }
 }
 
@@ -200,37 +585,250 @@ void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
   //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  BufPartition& part = partitionOf(file, pageNo);
+  while (true)
+  {
+    std::unique_lock<std::mutex> clockGuard(clockMutex);
+    std::unique_lock<std::mutex> guard(part.latch);
+    FrameId frameNo = 0;
+    try
+    {
+      part.table->lookup(file, pageNo, frameNo);
+    }
+    catch(HashNotFoundException &e)
+    {
+      break;
+    }
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+    BufDesc* tmpbuf = &desc(frameNo);
+    if (tmpbuf->loading || tmpbuf->writing)
+    {
+      clockGuard.unlock();
+      part.ioDone.wait(guard, [tmpbuf] { return !tmpbuf->loading && !tmpbuf->writing; });
+      continue;
+    }
 
-	hashTable->remove(file, pageNo);
+    // clear the page
+    clearFrame(frameNo);
+    part.table->remove(file, pageNo);
+    break;
+  }
 
   // deallocate it in the file	
+  std::lock_guard<std::mutex> fileGuard(fileMutex);
   file->deletePage(pageNo);
 }
 
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, const BufAccess access) 
 {
   FrameId frameNo;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  std::unique_lock<std::mutex> clockGuard(clockMutex);
+  allocBuf(clockGuard, frameNo, poolFor(file, access));
+  clockGuard.unlock();
 
   // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+  try
+  {
+    std::lock_guard<std::mutex> fileGuard(fileMutex);
+    *framePage(frameNo) = file->allocatePage(pageNo);
+  }
+  catch(...)
+  {
+    clockGuard.lock();
+    clearFrame(frameNo);
+    throw;
+  }
+  page = framePage(frameNo);
 
   // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  clockGuard.lock();
+  BufPartition& part = partitionOf(file, pageNo);
+  std::lock_guard<std::mutex> guard(part.latch);
+  desc(frameNo).Set(file, pageNo);
 
   printf("pageNo: [%d], frameNo: [%d]\n", pageNo, frameNo);
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  part.table->insert(file, pageNo, frameNo);
+}
+
+void BufMgr::resize(const std::uint32_t newFrames)
+{
+  if (newFrames == 0 || newFrames > MAXFRAMES)
+    throw BufferExceededException();
+
+  std::lock_guard<std::mutex> resizeGuard(resizeMutex);
+  std::unique_lock<std::mutex> clockGuard(clockMutex);
+  const std::uint32_t oldFrames = numBufs;
+  if (newFrames == oldFrames)
+    return;
+
+  if (newFrames > oldFrames)
+  {
+    // the new chunks are not reachable before numBufs grows, so they are allocated without the lock
+    clockGuard.unlock();
+    const std::uint32_t oldChunks = numChunks;
+    std::vector<FrameChunk*> added;
+    for (std::uint32_t c = oldChunks; c < chunksFor(newFrames); c++)
+    {
+      added.push_back(new FrameChunk);
+      for (FrameId i = 0; i < FRAMECHUNK; i++)
+        added.back()->descs[i].frameNo = c * FRAMECHUNK + i;
+    }
+
+    clockGuard.lock();
+    for (std::size_t c = 0; c < added.size(); c++)
+      chunks[oldChunks + c] = added[c];
+    numChunks = oldChunks + added.size();
+    numBufs = liveFrames = newFrames;
+    for (int i = 0; i < NUMPARTITIONS; i++)
+    {
+      std::lock_guard<std::mutex> guard(partitions[i].latch);
+      partitions[i].table->resize(partitionTableSize(newFrames));
+    }
+    return;
+  }
+
+  // refuse to shrink before touching anything if the tail is still in use
+  for (FrameId i = newFrames; i < oldFrames; i++)
+  {
+    BufDesc* tmpbuf = &desc(i);
+    if (tmpbuf->file == NULL)
+      continue;
+    std::lock_guard<std::mutex> guard(partitionOf(tmpbuf->file, tmpbuf->pageNo).latch);
+    if (tmpbuf->valid == true && tmpbuf->pinCnt > 0)
+      throw PagePinnedException(tmpbuf->file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+  }
+
+  // stop the clock from handing out the tail frames, then evict them one at a time
+  numBufs = newFrames;
+  if (clockHand >= numBufs)
+    clockHand = numBufs - 1;
+  clockGuard.unlock();
+
+  for (FrameId i = newFrames; i < oldFrames; i++)
+  {
+    try
+    {
+      evictFrame(i, NULL);
+    }
+    catch(...)
+    {
+      // put the tail back in use
+      clockGuard.lock();
+      numBufs = oldFrames;
+      throw;
+    }
+  }
+
+  // no frame past the new end holds a page any more, free the chunks that lie entirely beyond it
+  clockGuard.lock();
+  liveFrames = newFrames;
+  std::vector<FrameChunk*> removed;
+  while (numChunks > chunksFor(newFrames))
+  {
+    numChunks--;
+    removed.push_back(chunks[numChunks]);
+    chunks[numChunks] = NULL;
+  }
+  for (int i = 0; i < NUMPARTITIONS; i++)
+  {
+    std::lock_guard<std::mutex> guard(partitions[i].latch);
+    partitions[i].table->resize(partitionTableSize(newFrames));
+  }
+  clockGuard.unlock();
+
+  for (std::size_t c = 0; c < removed.size(); c++)
+    delete removed[c];
+}
+
+BufStats & BufMgr::getBufStats()
+{
+  std::lock_guard<std::mutex> clockGuard(clockMutex);
+  bufStats = clockStats;
+  for (int i = 0; i < NUMPARTITIONS; i++)
+  {
+    std::lock_guard<std::mutex> guard(partitions[i].latch);
+    bufStats.accesses += partitions[i].stats.accesses;
+    bufStats.pagereads += partitions[i].stats.pagereads;
+    bufStats.diskreads += partitions[i].stats.diskreads;
+    bufStats.diskwrites += partitions[i].stats.diskwrites;
+  }
+  return bufStats;
+}
+
+void BufMgr::clearBufStats()
+{
+  std::lock_guard<std::mutex> clockGuard(clockMutex);
+  clockStats.clear();
+  bufStats.clear();
+  for (int i = 0; i < NUMPARTITIONS; i++)
+  {
+    std::lock_guard<std::mutex> guard(partitions[i].latch);
+    partitions[i].stats.clear();
+  }
+}
+
+PoolId BufMgr::createPool(const std::string& name, const std::uint32_t quota,
+                          const std::uint32_t reserved)
+{
+  std::lock_guard<std::mutex> guard(clockMutex);
+  for (PoolId i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].name == name)
+    {
+      pools[i].quota = quota;
+      pools[i].reserved = reserved;
+      return i;
+    }
+  }
+
+  BufPool newPool = {name, quota, reserved, 0 /* used */};
+  pools.push_back(newPool);
+  return pools.size() - 1;
+}
+
+PoolId BufMgr::getPool(const std::string& name) const
+{
+  std::lock_guard<std::mutex> guard(clockMutex);
+  for (PoolId i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].name == name)
+      return i;
+  }
+  throw PoolNotFoundException(name);
+}
+
+void BufMgr::assignFile(const File* file, const PoolId pool)
+{
+  std::lock_guard<std::mutex> guard(clockMutex);
+  checkPool(pool);
+  if (pool == DEFAULT_POOL)
+    filePools.erase(file);
+  else
+    filePools[file] = pool;
+}
+
+void BufMgr::routeAccess(const BufAccess access, const PoolId pool)
+{
+  std::lock_guard<std::mutex> guard(clockMutex);
+  checkPool(pool);
+  accessRoutes[access] = pool;
+}
+
+void BufMgr::checkPool(const PoolId pool) const
+{
+  if (pool >= pools.size())
+    throw PoolNotFoundException(std::to_string(pool));
+}
+
+BufPool BufMgr::getPoolInfo(const PoolId pool) const
+{
+  std::lock_guard<std::mutex> guard(clockMutex);
+  checkPool(pool);
+  return pools[pool];
 }
 
 void BufMgr::printSelf(void) 
@@ -238,9 +836,9 @@ void BufMgr::printSelf(void)
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
-  for (std::uint32_t i = 0; i < numBufs; i++)
+  for (std::uint32_t i = 0; i < liveFrames; i++)
 	{
-  	tmpbuf = &(bufDescTable[i]);
+  	tmpbuf = &(desc(i));
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
@@ -9,7 +9,13 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace badgerdb {
 
@@ -18,6 +24,61 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+* @brief Kind of page access, passed to BufMgr::readPage() and BufMgr::allocPage() as a hint for the pool the
+* page should be cached in. BufMgr::routeAccess() decides which pool each kind of access goes to.
+*/
+enum BufAccess {
+  ACCESS_DEFAULT = 0,  /* Any access without a more specific kind */
+  ACCESS_INDEX_INNER,  /* Header and non-leaf pages of an index */
+  ACCESS_INDEX_LEAF,   /* Leaf pages of an index */
+  ACCESS_SCAN,         /* Pages read by a sequential scan of a relation */
+  NUM_ACCESS_KINDS
+};
+
+/**
+* @brief A named group of frames in the buffer pool with a cap on the number of frames it may hold and a number
+* of frames reserved for it
+*/
+struct BufPool {
+	/**
+   * Name of the pool
+	 */
+  std::string name;
+
+	/**
+   * Maximum number of frames the pool may hold, 0 for no limit. A pool that has reached its quota
+   * replaces its own pages instead of taking frames from other pools.
+	 */
+  std::uint32_t quota;
+
+	/**
+   * Number of frames the pool keeps, 0 for none. While the pool holds no more frames than this, replacement
+   * for other pools skips its pages, so a large scan cannot push them out.
+	 */
+  std::uint32_t reserved;
+
+	/**
+   * Number of frames currently holding a page of this pool
+	 */
+  std::uint32_t used;
+};
+
+/**
+* @brief A page of a file, as requested from BufMgr::readPages()
+*/
+struct PageRef {
+	/**
+   * File the page belongs to
+	 */
+  File* file;
+
+	/**
+   * Page number in the file
+	 */
+  PageId pageNo;
+};
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
@@ -56,11 +117,34 @@ class BufDesc {
 	 */
   bool valid;
 
+	/**
+   * True while the page is being read into the frame. The frame is in the hash table and pinned by the reader;
+   * others that pin it wait until the read is done.
+	 */
+  bool loading;
+
+	/**
+   * True while the page is being written back without holding any lock. The frame keeps its page, and is not
+   * evicted or replaced until the write is done; threads pinning it wait for that, so the page does not change
+   * while it is written.
+	 */
+  bool writing;
+
+	/**
+   * True while the frame is allocated for a page that is not in the hash table yet
+	 */
+  bool claimed;
+
 	/**
    * Has this buffer frame been reference recently
 	 */
   bool refbit;
 
+	/**
+   * Pool the page in this frame is charged to
+	 */
+  PoolId pool;
+
 	/**
    * Initialize buffer frame for a new user
 	 */
@@ -72,6 +156,10 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+    loading = false;
+    writing = false;
+    claimed = false;
+    pool = 0;
   };
 
 	/**
@@ -89,6 +177,8 @@ class BufDesc {
     dirty = false;
     valid = true;
     refbit = true;
+    loading = false;
+    claimed = false;
   }
 
   void Print()
@@ -104,7 +194,8 @@ class BufDesc {
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
 		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "refbit:" << refbit << " ";
+		std::cout << "pool:" << pool << "\n";
   }
 
 	/**
@@ -127,6 +218,12 @@ struct BufStats
 	 */
   int accesses;
 
+	/**
+   * Number of pages requested through readPage() and readPages(), whether
+   * they were cached or read from disk
+	 */
+  int pagereads;
+
 	/**
    * Number of pages read from disk (including allocs)
 	 */
@@ -142,7 +239,7 @@ struct BufStats
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = pagereads = diskreads = diskwrites = 0;
   }
       
 	/**
@@ -157,6 +254,14 @@ struct BufStats
 
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* Reading, allocating, unpinning, flushing and disposing of pages and resizing the pool may be called from many
+* threads at once. The hash table is split into partitions, each with its own latch that also guards the
+* descriptors of the frames holding its pages, so that pages of different partitions are found and pinned
+* without contending. Choosing a frame to replace, and any change of the page a frame holds, also takes the
+* clock mutex, always before a partition latch. No lock is held while a page is read or written: the frame is
+* marked as being read or written meanwhile, and others that need it wait on the partition.
+* The contents of a pinned page are not protected, callers latch them themselves.
 */
 class BufMgr 
 {
@@ -169,30 +274,207 @@ class BufMgr
 	/**
    * Number of frames in the buffer pool
 	 */
-  std::uint32_t numBufs;
-	
+  std::atomic<std::uint32_t> numBufs;
+
 	/**
-   * Hash table mapping (File, page) to frame
+   * Number of partitions of the hash table is 1 << PARTITIONBITS
 	 */
-  BufHashTbl *hashTable;
+  static const int PARTITIONBITS = 4;
+  static const int NUMPARTITIONS = 1 << PARTITIONBITS;
 
 	/**
-   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+   * A partition of the hash table. Its latch guards the table and the descriptors of the frames holding one
+   * of its pages (or, after a failed read, having held one).
 	 */
-  BufDesc *bufDescTable;
+  struct alignas(64) BufPartition
+  {
+    std::mutex latch;
+    /* Signalled whenever a frame of the partition is done being read or written */
+    std::condition_variable ioDone;
+    /* Hash table mapping (File, page) to frame for the pages of the partition */
+    BufHashTbl* table;
+    /* Page reads and disk I/O counted for the pages of the partition */
+    BufStats stats;
+  };
+
+	/**
+   * Partitions of the hash table
+	 */
+  BufPartition partitions[NUMPARTITIONS];
+
+	/**
+   * Partition the given page belongs to
+	 */
+  BufPartition& partitionOf(const File* file, const PageId pageNo)
+  {
+    const std::uint64_t key = (std::uint64_t)(std::uintptr_t)file * 31 + pageNo;
+    return partitions[(key * 0x9E3779B97F4A7C15ULL) >> (64 - PARTITIONBITS)];
+  }
 
 	/**
-   * Maintains Buffer pool usage statistics 
+   * Statistics kept by the clock, guarded by clockMutex
+	 */
+  BufStats clockStats;
+
+	/**
+   * Sum of the statistics of the partitions and the clock, filled in by getBufStats()
 	 */
   BufStats bufStats;
 
 	/**
-	 * Allocate a free frame.  
+   * Frames, and their descriptors, held by one chunk of the buffer pool. The pool is allocated and freed a
+   * chunk at a time; the last chunk may be only partly in use.
+	 */
+  static const std::uint32_t FRAMECHUNK = 128;
+
+	/**
+   * Largest number of frames the buffer pool can have
+	 */
+  static const std::uint32_t MAXFRAMES = 1 << 22;
+
+	/**
+   * A chunk of FRAMECHUNK frames and the BufDesc objects describing them
+	 */
+  struct FrameChunk
+  {
+    Page pages[FRAMECHUNK];
+    BufDesc descs[FRAMECHUNK];
+  };
+
+	/**
+   * Directory of the chunks making up the buffer pool, MAXFRAMES / FRAMECHUNK entries long. Entry i holds
+   * frames i * FRAMECHUNK and up, or is NULL if the pool does not reach that far. The directory itself never
+   * moves, so neither do the frames and descriptors of the chunks in it.
+	 */
+  FrameChunk** chunks;
+
+	/**
+   * Number of chunks allocated in 'chunks'
+	 */
+  std::uint32_t numChunks;
+
+	/**
+   * Number of frames that may hold a page. Equal to numBufs, except while resize() is evicting the frames at
+   * the tail of the pool, which the clock no longer hands out.
+	 */
+  std::uint32_t liveFrames;
+
+	/**
+   * Number of chunks needed to hold the given number of frames
+	 */
+  static std::uint32_t chunksFor(std::uint32_t bufs)
+  {
+    return (bufs + FRAMECHUNK - 1) / FRAMECHUNK;
+  }
+
+	/**
+   * Descriptor of the given frame
+	 */
+  BufDesc& desc(const FrameId frameNo)
+  {
+    return chunks[frameNo / FRAMECHUNK]->descs[frameNo % FRAMECHUNK];
+  }
+
+	/**
+   * Page held by the given frame
+	 */
+  Page* framePage(const FrameId frameNo)
+  {
+    return &chunks[frameNo / FRAMECHUNK]->pages[frameNo % FRAMECHUNK];
+  }
+
+	/**
+   * Named pools of frames. Pool 0 is the default pool and has no quota.
+	 */
+  std::vector<BufPool> pools;
+
+	/**
+   * Pool each kind of access is routed to when the file has no pool of its own
+	 */
+  PoolId accessRoutes[NUM_ACCESS_KINDS];
+
+	/**
+   * Files that were assigned to a pool with assignFile()
+	 */
+  std::map<const File*, PoolId> filePools;
+
+	/**
+   * Pool a page of the file read with the given kind of access is charged to
+	 */
+  PoolId poolFor(const File* file, const BufAccess access) const;
+
+	/**
+   * Throw PoolNotFoundException if the pool does not exist. Called with clockMutex held.
+	 */
+  void checkPool(const PoolId pool) const;
+
+	/**
+   * Reset the descriptor of a frame and release it from the pool it is charged to. Called with clockMutex
+   * held, and the latch of the partition of the frame's page if it holds one.
 	 *
+	 * @param frameNo	Frame to clear
+	 */
+  void clearFrame(const FrameId frameNo);
+
+	/**
+   * Size of the hash table used for a pool of the given number of frames
+	 */
+  static int hashTableSize(std::uint32_t bufs)
+  {
+    return ((((int) (bufs * 1.2))*2)/2)+1;
+  }
+
+	/**
+   * Size of the hash table of each partition for a pool of the given number of frames
+	 */
+  static int partitionTableSize(std::uint32_t bufs)
+  {
+    return hashTableSize(bufs / NUMPARTITIONS + 1);
+  }
+
+	/**
+	 * Allocate a free frame and mark it claimed.
+	 * If the pool has reached its quota only frames already charged to it are replaced. Frames of another pool
+	 * that holds no more than its reservation are not replaced. A dirty page is written back with all locks
+	 * dropped, and its frame is taken only if nobody used it meanwhile.
+	 *
+	 * @param clockGuard	Lock on clockMutex, held on entry and on return
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param pool   	Pool the frame is allocated for
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(std::unique_lock<std::mutex>& clockGuard, FrameId & frame, const PoolId pool);
+
+	/**
+	 * Pin the page, reading it into a new frame if it is not cached. Waits while another thread reads it in or
+	 * writes it back.
+	 * Counts a page read.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param access 	Kind of access, used to pick the pool of a newly read page
+	 * @return  			Frame holding the page
+	 */
+  FrameId pinPage(File* file, const PageId pageNo, const BufAccess access);
+
+	/**
+	 * Undo a read into a frame that failed: drop the page from the hash table and the pin of the reader. The
+	 * frame is reused once the others waiting for the read have dropped their pins too.
+	 *
+	 * @param frameNo	Frame the page was being read into
+	 */
+  void failLoad(const FrameId frameNo);
+
+	/**
+	 * Write back the page in a frame if it is dirty and evict it. The write is done without holding any lock,
+	 * and the frame is looked at again afterwards, as it may have been pinned meanwhile. Waits while the frame
+	 * is being read or written by another thread, or claimed for a page that is about to be read.
+	 *
+	 * @param frameNo	Frame to evict
+	 * @param file	Evict the frame only if it holds a page of this file, NULL to evict any page
+   * @throws  PagePinnedException If the frame holds a pinned page
+	 */
+  void evictFrame(const FrameId frameNo, const File* file);
 
 	/**
    * Advance clock to next frame in the buffer pool
@@ -202,13 +484,23 @@ class BufMgr
 		clockHand = (clockHand + 1) % numBufs;
   }
 
+	/**
+   * Guards the clock, the pools and the charges to them, and the page each frame holds
+	 */
+  mutable std::mutex clockMutex;
 
- public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Serializes allocating and deleting pages of files, which rewrite their headers
 	 */
-  Page* bufPool;
+  std::mutex fileMutex;
 
+	/**
+   * Serializes calls of resize(), and keeps flushFile() from looking at chunks that are being freed
+	 */
+  std::mutex resizeMutex;
+
+
+ public:
 	/**
    * Constructor of BufMgr class
 	 */
@@ -220,6 +512,11 @@ class BufMgr
   ~BufMgr();
 
 	/**
+   * Id of the default pool, which every page goes to unless a file or an access kind is assigned elsewhere
+	 */
+  static const PoolId DEFAULT_POOL = 0;
+
+	/**
 	 * Reads the given page from the file into a frame and returns the pointer to page.
 	 * If the requested page is already present in the buffer pool pointer to that frame is returned
 	 * otherwise a new frame is allocated from the buffer pool for reading the page.
@@ -227,8 +524,25 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param access 	Kind of access, used to pick the pool of a newly read page when the file has no pool of its own
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, const BufAccess access = ACCESS_DEFAULT);
+
+	/**
+	 * Reads many pages in one call and returns them all pinned, as if readPage() had been called for each.
+	 * Pages already in the buffer pool are pinned first, then frames are allocated for all the others, and
+	 * those are read sorted by file and page number with every run of consecutive pages read at once.
+	 * A page may be requested more than once; it is then pinned once per request.
+	 * If the call fails nothing stays pinned and none of the pages it was reading stay in the buffer pool.
+	 *
+	 * @param refs   	Pages to read
+	 * @param pages  	Set to the page read for each entry of refs
+	 * @param access 	Kind of access, used to pick the pool of newly read pages when a file has no pool of its own
+   * @throws  BufferExceededException If there are not enough unpinned frames for all pages that are not cached
+   * @throws  InvalidPageException If one of the pages doesn't exist in its file
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void readPages(const std::vector<PageRef>& refs, std::vector<Page*>& pages,
+                 const BufAccess access = ACCESS_DEFAULT);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -247,17 +561,17 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param access 	Kind of access, used to pick the pool of the page when the file has no pool of its own
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  void allocPage(File* file, PageId &PageNo, Page*& page, const BufAccess access = ACCESS_DEFAULT); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk and evicts them, writing each without holding any lock.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
-   * @throws BadBufferException If any frame allocated to the file is found to be invalid
 	 */
   void flushFile(const File* file);
 
@@ -271,25 +585,91 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
-   * Print member variable values. 
+	 * Change the number of frames in the buffer pool without dropping the cached pages.
+	 * Frames never move, so pointers to pinned pages stay valid. Growing allocates the chunks of frames that are
+	 * missing. Shrinking stops handing out the frames at the tail of the pool (frame numbers newFrames and up),
+	 * evicts them one at a time, writing back dirty pages without holding the lock, and then frees the chunks
+	 * past the new end. If a tail frame is pinned the pool keeps its old size; tail pages evicted until then
+	 * stay evicted. The hash table is resized as well, but its entries are moved over incrementally by the
+	 * following buffer operations.
+	 *
+	 * @param newFrames	Number of frames the buffer pool should have
+   * @throws  PagePinnedException If a frame that would be removed holds a pinned page
+   * @throws  BufferExceededException If newFrames is 0 or more than MAXFRAMES
 	 */
-  void  printSelf();
+  void resize(const std::uint32_t newFrames);
+
+	/**
+	 * Create a named pool, or change the quota and reservation of the pool if one with that name exists.
+	 * Reservations that add up to all frames of the buffer pool make allocations for other pools throw
+	 * BufferExceededException.
+	 *
+	 * @param name   	Name of the pool
+	 * @param quota  	Maximum number of frames the pool may hold, 0 for no limit
+	 * @param reserved	Number of frames kept for the pool, 0 for none
+	 * @return  			Id of the pool
+	 */
+  PoolId createPool(const std::string& name, const std::uint32_t quota,
+                    const std::uint32_t reserved = 0);
+
+	/**
+	 * Look up a pool by name.
+	 *
+	 * @param name   	Name of the pool
+	 * @return  			Id of the pool
+   * @throws  PoolNotFoundException If there is no pool with that name
+	 */
+  PoolId getPool(const std::string& name) const;
 
 	/**
-   * Get buffer pool usage statistics
+	 * Charge all pages of the file read or allocated from now on to the given pool, whatever kind of access
+	 * they are read with. Pages already cached stay in the pool they were read into.
+	 *
+	 * @param file   	File object
+	 * @param pool   	Pool id, DEFAULT_POOL to drop the assignment
+   * @throws  PoolNotFoundException If the pool does not exist
+	 */
+  void assignFile(const File* file, const PoolId pool);
+
+	/**
+	 * Send pages read with the given kind of access to a pool, for files that are not assigned to one.
+	 *
+	 * @param access 	Kind of access
+	 * @param pool   	Pool id
+   * @throws  PoolNotFoundException If the pool does not exist
 	 */
-  BufStats & getBufStats()
+  void routeAccess(const BufAccess access, const PoolId pool);
+
+	/**
+	 * Get a copy of a pool and its current usage.
+	 *
+	 * @param pool   	Pool id
+   * @throws  PoolNotFoundException If the pool does not exist
+	 */
+  BufPool getPoolInfo(const PoolId pool) const;
+
+	/**
+   * Number of frames currently in the buffer pool
+	 */
+  std::uint32_t getNumBufs() const
   {
-		return bufStats;
+		return numBufs;
   }
 
+	/**
+   * Print member variable values. 
+	 */
+  void  printSelf();
+
+	/**
+   * Get buffer pool usage statistics, summed over the partitions of the hash table
+	 */
+  BufStats & getBufStats();
+
 	/**
    * Clear buffer pool usage statistics
 	 */
-  void clearBufStats() 
-  {
-		bufStats.clear();
-  }
+  void clearBufStats();
 };
 
 }
@@ -0,0 +1,24 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_io_exception.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+FileIOException::FileIOException(const std::string& name, const int errorNumber)
+    : BadgerDbException(""), filename_(name), errorNumber_(errorNumber) {
+  std::stringstream ss;
+  ss << "I/O error on file " << filename_ << ": "
+     << (errorNumber_ != 0 ? std::strerror(errorNumber_) : "nothing written");
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,51 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when reading or writing a file fails.
+ */
+class FileIOException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file I/O exception for the given file.
+   *
+   * @param name         Name of the file that was read or written.
+   * @param errorNumber  errno of the failed call, 0 if a write wrote nothing.
+   */
+  FileIOException(const std::string& name, const int errorNumber);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the errno of the failed call, 0 if a write wrote nothing.
+   */
+  virtual int errorNumber() const { return errorNumber_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno of the failed call.
+   */
+  const int errorNumber_;
+};
+
+}
@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "not_counted_tree_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+NotCountedTreeException::NotCountedTreeException()
+    : BadgerDbException(""){
+  std::stringstream ss;
+  ss << "Index Is Not A Counted Tree";
+  message_.assign(ss.str());
+}
+
+}
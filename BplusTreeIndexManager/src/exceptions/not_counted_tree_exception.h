@@ -0,0 +1,28 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when an order statistic is asked of an
+ *        index that is not a counted tree.
+ */
+class NotCountedTreeException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a not counted tree exception.
+   */
+  NotCountedTreeException();
+};
+
+}
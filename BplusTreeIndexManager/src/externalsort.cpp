@@ -0,0 +1,336 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include "externalsort.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+RecordLess stringAttributeLess(const int attrByteOffset, const int attrLength)
+{
+  return [attrByteOffset, attrLength](const std::string &a, const std::string &b) {
+    return strncmp(a.data() + attrByteOffset, b.data() + attrByteOffset, attrLength) < 0;
+  };
+}
+
+ExternalSort::ExternalSort(const std::string &name, BufMgr *bufMgrIn, const RecordLess &lessIn,
+                           const std::uint32_t framesIn, const bool distinctIn,
+                           const FileIOMode io_mode, const std::uint32_t sharingIn)
+	: prefix(name), bufMgr(bufMgrIn), less(lessIn), frames(std::max<std::uint32_t>(framesIn, 3)),
+	  distinct(distinctIn), ioMode(io_mode), sharing(std::max<std::uint32_t>(sharingIn, 1)),
+	  workspaceBytes(0), sorted(false), workspacePos(0),
+	  haveLast(false), nextRunId(0), numRuns(0), numPasses(0)
+{
+}
+
+ExternalSort::~ExternalSort()
+{
+  endMerge();
+  for (std::size_t i = 0; i < runs.size(); i++)
+    removeRun(runs[i]);
+}
+
+void ExternalSort::add(const std::string &record)
+{
+  // every record takes its length and its bytes in a run
+  if (workspaceBytes + sizeof(std::uint32_t) + record.size() > frames * (std::size_t)Page::SIZE
+      && !workspace.empty())
+    spillWorkspace();
+
+  workspace.push_back(record);
+  workspaceBytes += sizeof(std::uint32_t) + record.size();
+}
+
+void ExternalSort::spillWorkspace()
+{
+  std::stable_sort(workspace.begin(), workspace.end(), less);
+
+  Run *run = createRun();
+  for (std::size_t i = 0; i < workspace.size(); i++)
+    writeRecord(run, workspace[i]);
+  endRun(run);
+  runs.push_back(run);
+
+  workspace.clear();
+  workspaceBytes = 0;
+}
+
+void ExternalSort::sort()
+{
+  sorted = true;
+  if (runs.empty())
+  {
+    // everything fit in the workspace
+    std::stable_sort(workspace.begin(), workspace.end(), less);
+    return;
+  }
+  if (!workspace.empty())
+    spillWorkspace();
+  std::vector<std::string>().swap(workspace);
+
+  // merge passes until the runs that are left can be merged at once; the
+  // inputs and the output of a merge pin at most their share of half of the
+  // buffer pool
+  const std::size_t fanIn = std::max<std::size_t>(
+      3, std::min<std::size_t>(frames, bufMgr->getNumBufs() / (2 * sharing))) - 1;
+  while (runs.size() > fanIn)
+  {
+    std::vector<Run *> merged;
+    for (std::size_t first = 0; first < runs.size(); first += fanIn)
+    {
+      std::vector<Run *> group(runs.begin() + first,
+                               runs.begin() + std::min(first + fanIn, runs.size()));
+      if (group.size() == 1)
+      {
+        merged.push_back(group[0]);
+        continue;
+      }
+
+      startMerge(group);
+      Run *run = createRun();
+      std::string record;
+      while (nextMerged(record))
+        writeRecord(run, record);
+      endRun(run);
+      endMerge();
+      merged.push_back(run);
+    }
+    runs.swap(merged);
+    numPasses++;
+  }
+
+  startMerge(runs);
+  runs.clear();
+  numPasses++;
+}
+
+void ExternalSort::next(std::string &record)
+{
+  while (true)
+  {
+    if (inputs.empty())
+    {
+      if (!sorted || workspacePos == workspace.size())
+        throw EndOfFileException();
+      record = workspace[workspacePos++];
+    }
+    else if (!nextMerged(record))
+    {
+      throw EndOfFileException();
+    }
+
+    // sorted input: a record equal to the previous one does not sort after it
+    if (distinct && haveLast && !less(lastRecord, record))
+      continue;
+    if (distinct)
+    {
+      lastRecord = record;
+      haveLast = true;
+    }
+    return;
+  }
+}
+
+ExternalSort::Run *ExternalSort::createRun()
+{
+  std::ostringstream runName;
+  runName << prefix << ".run" << nextRunId++;
+  try
+  {
+    File::remove(runName.str());
+  }
+  catch (FileNotFoundException &e)
+  {
+  }
+
+  Run *run = new Run();
+  run->name = runName.str();
+  run->file = new BlobFile(run->name, true, ioMode);
+  run->firstPageNo = 0;
+  run->numPages = 0;
+  run->numRecords = 0;
+  run->pageNo = 0;
+  run->page = NULL;
+  run->offset = 0;
+  run->pagesRead = 0;
+  run->recordsRead = 0;
+  numRuns++;
+  return run;
+}
+
+void ExternalSort::removeRun(Run *run)
+{
+  if (run->page != NULL)
+    bufMgr->unPinPage(run->file, run->pageNo, false);
+  bufMgr->flushFile(run->file);
+  delete run->file;
+  File::remove(run->name);
+  delete run;
+}
+
+void ExternalSort::writeBytes(Run *run, const char *data, std::size_t len)
+{
+  while (len > 0)
+  {
+    if (run->page == NULL || run->offset == Page::SIZE)
+    {
+      if (run->page != NULL)
+        bufMgr->unPinPage(run->file, run->pageNo, true);
+      bufMgr->allocPage(run->file, run->pageNo, run->page, ACCESS_SCAN);
+      if (run->numPages == 0)
+        run->firstPageNo = run->pageNo;
+      run->numPages++;
+      run->offset = 0;
+    }
+    const std::size_t n = std::min(len, Page::SIZE - run->offset);
+    memcpy(reinterpret_cast<char*>(run->page) + run->offset, data, n);
+    run->offset += n;
+    data += n;
+    len -= n;
+  }
+}
+
+void ExternalSort::writeRecord(Run *run, const std::string &record)
+{
+  const std::uint32_t len = record.size();
+  writeBytes(run, reinterpret_cast<const char*>(&len), sizeof(len));
+  writeBytes(run, record.data(), len);
+  run->numRecords++;
+}
+
+void ExternalSort::endRun(Run *run)
+{
+  if (run->page != NULL)
+    bufMgr->unPinPage(run->file, run->pageNo, true);
+  run->page = NULL;
+  run->pageNo = 0;
+  run->offset = 0;
+}
+
+void ExternalSort::readBytes(Run *run, char *data, std::size_t len)
+{
+  while (len > 0)
+  {
+    if (run->page == NULL || run->offset == Page::SIZE)
+    {
+      if (run->page != NULL)
+        bufMgr->unPinPage(run->file, run->pageNo, false);
+      run->page = NULL;
+      run->pageNo = run->firstPageNo + run->pagesRead++;
+      bufMgr->readPage(run->file, run->pageNo, run->page, ACCESS_SCAN);
+      run->offset = 0;
+    }
+    const std::size_t n = std::min(len, Page::SIZE - run->offset);
+    memcpy(data, reinterpret_cast<const char*>(run->page) + run->offset, n);
+    run->offset += n;
+    data += n;
+    len -= n;
+  }
+}
+
+bool ExternalSort::readRecord(Run *run, std::string &record)
+{
+  if (run->recordsRead == run->numRecords)
+  {
+    if (run->page != NULL)
+      bufMgr->unPinPage(run->file, run->pageNo, false);
+    run->page = NULL;
+    return false;
+  }
+  std::uint32_t len;
+  readBytes(run, reinterpret_cast<char*>(&len), sizeof(len));
+  record.resize(len);
+  readBytes(run, &record[0], len);
+  run->recordsRead++;
+  return true;
+}
+
+void ExternalSort::startMerge(const std::vector<Run *> &runsIn)
+{
+  inputs = runsIn;
+  const std::size_t k = inputs.size();
+  heads.assign(k, std::string());
+  exhausted.assign(k, false);
+  for (std::size_t i = 0; i < k; i++)
+    exhausted[i] = !readRecord(inputs[i], heads[i]);
+
+  // play the initial tournament bottom-up: the winner of the match at node n
+  // (1 <= n < k) moves up and the loser stays, input i is leaf k + i
+  tree.assign(k, 0);
+  std::vector<std::size_t> winner(2 * k);
+  for (std::size_t i = 0; i < k; i++)
+    winner[k + i] = i;
+  for (std::size_t n = k - 1; n >= 1; n--)
+  {
+    const std::size_t a = winner[2 * n];
+    const std::size_t b = winner[2 * n + 1];
+    if (beats(a, b))
+    {
+      winner[n] = a;
+      tree[n] = b;
+    }
+    else
+    {
+      winner[n] = b;
+      tree[n] = a;
+    }
+  }
+  tree[0] = k > 1 ? winner[1] : 0;
+}
+
+bool ExternalSort::nextMerged(std::string &record)
+{
+  const std::size_t w = tree[0];
+  if (exhausted[w])
+    return false;
+
+  record.swap(heads[w]);
+  exhausted[w] = !readRecord(inputs[w], heads[w]);
+  replay(w);
+  return true;
+}
+
+void ExternalSort::replay(std::size_t i)
+{
+  const std::size_t k = inputs.size();
+  std::size_t winner = i;
+  for (std::size_t n = (k + i) / 2; n >= 1; n /= 2)
+  {
+    if (beats(tree[n], winner))
+      std::swap(tree[n], winner);
+  }
+  tree[0] = winner;
+}
+
+bool ExternalSort::beats(std::size_t a, std::size_t b) const
+{
+  if (exhausted[a])
+    return false;
+  if (exhausted[b])
+    return true;
+  if (less(heads[a], heads[b]))
+    return true;
+  if (less(heads[b], heads[a]))
+    return false;
+  // equal records leave the earlier run first, so the sort is stable
+  return a < b;
+}
+
+void ExternalSort::endMerge()
+{
+  for (std::size_t i = 0; i < inputs.size(); i++)
+    removeRun(inputs[i]);
+  inputs.clear();
+  heads.clear();
+  exhausted.clear();
+  tree.clear();
+}
+
+}
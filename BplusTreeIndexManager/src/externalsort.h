@@ -0,0 +1,253 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Order of the records of an ExternalSort: returns whether record a
+ * sorts before record b.
+ */
+typedef std::function<bool(const std::string &a, const std::string &b)> RecordLess;
+
+/**
+ * @brief Orders records on the attribute of type K at attrByteOffset, e.g.
+ * attributeLess<int>(offsetof(RECORD, i)).
+ */
+template <class K>
+RecordLess attributeLess(const int attrByteOffset)
+{
+  return [attrByteOffset](const std::string &a, const std::string &b) {
+    K ka, kb;
+    memcpy(&ka, a.data() + attrByteOffset, sizeof(K));
+    memcpy(&kb, b.data() + attrByteOffset, sizeof(K));
+    return ka < kb;
+  };
+}
+
+/**
+ * @brief Orders records on the first attrLength characters of the string
+ * attribute at attrByteOffset, like strncmp().
+ */
+RecordLess stringAttributeLess(const int attrByteOffset, const int attrLength);
+
+/**
+ * @brief Sorts records that need not fit in memory.
+ *
+ * Records are added with add(), then sort() is called and the records are read
+ * back in order with next(). Runs are generated in a workspace of at most
+ * 'frames' pages of records. Runs that do not fit are spilled through the
+ * BufMgr to temporary BlobFiles and merged with a loser tree, at most
+ * frames - 1 at a time: one page of every input run and one page of output
+ * are pinned while merging, and no more than half of the frames of the
+ * BufMgr, which sorts running at the same time share. The last merge is not
+ * written out, next() streams its output.
+ */
+class ExternalSort
+{
+ public:
+  /**
+   * Constructor of the sort.
+   *
+   * @param name      Prefix of the names of the temporary files of the runs
+   * @param bufMgr    Buffer manager the runs are read and written through
+   * @param less      Order of the records
+   * @param frames    Number of pages of memory the sort may use, at least 3
+   * @param distinct  Whether next() skips records equal to the previous one
+   * @param io_mode   Mode the run files are read and written with
+   * @param sharing   Number of sorts that merge through bufMgr at the same
+   *                  time, this one included
+   */
+  ExternalSort(const std::string &name, BufMgr *bufMgr, const RecordLess &less,
+               const std::uint32_t frames, const bool distinct = false,
+               const FileIOMode io_mode = IO_BUFFERED,
+               const std::uint32_t sharing = 1);
+
+  /**
+   * Removes the run files that are left.
+   */
+  ~ExternalSort();
+
+  /**
+   * Adds a record to the sort. May spill a run.
+   *
+   * @param record  Record to add, at most Page::SIZE bytes
+   */
+  void add(const std::string &record);
+
+  /**
+   * Ends the input and merges the runs until a single merge is left.
+   */
+  void sort();
+
+  /**
+   * Returns the next record in sorted order.
+   *
+   * @param record  Set to the next record
+   * @throws EndOfFileException if all records were returned
+   */
+  void next(std::string &record);
+
+  /**
+   * Number of runs that were spilled, including the runs written by merges
+   * before the last one.
+   */
+  std::uint32_t getNumRuns() const { return numRuns; }
+
+  /**
+   * Number of merge passes over the data, including the last merge.
+   */
+  std::uint32_t getNumPasses() const { return numPasses; }
+
+ private:
+  /**
+   * A sorted run in a temporary file. Records are stored back to back as a
+   * 4 byte length and the bytes of the record, and may continue on the next
+   * page.
+   */
+  struct Run
+  {
+    BlobFile *file;
+    std::string name;
+    PageId firstPageNo;
+    std::uint32_t numPages;
+    std::size_t numRecords;
+
+    /**
+     * Position of the writer, then of the reader: the page it has pinned, or
+     * NULL, and the offset in it.
+     */
+    PageId pageNo;
+    Page *page;
+    std::size_t offset;
+    std::uint32_t pagesRead;
+    std::size_t recordsRead;
+  };
+
+  /**
+   * Sorts the workspace and writes it to a new run.
+   */
+  void spillWorkspace();
+
+  /**
+   * Creates an empty run in a new temporary file.
+   */
+  Run *createRun();
+
+  /**
+   * Deletes a run and its temporary file.
+   */
+  void removeRun(Run *run);
+
+  /**
+   * Appends len bytes to the run being written, allocating pages as needed.
+   */
+  void writeBytes(Run *run, const char *data, std::size_t len);
+
+  /**
+   * Appends a record to the run being written.
+   */
+  void writeRecord(Run *run, const std::string &record);
+
+  /**
+   * Unpins the last page of the run being written.
+   */
+  void endRun(Run *run);
+
+  /**
+   * Reads len bytes of the run, pinning its next page as needed.
+   */
+  void readBytes(Run *run, char *data, std::size_t len);
+
+  /**
+   * Reads the next record of the run.
+   * @return false if the run has no more records
+   */
+  bool readRecord(Run *run, std::string &record);
+
+  /**
+   * Starts a merge of the given runs.
+   */
+  void startMerge(const std::vector<Run *> &inputs);
+
+  /**
+   * Returns the next record of the merge.
+   * @return false if all inputs are exhausted
+   */
+  bool nextMerged(std::string &record);
+
+  /**
+   * Replays the matches of input i from its leaf to the root of the loser
+   * tree.
+   */
+  void replay(std::size_t i);
+
+  /**
+   * Whether the current record of input a sorts before that of input b. An
+   * exhausted input sorts after everything.
+   */
+  bool beats(std::size_t a, std::size_t b) const;
+
+  /**
+   * Unpins the page of every input of the merge and removes their files.
+   */
+  void endMerge();
+
+  std::string prefix;
+  BufMgr *bufMgr;
+  RecordLess less;
+  std::uint32_t frames;
+  bool distinct;
+  FileIOMode ioMode;
+  std::uint32_t sharing;
+
+  /**
+   * Records of the run being generated, and their size in bytes.
+   */
+  std::vector<std::string> workspace;
+  std::size_t workspaceBytes;
+
+  /**
+   * Runs that were spilled and are not merged yet.
+   */
+  std::vector<Run *> runs;
+
+  /**
+   * The merge that next() reads from: its inputs, their current records,
+   * which of them are exhausted, and the loser tree. tree[0] is the winner,
+   * tree[1..k-1] hold the losers of the inner matches.
+   */
+  std::vector<Run *> inputs;
+  std::vector<std::string> heads;
+  std::vector<bool> exhausted;
+  std::vector<std::size_t> tree;
+
+  /**
+   * Whether sort() was called, the position of next() when the records never
+   * left the workspace, and the last record returned by next().
+   */
+  bool sorted;
+  std::size_t workspacePos;
+  std::string lastRecord;
+  bool haveLast;
+
+  std::uint32_t nextRunId;
+  std::uint32_t numRuns;
+  std::uint32_t numPasses;
+};
+
+}
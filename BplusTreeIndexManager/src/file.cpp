@@ -12,9 +12,19 @@
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
 #include <cassert>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -25,6 +35,81 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::DescriptorMap File::open_fds_;
+std::mutex File::open_mutex_;
+
+/**
+ * Buffer obtained with std::aligned_alloc, for O_DIRECT transfers that do not
+ * start and end on block boundaries.
+ */
+struct AlignedFree {
+  void operator()(char* p) const { std::free(p); }
+};
+typedef std::unique_ptr<char, AlignedFree> AlignedBuffer;
+
+static AlignedBuffer allocAligned(const std::size_t len) {
+  return AlignedBuffer(static_cast<char*>(std::aligned_alloc(IO_ALIGNMENT, len)));
+}
+
+static bool isAligned(const std::size_t value) {
+  return value % IO_ALIGNMENT == 0;
+}
+
+/**
+ * A file created with IO_DIRECT pads its header to a whole page, so it is
+ * always a whole number of pages long.  A file created with IO_BUFFERED is
+ * sizeof(FileHeader) bytes longer than a whole number of pages.
+ */
+static bool hasAlignedLayout(const std::string& filename) {
+  struct stat st;
+  if (::stat(filename.c_str(), &st) != 0) {
+    return false;
+  }
+  return st.st_size > 0 && st.st_size % Page::SIZE == 0;
+}
+
+/**
+ * Reads whole blocks with pread(), zero-filling whatever lies past the end of
+ * the file.
+ */
+static void readBlocks(const std::string& filename, const int fd, off_t pos,
+                       char* buf, std::size_t len) {
+  while (len > 0) {
+    const ssize_t n = ::pread(fd, buf, len, pos);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename, errno);
+    }
+    if (n == 0) {
+      memset(buf, 0, len);
+      return;
+    }
+    buf += n;
+    pos += n;
+    len -= n;
+  }
+}
+
+static void writeBlocks(const std::string& filename, const int fd, off_t pos,
+                        const char* buf, std::size_t len) {
+  while (len > 0) {
+    const ssize_t n = ::pwrite(fd, buf, len, pos);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename, errno);
+    }
+    if (n == 0) {
+      throw FileIOException(filename, 0);
+    }
+    buf += n;
+    pos += n;
+    len -= n;
+  }
+}
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -40,6 +125,7 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
+  std::lock_guard<std::mutex> guard(open_mutex_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
@@ -64,7 +150,13 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+PageId File::getNumPages() {
+  return readHeader().num_pages;
+}
+
+File::File(const std::string& name, const bool create_new,
+           const FileIOMode io_mode)
+    : filename_(name), fd_(-1), requested_mode_(io_mode), aligned_(false) {
   openIfNeeded(create_new);
 
   if (create_new) {
@@ -76,9 +168,15 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
 }
 
 void File::openIfNeeded(const bool create_new) {
+  std::lock_guard<std::mutex> guard(open_mutex_);
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    if (open_fds_.find(filename_) != open_fds_.end()) {
+      fd_ = open_fds_[filename_];
+    } else {
+      stream_ = open_streams_[filename_];
+    }
+    aligned_ = hasAlignedLayout(filename_);
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
@@ -96,13 +194,29 @@ void File::openIfNeeded(const bool create_new) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    aligned_ = create_new ? requested_mode_ == IO_DIRECT
+                          : hasAlignedLayout(filename_);
+    if (requested_mode_ == IO_DIRECT && aligned_) {
+      int flags = O_RDWR | O_DIRECT;
+      if (create_new) {
+        flags |= O_CREAT | O_TRUNC;
+      }
+      // stays -1, and the file is used buffered, if the filesystem does not
+      // support O_DIRECT
+      fd_ = ::open(filename_.c_str(), flags, 0644);
+    }
+    if (fd_ >= 0) {
+      open_fds_[filename_] = fd_;
+    } else {
+      stream_.reset(new SharedStream(filename_, mode));
+      open_streams_[filename_] = stream_;
+    }
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
+  std::lock_guard<std::mutex> guard(open_mutex_);
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
@@ -110,38 +224,135 @@ void File::close() {
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    open_fds_.erase(filename_);
     open_streams_.erase(filename_);
     open_counts_.erase(filename_);
   }
+  fd_ = -1;
 }
 
 FileHeader File::readHeader() const {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  readAt(0 /* pos */, reinterpret_cast<char*>(&header), sizeof(FileHeader));
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  if (aligned_) {
+    // the rest of the header page is padding; writing all of it keeps even
+    // an empty file a whole number of pages long
+    AlignedBuffer block = allocAligned(Page::SIZE);
+    memset(block.get(), 0, Page::SIZE);
+    memcpy(block.get(), &header, sizeof(FileHeader));
+    writeAt(0 /* pos */, block.get(), Page::SIZE);
+    return;
+  }
+  writeAt(0 /* pos */, reinterpret_cast<const char*>(&header),
+          sizeof(FileHeader));
+}
+
+void File::readAt(const std::streampos pos, char* buf,
+                  const std::size_t len) const {
+  if (fd_ < 0) {
+    std::lock_guard<std::mutex> guard(stream_->mutex);
+    stream_->stream.seekg(pos, std::ios::beg);
+    stream_->stream.read(buf, len);
+    return;
+  }
+
+  const off_t start = (off_t)pos - (off_t)pos % IO_ALIGNMENT;
+  const off_t end = ((off_t)pos + len + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+  if (start == (off_t)pos && isAligned(len) && isAligned((std::size_t)buf)) {
+    readBlocks(filename_, fd_, start, buf, len);
+    return;
+  }
+
+  AlignedBuffer blocks = allocAligned(end - start);
+  readBlocks(filename_, fd_, start, blocks.get(), end - start);
+  memcpy(buf, blocks.get() + ((off_t)pos - start), len);
+}
+
+void File::readRun(const std::streampos pos, const std::size_t count,
+                   Page* const* pages) const {
+  if (fd_ < 0) {
+    std::lock_guard<std::mutex> guard(stream_->mutex);
+    stream_->stream.seekg(pos, std::ios::beg);
+    for (std::size_t i = 0; i < count; ++i) {
+      stream_->stream.read(reinterpret_cast<char*>(pages[i]), Page::SIZE);
+    }
+    return;
+  }
+
+  // frames are IO_ALIGNMENT aligned, so they can be read into directly
+  std::vector<struct iovec> iov(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = pages[i];
+    iov[i].iov_len = Page::SIZE;
+  }
+  std::size_t done = 0;
+  while (done < count) {
+    const int batch = (int)std::min<std::size_t>(count - done, IOV_MAX);
+    const off_t offset = (off_t)pos + (off_t)done * Page::SIZE;
+    const ssize_t n = ::preadv(fd_, &iov[done], batch, offset);
+    if (n != (ssize_t)(batch * Page::SIZE)) {
+      break;
+    }
+    done += batch;
+  }
+  // a short read is finished page by page, zero-filling past the end of file
+  for (; done < count; ++done) {
+    readAt(pos + (std::streamoff)(done * Page::SIZE),
+           reinterpret_cast<char*>(pages[done]), Page::SIZE);
+  }
+}
+
+void File::readPages(const PageId first_page_number, const std::size_t count,
+                     Page* const* pages) const {
+  readRun(pagePosition(first_page_number), count, pages);
+}
+
+void File::writeAt(const std::streampos pos, const char* buf,
+                   const std::size_t len) {
+  if (fd_ < 0) {
+    std::lock_guard<std::mutex> guard(stream_->mutex);
+    stream_->stream.seekp(pos, std::ios::beg);
+    stream_->stream.write(buf, len);
+    stream_->stream.flush();
+    return;
+  }
+
+  const off_t start = (off_t)pos - (off_t)pos % IO_ALIGNMENT;
+  const off_t end = ((off_t)pos + len + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+  if (start == (off_t)pos && isAligned(len) && isAligned((std::size_t)buf)) {
+    writeBlocks(filename_, fd_, start, buf, len);
+    return;
+  }
+
+  AlignedBuffer blocks = allocAligned(end - start);
+  readBlocks(filename_, fd_, start, blocks.get(), end - start);
+  memcpy(blocks.get() + ((off_t)pos - start), buf, len);
+  writeBlocks(filename_, fd_, start, blocks.get(), end - start);
 }
 
 
 
 
 
-PageFile PageFile::create(const std::string& filename) {
-  return PageFile(filename, true /* create_new */);
+PageFile PageFile::create(const std::string& filename,
+                       const FileIOMode io_mode) {
+  return PageFile(filename, true /* create_new */, io_mode);
 }
 
-PageFile PageFile::open(const std::string& filename) {
-  return PageFile(filename, false /* create_new */);
+PageFile PageFile::open(const std::string& filename, const FileIOMode io_mode) {
+  return PageFile(filename, false /* create_new */, io_mode);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
-: File(name, create_new)
+PageFile::PageFile(const std::string& name, const bool create_new,
+                   const FileIOMode io_mode)
+: File(name, create_new, io_mode)
 {
 }
 
@@ -149,7 +360,7 @@ PageFile::~PageFile() {
 }
 
 PageFile::PageFile(const PageFile& other)
-: File(other.filename_, false /* create_new */)
+: File(other.filename_, false /* create_new */, other.requested_mode_)
 {
 }
 
@@ -158,6 +369,7 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  requested_mode_ = rhs.requested_mode_;
   openIfNeeded(false /* create_new */);
   return *this;
 }
@@ -212,10 +424,14 @@ Page PageFile::allocatePage(PageId &new_page_number) {
 		else
 		{
       // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
+      // of the linked list.  The list is kept in page number order, so the
+      // tail is the used page with the highest number; looking for it from
+      // the end of the file saves walking the whole list.
+      for (PageId page_number = header.num_pages - 1;
+           page_number >= header.first_used_page; --page_number) {
+        if (readPageHeader(page_number).current_page_number ==
+            page_number) {
+          existing_page = readPage(page_number, false /* allow_free */);
           break;
         }
       }
@@ -247,9 +463,8 @@ Page PageFile::readPage(const PageId page_number) const {
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  // header_ and data_ are laid out back to back, as on disk
+  readAt(pagePosition(page_number), reinterpret_cast<char*>(&page), Page::SIZE);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -257,6 +472,21 @@ Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   return page;
 }
 
+void PageFile::readPages(const PageId first_page_number, const std::size_t count,
+                         Page* const* pages) const {
+  FileHeader header = readHeader();
+
+  if (first_page_number + count > header.num_pages) {
+    throw InvalidPageException(first_page_number + count - 1, filename_);
+  }
+  readRun(pagePosition(first_page_number), count, pages);
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!pages[i]->isUsed()) {
+      throw InvalidPageException(first_page_number + i, filename_);
+    }
+  }
+}
+
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
@@ -315,40 +545,41 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  Page page = new_page;
+  page.header_ = header;
+  writeAt(pagePosition(page_number), reinterpret_cast<const char*>(&page),
+          Page::SIZE);
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(pagePosition(page_number), reinterpret_cast<char*>(&header),
+         sizeof(PageHeader));
   return header;
 }
 
 
 
 
-BlobFile BlobFile::create(const std::string& filename) {
-  return BlobFile(filename, true /* create_new */);
+BlobFile BlobFile::create(const std::string& filename,
+                       const FileIOMode io_mode) {
+  return BlobFile(filename, true /* create_new */, io_mode);
 }
 
-BlobFile BlobFile::open(const std::string& filename) {
-  return BlobFile(filename, false /* create_new */);
+BlobFile BlobFile::open(const std::string& filename, const FileIOMode io_mode) {
+  return BlobFile(filename, false /* create_new */, io_mode);
 }
 
-BlobFile::BlobFile(const std::string& name, const bool create_new)
-: File(name, create_new) {
+BlobFile::BlobFile(const std::string& name, const bool create_new,
+                   const FileIOMode io_mode)
+: File(name, create_new, io_mode) {
 }
 
 BlobFile::~BlobFile() {
 }
 
 BlobFile::BlobFile(const BlobFile& other)
-: File(other.filename_, false /* create_new */)
+: File(other.filename_, false /* create_new */, other.requested_mode_)
 {
 }
 
@@ -357,6 +588,7 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  requested_mode_ = rhs.requested_mode_;
   openIfNeeded(false /* create_new */);
   return *this;
 }
@@ -365,13 +597,21 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
   FileHeader header = readHeader();
 	Page new_page;
 
-	new_page_number = header.num_pages;
+	if (header.num_free_pages > 0) {
+		// reuse the page freed last; its first bytes hold the next free page
+		new_page_number = header.first_free_page;
+		const Page free_page = readPage(new_page_number);
+		memcpy(&header.first_free_page, reinterpret_cast<const char*>(&free_page), sizeof(PageId));
+		--header.num_free_pages;
+	} else {
+		new_page_number = header.num_pages;
 
-	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
-	}
+		if (header.first_used_page == Page::INVALID_NUMBER) {
+			header.first_used_page = header.num_pages;
+		}
 
-	++header.num_pages;
+		++header.num_pages;
+	}
 
 	writePage(new_page_number, new_page);
 	writeHeader(header);
@@ -381,20 +621,30 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readAt(pagePosition(page_number), reinterpret_cast<char*>(&page), Page::SIZE);
 	return page;
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeAt(pagePosition(new_page_number), reinterpret_cast<const char*>(&new_page),
+	        Page::SIZE);
 }
 
-//delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+	FileHeader header = readHeader();
+	if (page_number == Page::INVALID_NUMBER || page_number >= header.num_pages) {
+		throw InvalidPageException(page_number, filename_);
+	}
+
+	// push the page on the free list, linked through the first bytes of the
+	// free pages
+	Page free_page;
+	memcpy(reinterpret_cast<char*>(&free_page), &header.first_free_page, sizeof(PageId));
+	writePage(page_number, free_page);
+
+	header.first_free_page = page_number;
+	++header.num_free_pages;
+	writeHeader(header);
 }
 
 }
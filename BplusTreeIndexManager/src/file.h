@@ -11,6 +11,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
 
 #include "page.h"
 
@@ -18,6 +19,14 @@ namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief How a File transfers pages to and from disk.
+ */
+enum FileIOMode {
+  IO_BUFFERED = 0, /* Through a std::fstream and the operating system page cache */
+  IO_DIRECT = 1    /* With O_DIRECT, bypassing the operating system page cache */
+};
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -68,7 +77,17 @@ struct FileHeader {
  * detects this (by looking in the open_streams_ map) and just returns a file object with
  * the already created stream for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * A file created with IO_DIRECT pads its header to a whole page so that every
+ * page sits at an aligned offset, and is then read and written with O_DIRECT
+ * so that its pages are cached only once, in the buffer pool.  Which layout a
+ * file has is recognised from its size when it is opened; a file created with
+ * IO_BUFFERED cannot be used with O_DIRECT and is always opened buffered.  The
+ * first File object that opens a file decides the mode for all objects sharing
+ * it.
+ *
+ * Files may be opened and closed from several threads at once.  Reading and
+ * writing pages is not threadsafe and is left to the BufMgr, which serializes
+ * it.
  */
 
 
@@ -80,12 +99,14 @@ class File {
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param io_mode     Whether to bypass the operating system page cache.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new,
+       const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Deletes an existing file.
@@ -134,6 +155,18 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads a run of consecutive pages from the file straight into the given
+   * pages, with one seek (one preadv() with O_DIRECT) for the whole run.
+   * No bounds checking is performed.
+   *
+   * @param first_page_number   Number of first page to read.
+   * @param count               Number of pages to read.
+   * @param pages               Where to read page first_page_number + i to.
+   */
+  virtual void readPages(const PageId first_page_number, const std::size_t count,
+                         Page* const* pages) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -157,6 +190,13 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns the mode this file is actually read and written with.
+   *
+   * @return IO_DIRECT if the file bypasses the operating system page cache.
+   */
+  FileIOMode ioMode() const { return fd_ >= 0 ? IO_DIRECT : IO_BUFFERED; }
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -164,6 +204,13 @@ class File {
    */
 	PageId getFirstPageNo();
 
+ 	/**
+   * Returns the number of pages allocated in the file, counting the header.
+   *
+   * @return  Number one greater than the highest page number of the file.
+   */
+	PageId getNumPages();
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -172,10 +219,46 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
+  std::streampos pagePosition(const PageId page_number) const {
+    if (aligned_) {
+      return (std::streampos)page_number * Page::SIZE;
+    }
     return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
   }
 
+  /**
+   * Reads bytes from the file.  With O_DIRECT the enclosing aligned blocks
+   * are read and the requested range copied out of them, unless the range and
+   * the buffer are already aligned.  Bytes past the end of the file read as 0.
+   *
+   * @param pos   Offset in the file.
+   * @param buf   Buffer to read into.
+   * @param len   Number of bytes to read.
+   * @throws  FileIOException  If an O_DIRECT read fails.
+   */
+  void readAt(const std::streampos pos, char* buf, const std::size_t len) const;
+
+  /**
+   * Writes bytes to the file.  With O_DIRECT a range that is not aligned is
+   * written by reading, patching and writing back its enclosing blocks.
+   *
+   * @param pos   Offset in the file.
+   * @param buf   Bytes to write.
+   * @param len   Number of bytes to write.
+   * @throws  FileIOException  If an O_DIRECT write fails or writes nothing.
+   */
+  void writeAt(const std::streampos pos, const char* buf, const std::size_t len);
+
+  /**
+   * Reads consecutive whole pages starting at the given offset.
+   *
+   * @param pos     Offset in the file of the first page.
+   * @param count   Number of pages to read.
+   * @param pages   Where to read each page to.
+   */
+  void readRun(const std::streampos pos, const std::size_t count,
+               Page* const* pages) const;
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
@@ -210,8 +293,22 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Stream of a file that is accessed buffered, shared by every File object
+   * open on it, and the mutex that keeps each seek together with the read or
+   * write that follows it.
+   */
+  struct SharedStream {
+    std::fstream stream;
+    std::mutex mutex;
+
+    SharedStream(const std::string& name, const std::ios_base::openmode mode)
+        : stream(name, mode) {}
+  };
+
+  typedef std::map<std::string, std::shared_ptr<SharedStream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, int> DescriptorMap;
 
   /**
    * Streams for opened files.
@@ -223,6 +320,16 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * O_DIRECT file descriptors for opened files that use IO_DIRECT.
+   */
+  static DescriptorMap open_fds_;
+
+  /**
+   * Guards open_streams_, open_counts_ and open_fds_.
+   */
+  static std::mutex open_mutex_;
+
   /**
    * Name of the file this object represents.
    */
@@ -231,7 +338,23 @@ class File {
   /**
    * Stream for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<SharedStream> stream_;
+
+  /**
+   * O_DIRECT file descriptor for underlying filesystem object, -1 if the file
+   * is accessed through stream_.
+   */
+  int fd_;
+
+  /**
+   * Mode requested when this object was constructed.
+   */
+  FileIOMode requested_mode_;
+
+  /**
+   * True if the header is padded to a whole page so that pages are aligned.
+   */
+  bool aligned_;
 
   friend class FileIterator;
 };
@@ -243,9 +366,11 @@ class PageFile : public File {
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param io_mode   Whether to bypass the operating system page cache.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static PageFile create(const std::string& filename);
+  static PageFile create(const std::string& filename,
+                       const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
@@ -255,21 +380,25 @@ class PageFile : public File {
 	 * open_streams_ map.
    *
    * @param filename  Name of the file.
+   * @param io_mode   Whether to bypass the operating system page cache.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static PageFile open(const std::string& filename);
+  static PageFile open(const std::string& filename,
+                     const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Constructs a file object representing a file on the filesystem.
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param io_mode     Whether to bypass the operating system page cache.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new,
+           const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Copy constructor.
@@ -310,6 +439,19 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads a run of consecutive pages from the file straight into the given
+   * pages, with one seek (one preadv() with O_DIRECT) for the whole run.
+   *
+   * @param first_page_number   Number of first page to read.
+   * @param count               Number of pages to read.
+   * @param pages               Where to read page first_page_number + i to.
+   * @throws  InvalidPageException  If one of the pages doesn't exist in the
+   *                                file or is not currently used.
+   */
+  void readPages(const PageId first_page_number, const std::size_t count,
+                 Page* const* pages) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -389,9 +531,11 @@ class BlobFile : public File {
    * Creates a new BlobFile.
    *
    * @param filename  Name of the file.
+   * @param io_mode   Whether to bypass the operating system page cache.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static BlobFile create(const std::string& filename);
+  static BlobFile create(const std::string& filename,
+                       const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
@@ -401,9 +545,11 @@ class BlobFile : public File {
 	 * open_streams_ map.
    *
    * @param filename  Name of the file.
+   * @param io_mode   Whether to bypass the operating system page cache.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static BlobFile open(const std::string& filename);
+  static BlobFile open(const std::string& filename,
+                     const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Constructs a file object representing a file on the filesystem.
@@ -412,12 +558,14 @@ class BlobFile : public File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param io_mode     Whether to bypass the operating system page cache.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  BlobFile(const std::string& name, const bool create_new);
+  BlobFile(const std::string& name, const bool create_new,
+           const FileIOMode io_mode = IO_BUFFERED);
 
   /**
    * Copy constructor.
@@ -442,7 +590,8 @@ class BlobFile : public File {
   ~BlobFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file. A page freed by deletePage() is reused
+   * before the file is extended.
    *
    * @return The new page.
    */
@@ -468,9 +617,11 @@ class BlobFile : public File {
   void writePage(const PageId page_number, const Page& new_page);
 
   /**
-   * Deletes a page from the file.
+   * Deletes a page from the file. The page is put on the free list of the
+   * file, which allocatePage() takes pages from.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page doesn't exist in the file.
    */
   void deletePage(const PageId page_number);
 };
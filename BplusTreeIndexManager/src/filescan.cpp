@@ -7,16 +7,32 @@
 
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr,
+                   const FileIOMode io_mode)
 {
-  file = new PageFile(name, false);	//dont create new file
+  file = new PageFile(name, false, io_mode);	//dont create new file
 	bufMgr = bufferMgr;
 	curDirtyFlag = false;
   curPage = NULL;
 	filePageIter = file->begin();
+  ranged = false;
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr,
+                   const PageId firstPageNo, const PageId endPageNo,
+                   const FileIOMode io_mode)
+{
+  file = new PageFile(name, false, io_mode);	//dont create new file
+  bufMgr = bufferMgr;
+  curDirtyFlag = false;
+  curPage = NULL;
+  ranged = true;
+  curPageNo = firstPageNo;
+  this->endPageNo = endPageNo;
 }
 
 FileScan::~FileScan()
@@ -24,10 +40,11 @@ FileScan::~FileScan()
   // generally must unpin last page of the scan
   if (curPage != NULL)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file,
+                      ranged ? curPageNo : (*filePageIter).page_number(),
+                      curDirtyFlag);
     curPage = NULL;
 		curDirtyFlag = false;
-    filePageIter = file->begin();
   }
   bufMgr->flushFile(file);
   delete file;
@@ -35,6 +52,12 @@ FileScan::~FileScan()
 
 void FileScan::scanNext(RecordId& outRid)
 {
+  if (ranged)
+  {
+    scanNextInRange(outRid);
+    return;
+  }
+
   std::string rec;
 
   if (filePageIter == file->end())
@@ -53,7 +76,7 @@ void FileScan::scanNext(RecordId& outRid)
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
+    bufMgr->readPage(file, (*filePageIter).page_number(), curPage, ACCESS_SCAN); 
 		curDirtyFlag = false;
 
 		// get the first record off the page
@@ -88,7 +111,7 @@ void FileScan::scanNext(RecordId& outRid)
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    bufMgr->readPage(file, (*filePageIter).page_number(), curPage, ACCESS_SCAN);
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -104,6 +127,43 @@ void FileScan::scanNext(RecordId& outRid)
 	return;
 }
 
+void FileScan::scanNextInRange(RecordId& outRid)
+{
+  if (curPage != NULL)
+  {
+    pageRecordIter++;
+  }
+
+  while (curPage == NULL || pageRecordIter == curPage->end())
+  {
+    if (curPage != NULL)
+    {
+      bufMgr->unPinPage(file, curPageNo, curDirtyFlag);
+      curPage = NULL;
+      curDirtyFlag = false;
+      curPageNo++;
+    }
+    if (curPageNo >= endPageNo)
+    {
+      throw EndOfFileException();
+    }
+
+    try
+    {
+      bufMgr->readPage(file, curPageNo, curPage, ACCESS_SCAN);
+    }
+    catch (InvalidPageException &e)
+    {
+      // a free page, or the range goes past the end of the file
+      curPageNo++;
+      continue;
+    }
+    pageRecordIter = curPage->begin();
+  }
+
+  outRid = pageRecordIter.getCurrentRecord();
+}
+
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page 
 std::string FileScan::getRecord()
@@ -19,12 +19,24 @@ namespace badgerdb {
 
 /**
  * @brief This class is used to sequentially scan records in a relation.
+ * Pages are read with ACCESS_SCAN, so BufMgr::routeAccess() can give scans a
+ * pool of their own.
  */
 class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  FileScan(const std::string &name, BufMgr *bufMgr,
+           const FileIOMode io_mode = IO_BUFFERED);
+
+  /**
+   * Scan of the used pages numbered firstPageNo to endPageNo - 1 only, which
+   * are read by page number rather than by following the page list, so that
+   * scans of disjoint ranges can run on several threads sharing one BufMgr.
+   * Free pages and numbers past the end of the file are skipped.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const PageId firstPageNo,
+           const PageId endPageNo, const FileIOMode io_mode = IO_BUFFERED);
 
   ~FileScan();
 
@@ -38,6 +50,11 @@ class FileScan
   void markDirty();
 
  private:
+  /**
+   * scanNext() of a scan of a range of page numbers.
+   */
+  void scanNextInRange(RecordId& outRid);
+
   /**
    * File which is being scanned.
    */
@@ -54,6 +71,15 @@ class FileScan
   Page*         curPage;
 
   FileIterator  filePageIter;
+
+  /**
+   * For a scan of a range of page numbers: the page being scanned, or the
+   * next one to read if curPage is NULL, and the end of the range.
+   */
+  bool          ranged;
+  PageId        curPageNo;
+  PageId        endPageNo;
+
   PageIterator  pageRecordIter;
 
   /**
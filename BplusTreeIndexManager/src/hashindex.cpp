@@ -0,0 +1,598 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "hashindex.h"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "filescan.h"
+#include "keysearch.h"
+
+namespace badgerdb {
+
+/**
+ * Whether the hashes agree on their bits from depth up to MAXGLOBALDEPTH,
+ * so that no split of a bucket of that depth tells them apart.
+ */
+bool same_hash_bits(const std::uint64_t a, const std::uint64_t b,
+                    const int depth){
+    const std::uint64_t mask = ((std::uint64_t)1 << MAXGLOBALDEPTH) - 1;
+    return ((a ^ b) & mask) >> depth == 0;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::HashIndex -- Constructor
+// -----------------------------------------------------------------------------
+
+HashIndex::HashIndex(const std::string &relationName,
+                     std::string &outIndexName, BufMgr *bufMgrIn,
+                     const int attrByteOffset, const Datatype attrType,
+                     const FileIOMode ioMode) {
+  this->bufMgr = bufMgrIn;
+  this->attrByteOffset = attrByteOffset;
+  this->attributeType = attrType;
+  this->globalDepth = 0;
+  this->directoryChanged = false;
+  this->numBuckets = 0;
+  this->overflowPages = 0;
+  this->numEntries = 0;
+
+  std::ostringstream idxstr;
+  idxstr << relationName << '.' << attrByteOffset << ".hash";
+  outIndexName = idxstr.str();
+
+  if (File::exists(outIndexName)) {
+    this->file = new BlobFile(outIndexName, false, ioMode);
+    this->headerPageNum = file->getFirstPageNo();
+    Page *headerPage;
+    bufMgr->readPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+    HashMetaInfo *meta = (HashMetaInfo *)headerPage;
+    if (!relation_name_matches(meta->relationName, relationName) ||
+        attrType != meta->attrType || attrByteOffset != meta->attrByteOffset) {
+      bufMgr->unPinPage(file, headerPageNum, false);
+      // no destructor runs for a throwing constructor, so close the file here
+      bufMgr->flushFile(file);
+      delete file;
+      file = nullptr;
+      throw BadIndexInfoException(outIndexName);
+    }
+    this->globalDepth = meta->globalDepth;
+    this->numBuckets = meta->numBuckets;
+    this->overflowPages = meta->overflowPages;
+    this->numEntries = meta->numEntries;
+    const PageId directoryPageNo = meta->directoryPageNo;
+    bufMgr->unPinPage(file, headerPageNum, false);
+    readDirectory(directoryPageNo);
+    return;
+  }
+
+  file = new BlobFile(outIndexName, true, ioMode);
+  Page *headerPage;
+  bufMgr->allocPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+  HashMetaInfo *meta = (HashMetaInfo *)headerPage;
+  memset(meta, 0, sizeof(HashMetaInfo));
+  relation_name_set(meta->relationName, relationName);
+  meta->attrByteOffset = attrByteOffset;
+  meta->attrType = attrType;
+  bufMgr->unPinPage(file, headerPageNum, true);
+
+  switch (attrType) {
+    case INTEGER:
+      buildIndex<int>(relationName, ioMode);
+      break;
+    case DOUBLE:
+      buildIndex<double>(relationName, ioMode);
+      break;
+    case STRING:
+      buildIndex<StringKey>(relationName, ioMode);
+      break;
+  }
+  writeDirectory();
+}
+
+/**
+ * Start with a single empty bucket of depth 0, which every key maps to, and
+ * insert an entry for every record of the relation.
+ */
+template <class T>
+void HashIndex::buildIndex(const std::string &relationName,
+                           const FileIOMode ioMode) {
+  PageId bucketPageNo;
+  allocBucket<T>(bucketPageNo, 0);
+  bufMgr->unPinPage(file, bucketPageNo, true);
+  this->directory.assign(1, bucketPageNo);
+  this->directoryChanged = true;
+  this->numBuckets = 1;
+
+  FileScan scan(relationName, bufMgr, ioMode);
+  RecordId rid;
+  try {
+    while (true) {
+      scan.scanNext(rid);
+      std::string recordStr = scan.getRecord();
+      T key;
+      key_set(key, recordStr.c_str() + attrByteOffset);
+      insertKey(key, rid);
+    }
+  } catch (EndOfFileException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::~HashIndex -- destructor
+// -----------------------------------------------------------------------------
+
+HashIndex::~HashIndex() {
+  writeDirectory();
+  bufMgr->flushFile(this->file);
+  delete this->file;
+  this->file = nullptr;
+}
+
+void HashIndex::readDirectory(const PageId firstPageNo) {
+  const std::size_t size = (std::size_t)1 << globalDepth;
+  this->directory.clear();
+  this->directory.reserve(size);
+  PageId pageNo = firstPageNo;
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_INNER);
+    const HashDirectoryPage *dir = (const HashDirectoryPage *)page;
+    const std::size_t n = std::min<std::size_t>(
+        HASHDIRECTORYSIZE, size - this->directory.size());
+    this->directory.insert(this->directory.end(), dir->bucketPageNo,
+                           dir->bucketPageNo + n);
+    this->directoryPages.push_back(pageNo);
+    const PageId nextPageNo = dir->nextPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = nextPageNo;
+  }
+}
+
+void HashIndex::writeDirectory() {
+  if (this->directoryChanged) {
+    // the directory only grows, so its pages are written over and new ones
+    // are added at the end of the chain
+    const std::size_t numPages =
+        (directory.size() + HASHDIRECTORYSIZE - 1) / HASHDIRECTORYSIZE;
+    while (this->directoryPages.size() < numPages) {
+      PageId pageNo;
+      Page *page;
+      bufMgr->allocPage(file, pageNo, page, ACCESS_INDEX_INNER);
+      bufMgr->unPinPage(file, pageNo, true);
+      this->directoryPages.push_back(pageNo);
+    }
+    for (std::size_t p = 0; p < numPages; p++) {
+      Page *page;
+      bufMgr->readPage(file, directoryPages[p], page, ACCESS_INDEX_INNER);
+      HashDirectoryPage *dir = (HashDirectoryPage *)page;
+      const std::size_t first = p * HASHDIRECTORYSIZE;
+      const std::size_t n =
+          std::min<std::size_t>(HASHDIRECTORYSIZE, directory.size() - first);
+      std::copy(directory.begin() + first, directory.begin() + first + n,
+                dir->bucketPageNo);
+      dir->nextPageNo = p + 1 < numPages ? directoryPages[p + 1] : 0;
+      bufMgr->unPinPage(file, directoryPages[p], true);
+    }
+    this->directoryChanged = false;
+  }
+
+  Page *headerPage;
+  bufMgr->readPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+  HashMetaInfo *meta = (HashMetaInfo *)headerPage;
+  meta->globalDepth = this->globalDepth;
+  meta->directoryPageNo = this->directoryPages.front();
+  meta->numBuckets = this->numBuckets;
+  meta->overflowPages = this->overflowPages;
+  meta->numEntries = this->numEntries;
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+template <class T>
+HashBucket<T> *HashIndex::allocBucket(PageId &pageNo, const int localDepth) {
+  Page *page;
+  bufMgr->allocPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+  HashBucket<T> *bucket = (HashBucket<T> *)page;
+  bucket->localDepth = localDepth;
+  bucket->keyNum = 0;
+  bucket->overflowPageNo = 0;
+  return bucket;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+void HashIndex::insertEntry(const void *key, const RecordId rid) {
+  switch (attributeType) {
+    case INTEGER: {
+      int intKey;
+      key_set(intKey, key);
+      insertKey(intKey, rid);
+      break;
+    }
+    case DOUBLE: {
+      double doubleKey;
+      key_set(doubleKey, key);
+      insertKey(doubleKey, rid);
+      break;
+    }
+    case STRING: {
+      StringKey stringKey;
+      key_set(stringKey, key);
+      insertKey(stringKey, rid);
+      break;
+    }
+  }
+}
+
+template <class T>
+void HashIndex::insertKey(const T &key, const RecordId rid) {
+  const std::uint64_t hash = key_hash(key);
+  std::unique_lock<std::shared_mutex> guard(indexLatch);
+  while (true) {
+    // the first page of the chain of the bucket with a free slot takes the
+    // entry, in key order
+    PageId pageNo = directory[slotOf(hash)];
+    while (true) {
+      Page *page;
+      bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+      HashBucket<T> *bucket = (HashBucket<T> *)page;
+      if (bucket->keyNum < HashBucket<T>::SIZE) {
+        const int n = bucket->keyNum;
+        const int i = keyUpperBound(bucket->keyArray, n, key);
+        std::move_backward(bucket->keyArray + i, bucket->keyArray + n,
+                           bucket->keyArray + n + 1);
+        std::move_backward(bucket->ridArray + i, bucket->ridArray + n,
+                           bucket->ridArray + n + 1);
+        bucket->keyArray[i] = key;
+        bucket->ridArray[i] = rid;
+        bucket->keyNum++;
+        bufMgr->unPinPage(file, pageNo, true);
+        this->numEntries++;
+        return;
+      }
+      const PageId nextPageNo = bucket->overflowPageNo;
+      bufMgr->unPinPage(file, pageNo, false);
+      if (nextPageNo == 0) {
+        break;
+      }
+      pageNo = nextPageNo;
+    }
+
+    if (splitBucket<T>(hash)) {
+      continue;
+    }
+
+    // no split tells the entries apart, so the chain grows by a page
+    PageId overflowPageNo;
+    HashBucket<T> *overflow = allocBucket<T>(overflowPageNo, 0);
+    overflow->keyArray[0] = key;
+    overflow->ridArray[0] = rid;
+    overflow->keyNum = 1;
+    bufMgr->unPinPage(file, overflowPageNo, true);
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    ((HashBucket<T> *)page)->overflowPageNo = overflowPageNo;
+    bufMgr->unPinPage(file, pageNo, true);
+    this->overflowPages++;
+    this->numEntries++;
+    return;
+  }
+}
+
+template <class T>
+bool HashIndex::splitBucket(const std::uint64_t hash) {
+  const std::size_t slot = slotOf(hash);
+  const PageId bucketPageNo = directory[slot];
+  Page *page;
+  bufMgr->readPage(file, bucketPageNo, page, ACCESS_INDEX_LEAF);
+  HashBucket<T> *bucket = (HashBucket<T> *)page;
+  const int depth = bucket->localDepth;
+
+  // the entries of the whole chain, each page of which is sorted, and the
+  // overflow pages they are moved out of
+  std::vector<RIDKeyPair<T> > entries;
+  std::vector<PageId> overflowPageNos;
+  bool separable = false;
+  const HashBucket<T> *chainPage = bucket;
+  PageId chainPageNo = bucketPageNo;
+  while (true) {
+    for (int i = 0; i < chainPage->keyNum; i++) {
+      RIDKeyPair<T> entry;
+      entry.set(chainPage->ridArray[i], chainPage->keyArray[i]);
+      entries.push_back(entry);
+      separable = separable ||
+                  !same_hash_bits(key_hash(entry.key), hash, depth);
+    }
+    const PageId nextPageNo = chainPage->overflowPageNo;
+    if (chainPage != bucket) {
+      bufMgr->unPinPage(file, chainPageNo, false);
+    }
+    if (nextPageNo == 0) {
+      break;
+    }
+    overflowPageNos.push_back(nextPageNo);
+    bufMgr->readPage(file, nextPageNo, page, ACCESS_INDEX_LEAF);
+    chainPage = (const HashBucket<T> *)page;
+    chainPageNo = nextPageNo;
+  }
+  if (depth >= MAXGLOBALDEPTH || !separable) {
+    bufMgr->unPinPage(file, bucketPageNo, false);
+    return false;
+  }
+
+  if (depth == this->globalDepth) {
+    // every bucket gets a second directory entry, one bit longer
+    this->directory.insert(this->directory.end(), this->directory.begin(),
+                           this->directory.end());
+    this->globalDepth++;
+  }
+
+  // the entries whose hash has bit depth set move to the new bucket
+  std::vector<RIDKeyPair<T> > low, high;
+  std::sort(entries.begin(), entries.end());
+  for (const RIDKeyPair<T> &entry : entries) {
+    if ((key_hash(entry.key) >> depth) & 1) {
+      high.push_back(entry);
+    } else {
+      low.push_back(entry);
+    }
+  }
+  for (const PageId pageNo : overflowPageNos) {
+    bufMgr->disposePage(file, pageNo);
+  }
+  this->overflowPages -= overflowPageNos.size();
+
+  PageId newPageNo;
+  HashBucket<T> *newBucket = allocBucket<T>(newPageNo, depth + 1);
+  bucket->localDepth = depth + 1;
+  writeBucket(bucket, low);
+  writeBucket(newBucket, high);
+  bufMgr->unPinPage(file, newPageNo, true);
+  bufMgr->unPinPage(file, bucketPageNo, true);
+
+  // of the directory entries of the bucket, which agree with slot on their
+  // low depth bits, those with bit depth set now go to the new bucket
+  const std::size_t step = (std::size_t)1 << depth;
+  for (std::size_t i = slot & (step - 1); i < directory.size(); i += step) {
+    if ((i >> depth) & 1) {
+      this->directory[i] = newPageNo;
+    }
+  }
+  this->numBuckets++;
+  this->directoryChanged = true;
+  return true;
+}
+
+template <class T>
+void HashIndex::writeBucket(HashBucket<T> *bucket,
+                            const std::vector<RIDKeyPair<T> > &entries) {
+  HashBucket<T> *page = bucket;
+  PageId pageNo = 0;
+  std::size_t next = 0;
+  while (true) {
+    const int n = std::min<std::size_t>(HashBucket<T>::SIZE,
+                                        entries.size() - next);
+    for (int i = 0; i < n; i++) {
+      page->keyArray[i] = entries[next + i].key;
+      page->ridArray[i] = entries[next + i].rid;
+    }
+    page->keyNum = n;
+    page->overflowPageNo = 0;
+    next += n;
+    if (next == entries.size()) {
+      break;
+    }
+    PageId overflowPageNo;
+    HashBucket<T> *overflow = allocBucket<T>(overflowPageNo, 0);
+    this->overflowPages++;
+    page->overflowPageNo = overflowPageNo;
+    if (page != bucket) {
+      bufMgr->unPinPage(file, pageNo, true);
+    }
+    page = overflow;
+    pageNo = overflowPageNo;
+  }
+  if (page != bucket) {
+    bufMgr->unPinPage(file, pageNo, true);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::lookup
+// -----------------------------------------------------------------------------
+
+std::optional<RecordId> HashIndex::lookup(const void *key) {
+  switch (attributeType) {
+    case INTEGER: {
+      int intKey;
+      key_set(intKey, key);
+      return lookupKey(intKey);
+    }
+    case DOUBLE: {
+      double doubleKey;
+      key_set(doubleKey, key);
+      return lookupKey(doubleKey);
+    }
+    case STRING: {
+      StringKey stringKey;
+      key_set(stringKey, key);
+      return lookupKey(stringKey);
+    }
+  }
+  return std::nullopt;
+}
+
+template <class T>
+std::optional<RecordId> HashIndex::lookupKey(const T &key) {
+  const std::uint64_t hash = key_hash(key);
+  std::shared_lock<std::shared_mutex> guard(indexLatch);
+  PageId pageNo = directory[slotOf(hash)];
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    const HashBucket<T> *bucket = (const HashBucket<T> *)page;
+    const int i = keyLowerBound(bucket->keyArray, bucket->keyNum, key);
+    std::optional<RecordId> found;
+    if (i < bucket->keyNum && bucket->keyArray[i] == key) {
+      found = bucket->ridArray[i];
+    }
+    const PageId nextPageNo = bucket->overflowPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    if (found) {
+      return found;
+    }
+    pageNo = nextPageNo;
+  }
+  return std::nullopt;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::lookupAll
+// -----------------------------------------------------------------------------
+
+std::size_t HashIndex::lookupAll(const void *key,
+                                 std::vector<RecordId> &outRids) {
+  switch (attributeType) {
+    case INTEGER: {
+      int intKey;
+      key_set(intKey, key);
+      return lookupAllKey(intKey, outRids);
+    }
+    case DOUBLE: {
+      double doubleKey;
+      key_set(doubleKey, key);
+      return lookupAllKey(doubleKey, outRids);
+    }
+    case STRING: {
+      StringKey stringKey;
+      key_set(stringKey, key);
+      return lookupAllKey(stringKey, outRids);
+    }
+  }
+  return 0;
+}
+
+template <class T>
+std::size_t HashIndex::lookupAllKey(const T &key,
+                                    std::vector<RecordId> &outRids) {
+  const std::uint64_t hash = key_hash(key);
+  std::shared_lock<std::shared_mutex> guard(indexLatch);
+  const std::size_t before = outRids.size();
+  PageId pageNo = directory[slotOf(hash)];
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    const HashBucket<T> *bucket = (const HashBucket<T> *)page;
+    for (int i = keyLowerBound(bucket->keyArray, bucket->keyNum, key);
+         i < bucket->keyNum && bucket->keyArray[i] == key; i++) {
+      outRids.push_back(bucket->ridArray[i]);
+    }
+    const PageId nextPageNo = bucket->overflowPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = nextPageNo;
+  }
+  return outRids.size() - before;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool HashIndex::deleteEntry(const void *key, const RecordId rid) {
+  switch (attributeType) {
+    case INTEGER: {
+      int intKey;
+      key_set(intKey, key);
+      return deleteKey(intKey, rid);
+    }
+    case DOUBLE: {
+      double doubleKey;
+      key_set(doubleKey, key);
+      return deleteKey(doubleKey, rid);
+    }
+    case STRING: {
+      StringKey stringKey;
+      key_set(stringKey, key);
+      return deleteKey(stringKey, rid);
+    }
+  }
+  return false;
+}
+
+template <class T>
+bool HashIndex::deleteKey(const T &key, const RecordId rid) {
+  const std::uint64_t hash = key_hash(key);
+  std::unique_lock<std::shared_mutex> guard(indexLatch);
+  PageId prevPageNo = 0;
+  PageId pageNo = directory[slotOf(hash)];
+  while (pageNo != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNo, page, ACCESS_INDEX_LEAF);
+    HashBucket<T> *bucket = (HashBucket<T> *)page;
+    const int n = bucket->keyNum;
+    int i = keyLowerBound(bucket->keyArray, n, key);
+    while (i < n && bucket->keyArray[i] == key && bucket->ridArray[i] != rid) {
+      i++;
+    }
+    if (i < n && bucket->keyArray[i] == key) {
+      std::move(bucket->keyArray + i + 1, bucket->keyArray + n,
+                bucket->keyArray + i);
+      std::move(bucket->ridArray + i + 1, bucket->ridArray + n,
+                bucket->ridArray + i);
+      bucket->keyNum--;
+      this->numEntries--;
+      const PageId nextPageNo = bucket->overflowPageNo;
+      const bool emptyOverflow = prevPageNo != 0 && bucket->keyNum == 0;
+      bufMgr->unPinPage(file, pageNo, true);
+      if (emptyOverflow) {
+        // an empty overflow page is unlinked, the bucket itself stays
+        bufMgr->readPage(file, prevPageNo, page, ACCESS_INDEX_LEAF);
+        ((HashBucket<T> *)page)->overflowPageNo = nextPageNo;
+        bufMgr->unPinPage(file, prevPageNo, true);
+        bufMgr->disposePage(file, pageNo);
+        this->overflowPages--;
+      }
+      return true;
+    }
+    const PageId nextPageNo = bucket->overflowPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    prevPageNo = pageNo;
+    pageNo = nextPageNo;
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::stats
+// -----------------------------------------------------------------------------
+
+HashIndexStats HashIndex::stats() {
+  std::shared_lock<std::shared_mutex> guard(indexLatch);
+  HashIndexStats stats;
+  stats.globalDepth = this->globalDepth;
+  stats.numBuckets = this->numBuckets;
+  stats.overflowPages = this->overflowPages;
+  stats.numEntries = this->numEntries;
+  int slots = HashBucket<int>::SIZE;
+  if (attributeType == DOUBLE) {
+    slots = HashBucket<double>::SIZE;
+  } else if (attributeType == STRING) {
+    slots = HashBucket<StringKey>::SIZE;
+  }
+  stats.bucketFill = (double)this->numEntries /
+                     ((this->numBuckets + this->overflowPages) * slots);
+  return stats;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,367 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Largest global depth of a HashIndex, so the directory has at most
+ * 2^MAXGLOBALDEPTH entries. A full bucket that is already this deep is
+ * extended with overflow pages instead of split.
+ */
+const int MAXGLOBALDEPTH = 24;
+
+/**
+ * @brief The meta page of a hash index file, its first page, which holds what
+ * IndexMetaInfo holds for a BTreeIndex: the relation, the byte offset and type
+ * of the key, and the shape of the index.
+ */
+struct HashMetaInfo {
+  /**
+   * Name of base relation.
+   */
+  char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored
+   * in pages.
+   */
+  int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+  Datatype attrType;
+
+  /**
+   * Number of low bits of the hash of a key that index the directory.
+   */
+  int globalDepth;
+
+  /**
+   * First page of the directory, see HashDirectoryPage.
+   */
+  PageId directoryPageNo;
+
+  /**
+   * Buckets, overflow pages and entries of the index.
+   */
+  std::int64_t numBuckets;
+  std::int64_t overflowPages;
+  std::int64_t numEntries;
+};
+
+/**
+ * @brief Number of bucket page numbers in a page of the directory.
+ */
+//                                                   next pageNo
+const int HASHDIRECTORYSIZE = (Page::SIZE - sizeof(PageId)) / sizeof(PageId);
+
+/**
+ * @brief Structure for the pages of the directory of a hash index, which maps
+ * the low globalDepth bits of the hash of a key to the bucket that holds the
+ * key. Its 2^globalDepth entries fill a chain of pages linked by nextPageNo.
+ */
+struct HashDirectoryPage {
+  /**
+   * Next page of the directory, or 0 on the last one.
+   */
+  PageId nextPageNo;
+
+  /**
+   * Page numbers of the buckets.
+   */
+  PageId bucketPageNo[HASHDIRECTORYSIZE];
+};
+
+/**
+ * @brief Structure for the buckets of a hash index, for keys of type T. A
+ * bucket holds the entries whose hashes end in the same localDepth bits,
+ * sorted by key so that they are searched like the keys of a leaf. Its
+ * entries that do not fit are kept in a chain of overflow pages of the same
+ * structure, each sorted on its own, linked by overflowPageNo, whose
+ * localDepth is not used.
+ */
+template <class T>
+struct HashBucket {
+  /**
+   * Number of key slots of a bucket.
+   */
+  //                                    localDepth, keyNum, overflow pageNo
+  //                                    padding
+  static const int SIZE =
+      (Page::SIZE - 4 * sizeof(int)) / (sizeof(T) + sizeof(RecordId));
+
+  /**
+   * Number of low bits of the hash that all keys of the bucket share.
+   */
+  int localDepth;
+
+  /**
+   * Number of keys in this page.
+   */
+  int keyNum;
+
+  /**
+   * Next overflow page of the bucket, or 0.
+   */
+  PageId overflowPageNo;
+
+  /**
+   * Stores keys.
+   */
+  T keyArray[SIZE];
+
+  /**
+   * Stores RecordIds.
+   */
+  RecordId ridArray[SIZE];
+};
+
+static_assert(sizeof(HashBucket<int>) <= Page::SIZE &&
+                  sizeof(HashBucket<double>) <= Page::SIZE &&
+                  sizeof(HashBucket<StringKey>) <= Page::SIZE,
+              "hash buckets must fit in a page");
+
+/**
+ * @brief Shape of a hash index, see HashIndex::stats().
+ */
+struct HashIndexStats {
+  int globalDepth;
+  std::int64_t numBuckets;
+  std::int64_t overflowPages;
+  std::int64_t numEntries;
+
+  /**
+   * Average fraction of the slots of a bucket in use, overflow pages not
+   * counted.
+   */
+  double bucketFill;
+};
+
+/**
+ * @brief HashIndex class. It implements a disk-based extendible hash index on
+ * a single attribute of a relation, for workloads of equality lookups only.
+ *
+ * The directory is read into memory when the index is opened and written
+ * back when it is closed, so a lookup reads the bucket of its key and no
+ * other page, and the overflow pages of the bucket if it has any. A full
+ * bucket is split in two on the next bit of the hash of its keys, doubling
+ * the directory if the bucket is as deep as it, so the index grows one
+ * bucket at a time. A bucket whose entries all hash the same, such as the
+ * entries of one key, cannot be split and takes overflow pages. Deletes do
+ * not merge buckets or shrink the directory.
+ *
+ * Buckets are read with ACCESS_INDEX_LEAF and the meta and directory pages
+ * with ACCESS_INDEX_INNER. lookup() and lookupAll() may be called from many
+ * threads at once; insertEntry() and deleteEntry() hold the index exclusive.
+ */
+class HashIndex {
+ private:
+  /**
+   * File object for the index file.
+   */
+  File *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  /**
+   * Number of low bits of the hash of a key that index directory.
+   */
+  int globalDepth;
+
+  /**
+   * Bucket page of every value of the low globalDepth bits of a hash. A
+   * bucket of local depth d has 2^(globalDepth - d) entries.
+   */
+  std::vector<PageId> directory;
+
+  /**
+   * Pages of the directory in the index file, and whether the directory
+   * changed since it was written to them.
+   */
+  std::vector<PageId> directoryPages;
+  bool directoryChanged;
+
+  /**
+   * Buckets, overflow pages and entries of the index.
+   */
+  std::int64_t numBuckets;
+  std::int64_t overflowPages;
+  std::int64_t numEntries;
+
+  /**
+   * Held shared by lookups and exclusive by inserts and deletes.
+   */
+  std::shared_mutex indexLatch;
+
+  /**
+   * Reads the directory from its chain of pages, or writes it over them,
+   * adding pages as it grows, and stores the shape of the index in the meta
+   * page.
+   */
+  void readDirectory(const PageId firstPageNo);
+  void writeDirectory();
+
+  /**
+   * Allocates a bucket or an overflow page, with no entries.
+   */
+  template <class T>
+  HashBucket<T> *allocBucket(PageId &pageNo, const int localDepth);
+
+  /**
+   * Build the index by inserting an entry for every record of the relation.
+   */
+  template <class T>
+  void buildIndex(const std::string &relationName, const FileIOMode ioMode);
+
+  template <class T>
+  void insertKey(const T &key, const RecordId rid);
+
+  /**
+   * Splits the full bucket at the directory entry of the hash in two on bit
+   * localDepth of the hashes of its entries, doubling the directory if the
+   * bucket is as deep as it. The entries of its overflow pages are moved too.
+   * @return false, and nothing is changed, if the bucket is MAXGLOBALDEPTH
+   * deep or all of its entries and the hash agree on every bit up to it, so
+   * that a split would leave them all on one side
+   */
+  template <class T>
+  bool splitBucket(const std::uint64_t hash);
+
+  /**
+   * Writes the entries to the bucket page and as many new overflow pages
+   * after it as they need.
+   */
+  template <class T>
+  void writeBucket(HashBucket<T> *bucket,
+                   const std::vector<RIDKeyPair<T> > &entries);
+
+  template <class T>
+  std::optional<RecordId> lookupKey(const T &key);
+
+  template <class T>
+  std::size_t lookupAllKey(const T &key, std::vector<RecordId> &outRids);
+
+  template <class T>
+  bool deleteKey(const T &key, const RecordId rid);
+
+  /**
+   * Directory entry of a hash.
+   */
+  std::size_t slotOf(const std::uint64_t hash) const {
+    return hash & (((std::uint64_t)1 << globalDepth) - 1);
+  }
+
+ public:
+  /**
+   * HashIndex Constructor.
+   * Check to see if the corresponding index file exists. If so, open the
+   * file. If not, create it and insert entries for every tuple in the base
+   * relation using FileScan class.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file, the name of
+   * the relation, the offset of the attribute and ".hash"
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param attrByteOffset      Offset of attribute, over which index is to be
+   * built, in the record
+   * @param attrType            Datatype of attribute over which index is
+   * built
+   * @param ioMode              Mode the index file, and the relation while
+   * the index is built from it, are read and written with
+   * @throws  BadIndexInfoException     If the index file already exists for
+   * the corresponding attribute, but values in its meta page do not match
+   * with values received through constructor parameters.
+   */
+  HashIndex(const std::string &relationName, std::string &outIndexName,
+            BufMgr *bufMgrIn, const int attrByteOffset,
+            const Datatype attrType, const FileIOMode ioMode = IO_BUFFERED);
+
+  /**
+   * HashIndex Destructor.
+   * Writes the directory and the meta page, flushes the index file from the
+   * buffer manager and closes it. Does not throw.
+   */
+  ~HashIndex();
+
+  /**
+   * Insert a new entry using the pair <value,rid>.
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted
+   *into the index.
+   **/
+  void insertEntry(const void *key, const RecordId rid);
+
+  /**
+   * Delete the entry <key,rid>. An overflow page left empty is given back to
+   * the index file.
+   * @param key			Key of the entry, pointer to integer/double/char
+   *string
+   * @param rid			Record ID of the entry
+   * @return whether the index held the entry
+   **/
+  bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Find an entry with the given key.
+   * @param key			Key to look for, pointer to integer/double/char
+   *string
+   * @return Record ID of an entry with the key, if the index holds it
+   **/
+  std::optional<RecordId> lookup(const void *key);
+
+  /**
+   * Find all entries with the given key.
+   * @param key			Key to look for, pointer to integer/double/char
+   *string
+   * @param outRids	Record IDs of the entries are appended to this, in no
+   *order
+   * @return number of entries found
+   **/
+  std::size_t lookupAll(const void *key, std::vector<RecordId> &outRids);
+
+  /**
+   * Shape of the index, read from counters kept up to date, so no page is
+   * read.
+   */
+  HashIndexStats stats();
+};
+
+}  // namespace badgerdb
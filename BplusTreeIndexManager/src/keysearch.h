@@ -0,0 +1,201 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief Search of the sorted key array of a B+ tree node.
+ *
+ * keyLowerBound() and keyUpperBound() return the same index as
+ * std::lower_bound() and std::upper_bound(). For INTEGER and DOUBLE keys they
+ * binary search down to a block of at most KEYSEARCHBLOCK keys and then
+ * compare the key with the whole block, adding up the comparison masks in a
+ * vector register, which needs no branch per key. The block is compared with
+ * AVX2 when the code is compiled for it (-mavx2), else with SSE2, else one key
+ * at a time. STRING keys always use std::lower_bound() and std::upper_bound().
+ */
+#if defined(__AVX2__)
+const int KEYSEARCHBLOCK = 64;
+#else
+const int KEYSEARCHBLOCK = 32;
+#endif
+
+/**
+ * Name of the instructions the blocks are compared with.
+ */
+#if defined(__AVX2__)
+const char *const KEYSEARCHISA = "avx2";
+#elif defined(__SSE2__)
+const char *const KEYSEARCHISA = "sse2";
+#else
+const char *const KEYSEARCHISA = "scalar";
+#endif
+
+#if defined(__AVX2__)
+/**
+ * Sum of the lanes of a vector of 32 or 64 bit counters.
+ */
+inline int sumLanes32(const __m256i v) {
+  __m128i sum =
+      _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+inline int sumLanes64(const __m256i v) {
+  __m128i sum =
+      _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi64(sum, _mm_shuffle_epi32(sum, 0x4e));
+  return _mm_cvtsi128_si32(sum);
+}
+#elif defined(__SSE2__)
+inline int sumLanes32(__m128i sum) {
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+inline int sumLanes64(__m128i sum) {
+  sum = _mm_add_epi64(sum, _mm_shuffle_epi32(sum, 0x4e));
+  return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+/**
+ * Number of keys of the block that are less than key, or that are less than
+ * or equal to key if orEqual. A true comparison is a lane of all ones, -1, so
+ * subtracting the masks counts them.
+ */
+template <bool orEqual>
+inline int countBefore(const int *keys, const int n, const int key) {
+  int count = 0;
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256i k = _mm256_set1_epi32(key);
+  __m256i counts = _mm256_setzero_si256();
+  for (; i + 8 <= n; i += 8) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+    // x <= key is counted as !(x > key)
+    counts = _mm256_sub_epi32(
+        counts, orEqual ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v));
+  }
+  count = sumLanes32(counts);
+  if (orEqual) count = i - count;
+#elif defined(__SSE2__)
+  const __m128i k = _mm_set1_epi32(key);
+  __m128i counts = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+    // x <= key is counted as !(x > key)
+    counts = _mm_sub_epi32(
+        counts, orEqual ? _mm_cmpgt_epi32(v, k) : _mm_cmplt_epi32(v, k));
+  }
+  count = sumLanes32(counts);
+  if (orEqual) count = i - count;
+#endif
+  for (; i < n; i++) {
+    count += orEqual ? keys[i] <= key : keys[i] < key;
+  }
+  return count;
+}
+
+template <bool orEqual>
+inline int countBefore(const double *keys, const int n, const double key) {
+  int count = 0;
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256d k = _mm256_set1_pd(key);
+  __m256i counts = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    const __m256d v = _mm256_loadu_pd(keys + i);
+    const __m256d before = orEqual ? _mm256_cmp_pd(v, k, _CMP_LE_OQ)
+                                   : _mm256_cmp_pd(v, k, _CMP_LT_OQ);
+    counts = _mm256_sub_epi64(counts, _mm256_castpd_si256(before));
+  }
+  count = sumLanes64(counts);
+#elif defined(__SSE2__)
+  const __m128d k = _mm_set1_pd(key);
+  __m128i counts = _mm_setzero_si128();
+  for (; i + 2 <= n; i += 2) {
+    const __m128d v = _mm_loadu_pd(keys + i);
+    const __m128d before = orEqual ? _mm_cmple_pd(v, k) : _mm_cmplt_pd(v, k);
+    counts = _mm_sub_epi64(counts, _mm_castpd_si128(before));
+  }
+  count = sumLanes64(counts);
+#endif
+  for (; i < n; i++) {
+    count += orEqual ? keys[i] <= key : keys[i] < key;
+  }
+  return count;
+}
+
+/**
+ * Index of the first of the n sorted keys that is not less than key, or that
+ * is greater than key if upper.
+ */
+template <bool upper, class T>
+inline int blockSearch(const T *keys, const int n, const T &key) {
+  int lo = 0;
+  int len = n;
+  while (len > KEYSEARCHBLOCK) {
+    const int half = len / 2;
+    const T &mid = keys[lo + half];
+    if (upper ? !(key < mid) : mid < key) {
+      lo += half + 1;
+      len -= half + 1;
+    } else {
+      len = half;
+    }
+  }
+  return lo + countBefore<upper>(keys + lo, len, key);
+}
+
+/**
+ * Index of the first of the n sorted keys that is not less than key.
+ */
+template <class T>
+inline int keyLowerBound(const T *keys, const int n, const T &key) {
+  return std::lower_bound(keys, keys + n, key) - keys;
+}
+
+inline int keyLowerBound(const int *keys, const int n, const int &key) {
+  return blockSearch<false>(keys, n, key);
+}
+
+inline int keyLowerBound(const double *keys, const int n, const double &key) {
+  return blockSearch<false>(keys, n, key);
+}
+
+/**
+ * Index of the first of the n sorted keys that is greater than key.
+ */
+template <class T>
+inline int keyUpperBound(const T *keys, const int n, const T &key) {
+  return std::upper_bound(keys, keys + n, key) - keys;
+}
+
+inline int keyUpperBound(const int *keys, const int n, const int &key) {
+  return blockSearch<true>(keys, n, key);
+}
+
+inline int keyUpperBound(const double *keys, const int n, const double &key) {
+  return blockSearch<true>(keys, n, key);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,1060 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "lsmindex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <sstream>
+
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "filescan.h"
+#include "keysearch.h"
+
+namespace badgerdb {
+
+/**
+ * Key of type T read from an attribute value or a key passed to a public
+ * method.
+ */
+template <class T>
+T lsm_key(const void *value){
+    T key;
+    key_set(key, value);
+    return key;
+}
+
+/**
+ * Order of entries, by key and then by record id, as in the runs.
+ */
+template <class T>
+bool lsm_entry_less(const LSMEntry<T> &a, const LSMEntry<T> &b){
+    if (a.key != b.key)
+        return a.key < b.key;
+    if (a.rid.page_number != b.rid.page_number)
+        return a.rid.page_number < b.rid.page_number;
+    return a.rid.slot_number < b.rid.slot_number;
+}
+
+/**
+ * The memtable key of the first entry with the key.
+ */
+template <class T>
+RIDKeyPair<T> lsm_first_pair(const T &key){
+    RecordId rid;
+    rid.page_number = 0;
+    rid.slot_number = 0;
+    RIDKeyPair<T> pair;
+    pair.set(rid, key);
+    return pair;
+}
+
+// -----------------------------------------------------------------------------
+// LSMRun
+// -----------------------------------------------------------------------------
+
+LSMRun::~LSMRun() {
+  if (this->file == NULL) {
+    return;
+  }
+  bufMgr->flushFile(this->file);
+  delete this->file;
+  this->file = NULL;
+  if (this->obsolete) {
+    File::remove(this->fileName);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::LSMIndex -- Constructor
+// -----------------------------------------------------------------------------
+
+LSMIndex::LSMIndex(const std::string &relationName, std::string &outIndexName,
+                   BufMgr *bufMgrIn, const int attrByteOffset,
+                   const Datatype attrType, const LSMOptions &options) {
+  this->bufMgr = bufMgrIn;
+  this->attrByteOffset = attrByteOffset;
+  this->attributeType = attrType;
+  this->options = options;
+  this->nextRunId = 0;
+  this->compactionWanted = false;
+  this->compactorStopping = false;
+  this->flushes = 0;
+  this->compactions = 0;
+  this->pagesWritten = 0;
+  this->currentScan = NULL;
+
+  std::ostringstream idxstr;
+  idxstr << relationName << '.' << attrByteOffset << ".lsm";
+  outIndexName = idxstr.str();
+  this->indexName = outIndexName;
+  if (options.memtableEntries == 0 || options.runsPerLevel < 2 ||
+      options.runsPerLevel > 8 || options.bloomFalsePositiveRate < 0 ||
+      options.bloomFalsePositiveRate >= 1) {
+    throw BadIndexInfoException(outIndexName);
+  }
+
+  if (File::exists(outIndexName)) {
+    this->file = new BlobFile(outIndexName, false, options.ioMode);
+    this->headerPageNum = file->getFirstPageNo();
+    Page *headerPage;
+    bufMgr->readPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+    const LSMMetaInfo *meta = (const LSMMetaInfo *)headerPage;
+    if (!relation_name_matches(meta->relationName, relationName) ||
+        attrType != meta->attrType || attrByteOffset != meta->attrByteOffset) {
+      bufMgr->unPinPage(file, headerPageNum, false);
+      // no destructor runs for a throwing constructor, so close the file here
+      bufMgr->flushFile(file);
+      delete file;
+      file = nullptr;
+      throw BadIndexInfoException(outIndexName);
+    }
+    this->nextRunId = meta->nextRunId;
+    const std::vector<LSMRunInfo> listed(meta->runs,
+                                         meta->runs + meta->numRuns);
+    bufMgr->unPinPage(file, headerPageNum, false);
+    for (const LSMRunInfo &info : listed) {
+      switch (attrType) {
+        case INTEGER:
+          runs.push_back(openRun<int>(info.runId, info.level));
+          break;
+        case DOUBLE:
+          runs.push_back(openRun<double>(info.runId, info.level));
+          break;
+        case STRING:
+          runs.push_back(openRun<StringKey>(info.runId, info.level));
+          break;
+      }
+    }
+  } else {
+    file = new BlobFile(outIndexName, true, options.ioMode);
+    Page *headerPage;
+    bufMgr->allocPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+    LSMMetaInfo *meta = (LSMMetaInfo *)headerPage;
+    memset(meta, 0, sizeof(LSMMetaInfo));
+    relation_name_set(meta->relationName, relationName);
+    meta->attrByteOffset = attrByteOffset;
+    meta->attrType = attrType;
+    bufMgr->unPinPage(file, headerPageNum, true);
+
+    switch (attrType) {
+      case INTEGER:
+        buildIndex<int>(relationName);
+        break;
+      case DOUBLE:
+        buildIndex<double>(relationName);
+        break;
+      case STRING:
+        buildIndex<StringKey>(relationName);
+        break;
+    }
+    writeManifest();
+  }
+
+  if (options.backgroundCompaction) {
+    this->compactor = std::thread([this]() { compactorLoop(); });
+  }
+}
+
+template <class T>
+void LSMIndex::buildIndex(const std::string &relationName) {
+  FileScan scan(relationName, bufMgr, options.ioMode);
+  RecordId rid;
+  try {
+    while (true) {
+      scan.scanNext(rid);
+      std::string recordStr = scan.getRecord();
+      insertKey(lsm_key<T>(recordStr.c_str() + attrByteOffset), rid);
+    }
+  } catch (EndOfFileException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::~LSMIndex -- destructor
+// -----------------------------------------------------------------------------
+
+LSMIndex::~LSMIndex() {
+  if (this->compactor.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(compactorMutex);
+      this->compactorStopping = true;
+    }
+    compactorWakeup.notify_one();
+    this->compactor.join();
+  }
+  if (this->currentScan != NULL) {
+    endScan();
+  }
+  flush();
+  {
+    std::unique_lock<std::shared_mutex> guard(lsmLatch);
+    writeManifest();
+    this->runs.clear();
+  }
+  bufMgr->flushFile(this->file);
+  delete this->file;
+  this->file = nullptr;
+}
+
+void LSMIndex::writeManifest() {
+  Page *headerPage;
+  bufMgr->readPage(file, headerPageNum, headerPage, ACCESS_INDEX_INNER);
+  LSMMetaInfo *meta = (LSMMetaInfo *)headerPage;
+  meta->nextRunId = this->nextRunId;
+  meta->numRuns = this->runs.size();
+  for (std::size_t r = 0; r < this->runs.size(); r++) {
+    meta->runs[r].runId = this->runs[r]->runId;
+    meta->runs[r].level = this->runs[r]->level;
+  }
+  bufMgr->unPinPage(file, headerPageNum, true);
+  // a new run is listed only once its file is written, and the files of the
+  // runs it replaced are removed only once it is listed
+  bufMgr->flushFile(file);
+}
+
+std::string LSMIndex::runFileName(const std::string &indexName,
+                                  const int runId) {
+  std::ostringstream name;
+  name << indexName << '.' << runId;
+  return name.str();
+}
+
+void LSMIndex::removeIndex(const std::string &indexName) {
+  int nextRunId;
+  {
+    BlobFile indexFile(indexName, false);
+    const Page page = indexFile.readPage(indexFile.getFirstPageNo());
+    nextRunId = ((const LSMMetaInfo *)&page)->nextRunId;
+  }
+  for (int runId = 0; runId < nextRunId; runId++) {
+    if (File::exists(runFileName(indexName, runId))) {
+      File::remove(runFileName(indexName, runId));
+    }
+  }
+  File::remove(indexName);
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::writeRun
+// -----------------------------------------------------------------------------
+
+template <class T>
+std::shared_ptr<LSMRun> LSMIndex::openRun(const int runId, const int level) {
+  std::shared_ptr<LSMRun> run = std::make_shared<LSMRun>();
+  run->bufMgr = bufMgr;
+  run->fileName = runFileName(indexName, runId);
+  run->runId = runId;
+  run->level = level;
+  run->file = new BlobFile(run->fileName, false, options.ioMode);
+
+  Page *page;
+  const PageId headerPageNo = run->file->getFirstPageNo();
+  bufMgr->readPage(run->file, headerPageNo, page, ACCESS_INDEX_INNER);
+  const LSMRunHeader header = *(const LSMRunHeader *)page;
+  bufMgr->unPinPage(run->file, headerPageNo, false);
+  run->numEntries = header.numEntries;
+  run->firstDataPageNo = header.firstDataPageNo;
+  run->numDataPages = header.numDataPages;
+
+  // the fence pointers fill their pages one after another
+  std::vector<T> &fences = run->fences((T *)NULL);
+  const std::size_t perPage = Page::SIZE / sizeof(T);
+  PageId pageNo = header.fencePageNo;
+  while (fences.size() < header.numDataPages) {
+    bufMgr->readPage(run->file, pageNo, page, ACCESS_INDEX_INNER);
+    const T *keys = (const T *)page;
+    const std::size_t n =
+        std::min<std::size_t>(perPage, header.numDataPages - fences.size());
+    fences.insert(fences.end(), keys, keys + n);
+    bufMgr->unPinPage(run->file, pageNo, false);
+    pageNo++;
+  }
+  if (header.bloomPageNo != 0) {
+    run->bloom.load(run->file, bufMgr, header.bloomCapacity,
+                    header.bloomBlocks, header.bloomHashes, header.bloomPageNo);
+  }
+  return run;
+}
+
+/**
+ * The header page is allocated first and written last, once the data pages,
+ * which are filled one after another, the fence pointers and the filter
+ * follow it.
+ */
+template <class T>
+std::shared_ptr<LSMRun> LSMIndex::writeRun(
+    std::vector<LSMSource<T> > &sources, const int level,
+    const std::uint64_t capacity, const bool dropTombstones) {
+  std::shared_ptr<LSMRun> run = std::make_shared<LSMRun>();
+  run->bufMgr = bufMgr;
+  run->runId = this->nextRunId++;
+  run->fileName = runFileName(indexName, run->runId);
+  run->level = level;
+  run->numEntries = 0;
+  run->firstDataPageNo = 0;
+  run->numDataPages = 0;
+  // a file of the same name is left over from a run that was never listed
+  if (File::exists(run->fileName)) {
+    File::remove(run->fileName);
+  }
+  run->file = new BlobFile(run->fileName, true, options.ioMode);
+  if (options.bloomFalsePositiveRate > 0) {
+    run->bloom.reset(capacity, options.bloomFalsePositiveRate);
+  }
+  std::int64_t numPages = 0;
+
+  PageId headerPageNo;
+  Page *page;
+  bufMgr->allocPage(run->file, headerPageNo, page, ACCESS_INDEX_INNER);
+  bufMgr->unPinPage(run->file, headerPageNo, true);
+  numPages++;
+
+  std::vector<T> &fences = run->fences((T *)NULL);
+  LSMRunPage<T> *out = NULL;
+  PageId outPageNo = 0;
+  LSMEntry<T> entry;
+  while (nextMerged(sources, entry)) {
+    if (entry.deleted && dropTombstones) {
+      continue;
+    }
+    if (out != NULL && out->keyNum == LSMRunPage<T>::SIZE) {
+      bufMgr->unPinPage(run->file, outPageNo, true);
+      out = NULL;
+    }
+    if (out == NULL) {
+      bufMgr->allocPage(run->file, outPageNo, page, ACCESS_INDEX_LEAF);
+      out = (LSMRunPage<T> *)page;
+      out->keyNum = 0;
+      if (run->numDataPages == 0) {
+        run->firstDataPageNo = outPageNo;
+      }
+      run->numDataPages++;
+      numPages++;
+      fences.push_back(entry.key);
+    }
+    out->keyArray[out->keyNum] = entry.key;
+    out->ridArray[out->keyNum] = entry.rid;
+    out->deleted[out->keyNum] = entry.deleted;
+    out->keyNum++;
+    run->bloom.add(key_hash(entry.key));
+    run->numEntries++;
+  }
+  if (out != NULL) {
+    bufMgr->unPinPage(run->file, outPageNo, true);
+  }
+
+  LSMRunHeader header;
+  memset(&header, 0, sizeof(header));
+  header.numEntries = run->numEntries;
+  header.firstDataPageNo = run->firstDataPageNo;
+  header.numDataPages = run->numDataPages;
+  const std::size_t perPage = Page::SIZE / sizeof(T);
+  for (std::size_t first = 0; first < fences.size(); first += perPage) {
+    PageId pageNo;
+    bufMgr->allocPage(run->file, pageNo, page, ACCESS_INDEX_INNER);
+    const std::size_t n = std::min(perPage, fences.size() - first);
+    std::copy(fences.begin() + first, fences.begin() + first + n, (T *)page);
+    bufMgr->unPinPage(run->file, pageNo, true);
+    if (first == 0) {
+      header.fencePageNo = pageNo;
+    }
+    numPages++;
+  }
+  if (run->bloom.getNumBlocks() > 0) {
+    header.bloomPageNo = run->bloom.save(run->file, bufMgr);
+    header.bloomCapacity = run->bloom.getCapacity();
+    header.bloomBlocks = run->bloom.getNumBlocks();
+    header.bloomHashes = run->bloom.getNumHashes();
+    const std::size_t bloomBytes =
+        (std::size_t)header.bloomBlocks * BloomFilter::BLOCKBITS / 8;
+    numPages += (bloomBytes + Page::SIZE - 1) / Page::SIZE;
+  }
+
+  bufMgr->readPage(run->file, headerPageNo, page, ACCESS_INDEX_INNER);
+  *(LSMRunHeader *)page = header;
+  bufMgr->unPinPage(run->file, headerPageNo, true);
+  bufMgr->flushFile(run->file);
+  this->pagesWritten += numPages;
+  return run;
+}
+
+template <class T>
+void LSMIndex::readRunPage(const LSMRun &run, const std::uint32_t pageIndex,
+                           std::vector<LSMEntry<T> > &out) {
+  const PageId pageNo = run.firstDataPageNo + pageIndex;
+  Page *page;
+  bufMgr->readPage(run.file, pageNo, page, ACCESS_INDEX_LEAF);
+  const LSMRunPage<T> *runPage = (const LSMRunPage<T> *)page;
+  out.resize(runPage->keyNum);
+  for (int i = 0; i < runPage->keyNum; i++) {
+    out[i].key = runPage->keyArray[i];
+    out[i].rid = runPage->ridArray[i];
+    out[i].deleted = runPage->deleted[i];
+  }
+  bufMgr->unPinPage(run.file, pageNo, false);
+}
+
+template <class T>
+bool LSMIndex::fillSource(LSMSource<T> &source) {
+  while (source.pos >= source.entries.size()) {
+    if (source.run == nullptr ||
+        source.nextPage >= source.run->numDataPages) {
+      return false;
+    }
+    readRunPage(*source.run, source.nextPage++, source.entries);
+    source.pos = 0;
+  }
+  return true;
+}
+
+/**
+ * Sources are few, a memtable and a run or two per level, so the smallest
+ * entry is found by comparing the next entry of each.
+ */
+template <class T>
+bool LSMIndex::nextMerged(std::vector<LSMSource<T> > &sources,
+                          LSMEntry<T> &out) {
+  int best = -1;
+  for (std::size_t s = 0; s < sources.size(); s++) {
+    if (!fillSource(sources[s])) {
+      continue;
+    }
+    if (best < 0 || lsm_entry_less(sources[s].entries[sources[s].pos],
+                                   sources[best].entries[sources[best].pos])) {
+      best = s;
+    }
+  }
+  if (best < 0) {
+    return false;
+  }
+  out = sources[best].entries[sources[best].pos];
+  // an equal entry of an older source is an older version of the same one
+  for (std::size_t s = best; s < sources.size(); s++) {
+    LSMSource<T> &source = sources[s];
+    if (source.pos < source.entries.size() &&
+        !lsm_entry_less(out, source.entries[source.pos])) {
+      source.pos++;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+void LSMIndex::insertEntry(const void *key, const RecordId rid) {
+  switch (attributeType) {
+    case INTEGER:
+      insertKey(lsm_key<int>(key), rid);
+      break;
+    case DOUBLE:
+      insertKey(lsm_key<double>(key), rid);
+      break;
+    case STRING:
+      insertKey(lsm_key<StringKey>(key), rid);
+      break;
+  }
+}
+
+template <class T>
+void LSMIndex::insertKey(const T &key, const RecordId rid) {
+  bool flushed;
+  {
+    std::unique_lock<std::shared_mutex> guard(lsmLatch);
+    flushed = addToMemtable(key, rid, false);
+  }
+  if (flushed) {
+    compactAfterFlush();
+  }
+}
+
+template <class T>
+bool LSMIndex::addToMemtable(const T &key, const RecordId rid,
+                             const bool deleted) {
+  std::map<RIDKeyPair<T>, bool> &mem = memtable((T *)NULL);
+  RIDKeyPair<T> pair;
+  pair.set(rid, key);
+  if (deleted && this->runs.empty()) {
+    // there is no older version for a tombstone to delete
+    mem.erase(pair);
+    return false;
+  }
+  mem[pair] = deleted;
+  if (mem.size() < options.memtableEntries) {
+    return false;
+  }
+  // the meta page lists no more runs, so the memtable waits for compaction
+  if (this->runs.size() < MAXLSMRUNS) {
+    flushMemtable<T>();
+  }
+  return true;
+}
+
+template <class T>
+void LSMIndex::flushMemtable() {
+  std::map<RIDKeyPair<T>, bool> &mem = memtable((T *)NULL);
+  if (mem.empty()) {
+    return;
+  }
+  std::vector<LSMSource<T> > sources(1);
+  sources[0].entries.reserve(mem.size());
+  for (const auto &entry : mem) {
+    sources[0].entries.push_back(
+        {entry.first.key, entry.first.rid, entry.second});
+  }
+  // with no older run a tombstone deletes nothing
+  std::shared_ptr<LSMRun> run =
+      writeRun(sources, 0, mem.size(), this->runs.empty());
+  mem.clear();
+  if (run->numEntries > 0) {
+    this->runs.insert(this->runs.begin(), run);
+  } else {
+    run->obsolete = true;
+  }
+  this->flushes++;
+  writeManifest();
+}
+
+void LSMIndex::flush() {
+  std::unique_lock<std::shared_mutex> guard(lsmLatch);
+  while (this->runs.size() >= MAXLSMRUNS) {
+    guard.unlock();
+    compactLevels();
+    guard.lock();
+  }
+  switch (attributeType) {
+    case INTEGER:
+      flushMemtable<int>();
+      break;
+    case DOUBLE:
+      flushMemtable<double>();
+      break;
+    case STRING:
+      flushMemtable<StringKey>();
+      break;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::compact
+// -----------------------------------------------------------------------------
+
+void LSMIndex::compactAfterFlush() {
+  if (!options.backgroundCompaction) {
+    compactLevels();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(compactorMutex);
+    this->compactionWanted = true;
+  }
+  compactorWakeup.notify_one();
+
+  // inserts wait for a compactor that fell far behind
+  std::size_t numRuns;
+  {
+    std::shared_lock<std::shared_mutex> guard(lsmLatch);
+    numRuns = this->runs.size();
+  }
+  if (numRuns > MAXLSMRUNS / 2) {
+    compactLevels();
+  }
+}
+
+void LSMIndex::compactorLoop() {
+  std::unique_lock<std::mutex> guard(compactorMutex);
+  while (true) {
+    compactorWakeup.wait(guard, [this]() {
+      return this->compactionWanted || this->compactorStopping;
+    });
+    if (this->compactorStopping) {
+      return;
+    }
+    this->compactionWanted = false;
+    guard.unlock();
+    compactLevels();
+    guard.lock();
+  }
+}
+
+/**
+ * A level that never fills leaves its runs in place, so with many levels the
+ * runs may still be too many; then they are all merged into one.
+ */
+void LSMIndex::compactLevels() {
+  std::lock_guard<std::mutex> compactionGuard(compactionLatch);
+  bool merged = true;
+  while (merged) {
+    switch (attributeType) {
+      case INTEGER:
+        merged = compactLevel<int>();
+        break;
+      case DOUBLE:
+        merged = compactLevel<double>();
+        break;
+      case STRING:
+        merged = compactLevel<StringKey>();
+        break;
+    }
+  }
+  std::size_t numRuns;
+  {
+    std::shared_lock<std::shared_mutex> guard(lsmLatch);
+    numRuns = this->runs.size();
+  }
+  if (numRuns > MAXLSMRUNS / 2) {
+    switch (attributeType) {
+      case INTEGER:
+        compactAll<int>();
+        break;
+      case DOUBLE:
+        compactAll<double>();
+        break;
+      case STRING:
+        compactAll<StringKey>();
+        break;
+    }
+  }
+}
+
+template <class T>
+bool LSMIndex::compactLevel() {
+  std::vector<std::shared_ptr<LSMRun> > inputs;
+  int level = -1;
+  bool toOldest;
+  {
+    std::shared_lock<std::shared_mutex> guard(lsmLatch);
+    std::map<int, int> runsOfLevel;
+    for (const std::shared_ptr<LSMRun> &run : this->runs) {
+      runsOfLevel[run->level]++;
+    }
+    for (const auto &count : runsOfLevel) {
+      if (count.second >= options.runsPerLevel) {
+        level = count.first;
+        break;
+      }
+    }
+    if (level < 0) {
+      return false;
+    }
+    for (const std::shared_ptr<LSMRun> &run : this->runs) {
+      if (run->level == level) {
+        inputs.push_back(run);
+      }
+    }
+    toOldest = this->runs.back()->level == level;
+  }
+  mergeRuns<T>(inputs, level + 1, toOldest);
+  return true;
+}
+
+/**
+ * The inputs are read without lsmLatch, which runs never need, while flushes
+ * put new runs in front of them.
+ */
+template <class T>
+void LSMIndex::mergeRuns(const std::vector<std::shared_ptr<LSMRun> > &inputs,
+                         const int level, const bool dropTombstones) {
+  std::vector<LSMSource<T> > sources(inputs.size());
+  std::uint64_t capacity = 0;
+  for (std::size_t i = 0; i < inputs.size(); i++) {
+    sources[i].run = inputs[i];
+    capacity += inputs[i]->numEntries;
+  }
+  std::shared_ptr<LSMRun> output =
+      writeRun(sources, level, capacity, dropTombstones);
+  sources.clear();
+
+  std::unique_lock<std::shared_mutex> guard(lsmLatch);
+  std::vector<std::shared_ptr<LSMRun> >::iterator first =
+      std::find(this->runs.begin(), this->runs.end(), inputs.front());
+  first = this->runs.erase(first, first + inputs.size());
+  if (output->numEntries > 0) {
+    this->runs.insert(first, output);
+  } else {
+    output->obsolete = true;
+  }
+  for (const std::shared_ptr<LSMRun> &input : inputs) {
+    input->obsolete = true;
+  }
+  this->compactions++;
+  writeManifest();
+}
+
+/**
+ * A memtable that finds no room for its run is written once the runs are
+ * merged, and merged with them in a second pass.
+ */
+template <class T>
+void LSMIndex::compactAll() {
+  bool written = false;
+  while (true) {
+    std::vector<std::shared_ptr<LSMRun> > inputs;
+    {
+      std::unique_lock<std::shared_mutex> guard(lsmLatch);
+      if (this->runs.size() < MAXLSMRUNS) {
+        flushMemtable<T>();
+        written = true;
+      }
+      inputs = this->runs;
+    }
+    if (inputs.size() > 1) {
+      mergeRuns<T>(inputs, inputs.back()->level, true);
+    }
+    if (written) {
+      return;
+    }
+  }
+}
+
+void LSMIndex::compact() {
+  std::lock_guard<std::mutex> compactionGuard(compactionLatch);
+  switch (attributeType) {
+    case INTEGER:
+      compactAll<int>();
+      break;
+    case DOUBLE:
+      compactAll<double>();
+      break;
+    case STRING:
+      compactAll<StringKey>();
+      break;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool LSMIndex::deleteEntry(const void *key, const RecordId rid) {
+  switch (attributeType) {
+    case INTEGER:
+      return deleteKey(lsm_key<int>(key), rid);
+    case DOUBLE:
+      return deleteKey(lsm_key<double>(key), rid);
+    case STRING:
+      return deleteKey(lsm_key<StringKey>(key), rid);
+  }
+  return false;
+}
+
+template <class T>
+bool LSMIndex::deleteKey(const T &key, const RecordId rid) {
+  bool held = false;
+  bool flushed = false;
+  {
+    std::unique_lock<std::shared_mutex> guard(lsmLatch);
+    visitKey(key, [&](const RecordId &found, const bool deleted) {
+      if (found != rid) {
+        return true;
+      }
+      held = !deleted;
+      return false;
+    });
+    if (held) {
+      flushed = addToMemtable(key, rid, true);
+    }
+  }
+  if (flushed) {
+    compactAfterFlush();
+  }
+  return held;
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::lookup
+// -----------------------------------------------------------------------------
+
+/**
+ * A run is read from the page before the first one whose fence is at or
+ * after the key, which may end with entries of the key, up to the last page
+ * whose fence is the key.
+ */
+template <class T, class F>
+void LSMIndex::visitKey(const T &key, F visit) {
+  std::set<std::pair<PageId, SlotId> > seen;
+  const std::map<RIDKeyPair<T>, bool> &mem = memtable((T *)NULL);
+  for (auto it = mem.lower_bound(lsm_first_pair(key));
+       it != mem.end() && it->first.key == key; ++it) {
+    const RecordId &rid = it->first.rid;
+    seen.insert(std::make_pair(rid.page_number, rid.slot_number));
+    if (!visit(rid, it->second)) {
+      return;
+    }
+  }
+
+  const std::uint64_t hash = key_hash(key);
+  for (const std::shared_ptr<LSMRun> &run : this->runs) {
+    if (run->bloom.getNumBlocks() > 0 && !run->bloom.mayContain(hash)) {
+      continue;
+    }
+    const std::vector<T> &fences = run->fences((T *)NULL);
+    const int numPages = fences.size();
+    const int first = keyLowerBound(fences.data(), numPages, key);
+    for (int p = std::max(first - 1, 0);
+         p < numPages && (p < first || !(key < fences[p])); p++) {
+      const PageId pageNo = run->firstDataPageNo + p;
+      Page *page;
+      bufMgr->readPage(run->file, pageNo, page, ACCESS_INDEX_LEAF);
+      const LSMRunPage<T> *runPage = (const LSMRunPage<T> *)page;
+      bool more = true;
+      for (int i = keyLowerBound(runPage->keyArray, runPage->keyNum, key);
+           more && i < runPage->keyNum && runPage->keyArray[i] == key; i++) {
+        const RecordId &rid = runPage->ridArray[i];
+        // a newer version was visited already
+        if (seen.insert(std::make_pair(rid.page_number, rid.slot_number))
+                .second) {
+          more = visit(rid, runPage->deleted[i]);
+        }
+      }
+      bufMgr->unPinPage(run->file, pageNo, false);
+      if (!more) {
+        return;
+      }
+    }
+  }
+}
+
+std::optional<RecordId> LSMIndex::lookup(const void *key) {
+  switch (attributeType) {
+    case INTEGER:
+      return lookupKey(lsm_key<int>(key));
+    case DOUBLE:
+      return lookupKey(lsm_key<double>(key));
+    case STRING:
+      return lookupKey(lsm_key<StringKey>(key));
+  }
+  return std::nullopt;
+}
+
+template <class T>
+std::optional<RecordId> LSMIndex::lookupKey(const T &key) {
+  std::shared_lock<std::shared_mutex> guard(lsmLatch);
+  std::optional<RecordId> found;
+  visitKey(key, [&found](const RecordId &rid, const bool deleted) {
+    if (deleted) {
+      return true;
+    }
+    found = rid;
+    return false;
+  });
+  return found;
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::lookupAll
+// -----------------------------------------------------------------------------
+
+std::size_t LSMIndex::lookupAll(const void *key,
+                                std::vector<RecordId> &outRids) {
+  switch (attributeType) {
+    case INTEGER:
+      return lookupAllKey(lsm_key<int>(key), outRids);
+    case DOUBLE:
+      return lookupAllKey(lsm_key<double>(key), outRids);
+    case STRING:
+      return lookupAllKey(lsm_key<StringKey>(key), outRids);
+  }
+  return 0;
+}
+
+template <class T>
+std::size_t LSMIndex::lookupAllKey(const T &key,
+                                   std::vector<RecordId> &outRids) {
+  const std::size_t before = outRids.size();
+  {
+    std::shared_lock<std::shared_mutex> guard(lsmLatch);
+    visitKey(key, [&outRids](const RecordId &rid, const bool deleted) {
+      if (!deleted) {
+        outRids.push_back(rid);
+      }
+      return true;
+    });
+  }
+  std::sort(outRids.begin() + before, outRids.end(),
+            [](const RecordId &a, const RecordId &b) {
+              return a.page_number != b.page_number
+                         ? a.page_number < b.page_number
+                         : a.slot_number < b.slot_number;
+            });
+  return outRids.size() - before;
+}
+
+// -----------------------------------------------------------------------------
+// LSMIndex::stats
+// -----------------------------------------------------------------------------
+
+LSMIndexStats LSMIndex::stats() {
+  std::shared_lock<std::shared_mutex> guard(lsmLatch);
+  LSMIndexStats result;
+  result.numRuns = this->runs.size();
+  result.numLevels = this->runs.empty() ? 0 : this->runs.back()->level + 1;
+  result.memtableEntries = memtableInt.size() + memtableDouble.size() +
+                           memtableString.size();
+  result.runEntries = 0;
+  result.runPages = 0;
+  for (const std::shared_ptr<LSMRun> &run : this->runs) {
+    result.runEntries += run->numEntries;
+    result.runPages += run->numDataPages;
+  }
+  result.flushes = this->flushes;
+  result.compactions = this->compactions;
+  result.pagesWritten = this->pagesWritten;
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+// LSMScanCursor
+// -----------------------------------------------------------------------------
+
+LSMScanCursor::LSMScanCursor(LSMIndex *indexIn, const void *lowValParm,
+                             const Operator lowOpParm, const void *highValParm,
+                             const Operator highOpParm) {
+  if ((lowOpParm != GT && lowOpParm != GTE) ||
+      (highOpParm != LT && highOpParm != LTE)) {
+    throw BadOpcodesException();
+  }
+  this->index = indexIn;
+  this->lowOp = lowOpParm;
+  this->highOp = highOpParm;
+  this->nextEntry = 0;
+  this->scanAtEnd = false;
+
+  switch (index->attributeType) {
+    case INTEGER:
+      index->startScanKeys(*this, lsm_key<int>(lowValParm),
+                           lsm_key<int>(highValParm));
+      break;
+    case DOUBLE:
+      index->startScanKeys(*this, lsm_key<double>(lowValParm),
+                           lsm_key<double>(highValParm));
+      break;
+    case STRING:
+      index->startScanKeys(*this, lsm_key<StringKey>(lowValParm),
+                           lsm_key<StringKey>(highValParm));
+      break;
+  }
+}
+
+void LSMScanCursor::scanNext(RecordId &outRid) {
+  while (this->nextEntry >= this->scanBuffer.size()) {
+    if (this->scanAtEnd) {
+      throw IndexScanCompletedException();
+    }
+    switch (index->attributeType) {
+      case INTEGER:
+        index->fillScanBuffer<int>(*this);
+        break;
+      case DOUBLE:
+        index->fillScanBuffer<double>(*this);
+        break;
+      case STRING:
+        index->fillScanBuffer<StringKey>(*this);
+        break;
+    }
+  }
+  outRid = this->scanBuffer[this->nextEntry++];
+}
+
+/**
+ * The entries of the memtable in the range are copied, and the runs are read
+ * from the page before the first one whose fence is at or after the low
+ * value.
+ */
+template <class T>
+void LSMIndex::startScanKeys(LSMScanCursor &scan, const T &lowVal,
+                             const T &highVal) {
+  if (highVal < lowVal) {
+    throw BadScanrangeException();
+  }
+  scan.scanLowVal((T *)NULL) = lowVal;
+  scan.scanHighVal((T *)NULL) = highVal;
+  std::vector<LSMSource<T> > &sources = scan.sources((T *)NULL);
+  {
+    std::shared_lock<std::shared_mutex> guard(lsmLatch);
+    const std::map<RIDKeyPair<T>, bool> &mem = memtable((T *)NULL);
+    sources.resize(1 + this->runs.size());
+    for (auto it = mem.lower_bound(lsm_first_pair(lowVal));
+         it != mem.end() && !(highVal < it->first.key); ++it) {
+      sources[0].entries.push_back(
+          {it->first.key, it->first.rid, it->second});
+    }
+    for (std::size_t r = 0; r < this->runs.size(); r++) {
+      const std::vector<T> &fences = this->runs[r]->fences((T *)NULL);
+      const int first = keyLowerBound(fences.data(), fences.size(), lowVal);
+      sources[r + 1].run = this->runs[r];
+      sources[r + 1].nextPage = std::max(first - 1, 0);
+    }
+  }
+
+  fillScanBuffer<T>(scan);
+  if (scan.scanBuffer.empty()) {
+    throw NoSuchKeyFoundException();
+  }
+}
+
+template <class T>
+void LSMIndex::fillScanBuffer(LSMScanCursor &scan) {
+  const T &lowVal = scan.scanLowVal((T *)NULL);
+  const T &highVal = scan.scanHighVal((T *)NULL);
+  std::vector<LSMSource<T> > &sources = scan.sources((T *)NULL);
+  scan.scanBuffer.clear();
+  scan.nextEntry = 0;
+  LSMEntry<T> entry;
+  while (scan.scanBuffer.size() < LSMScanCursor::BATCHSIZE) {
+    if (!nextMerged(sources, entry)) {
+      scan.scanAtEnd = true;
+      return;
+    }
+    if (scan.lowOp == GT ? !(lowVal < entry.key) : entry.key < lowVal) {
+      continue;
+    }
+    if (scan.highOp == LT ? !(entry.key < highVal) : highVal < entry.key) {
+      scan.scanAtEnd = true;
+      return;
+    }
+    if (!entry.deleted) {
+      scan.scanBuffer.push_back(entry.rid);
+    }
+  }
+}
+
+void LSMIndex::startScan(const void *lowValParm, const Operator lowOpParm,
+                         const void *highValParm, const Operator highOpParm) {
+  if (this->currentScan != NULL) {
+    endScan();
+  }
+  this->currentScan =
+      new LSMScanCursor(this, lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+void LSMIndex::scanNext(RecordId &outRid) {
+  if (this->currentScan == NULL) {
+    throw ScanNotInitializedException();
+  }
+  this->currentScan->scanNext(outRid);
+}
+
+void LSMIndex::endScan() {
+  if (this->currentScan == NULL) {
+    throw ScanNotInitializedException();
+  }
+  delete this->currentScan;
+  this->currentScan = NULL;
+}
+
+}  // namespace badgerdb
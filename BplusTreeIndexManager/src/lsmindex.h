@@ -0,0 +1,763 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bloomfilter.h"
+#include "btree.h"
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Most runs an LSMIndex lists in its meta page. A flush that leaves
+ * more than half as many waits for compaction to merge them, and a memtable
+ * is not written to a new run while there are this many.
+ */
+const int MAXLSMRUNS = 64;
+
+/**
+ * @brief A run listed in the meta page of an LSMIndex.
+ */
+struct LSMRunInfo {
+  /**
+   * Number of the run, which names its file, see LSMIndex::runFileName().
+   */
+  int runId;
+
+  /**
+   * 0 for a run flushed from the memtable, and one more than the level of
+   * its inputs for a run written by compaction.
+   */
+  int level;
+};
+
+/**
+ * @brief The meta page of an LSMIndex, the first page of its file, which holds
+ * what IndexMetaInfo holds for a BTreeIndex and the runs of the index, from
+ * the newest to the oldest.
+ */
+struct LSMMetaInfo {
+  /**
+   * Name of base relation.
+   */
+  char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored
+   * in pages.
+   */
+  int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+  Datatype attrType;
+
+  /**
+   * Number of the next run to be written. Files of runs below it that are
+   * not listed are left over from runs that compaction replaced.
+   */
+  int nextRunId;
+
+  int numRuns;
+  LSMRunInfo runs[MAXLSMRUNS];
+};
+
+/**
+ * @brief The first page of the file of a run. The data pages of the run
+ * follow it, then the fence pointers, the first key of every data page, as
+ * many to a page as fit, then the pages of the Bloom filter of the run.
+ */
+struct LSMRunHeader {
+  /**
+   * Entries of the run, counting tombstones.
+   */
+  std::int64_t numEntries;
+
+  /**
+   * First of the data pages, which are numbered one after another.
+   */
+  PageId firstDataPageNo;
+  std::uint32_t numDataPages;
+
+  /**
+   * First of the pages of fence pointers, 0 if the run has no data pages.
+   */
+  PageId fencePageNo;
+
+  /**
+   * First page of the Bloom filter, 0 for none, and its shape.
+   */
+  PageId bloomPageNo;
+  std::uint64_t bloomCapacity;
+  std::uint32_t bloomBlocks;
+  int bloomHashes;
+};
+
+/**
+ * @brief Structure for the data pages of a run, for keys of type T. Entries
+ * are sorted by key and then by record id, and an entry is either in the
+ * index or a tombstone, which deletes the entry from the older runs.
+ */
+template <class T>
+struct LSMRunPage {
+  /**
+   * Number of entry slots of a page.
+   */
+  //                                    keyNum        key, rid, deleted flag
+  static const int SIZE =
+      (Page::SIZE - sizeof(int)) / (sizeof(T) + sizeof(RecordId) + 1);
+
+  /**
+   * Number of entries in this page.
+   */
+  int keyNum;
+
+  /**
+   * Stores keys.
+   */
+  T keyArray[SIZE];
+
+  /**
+   * Stores RecordIds.
+   */
+  RecordId ridArray[SIZE];
+
+  /**
+   * Whether each entry is a tombstone.
+   */
+  bool deleted[SIZE];
+};
+
+static_assert(sizeof(LSMRunPage<int>) <= Page::SIZE &&
+                  sizeof(LSMRunPage<double>) <= Page::SIZE &&
+                  sizeof(LSMRunPage<StringKey>) <= Page::SIZE,
+              "run pages must fit in a page");
+
+/**
+ * @brief An entry of the memtable or of a run.
+ */
+template <class T>
+struct LSMEntry {
+  T key;
+  RecordId rid;
+  bool deleted;
+};
+
+/**
+ * @brief An open run of an LSMIndex, with its fence pointers and Bloom filter
+ * in memory. A run does not change once it is written. The index, and the
+ * scans and compactions reading it, share it, so a run that compaction
+ * replaced is closed, and its file removed, once the last of them lets go of
+ * it.
+ */
+struct LSMRun {
+  BufMgr *bufMgr;
+  BlobFile *file;
+  std::string fileName;
+  int runId;
+  int level;
+
+  /**
+   * See LSMRunHeader.
+   */
+  std::int64_t numEntries;
+  PageId firstDataPageNo;
+  std::uint32_t numDataPages;
+
+  /**
+   * First key of every data page.
+   */
+  std::vector<int> fencesInt;
+  std::vector<double> fencesDouble;
+  std::vector<StringKey> fencesString;
+
+  std::vector<int> &fences(const int *) { return fencesInt; }
+  std::vector<double> &fences(const double *) { return fencesDouble; }
+  std::vector<StringKey> &fences(const StringKey *) { return fencesString; }
+
+  /**
+   * Filter of the keys of the entries and tombstones, with no blocks if the
+   * index has no filters.
+   */
+  BloomFilter bloom;
+
+  /**
+   * Set once the run is no longer listed, so that its file is removed when it
+   * is closed.
+   */
+  std::atomic<bool> obsolete;
+
+  LSMRun() : bufMgr(NULL), file(NULL), obsolete(false) {}
+
+  /**
+   * Closes the file of the run, and removes it if the run is obsolete.
+   */
+  ~LSMRun();
+};
+
+/**
+ * @brief Input of a merge: a copy of entries of the memtable, for a null run,
+ * or the entries of a run, read a page at a time.
+ */
+template <class T>
+struct LSMSource {
+  std::shared_ptr<LSMRun> run;
+
+  /**
+   * Data page of the run that is read next.
+   */
+  std::uint32_t nextPage = 0;
+
+  /**
+   * Entries of the current page, and the next of them.
+   */
+  std::vector<LSMEntry<T> > entries;
+  std::size_t pos = 0;
+};
+
+/**
+ * @brief Settings for an LSMIndex, which are not stored in its meta page.
+ */
+struct LSMOptions {
+  /**
+   * Mode the index files, and the relation while the index is built from it,
+   * are read and written with.
+   */
+  FileIOMode ioMode = IO_BUFFERED;
+
+  /**
+   * Entries and tombstones the memtable holds before it is written to a new
+   * run.
+   */
+  std::size_t memtableEntries = 1 << 16;
+
+  /**
+   * Runs of a level, from 2 to 8, that compaction merges into one run of the
+   * next level. More runs per level write each entry fewer times and make
+   * lookups and scans read more runs.
+   */
+  int runsPerLevel = 4;
+
+  /**
+   * Rate of false positives of the Bloom filter of every run, 0 for none. A
+   * lookup reads no page of a run whose filter rules its key out.
+   */
+  double bloomFalsePositiveRate = 0.01;
+
+  /**
+   * Compact in a thread of the index instead of in the insert or delete that
+   * filled the memtable.
+   */
+  bool backgroundCompaction = true;
+};
+
+/**
+ * @brief Shape of an LSM index, see LSMIndex::stats().
+ */
+struct LSMIndexStats {
+  int numRuns;
+
+  /**
+   * One more than the highest level of a run, 0 if there is no run.
+   */
+  int numLevels;
+
+  /**
+   * Entries and tombstones in the memtable and in the runs, and the data
+   * pages of the runs.
+   */
+  std::int64_t memtableEntries;
+  std::int64_t runEntries;
+  std::int64_t runPages;
+
+  /**
+   * Runs written from the memtable, merges of runs, and pages of runs written
+   * by both, since the index was opened.
+   */
+  std::int64_t flushes;
+  std::int64_t compactions;
+  std::int64_t pagesWritten;
+};
+
+class LSMIndex;
+
+/**
+ * @brief A range scan of an LSMIndex, which merges the memtable and the runs
+ * as they were when the scan started. Entries inserted or deleted after that
+ * are not seen. A cursor must be destroyed before its index.
+ */
+class LSMScanCursor {
+  friend class LSMIndex;
+
+ public:
+  /**
+   * Begin a filtered scan of the index, see IndexScanCursor.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the index that
+   *satisfies the scan criteria.
+   */
+  LSMScanCursor(LSMIndex *index, const void *lowVal, const Operator lowOp,
+                const void *highVal, const Operator highOp);
+
+  /**
+   * Fetch the record id of the next index entry that matches the scan, in
+   * key order.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   */
+  void scanNext(RecordId &outRid);
+
+ private:
+  /**
+   * Entries merged at a time into scanBuffer.
+   */
+  static const std::size_t BATCHSIZE = 256;
+
+  LSMIndex *index;
+
+  /**
+   * Record ids of the next entries of the scan, and the next of them.
+   */
+  std::vector<RecordId> scanBuffer;
+  std::size_t nextEntry;
+
+  /**
+   * True once scanBuffer holds the last entries of the scan.
+   */
+  bool scanAtEnd;
+
+  Operator lowOp;
+  Operator highOp;
+
+  /**
+   * Range of the scan and its inputs, the memtable first and then the runs
+   * from the newest to the oldest, for keys of type T.
+   */
+  int lowValInt, highValInt;
+  double lowValDouble, highValDouble;
+  StringKey lowValString, highValString;
+  std::vector<LSMSource<int> > sourcesInt;
+  std::vector<LSMSource<double> > sourcesDouble;
+  std::vector<LSMSource<StringKey> > sourcesString;
+
+  int &scanLowVal(const int *) { return lowValInt; }
+  double &scanLowVal(const double *) { return lowValDouble; }
+  StringKey &scanLowVal(const StringKey *) { return lowValString; }
+  int &scanHighVal(const int *) { return highValInt; }
+  double &scanHighVal(const double *) { return highValDouble; }
+  StringKey &scanHighVal(const StringKey *) { return highValString; }
+  std::vector<LSMSource<int> > &sources(const int *) { return sourcesInt; }
+  std::vector<LSMSource<double> > &sources(const double *) {
+    return sourcesDouble;
+  }
+  std::vector<LSMSource<StringKey> > &sources(const StringKey *) {
+    return sourcesString;
+  }
+};
+
+/**
+ * @brief LSMIndex class. It implements a log-structured merge index on a
+ * single attribute of a relation, for workloads of many inserts, with the
+ * insert, lookup and scan methods of a BTreeIndex.
+ *
+ * Inserts and deletes go into the memtable, a sorted map in memory, where a
+ * delete leaves a tombstone. A full memtable is written out to a new run, a
+ * BlobFile of sorted entries whose pages are written once, one after another,
+ * so no page is ever read and written back for an insert. Runs are merged by
+ * tiered compaction: once a level has LSMOptions::runsPerLevel runs, they are
+ * merged into one run of the next level, dropping the entries that newer
+ * ones replace and, when the merge reaches the oldest run, the tombstones.
+ *
+ * A lookup searches the memtable and then the runs from the newest to the
+ * oldest, skipping a run whose Bloom filter rules its key out and reading one
+ * page of any other, found from its fence pointers. The index holds an entry
+ * <key, rid> at most once, and the newest insert or delete of it decides
+ * whether it is held. The memtable is written to a run when the index is
+ * closed.
+ *
+ * Run pages are read with ACCESS_INDEX_LEAF and the other pages with
+ * ACCESS_INDEX_INNER. Any number of threads may call the methods at once;
+ * inserts and deletes hold the index exclusive, and also while the memtable
+ * is written out.
+ */
+class LSMIndex {
+  friend class LSMScanCursor;
+
+ private:
+  /**
+   * File object for the meta page.
+   */
+  BlobFile *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum;
+
+  /**
+   * Name of the index file, which names the files of the runs too.
+   */
+  std::string indexName;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  LSMOptions options;
+
+  /**
+   * Newest entry or tombstone of every <key, rid> not yet written to a run,
+   * true for a tombstone.
+   */
+  std::map<RIDKeyPair<int>, bool> memtableInt;
+  std::map<RIDKeyPair<double>, bool> memtableDouble;
+  std::map<RIDKeyPair<StringKey>, bool> memtableString;
+
+  std::map<RIDKeyPair<int>, bool> &memtable(const int *) {
+    return memtableInt;
+  }
+  std::map<RIDKeyPair<double>, bool> &memtable(const double *) {
+    return memtableDouble;
+  }
+  std::map<RIDKeyPair<StringKey>, bool> &memtable(const StringKey *) {
+    return memtableString;
+  }
+
+  /**
+   * Runs from the newest to the oldest. Levels only grow from one run to the
+   * next, so the runs of a level are next to each other.
+   */
+  std::vector<std::shared_ptr<LSMRun> > runs;
+  std::atomic<int> nextRunId;
+
+  /**
+   * Held shared while the memtable and the list of runs are read and
+   * exclusive while they change.
+   */
+  std::shared_mutex lsmLatch;
+
+  /**
+   * Held by a compaction from choosing its runs until it replaced them,
+   * before lsmLatch is taken.
+   */
+  std::mutex compactionLatch;
+
+  /**
+   * The thread of background compaction, which waits for compactionWanted.
+   */
+  std::thread compactor;
+  std::mutex compactorMutex;
+  std::condition_variable compactorWakeup;
+  bool compactionWanted;
+  bool compactorStopping;
+
+  /**
+   * See LSMIndexStats.
+   */
+  std::atomic<std::int64_t> flushes;
+  std::atomic<std::int64_t> compactions;
+  std::atomic<std::int64_t> pagesWritten;
+
+  /**
+   * The scan of startScan(), NULL if none is running.
+   */
+  LSMScanCursor *currentScan;
+
+  /**
+   * Writes the list of runs to the meta page and flushes it. Called with
+   * lsmLatch held exclusive.
+   */
+  void writeManifest();
+
+  /**
+   * Opens a run listed in the meta page.
+   */
+  template <class T>
+  std::shared_ptr<LSMRun> openRun(const int runId, const int level);
+
+  /**
+   * Writes the merge of the sources to a new run of the level, without the
+   * tombstones if dropTombstones, sizing its filter for capacity entries.
+   */
+  template <class T>
+  std::shared_ptr<LSMRun> writeRun(std::vector<LSMSource<T> > &sources,
+                                   const int level,
+                                   const std::uint64_t capacity,
+                                   const bool dropTombstones);
+
+  /**
+   * Copies the entries of a data page of a run.
+   */
+  template <class T>
+  void readRunPage(const LSMRun &run, const std::uint32_t pageIndex,
+                   std::vector<LSMEntry<T> > &out);
+
+  /**
+   * Reads the next page of the source if its entries are used up.
+   * @return false if the source has no entries left
+   */
+  template <class T>
+  bool fillSource(LSMSource<T> &source);
+
+  /**
+   * Next entry of the merge of the sources, which are from the newest to the
+   * oldest, in order of key and record id. Of the versions of an entry in
+   * several sources only the newest is returned.
+   * @return false once all sources are used up
+   */
+  template <class T>
+  bool nextMerged(std::vector<LSMSource<T> > &sources, LSMEntry<T> &out);
+
+  /**
+   * Build the index by inserting an entry for every record of the relation.
+   */
+  template <class T>
+  void buildIndex(const std::string &relationName);
+
+  /**
+   * Puts the entry or tombstone into the memtable and writes the memtable to
+   * a run if it is full. A full memtable is kept while there are MAXLSMRUNS
+   * runs. Called with lsmLatch held exclusive.
+   * @return whether the memtable is full, so that compaction is due
+   */
+  template <class T>
+  bool addToMemtable(const T &key, const RecordId rid, const bool deleted);
+
+  /**
+   * Writes the memtable, if it holds anything, to a new run of level 0.
+   * Called with lsmLatch held exclusive and fewer than MAXLSMRUNS runs.
+   */
+  template <class T>
+  void flushMemtable();
+
+  /**
+   * Wakes the compactor or compacts after the memtable was written, and
+   * waits for compaction if there are too many runs.
+   */
+  void compactAfterFlush();
+
+  /**
+   * Merges the runs of every level that has runsPerLevel of them, until none
+   * has.
+   */
+  void compactLevels();
+
+  /**
+   * Merges the runs of the lowest level that has runsPerLevel of them.
+   * Called with compactionLatch held.
+   * @return false if no level has that many
+   */
+  template <class T>
+  bool compactLevel();
+
+  /**
+   * Writes the inputs, which are next to each other in runs, to a new run of
+   * the level and puts it in their place. Called with compactionLatch held.
+   */
+  template <class T>
+  void mergeRuns(const std::vector<std::shared_ptr<LSMRun> > &inputs,
+                 const int level, const bool dropTombstones);
+
+  /**
+   * Writes the memtable to a run and merges all runs into one.
+   */
+  template <class T>
+  void compactAll();
+
+  /**
+   * Body of the compactor thread.
+   */
+  void compactorLoop();
+
+  /**
+   * Calls visit(rid, deleted) for the newest version of every entry with
+   * the key, from the newest to the oldest, until it returns false. Called
+   * with lsmLatch held.
+   */
+  template <class T, class F>
+  void visitKey(const T &key, F visit);
+
+  template <class T>
+  void insertKey(const T &key, const RecordId rid);
+
+  template <class T>
+  bool deleteKey(const T &key, const RecordId rid);
+
+  template <class T>
+  std::optional<RecordId> lookupKey(const T &key);
+
+  template <class T>
+  std::size_t lookupAllKey(const T &key, std::vector<RecordId> &outRids);
+
+  /**
+   * Sets up the sources of a scan and fills its buffer.
+   */
+  template <class T>
+  void startScanKeys(LSMScanCursor &scan, const T &lowVal, const T &highVal);
+
+  /**
+   * Merges the next entries of the scan into its buffer.
+   */
+  template <class T>
+  void fillScanBuffer(LSMScanCursor &scan);
+
+ public:
+  /**
+   * LSMIndex Constructor.
+   * Check to see if the corresponding index file exists. If so, open the
+   * file and its runs. If not, create it and insert entries for every tuple
+   * in the base relation using FileScan class.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file, the name of
+   * the relation, the offset of the attribute and ".lsm"
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param attrByteOffset      Offset of attribute, over which index is to be
+   * built, in the record
+   * @param attrType            Datatype of attribute over which index is
+   * built
+   * @param options             Settings of the index
+   * @throws  BadIndexInfoException     If the index file already exists for
+   * the corresponding attribute, but values in its meta page do not match
+   * with values received through constructor parameters, or the options are
+   * out of range.
+   */
+  LSMIndex(const std::string &relationName, std::string &outIndexName,
+           BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType,
+           const LSMOptions &options = LSMOptions());
+
+  /**
+   * LSMIndex Destructor.
+   * Stops the compactor, ends the scan, writes the memtable to a run and
+   * closes the files. Does not throw.
+   */
+  ~LSMIndex();
+
+  /**
+   * Insert a new entry using the pair <value,rid>. Inserting an entry the
+   * index holds does nothing.
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted
+   *into the index.
+   **/
+  void insertEntry(const void *key, const RecordId rid);
+
+  /**
+   * Delete the entry <key,rid> by putting a tombstone for it in the memtable.
+   * @param key			Key of the entry, pointer to integer/double/char
+   *string
+   * @param rid			Record ID of the entry
+   * @return whether the index held the entry
+   **/
+  bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Find an entry with the given key.
+   * @param key			Key to look for, pointer to integer/double/char
+   *string
+   * @return Record ID of an entry with the key, if the index holds it
+   **/
+  std::optional<RecordId> lookup(const void *key);
+
+  /**
+   * Find all entries with the given key.
+   * @param key			Key to look for, pointer to integer/double/char
+   *string
+   * @param outRids	Record IDs of the entries are appended to this, in index
+   *order
+   * @return number of entries found
+   **/
+  std::size_t lookupAll(const void *key, std::vector<RecordId> &outRids);
+
+  /**
+   * Begin a filtered scan of the index, see BTreeIndex::startScan(). The scan
+   * is an LSMScanCursor owned by the index.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the index that
+   *satisfies the scan criteria.
+   **/
+  void startScan(const void *lowVal, const Operator lowOp,
+                 const void *highVal, const Operator highOp);
+
+  /**
+   * Fetch the record id of the next index entry that matches the scan.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(RecordId &outRid);
+
+  /**
+   * Terminate the current scan.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  void endScan();
+
+  /**
+   * Write the memtable to a new run, as closing the index does. Compacts
+   * first if there are MAXLSMRUNS runs.
+   **/
+  void flush();
+
+  /**
+   * Write the memtable to a run and merge all runs into one, which has no
+   * tombstones. Waits for a background compaction that is running.
+   **/
+  void compact();
+
+  /**
+   * Shape of the index, read from memory, so no page is read.
+   */
+  LSMIndexStats stats();
+
+  /**
+   * Name of the file of a run of the index file indexName.
+   **/
+  static std::string runFileName(const std::string &indexName,
+                                 const int runId);
+
+  /**
+   * Removes the index file indexName and the files of its runs. The index
+   * must not be open.
+   **/
+  static void removeIndex(const std::string &indexName);
+};
+
+}  // namespace badgerdb
@@ -6,8 +6,24 @@
  * of Wisconsin-Madison.
  */
 
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <thread>
 #include <vector>
 #include "btree.h"
+#include "externalsort.h"
+#include "hashindex.h"
+#include "lsmindex.h"
+#include "keysearch.h"
 #include "page.h"
 #include "filescan.h"
 #include "page_iterator.h"
@@ -15,11 +31,16 @@
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/pool_not_found_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/not_counted_tree_exception.h"
 
 #define checkPassFail(a, b)                                         \
   {                                                                 \
@@ -71,8 +92,45 @@ void createRelationBackward();
 void createRelationRandom();
 void intTests();
 void intTestsWithSmallBuf();
+void intTestsWithResize();
+void intTestsWithPools();
+void intTestsWithReservedPool();
+void intTestsWithDirectIO();
+void batchReadTests();
+void doubleTests();
+void stringTests();
+void bulkLoadTests();
+void externalSortTests();
+void deleteStressTests();
+void concurrencyTests();
+void keySearchTests();
+void cursorTests();
+void scanBatchTests();
+void lookupTests();
+void appendTests();
+void postingListTests();
+void compressedBulkLoadTests();
+void compressedLeafTests();
+void coveringIndexTests();
+void countedTreeTests();
+void parallelBuildTests();
+void statsTests();
+void bloomFilterTests();
+void hashIndexTests();
+void innerCacheTests();
+void insertBufferTests();
+void lsmIndexTests();
+int countMismatches(BTreeIndex *index,
+                    const std::multimap<int, PageId> &oracle);
+int scanOutOfOrder(BTreeIndex *index, int &numEntries);
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
             Operator highOp);
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp);
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp);
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp,
+              const void *highVal, Operator highOp);
 void indexTests();
 void indexTestsWithoutRemove();
 void removeIndex();
@@ -81,6 +139,30 @@ void test2();
 void test3();
 void test4();
 void test5();
+void test6();
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
 void errorTests();
 void deleteRelation();
 
@@ -141,7 +223,32 @@ int main(int argc, char **argv) {
   // test3();
   // test4();
   test5();
-  // errorTests();
+  test6();
+  test7();
+  test8();
+  test9();
+  test10();
+  test11();
+  test12();
+  test13();
+  test14();
+  test15();
+  test16();
+  test17();
+  test18();
+  test19();
+  test20();
+  test21();
+  test22();
+  test23();
+  test24();
+  test25();
+  test26();
+  test27();
+  test28();
+  test29();
+  keySearchTests();
+  errorTests();
 
   return 1;
 }
@@ -196,6 +303,268 @@ void test5() {
   deleteRelation();
 }
 
+void test6() {
+  // Create a relation with tuples valued 0 to relationSize and perform index
+  // tests while the buffer pool is grown and shrunk underneath the index
+  std::cout << "---------------------" << std::endl;
+  std::cout << "createRelationForward" << std::endl;
+  createRelationForward();
+  intTestsWithResize();
+  deleteRelation();
+}
+
+void test7() {
+  // Create a relation with tuples valued 0 to relationSize and perform index
+  // tests with index pages and relation scans kept in separate buffer pools
+  std::cout << "---------------------" << std::endl;
+  std::cout << "createRelationForward" << std::endl;
+  createRelationForward();
+  intTestsWithPools();
+  intTestsWithReservedPool();
+  deleteRelation();
+}
+
+void test8() {
+  // Create a relation with tuples valued 0 to relationSize and perform index
+  // tests on an index file that bypasses the operating system page cache
+  std::cout << "---------------------" << std::endl;
+  std::cout << "createRelationForward" << std::endl;
+  createRelationForward();
+  intTestsWithDirectIO();
+  deleteRelation();
+}
+
+void test9() {
+  // Create a relation with tuples valued 0 to relationSize and read its pages
+  // through the batch interface of the buffer manager
+  std::cout << "---------------------" << std::endl;
+  std::cout << "createRelationForward" << std::endl;
+  createRelationForward();
+  batchReadTests();
+  deleteRelation();
+}
+
+void test10() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // perform index tests on the double and string attributes
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  doubleTests();
+  stringTests();
+  deleteRelation();
+}
+
+void test11() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // perform index tests on indexes that are bulk loaded from it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  bulkLoadTests();
+  deleteRelation();
+}
+
+void test12() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // sort its records in a few pages of memory
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  externalSortTests();
+  deleteRelation();
+}
+
+void test13() {
+  // Create an empty relation and insert and delete entries of its index at
+  // random, comparing the index with a multimap after every phase
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationEmpty" << std::endl;
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+  deleteStressTests();
+  deleteRelation();
+}
+
+void test14() {
+  // Insert, look up, scan and delete entries of the index of an empty
+  // relation from several threads at once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationEmpty" << std::endl;
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+  concurrencyTests();
+  deleteRelation();
+}
+
+void test15() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // run many scans of its index at once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  cursorTests();
+  scanBatchTests();
+  deleteRelation();
+}
+
+void test16() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // look up keys in its indices
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  lookupTests();
+  deleteRelation();
+}
+
+void test17() {
+  // Append increasing keys to the index of an empty relation
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationEmpty" << std::endl;
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+  appendTests();
+  deleteRelation();
+}
+
+void test18() {
+  // Insert and delete many entries of few keys in the index of an empty
+  // relation
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationEmpty" << std::endl;
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+  postingListTests();
+  deleteRelation();
+}
+
+void test19() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // bulk load an index with compressed leaves on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  compressedBulkLoadTests();
+  deleteRelation();
+}
+
+void test20() {
+  // Insert and delete entries of an index with compressed leaves on an empty
+  // relation
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationEmpty" << std::endl;
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+  compressedLeafTests();
+  deleteRelation();
+}
+
+void test21() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build covering indexes with payload columns on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  coveringIndexTests();
+  deleteRelation();
+}
+
+void test22() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build counted trees on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  countedTreeTests();
+  deleteRelation();
+}
+
+void test23() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build indexes on it with several threads
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  parallelBuildTests();
+  deleteRelation();
+}
+
+void test24() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // check the statistics of indexes on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  statsTests();
+  deleteRelation();
+}
+
+void test25() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build indexes with Bloom filters on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  bloomFilterTests();
+  deleteRelation();
+}
+
+void test26() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build hash indexes on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  hashIndexTests();
+  deleteRelation();
+}
+
+void test27() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build indexes that cache their upper levels on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  innerCacheTests();
+  deleteRelation();
+}
+
+void test28() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build indexes that buffer their inserts on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  insertBufferTests();
+  deleteRelation();
+}
+
+void test29() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // build LSM indexes on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom" << std::endl;
+  createRelationRandom();
+  lsmIndexTests();
+  deleteRelation();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -373,6 +742,10 @@ void removeIndex() {
     File::remove(intIndexName);
   } catch (FileNotFoundException &e) {
   }
+  try {
+    File::remove(BTreeIndex::bloomFileName(intIndexName));
+  } catch (FileNotFoundException &e) {
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -397,81 +770,3417 @@ void intTests() {
                               checkPassFail(intScan(&index, 26, GTE, 26, LT), 0)
 }
 
-void intTestsWithSmallBuf() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BufMgr *smBufMgr = new BufMgr(6);
-  BTreeIndex index(relationName, intIndexName, smBufMgr, offsetof(tuple, i),
-                   INTEGER);
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-      checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-          checkPassFail(intScan(&index, -3, GT, 3, LT), 3) checkPassFail(
-              intScan(&index, 996, GT, 1001, LT), 4)
-              checkPassFail(intScan(&index, 0, GT, 1, LT), 0) checkPassFail(
-                  intScan(&index, 300, GT, 400, LT), 99)
-                  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
-                      checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
-                          checkPassFail(intScan(&index, 26, GTE, 26, LTE), 1)
-                              checkPassFail(intScan(&index, 26, GTE, 26, LT), 0)
-}
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
-            Operator highOp) {
-  RecordId scanRid;
-  Page *curPage;
+void doubleTests() {
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
 
-  std::cout << "Scan for ";
-  if (lowOp == GT) {
-    std::cout << "(";
-  } else {
-    std::cout << "[";
-  }
-  std::cout << lowVal << "," << highVal;
-  if (highOp == LT) {
-    std::cout << ")";
-  } else {
-    std::cout << "]";
+    // run some tests
+    checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+    checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99)
+    checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(doubleScan(&index, 25.5, GT, 26.5, LT), 1)
+    checkPassFail(doubleScan(&index, 26, GTE, 26, LTE), 1)
+    checkPassFail(doubleScan(&index, 26, GTE, 26, LT), 0)
   }
-  std::cout << std::endl;
-
-  int numResults = 0;
-
   try {
-    index->startScan(&lowVal, lowOp, &highVal, highOp);
-  } catch (NoSuchKeyFoundException &e) {
-    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
-    return 0;
+    File::remove(doubleIndexName);
+  } catch (FileNotFoundException &e) {
   }
+}
 
-  while (1) {
-    try {
-      index->scanNext(scanRid);
-      bufMgr->readPage(file1, scanRid.page_number, curPage);
-      RECORD myRec = *(
-          reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
-      bufMgr->unPinPage(file1, scanRid.page_number, false);
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
 
-      if (numResults < 5) {
-        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s
-                  << ":" << std::endl;
-      } else if (numResults == 5) {
-        std::cout << "..." << std::endl;
-      }
-    } catch (IndexScanCompletedException &e) {
-      break;
-    }
+void stringTests() {
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
 
-    numResults++;
+    // run some tests
+    checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(stringScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+    checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+    checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(stringScan(&index, 26, GTE, 26, LTE), 1)
+    checkPassFail(stringScan(&index, 26, GTE, 26, LT), 0)
   }
 
-  if (numResults >= 5) {
-    std::cout << "Number of results: " << numResults << std::endl;
+  // reopening checks the attribute type stored in the meta page
+  std::cout << "Reopen the string index as an integer index" << std::endl;
+  try {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     INTEGER);
+    std::cout << "BadIndexInfoException Test Failed." << std::endl;
+  } catch (BadIndexInfoException &e) {
+    std::cout << "BadIndexInfoException Test Passed." << std::endl;
   }
-  index->endScan();
-  std::cout << std::endl;
-
-  return numResults;
-}
+  try {
+    File::remove(stringIndexName);
+  } catch (FileNotFoundException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// bulkLoadTests
+// -----------------------------------------------------------------------------
+
+void bulkLoadTests() {
+  std::cout << "Bulk load a B+ Tree index on the integer field" << std::endl;
+  {
+    // a sort in 3 pages spills 4 runs, which are merged 2 at a time
+    BTreeOptions options;
+    options.bulkLoad = true;
+    options.sortMemory = 3 * Page::SIZE;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+    checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
+
+    // the leaves are full, so inserting a second entry for 26 splits one
+    int key = 26;
+    RecordId rid26;
+    index.startScan(&key, GTE, &key, LTE);
+    index.scanNext(rid26);
+    index.endScan();
+    index.insertEntry(&key, rid26);
+    checkPassFail(intScan(&index, 26, GTE, 26, LTE), 2)
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize + 1)
+  }
+  removeIndex();
+
+  std::cout << "Bulk load a half full B+ Tree index on the double field"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.bulkLoad = true;
+    options.fillFactor = 0.5;
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE, options);
+
+    checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(doubleScan(&index, -1, GT, 5000, LT), relationSize)
+  }
+  try {
+    File::remove(doubleIndexName);
+  } catch (FileNotFoundException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// externalSortTests
+// -----------------------------------------------------------------------------
+
+void externalSortTests() {
+  std::cout << "Sort the relation on the integer field in 4 pages" << std::endl;
+  {
+    ExternalSort sorter("sortA", bufMgr, attributeLess<int>(offsetof(tuple, i)),
+                        4);
+    {
+      FileScan fscan(relationName, bufMgr);
+      RecordId scanRid;
+      try {
+        while (1) {
+          fscan.scanNext(scanRid);
+          sorter.add(fscan.getRecord());
+        }
+      } catch (EndOfFileException &e) {
+      }
+    }
+    sorter.sort();
+
+    int numInOrder = 0;
+    std::string record;
+    try {
+      while (1) {
+        sorter.next(record);
+        const RECORD *myRec = reinterpret_cast<const RECORD *>(record.data());
+        if (myRec->i == numInOrder) numInOrder++;
+      }
+    } catch (EndOfFileException &e) {
+    }
+    const bool multiPass = sorter.getNumPasses() > 1;
+    checkPassFail(numInOrder, relationSize)
+    checkPassFail(multiPass, true)
+  }
+  const bool runsRemoved = !File::exists("sortA.run0");
+  checkPassFail(runsRemoved, true)
+
+  std::cout << "Sort the relation on the first 2 characters of the string "
+               "field, without duplicates"
+            << std::endl;
+  {
+    ExternalSort sorter("sortA", bufMgr,
+                        stringAttributeLess(offsetof(tuple, s), 2), 4, true);
+    {
+      FileScan fscan(relationName, bufMgr);
+      RecordId scanRid;
+      try {
+        while (1) {
+          fscan.scanNext(scanRid);
+          sorter.add(fscan.getRecord());
+        }
+      } catch (EndOfFileException &e) {
+      }
+    }
+    sorter.sort();
+
+    // the records are valued 00000 to 04999
+    int numDistinct = 0;
+    std::string record;
+    try {
+      while (1) {
+        sorter.next(record);
+        numDistinct++;
+      }
+    } catch (EndOfFileException &e) {
+    }
+    checkPassFail(numDistinct, 5)
+  }
+}
+
+// -----------------------------------------------------------------------------
+// deleteStressTests
+// -----------------------------------------------------------------------------
+
+void deleteStressTests() {
+  BufMgr *dlBufMgr = new BufMgr(2000);
+  {
+    BTreeIndex index(relationName, intIndexName, dlBufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // the entries are <key, {id, 0}> for a unique id; live lists them so
+    // that one can be picked at random
+    std::multimap<int, PageId> oracle;
+    std::vector<std::pair<int, PageId> > live;
+    PageId nextId = 1;
+    RecordId entryRid;
+    entryRid.slot_number = 0;
+    srand(13);
+
+    // enough entries for the root to split, so that inner nodes merge too
+    std::cout << "Insert 600000 entries and delete 200000 of them at random"
+              << std::endl;
+    int numWrongDeletes = 0;
+    for (int op = 0; op < 800000; op++) {
+      if (op % 4 != 3) {
+        int key = rand() % 100000;
+        entryRid.page_number = nextId++;
+        index.insertEntry(&key, entryRid);
+        oracle.insert(std::make_pair(key, entryRid.page_number));
+        live.push_back(std::make_pair(key, entryRid.page_number));
+      } else {
+        const std::size_t pos = rand() % live.size();
+        int key = live[pos].first;
+        entryRid.page_number = live[pos].second;
+        if (!index.deleteEntry(&key, entryRid)) numWrongDeletes++;
+        std::multimap<int, PageId>::iterator it = oracle.find(key);
+        while (it->second != entryRid.page_number) ++it;
+        oracle.erase(it);
+        live[pos] = live.back();
+        live.pop_back();
+
+        // an entry that is not in the index
+        entryRid.page_number = nextId;
+        if (index.deleteEntry(&key, entryRid)) numWrongDeletes++;
+      }
+    }
+    checkPassFail(numWrongDeletes, 0)
+    checkPassFail(countMismatches(&index, oracle), 0)
+    std::ifstream indexFile(intIndexName, std::ios::binary | std::ios::ate);
+    const long peakSize = indexFile.tellg();
+    const std::size_t peakEntries = live.size();
+    indexFile.close();
+
+    std::cout << "Delete all entries at random" << std::endl;
+    while (!live.empty()) {
+      const std::size_t pos = rand() % live.size();
+      int key = live[pos].first;
+      entryRid.page_number = live[pos].second;
+      if (!index.deleteEntry(&key, entryRid)) numWrongDeletes++;
+      std::multimap<int, PageId>::iterator it = oracle.find(key);
+      while (it->second != entryRid.page_number) ++it;
+      oracle.erase(it);
+      live[pos] = live.back();
+      live.pop_back();
+      if (live.size() % 50000 == 0) {
+        checkPassFail(countMismatches(&index, oracle), 0)
+      }
+    }
+    checkPassFail(numWrongDeletes, 0)
+    checkPassFail(intScan(&index, INT_MIN, GT, INT_MAX, LT), 0)
+
+    // half as many entries fit in the pages that were freed
+    std::cout << "Insert half as many entries into the freed pages"
+              << std::endl;
+    for (std::size_t i = 0; i < peakEntries / 2; i++) {
+      int key = rand() % 100000;
+      entryRid.page_number = nextId++;
+      index.insertEntry(&key, entryRid);
+      oracle.insert(std::make_pair(key, entryRid.page_number));
+    }
+    checkPassFail(countMismatches(&index, oracle), 0)
+    indexFile.open(intIndexName, std::ios::binary | std::ios::ate);
+    const bool notGrown = indexFile.tellg() <= peakSize;
+    checkPassFail(notGrown, true)
+  }
+  removeIndex();
+  delete dlBufMgr;
+}
+
+// -----------------------------------------------------------------------------
+// cursorTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Returns the key of the record an index entry points to.
+ */
+int recordKey(const RecordId &rid) {
+  Page *page;
+  bufMgr->readPage(file1, rid.page_number, page);
+  const int key = ((const RECORD *)page->getRecord(rid).c_str())->i;
+  bufMgr->unPinPage(file1, rid.page_number, false);
+  return key;
+}
+
+void cursorTests() {
+  std::cout << "Open many scans of one index at once" << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // two overlapping scans, stepped in turn, each see their own range
+    int lowA = 0, highA = 100, lowB = 50, highB = 150;
+    IndexScanCursor a(&index, &lowA, GTE, &highA, LT);
+    IndexScanCursor b(&index, &lowB, GTE, &highB, LTE);
+    int numA = 0, numB = 0, wrongKeys = 0;
+    bool doneA = false, doneB = false;
+    RecordId rid;
+    while (!doneA || !doneB) {
+      try {
+        if (!doneA) {
+          a.scanNext(rid);
+          wrongKeys += recordKey(rid) != numA;
+          numA++;
+        }
+      } catch (IndexScanCompletedException &e) {
+        doneA = true;
+      }
+      try {
+        if (!doneB) {
+          b.scanNext(rid);
+          wrongKeys += recordKey(rid) != lowB + numB;
+          numB++;
+        }
+      } catch (IndexScanCompletedException &e) {
+        doneB = true;
+      }
+    }
+    checkPassFail(numA, 100)
+    checkPassFail(numB, 101)
+    checkPassFail(wrongKeys, 0)
+
+    // a cursor does not disturb the scan of startScan()
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    int low = 1000, high = 2000;
+    index.startScan(&low, GTE, &high, LT);
+    IndexScanCursor inner(&index, &low, GT, &high, LTE);
+    int numOuter = 0, numInner = 0;
+    try {
+      while (1) {
+        index.scanNext(rid);
+        numOuter++;
+        inner.scanNext(rid);
+        numInner++;
+      }
+    } catch (IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    checkPassFail(numOuter, 1000)
+    checkPassFail(numInner, 1000)
+
+    // index nested loop join of the keys 0 to 99 with themselves, with a new
+    // cursor for every outer entry
+    std::cout << "Self-join of 100 keys with a cursor per probe" << std::endl;
+    IndexScanCursor outer(&index, &lowA, GTE, &highA, LT);
+    int numMatches = 0;
+    try {
+      while (1) {
+        outer.scanNext(rid);
+        int key = recordKey(rid);
+        IndexScanCursor probe(&index, &key, GTE, &key, LTE);
+        try {
+          while (1) {
+            probe.scanNext(rid);
+            numMatches++;
+          }
+        } catch (IndexScanCompletedException &e) {
+        }
+      }
+    } catch (IndexScanCompletedException &e) {
+    }
+    checkPassFail(numMatches, 100)
+
+    bool noKeyThrown = false;
+    int missing = relationSize + 10;
+    try {
+      IndexScanCursor none(&index, &missing, GTE, &missing, LTE);
+    } catch (NoSuchKeyFoundException &e) {
+      noKeyThrown = true;
+    }
+    checkPassFail(noKeyThrown, true)
+
+    // scans of disjoint ranges from several threads
+    std::cout << "Scan from 4 threads at once" << std::endl;
+    std::atomic<int> numScanned(0);
+    std::vector<std::thread> scanners;
+    for (int t = 0; t < 4; t++) {
+      scanners.push_back(std::thread([&index, &numScanned, t]() {
+        const int part = relationSize / 4;
+        for (int round = 0; round < 5; round++) {
+          int lowVal = t * part, highVal = (t + 1) * part;
+          IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+          RecordId scanRid;
+          try {
+            while (1) {
+              scan.scanNext(scanRid);
+              numScanned++;
+            }
+          } catch (IndexScanCompletedException &e) {
+          }
+        }
+      }));
+    }
+    for (std::thread &scanner : scanners) scanner.join();
+    checkPassFail(numScanned, 5 * relationSize)
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// scanBatchTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Returns all record ids of a scan, read with scanNext() if batchSize is 0 and
+ * with scanNextBatch() otherwise.
+ */
+std::vector<RecordId> cursorScan(BTreeIndex *index, int lowVal, Operator lowOp,
+                                 int highVal, Operator highOp,
+                                 std::size_t batchSize) {
+  std::vector<RecordId> rids;
+  IndexScanCursor scan(index, &lowVal, lowOp, &highVal, highOp);
+  if (batchSize == 0) {
+    RecordId rid;
+    try {
+      while (1) {
+        scan.scanNext(rid);
+        rids.push_back(rid);
+      }
+    } catch (IndexScanCompletedException &e) {
+    }
+    return rids;
+  }
+
+  std::vector<RecordId> batch(batchSize);
+  std::size_t n;
+  while ((n = scan.scanNextBatch(batch.data(), batchSize)) > 0) {
+    rids.insert(rids.end(), batch.begin(), batch.begin() + n);
+  }
+  return rids;
+}
+
+void scanBatchTests() {
+  std::cout << "Scan in batches" << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // batches return the entries of scanNext() in the same order
+    const int ranges[][4] = {{0, GTE, 100, LT},
+                             {10, GT, 4000, LTE},
+                             {0, GTE, relationSize - 1, LTE},
+                             {2500, GTE, 2500, LTE}};
+    const std::size_t batchSizes[] = {1, 7, 1000};
+    int numDiffering = 0;
+    for (const int *range : ranges) {
+      const std::vector<RecordId> expected =
+          cursorScan(&index, range[0], (Operator)range[1], range[2],
+                     (Operator)range[3], 0);
+      for (std::size_t batchSize : batchSizes) {
+        const std::vector<RecordId> rids =
+            cursorScan(&index, range[0], (Operator)range[1], range[2],
+                       (Operator)range[3], batchSize);
+        numDiffering += rids != expected;
+      }
+    }
+    checkPassFail(numDiffering, 0)
+
+    // the scan of the index keeps returning 0 at the end
+    int lowVal = 0, highVal = relationSize;
+    index.startScan(&lowVal, GTE, &highVal, LT);
+    RecordId batch[256];
+    std::size_t n, numScanned = 0;
+    while ((n = index.scanNextBatch(batch, 256)) > 0) {
+      numScanned += n;
+    }
+    const std::size_t numAfterEnd = index.scanNextBatch(batch, 256);
+    checkPassFail(numScanned, (std::size_t)relationSize)
+    checkPassFail(numAfterEnd, (std::size_t)0)
+    index.endScan();
+
+    bool notInitThrown = false;
+    try {
+      index.scanNextBatch(batch, 256);
+    } catch (ScanNotInitializedException &e) {
+      notInitThrown = true;
+    }
+    checkPassFail(notInitThrown, true)
+
+    // duplicates spanning several leaves, with deletes merging other leaves
+    // between the batches, are each returned once
+    const int numDuplicates = 2000;
+    int dupKey = relationSize / 2;
+    for (int j = 0; j < numDuplicates; j++) {
+      RecordId rid;
+      rid.page_number = relationSize + j + 1;
+      rid.slot_number = 1;
+      index.insertEntry(&dupKey, rid);
+    }
+    IndexScanCursor scan(&index, &dupKey, GTE, &dupKey, LTE);
+    std::set<std::pair<PageId, SlotId>> seen;
+    int numReturned = 0, nextDeleted = 0;
+    while ((n = scan.scanNextBatch(batch, 7)) > 0) {
+      for (std::size_t j = 0; j < n; j++) {
+        seen.insert(std::make_pair(batch[j].page_number, batch[j].slot_number));
+      }
+      numReturned += n;
+      if (nextDeleted < 1000 && numReturned > 300) {
+        for (int j = 0; j < 100; j++, nextDeleted++) {
+          const std::optional<RecordId> rid = index.lookup(&nextDeleted);
+          if (rid) {
+            index.deleteEntry(&nextDeleted, *rid);
+          }
+        }
+      }
+    }
+    const int numSeen = seen.size();
+    checkPassFail(numReturned, numDuplicates + 1)
+    checkPassFail(numSeen, numDuplicates + 1)
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// lookupTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Returns the number of keys whose multiGet() result differs from lookup().
+ */
+int multiGetMismatches(BTreeIndex *index, const std::vector<int> &keys) {
+  std::vector<const void *> keyPtrs;
+  for (const int &key : keys) keyPtrs.push_back(&key);
+  std::vector<std::optional<RecordId> > rids(keys.size());
+  index->multiGet(keyPtrs.data(), keys.size(), rids.data());
+  int numMismatches = 0;
+  for (std::size_t k = 0; k < keys.size(); k++) {
+    numMismatches += rids[k] != index->lookup(&keys[k]);
+  }
+  return numMismatches;
+}
+
+void lookupTests() {
+  std::cout << "Look up single keys and many keys at once" << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    int wrongKeys = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const std::optional<RecordId> rid = index.lookup(&key);
+      wrongKeys += !rid || recordKey(*rid) != key;
+    }
+    checkPassFail(wrongKeys, 0)
+    int below = -1, above = relationSize;
+    const bool missingFound =
+        index.lookup(&below).has_value() || index.lookup(&above).has_value();
+    checkPassFail(missingFound, false)
+
+    // duplicates spanning several leaves are all found
+    const int numDuplicates = 2000;
+    int dupKey = relationSize / 3;
+    for (int j = 0; j < numDuplicates; j++) {
+      RecordId rid;
+      rid.page_number = relationSize + j + 1;
+      rid.slot_number = 1;
+      index.insertEntry(&dupKey, rid);
+    }
+    std::vector<RecordId> rids;
+    const std::size_t numDupsFound = index.lookupAll(&dupKey, rids);
+    checkPassFail(numDupsFound, (std::size_t)numDuplicates + 1)
+    checkPassFail(rids.size(), (std::size_t)numDuplicates + 1)
+    const std::size_t numMissingFound = index.lookupAll(&above, rids);
+    checkPassFail(numMissingFound, (std::size_t)0)
+
+    // random probes, some missing and some repeated
+    std::vector<int> probes;
+    srand(16);
+    for (int k = 0; k < 3000; k++) {
+      probes.push_back(rand() % (relationSize + 20) - 10);
+    }
+    probes.push_back(dupKey);
+    probes.push_back(dupKey);
+    checkPassFail(multiGetMismatches(&index, probes), 0)
+    const int numEmptyMismatches = multiGetMismatches(&index, {});
+    checkPassFail(numEmptyMismatches, 0)
+  }
+  removeIndex();
+
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    std::vector<std::string> keys;
+    srand(16);
+    for (int k = 0; k < 500; k++) {
+      char key[STRINGSIZE + 10];
+      sprintf(key, "%05d string record", rand() % (relationSize + 20) - 10);
+      keys.push_back(key);
+    }
+    std::vector<const void *> keyPtrs;
+    for (const std::string &key : keys) keyPtrs.push_back(key.c_str());
+    std::vector<std::optional<RecordId> > rids(keys.size());
+    index.multiGet(keyPtrs.data(), keys.size(), rids.data());
+    int numMismatches = 0, numFound = 0;
+    for (std::size_t k = 0; k < keys.size(); k++) {
+      numMismatches += rids[k] != index.lookup(keys[k].c_str());
+      numFound += rids[k].has_value();
+    }
+    checkPassFail(numMismatches, 0)
+    const bool someFound = numFound > 0 && numFound < (int)keys.size();
+    checkPassFail(someFound, true)
+  }
+  try {
+    File::remove(stringIndexName);
+  } catch (FileNotFoundException &e) {
+  }
+
+  // a tree with two levels of non-leaf nodes, so that probes share part of
+  // the path from the root
+  std::cout << "Look up many keys at once in a deeper tree" << std::endl;
+  BufMgr *lkBufMgr = new BufMgr(2000);
+  {
+    BTreeIndex index(relationName, intIndexName, lkBufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int numEntries = 1000000;
+    std::vector<int> keys;
+    for (int j = 0; j < numEntries; j++) keys.push_back(relationSize + 2 * j);
+    srand(16);
+    for (int j = numEntries - 1; j > 0; j--) {
+      std::swap(keys[j], keys[rand() % (j + 1)]);
+    }
+    RecordId rid;
+    rid.slot_number = 0;
+    for (int key : keys) {
+      rid.page_number = key + 1;
+      index.insertEntry(&key, rid);
+    }
+
+    std::vector<int> probes;
+    for (int k = 0; k < 20000; k++) {
+      probes.push_back(rand() % (relationSize + 2 * numEntries + 10) - 5);
+    }
+    checkPassFail(multiGetMismatches(&index, probes), 0)
+  }
+  removeIndex();
+  delete lkBufMgr;
+}
+
+// -----------------------------------------------------------------------------
+// appendTests
+// -----------------------------------------------------------------------------
+
+void appendTests() {
+  BufMgr *apBufMgr = new BufMgr(2000);
+  {
+    BTreeIndex index(relationName, intIndexName, apBufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // enough leaves for the root to split, so that non-leaf nodes are
+    // appended to as well
+    const int numAppends = 1000000;
+    std::cout << "Append " << numAppends << " increasing keys" << std::endl;
+    RecordId rid;
+    rid.slot_number = 0;
+    for (int key = 0; key < numAppends; key++) {
+      rid.page_number = key + 1;
+      index.insertEntry(&key, rid);
+    }
+
+    // full leaves, rather than half full ones
+    std::ifstream indexFile(intIndexName, std::ios::binary | std::ios::ate);
+    const long numPages = (long)indexFile.tellg() / Page::SIZE;
+    indexFile.close();
+    std::cout << numPages << " pages for " << numAppends << " entries"
+              << std::endl;
+    const bool leavesFull = numPages <= numAppends / INTARRAYLEAFSIZE + 5;
+    checkPassFail(leavesFull, true)
+    int numEntries;
+    checkPassFail(scanOutOfOrder(&index, numEntries), 0)
+    checkPassFail(numEntries, numAppends)
+    int notFound = 0;
+    for (int key = 0; key < numAppends; key += 97) {
+      const std::optional<RecordId> found = index.lookup(&key);
+      notFound += !found || found->page_number != (PageId)key + 1;
+    }
+    checkPassFail(notFound, 0)
+
+    // keys below the last leaf, deletes that merge the last leaves, and
+    // appends after them
+    std::cout << "Insert before the last leaf and delete from it" << std::endl;
+    std::map<int, int> extra;
+    srand(17);
+    for (int j = 0; j < 20000; j++) {
+      int key = rand() % numAppends;
+      rid.page_number = numAppends + j + 1;
+      index.insertEntry(&key, rid);
+      extra[key]++;
+    }
+    int wrongDeletes = 0;
+    for (int key = numAppends - 1; key >= numAppends - 5000; key--) {
+      rid.page_number = key + 1;
+      wrongDeletes += !index.deleteEntry(&key, rid);
+    }
+    checkPassFail(wrongDeletes, 0)
+    for (int key = numAppends; key < numAppends + 5000; key++) {
+      rid.page_number = key + 1;
+      index.insertEntry(&key, rid);
+    }
+    int lowVal = INT_MIN, highVal = INT_MAX;
+    IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LTE);
+    RecordId batch[256];
+    std::size_t n, numScanned = 0;
+    while ((n = scan.scanNextBatch(batch, 256)) > 0) {
+      numScanned += n;
+    }
+    checkPassFail(numScanned, (std::size_t)numAppends + 20000)
+    int wrongCounts = 0;
+    std::vector<RecordId> rids;
+    for (int key = numAppends - 10000; key < numAppends + 5000; key++) {
+      rids.clear();
+      const bool deleted = key >= numAppends - 5000 && key < numAppends;
+      const std::size_t expected = !deleted + extra[key];
+      wrongCounts += index.lookupAll(&key, rids) != expected;
+    }
+    checkPassFail(wrongCounts, 0)
+  }
+  removeIndex();
+  delete apBufMgr;
+}
+
+// -----------------------------------------------------------------------------
+// postingListTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Size of the index file, in pages.
+ */
+long indexPages() {
+  std::ifstream indexFile(intIndexName, std::ios::binary | std::ios::ate);
+  return (long)indexFile.tellg() / Page::SIZE;
+}
+
+void postingListTests() {
+  BufMgr *plBufMgr = new BufMgr(500);
+  const int numKeys = 20;
+  const int numEntries = 200000;
+
+  // the same entries without posting lists, for the size
+  long plainPages;
+  {
+    BTreeOptions options;
+    options.postingLists = false;
+    BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(18);
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % numKeys;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+    }
+    plainPages = indexPages();
+  }
+  removeIndex();
+
+  // an index built with the default options keeps every entry in its leaf
+  std::cout << "Insert " << numEntries << " entries of " << numKeys
+            << " keys with the default options" << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                     INTEGER);
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(18);
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % numKeys;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+    }
+    checkPassFail(index.stats().postingPages, (std::int64_t)0)
+    checkPassFail(indexPages(), plainPages)
+    int lowVal = 0, highVal = numKeys;
+    std::size_t numPosted = 0, numScanned = 0;
+    IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+    RecordId batch[256];
+    std::size_t n;
+    while ((n = scan.scanNextBatch(batch, 256)) > 0) {
+      for (std::size_t j = 0; j < n; j++) {
+        numPosted += batch[j].slot_number == POSTINGLISTSLOT;
+      }
+      numScanned += n;
+    }
+    checkPassFail(numScanned, (std::size_t)numEntries)
+    checkPassFail(numPosted, (std::size_t)0)
+  }
+  removeIndex();
+
+  std::cout << "Insert " << numEntries << " entries of " << numKeys
+            << " keys into posting lists" << std::endl;
+  BTreeOptions postingOptions;
+  postingOptions.postingLists = true;
+  {
+    BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                     INTEGER, postingOptions);
+    std::multimap<int, PageId> oracle;
+    std::vector<std::pair<int, PageId> > live;
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(18);
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % numKeys;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+      oracle.insert(std::make_pair(key, rid.page_number));
+      live.push_back(std::make_pair(key, rid.page_number));
+    }
+    const long postingPages = indexPages();
+    std::cout << postingPages << " pages, " << plainPages
+              << " without posting lists" << std::endl;
+    const bool smaller = postingPages * 3 < plainPages;
+    checkPassFail(smaller, true)
+    checkPassFail(countMismatches(&index, oracle), 0)
+
+    // record ids out of order go into the middle of the lists
+    std::cout << "Insert record ids out of order" << std::endl;
+    std::vector<PageId> ids;
+    for (int j = 0; j < 20000; j++) ids.push_back(2 * numEntries - 2 * j);
+    for (int j = (int)ids.size() - 1; j > 0; j--) {
+      std::swap(ids[j], ids[rand() % (j + 1)]);
+    }
+    for (PageId id : ids) {
+      int key = rand() % numKeys;
+      rid.page_number = id;
+      index.insertEntry(&key, rid);
+      oracle.insert(std::make_pair(key, rid.page_number));
+      live.push_back(std::make_pair(key, rid.page_number));
+    }
+    checkPassFail(countMismatches(&index, oracle), 0)
+    int wrongCounts = 0;
+    for (int key = -1; key <= numKeys; key++) {
+      std::vector<RecordId> rids;
+      wrongCounts += index.lookupAll(&key, rids) != oracle.count(key);
+    }
+    checkPassFail(wrongCounts, 0)
+
+    // delete half of the entries, then the rest
+    std::cout << "Delete the entries from the posting lists" << std::endl;
+    int wrongDeletes = 0;
+    const long peakPages = indexPages();
+    for (int round = 0; round < 2; round++) {
+      const std::size_t keep = round == 0 ? live.size() / 2 : 0;
+      while (live.size() > keep) {
+        const std::size_t pos = rand() % live.size();
+        int key = live[pos].first;
+        rid.page_number = live[pos].second;
+        wrongDeletes += !index.deleteEntry(&key, rid);
+        // deleting it again finds nothing
+        wrongDeletes += index.deleteEntry(&key, rid);
+        std::multimap<int, PageId>::iterator it = oracle.find(key);
+        while (it->second != rid.page_number) ++it;
+        oracle.erase(it);
+        live[pos] = live.back();
+        live.pop_back();
+      }
+      checkPassFail(countMismatches(&index, oracle), 0)
+    }
+    checkPassFail(wrongDeletes, 0)
+
+    // the pages of the lists are given back and used again
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % numKeys;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+    }
+    const bool notGrown = indexPages() <= peakPages;
+    checkPassFail(notGrown, true)
+  }
+  removeIndex();
+
+  // short lists stay in their leaves
+  const int numInlineKeys = 2000;
+  long plainInlinePages;
+  {
+    BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                     INTEGER);
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(19);
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % numInlineKeys;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+    }
+    plainInlinePages = indexPages();
+  }
+  removeIndex();
+
+  std::cout << "Insert " << numEntries << " entries of " << numInlineKeys
+            << " keys into posting lists in the leaves" << std::endl;
+  {
+    std::multimap<int, PageId> oracle;
+    std::vector<std::pair<int, PageId> > live;
+    RecordId rid;
+    rid.slot_number = 1;
+    {
+      BTreeIndex index(relationName, intIndexName, plBufMgr,
+                       offsetof(tuple, i), INTEGER, postingOptions);
+      srand(19);
+      for (int j = 0; j < numEntries; j++) {
+        int key = rand() % numInlineKeys;
+        rid.page_number = j + 1;
+        index.insertEntry(&key, rid);
+        oracle.insert(std::make_pair(key, rid.page_number));
+        live.push_back(std::make_pair(key, rid.page_number));
+      }
+      const long inlinePages = indexPages();
+      std::cout << inlinePages << " pages, " << plainInlinePages
+                << " without posting lists" << std::endl;
+      const bool smaller = inlinePages * 2 < plainInlinePages;
+      checkPassFail(smaller, true)
+      checkPassFail(index.stats().postingPages, (std::int64_t)0)
+      checkPassFail(index.analyze().numEntries, (std::int64_t)numEntries)
+      checkPassFail(countMismatches(&index, oracle), 0)
+      int wrongFirsts = 0;
+      for (int key = 0; key < numInlineKeys; key += 7) {
+        const std::optional<RecordId> first = index.lookup(&key);
+        wrongFirsts += !first || first->page_number !=
+                                     oracle.lower_bound(key)->second;
+      }
+      checkPassFail(wrongFirsts, 0)
+    }
+
+    // reopened without the option, the lists still grow in their leaves,
+    // also with record ids out of order
+    std::cout << "Insert into the lists of a reopened index" << std::endl;
+    BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (int j = 0; j < 20000; j++) {
+      int key = rand() % numInlineKeys;
+      rid.page_number = j % 2 == 0 ? numEntries + j + 1 : 2 * numEntries - j;
+      rid.slot_number = j % 2 == 0 ? 1 : 2;
+      index.insertEntry(&key, rid);
+      oracle.insert(std::make_pair(key, rid.page_number));
+      live.push_back(std::make_pair(key, rid.page_number));
+    }
+    checkPassFail(index.stats().postingPages, (std::int64_t)0)
+    checkPassFail(countMismatches(&index, oracle), 0)
+    int wrongCounts = 0;
+    for (int key = -1; key <= numInlineKeys; key++) {
+      std::vector<RecordId> rids;
+      wrongCounts += index.lookupAll(&key, rids) != oracle.count(key);
+    }
+    checkPassFail(wrongCounts, 0)
+
+    // delete half of the entries, then the rest
+    std::cout << "Delete the entries from the lists in the leaves"
+              << std::endl;
+    int wrongDeletes = 0;
+    for (int round = 0; round < 2; round++) {
+      const std::size_t keep = round == 0 ? live.size() / 2 : 0;
+      while (live.size() > keep) {
+        const std::size_t pos = rand() % live.size();
+        int key = live[pos].first;
+        rid.page_number = live[pos].second;
+        rid.slot_number = rid.page_number > (PageId)numEntries + 20000 ? 2 : 1;
+        wrongDeletes += !index.deleteEntry(&key, rid);
+        wrongDeletes += index.deleteEntry(&key, rid);
+        std::multimap<int, PageId>::iterator it = oracle.find(key);
+        while (it->second != rid.page_number) ++it;
+        oracle.erase(it);
+        live[pos] = live.back();
+        live.pop_back();
+      }
+      checkPassFail(countMismatches(&index, oracle), 0)
+    }
+    checkPassFail(wrongDeletes, 0)
+  }
+  removeIndex();
+
+  // posting lists that grow while they are scanned and looked up
+  std::cout << "Insert into posting lists from 4 threads while scanning"
+            << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                     INTEGER, postingOptions);
+    const int numThreads = 4;
+    const int perThread = 20000;
+    std::atomic<bool> writing(true);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < numThreads; t++) {
+      writers.push_back(std::thread([&index, t]() {
+        RecordId rid;
+        rid.slot_number = 1;
+        for (int j = 0; j < perThread; j++) {
+          int key = j % 8;
+          rid.page_number = t * perThread + j + 1;
+          index.insertEntry(&key, rid);
+        }
+      }));
+    }
+    int wrongScans = 0;
+    std::thread reader([&]() {
+      while (writing) {
+        int lowVal = 0, highVal = 8;
+        std::set<PageId> seen;
+        try {
+          IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LT);
+          RecordId batch[256];
+          std::size_t n;
+          while ((n = scan.scanNextBatch(batch, 256)) > 0) {
+            for (std::size_t j = 0; j < n; j++) {
+              wrongScans += !seen.insert(batch[j].page_number).second;
+            }
+          }
+        } catch (NoSuchKeyFoundException &e) {
+        }
+        for (int key = 0; key < 8; key++) {
+          std::vector<RecordId> rids;
+          index.lookupAll(&key, rids);
+        }
+      }
+    });
+    for (std::thread &writer : writers) writer.join();
+    writing = false;
+    reader.join();
+    checkPassFail(wrongScans, 0)
+    std::size_t numFound = 0;
+    for (int key = 0; key < 8; key++) {
+      std::vector<RecordId> rids;
+      numFound += index.lookupAll(&key, rids);
+    }
+    checkPassFail(numFound, (std::size_t)numThreads * perThread)
+  }
+  removeIndex();
+  delete plBufMgr;
+}
+
+// -----------------------------------------------------------------------------
+// compressedLeafTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of entries of the whole index.
+ */
+std::size_t countEntries(BTreeIndex *index) {
+  int lowVal = INT_MIN, highVal = INT_MAX;
+  std::size_t numEntries = 0;
+  try {
+    IndexScanCursor scan(index, &lowVal, GTE, &highVal, LTE);
+    RecordId batch[256];
+    std::size_t n;
+    while ((n = scan.scanNextBatch(batch, 256)) > 0) numEntries += n;
+  } catch (NoSuchKeyFoundException &e) {
+  }
+  return numEntries;
+}
+
+void compressedBulkLoadTests() {
+  long plainPages;
+  {
+    BTreeOptions options;
+    options.bulkLoad = true;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    plainPages = indexPages();
+  }
+  removeIndex();
+
+  std::cout << "Bulk load a B+ Tree index with compressed leaves" << std::endl;
+  {
+    BTreeOptions options;
+    options.bulkLoad = true;
+    options.compressLeaves = true;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    const long compressedPages = indexPages();
+    std::cout << compressedPages << " pages, " << plainPages
+              << " with plain leaves" << std::endl;
+    const bool smaller = compressedPages < plainPages;
+    checkPassFail(smaller, true)
+
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+    checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
+
+    // a second entry of every key splits the full leaves
+    int notFound = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const std::optional<RecordId> found = index.lookup(&key);
+      notFound += !found;
+      if (found) index.insertEntry(&key, *found);
+    }
+    checkPassFail(notFound, 0)
+    checkPassFail(intScan(&index, 26, GTE, 26, LTE), 2)
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), 2 * relationSize)
+
+    // and deleting them leaves one of each
+    int wrongDeletes = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const std::optional<RecordId> found = index.lookup(&key);
+      wrongDeletes += !found || !index.deleteEntry(&key, *found);
+    }
+    checkPassFail(wrongDeletes, 0)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize)
+  }
+  removeIndex();
+}
+
+void compressedLeafTests() {
+  BufMgr *clBufMgr = new BufMgr(500);
+  const int numEntries = 200000;
+
+  // the same entries in plain leaves, for the size
+  long plainPages;
+  {
+    BTreeIndex index(relationName, intIndexName, clBufMgr, offsetof(tuple, i),
+                     INTEGER);
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(19);
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % 100000;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+    }
+    plainPages = indexPages();
+  }
+  removeIndex();
+
+  std::cout << "Insert " << numEntries << " random keys into compressed leaves"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.compressLeaves = true;
+    BTreeIndex index(relationName, intIndexName, clBufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    std::multimap<int, PageId> oracle;
+    std::vector<std::pair<int, RecordId> > live;
+    std::vector<int> keys;
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(19);
+    for (int j = 0; j < numEntries; j++) {
+      int key = rand() % 100000;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+      oracle.insert(std::make_pair(key, rid.page_number));
+      live.push_back(std::make_pair(key, rid));
+    }
+    const long compressedPages = indexPages();
+    std::cout << compressedPages << " pages, " << plainPages
+              << " with plain leaves" << std::endl;
+    const bool smaller = compressedPages * 2 < plainPages;
+    checkPassFail(smaller, true)
+    checkPassFail(countMismatches(&index, oracle), 0)
+    int wrongCounts = 0;
+    for (int j = 0; j < 2000; j++) {
+      int key = rand() % 100010 - 5;
+      std::vector<RecordId> rids;
+      wrongCounts += index.lookupAll(&key, rids) != oracle.count(key);
+      keys.push_back(key);
+    }
+    checkPassFail(wrongCounts, 0)
+    std::sort(keys.begin(), keys.end());
+    checkPassFail(multiGetMismatches(&index, keys), 0)
+
+    // keys and page numbers far from the others widen the fields of a leaf,
+    // and a leaf whose entries no longer fit splits
+    std::cout << "Insert extreme keys and page numbers" << std::endl;
+    const int extremes[] = {INT_MIN, INT_MIN + 1, -1, 0, 50000, INT_MAX - 1,
+                            INT_MAX};
+    for (int j = 0; j < 3000; j++) {
+      int key = extremes[j % 7];
+      rid.page_number = j % 2 == 0 ? 0xFFFFFFF0u - j : numEntries + j + 1;
+      rid.slot_number = j % 3 == 0 ? POSTINGLISTSLOT - 1 : 1;
+      index.insertEntry(&key, rid);
+      oracle.insert(std::make_pair(key, rid.page_number));
+      live.push_back(std::make_pair(key, rid));
+    }
+    int wrongExtremes = 0;
+    for (int key : extremes) {
+      std::vector<RecordId> rids;
+      index.lookupAll(&key, rids);
+      std::multiset<PageId> found, expected;
+      for (const RecordId &r : rids) found.insert(r.page_number);
+      for (std::multimap<int, PageId>::iterator it = oracle.find(key);
+           it != oracle.end() && it->first == key; ++it) {
+        expected.insert(it->second);
+      }
+      wrongExtremes += found != expected;
+      const std::optional<RecordId> first = index.lookup(&key);
+      wrongExtremes += !first || !expected.count(first->page_number);
+    }
+    checkPassFail(wrongExtremes, 0)
+    checkPassFail(countEntries(&index), oracle.size())
+
+    // delete half of the entries, then the rest
+    std::cout << "Delete the entries from the compressed leaves" << std::endl;
+    int wrongDeletes = 0;
+    for (int round = 0; round < 2; round++) {
+      const std::size_t keep = round == 0 ? live.size() / 2 : 0;
+      while (live.size() > keep) {
+        const std::size_t pos = rand() % live.size();
+        int key = live[pos].first;
+        rid = live[pos].second;
+        wrongDeletes += !index.deleteEntry(&key, rid);
+        // deleting it again finds nothing
+        wrongDeletes += index.deleteEntry(&key, rid);
+        std::multimap<int, PageId>::iterator it = oracle.find(key);
+        while (it->second != rid.page_number) ++it;
+        oracle.erase(it);
+        live[pos] = live.back();
+        live.pop_back();
+      }
+      checkPassFail(countMismatches(&index, oracle), 0)
+    }
+    checkPassFail(wrongDeletes, 0)
+
+    // the empty index takes entries again
+    rid.slot_number = 1;
+    for (int j = 0; j < numEntries / 4; j++) {
+      int key = rand() % 100000;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+      oracle.insert(std::make_pair(key, rid.page_number));
+    }
+    checkPassFail(countMismatches(&index, oracle), 0)
+  }
+  removeIndex();
+
+  // compressed leaves that split while they are scanned and looked up
+  std::cout << "Insert into compressed leaves from 4 threads while scanning"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.compressLeaves = true;
+    BTreeIndex index(relationName, intIndexName, clBufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    const int numThreads = 4;
+    const int perThread = 20000;
+    std::atomic<bool> writing(true);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < numThreads; t++) {
+      writers.push_back(std::thread([&index, t]() {
+        RecordId rid;
+        rid.slot_number = 1;
+        for (int j = 0; j < perThread; j++) {
+          // one thread appends, the others insert all over the key range
+          int key = t == 0 ? 100000 + j : (j * 7919 + t) % 100000;
+          rid.page_number = t * perThread + j + 1;
+          index.insertEntry(&key, rid);
+        }
+      }));
+    }
+    int wrongScans = 0;
+    std::thread reader([&]() {
+      while (writing) {
+        int lowVal = 0, highVal = INT_MAX;
+        std::set<PageId> seen;
+        try {
+          IndexScanCursor scan(&index, &lowVal, GTE, &highVal, LTE);
+          RecordId batch[256];
+          std::size_t n;
+          while ((n = scan.scanNextBatch(batch, 256)) > 0) {
+            for (std::size_t j = 0; j < n; j++) {
+              wrongScans += !seen.insert(batch[j].page_number).second;
+            }
+          }
+        } catch (NoSuchKeyFoundException &e) {
+        }
+        for (int key = 0; key < 100; key++) {
+          index.lookup(&key);
+        }
+      }
+    });
+    for (std::thread &writer : writers) writer.join();
+    writing = false;
+    reader.join();
+    checkPassFail(wrongScans, 0)
+    checkPassFail(countEntries(&index), (std::size_t)numThreads * perThread)
+  }
+  removeIndex();
+  delete clBufMgr;
+}
+
+// -----------------------------------------------------------------------------
+// coveringIndexTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Payload of the covering index of coveringIndexTests: the columns d and s of
+ * the tuple.
+ */
+struct CoveringPayload {
+  double d;
+  char s[64];
+};
+
+/**
+ * Record ids of entries inserted without a record point past the relation,
+ * to FAKEPAGEBASE plus the key.
+ */
+const PageId FAKEPAGEBASE = 1000000;
+
+std::vector<PayloadColumn> coveringColumns() {
+  PayloadColumn d = {(int)offsetof(tuple, d), (int)sizeof(double)};
+  PayloadColumn s = {(int)offsetof(tuple, s), 64};
+  return std::vector<PayloadColumn>{d, s};
+}
+
+/**
+ * Number of entries of a full scan whose payload is not the one of their key,
+ * the key of the record or the one of a fake record id. The scan alternates
+ * between scanNext and scanNextBatch.
+ */
+int payloadMismatches(BTreeIndex *index, std::size_t &numEntries) {
+  int lowVal = INT_MIN, highVal = INT_MAX;
+  int mismatches = 0;
+  numEntries = 0;
+  RecordId rids[100];
+  CoveringPayload payloads[100];
+  index->startScan(&lowVal, GTE, &highVal, LTE);
+  try {
+    std::size_t n = 1;
+    while (n > 0) {
+      if (numEntries % 2 == 0) {
+        index->scanNext(rids[0], &payloads[0]);
+        n = 1;
+      } else {
+        n = index->scanNextBatch(rids, payloads, 100);
+      }
+      for (std::size_t j = 0; j < n; j++) {
+        const int key = rids[j].page_number >= FAKEPAGEBASE
+                            ? rids[j].page_number - FAKEPAGEBASE
+                            : recordKey(rids[j]);
+        char expected[64];
+        memset(expected, ' ', sizeof(expected));
+        sprintf(expected, "%05d string record", key);
+        mismatches += payloads[j].d != key ||
+                      memcmp(payloads[j].s, expected, sizeof(expected)) != 0;
+      }
+      numEntries += n;
+    }
+  } catch (IndexScanCompletedException &e) {
+  }
+  index->endScan();
+  return mismatches;
+}
+
+void coveringIndexTests() {
+  std::cout << "Build covering indexes with the columns d and s" << std::endl;
+  // inserted one at a time, then bulk loaded, which is left for the rest
+  for (int bulk = 0; bulk < 2; bulk++) {
+    removeIndex();
+    BTreeOptions options;
+    options.bulkLoad = bulk;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, coveringColumns(), options);
+    checkPassFail(index.getPayloadLength(), sizeof(CoveringPayload))
+    std::size_t numEntries;
+    checkPassFail(payloadMismatches(&index, numEntries), 0)
+    checkPassFail(numEntries, (std::size_t)relationSize)
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+  }
+
+  std::cout << "Reopen the covering index" << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, coveringColumns());
+    std::size_t numEntries;
+    checkPassFail(payloadMismatches(&index, numEntries), 0)
+    checkPassFail(numEntries, (std::size_t)relationSize)
+  }
+  try {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    std::cout << "BadIndexInfoException Test Failed." << std::endl;
+  } catch (BadIndexInfoException &e) {
+    std::cout << "BadIndexInfoException Test Passed." << std::endl;
+  }
+
+  std::cout << "Insert and delete entries of the covering index" << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, coveringColumns());
+    // a second entry of every key, and new keys past the relation
+    CoveringPayload payload;
+    RecordId fake;
+    fake.slot_number = 1;
+    for (int key = 0; key < 2 * relationSize; key++) {
+      payload.d = key;
+      memset(payload.s, ' ', sizeof(payload.s));
+      sprintf(payload.s, "%05d string record", key);
+      fake.page_number = FAKEPAGEBASE + key;
+      index.insertEntry(&key, fake, &payload);
+    }
+    std::size_t numEntries;
+    checkPassFail(payloadMismatches(&index, numEntries), 0)
+    checkPassFail(numEntries, (std::size_t)3 * relationSize)
+
+    // deleting every other fake entry merges and rebalances leaves
+    int wrongDeletes = 0;
+    for (int key = 0; key < 2 * relationSize; key += 2) {
+      fake.page_number = FAKEPAGEBASE + key;
+      wrongDeletes += !index.deleteEntry(&key, fake);
+    }
+    checkPassFail(wrongDeletes, 0)
+    checkPassFail(payloadMismatches(&index, numEntries), 0)
+    checkPassFail(numEntries, (std::size_t)2 * relationSize)
+  }
+  removeIndex();
+
+  // the payload columns are checked when the index is built
+  try {
+    PayloadColumn tooLong = {0, MAXPAYLOADLENGTH + 1};
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, std::vector<PayloadColumn>{tooLong});
+    std::cout << "BadIndexInfoException Test Failed." << std::endl;
+  } catch (BadIndexInfoException &e) {
+    std::cout << "BadIndexInfoException Test Passed." << std::endl;
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// countedTreeTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of random rank(), countRange() and select() calls, and numEntries(),
+ * whose result differs from the one computed from the sorted keys of all
+ * entries of the index.
+ */
+int orderStatMismatches(BTreeIndex *index, const std::vector<int> &keys) {
+  int mismatches = index->numEntries() != keys.size();
+  const int maxKey = keys.empty() ? 1 : keys.back() + 2;
+  for (int j = 0; j < 300; j++) {
+    int key = rand() % maxKey - 1;
+    const std::size_t below =
+        std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+    mismatches += index->rank(&key) != below;
+
+    int lowVal = rand() % maxKey - 1;
+    int highVal = lowVal + rand() % 300;
+    const Operator lowOp = j % 2 ? GT : GTE;
+    const Operator highOp = j % 3 ? LT : LTE;
+    const auto first =
+        lowOp == GT ? std::upper_bound(keys.begin(), keys.end(), lowVal)
+                    : std::lower_bound(keys.begin(), keys.end(), lowVal);
+    const auto last =
+        highOp == LTE ? std::upper_bound(keys.begin(), keys.end(), highVal)
+                      : std::lower_bound(keys.begin(), keys.end(), highVal);
+    const std::size_t inRange = last > first ? last - first : 0;
+    mismatches +=
+        index->countRange(&lowVal, lowOp, &highVal, highOp) != inRange;
+
+    const std::size_t k = rand() % (keys.size() + 1);
+    int selected;
+    const std::optional<RecordId> found = index->select(k, &selected);
+    mismatches += k < keys.size() ? !found || selected != keys[k] : !!found;
+  }
+  return mismatches;
+}
+
+void countedTreeTests() {
+  std::cout << "Bulk load counted trees" << std::endl;
+  for (int compress = 0; compress < 2; compress++) {
+    removeIndex();
+    BTreeOptions options;
+    options.bulkLoad = true;
+    options.countedTree = true;
+    options.compressLeaves = compress;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    checkPassFail(index.numEntries(), (std::size_t)relationSize)
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    int lowVal = 25, highVal = 40;
+    checkPassFail(index.countRange(&lowVal, GT, &highVal, LT), 14)
+    lowVal = 3000, highVal = 4000;
+    checkPassFail(index.countRange(&lowVal, GTE, &highVal, LT), 1000)
+    lowVal = 5000, highVal = 6000;
+    checkPassFail(index.countRange(&lowVal, GT, &highVal, LT), 0)
+    int key = 3000;
+    checkPassFail(index.rank(&key), 3000)
+    int median = -1;
+    index.select(relationSize / 2, &median);
+    checkPassFail(median, relationSize / 2)
+    const bool pastEnd = index.select(relationSize, &median).has_value();
+    checkPassFail(pastEnd, false)
+  }
+  removeIndex();
+
+  // enough entries for two levels of non-leaf nodes
+  BufMgr *ctBufMgr = new BufMgr(2000);
+  const int numFakes = 600000;
+  std::cout << "Insert " << numFakes << " entries into a counted tree and "
+            << "delete them" << std::endl;
+  {
+    BTreeOptions options;
+    options.countedTree = true;
+    BTreeIndex index(relationName, intIndexName, ctBufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    std::vector<int> keys;
+    for (int key = 0; key < relationSize; key++) keys.push_back(key);
+
+    // many entries of few keys, which posting lists would otherwise take
+    std::vector<std::pair<int, RecordId> > fakes;
+    RecordId fake;
+    fake.slot_number = 1;
+    srand(43);
+    for (int j = 0; j < numFakes; j++) {
+      int key = j % 3 ? rand() % (2 * relationSize) : rand() % 20;
+      fake.page_number = FAKEPAGEBASE + j;
+      index.insertEntry(&key, fake);
+      fakes.push_back(std::make_pair(key, fake));
+      keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    checkPassFail(orderStatMismatches(&index, keys), 0)
+
+    // deletes rebalance nodes, whose counts move with them: the entries of
+    // the upper keys go first, so that the last nodes borrow from the ones
+    // before them, and then the others in random order, which merges nodes
+    std::random_shuffle(fakes.begin(), fakes.end());
+    const auto upper = std::stable_partition(
+        fakes.begin(), fakes.end(),
+        [](const std::pair<int, RecordId> &f) {
+          return f.first >= relationSize;
+        });
+    const std::size_t checkpoints[] = {(std::size_t)(upper - fakes.begin()),
+                                       fakes.size() - 10000};
+    int wrongDeletes = 0;
+    for (std::size_t j = 0; j < fakes.size(); j++) {
+      wrongDeletes += !index.deleteEntry(&fakes[j].first, fakes[j].second);
+      if (j + 1 == checkpoints[0] || j + 1 == checkpoints[1]) {
+        keys.clear();
+        for (int key = 0; key < relationSize; key++) keys.push_back(key);
+        for (std::size_t f = j + 1; f < fakes.size(); f++) {
+          keys.push_back(fakes[f].first);
+        }
+        std::sort(keys.begin(), keys.end());
+        checkPassFail(orderStatMismatches(&index, keys), 0)
+      }
+    }
+    checkPassFail(wrongDeletes, 0)
+    checkPassFail(index.numEntries(), (std::size_t)relationSize)
+  }
+  delete ctBufMgr;
+
+  // the meta page keeps the kind of tree
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(index.numEntries(), (std::size_t)relationSize)
+  }
+  removeIndex();
+
+  std::cout << "Count the entries of a counted tree on the double field"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.countedTree = true;
+    BTreeIndex index(relationName, doubleIndexName, bufMgr,
+                     offsetof(tuple, d), DOUBLE, options);
+    double lowVal = 25, highVal = 40;
+    checkPassFail(index.countRange(&lowVal, GT, &highVal, LT), 14)
+    lowVal = 25.5, highVal = 26.5;
+    checkPassFail(index.countRange(&lowVal, GT, &highVal, LT), 1)
+    double key = 1000.5;
+    checkPassFail(index.rank(&key), 1001)
+    double selected = -1;
+    index.select(4321, &selected);
+    checkPassFail(selected, 4321)
+  }
+  try {
+    File::remove(doubleIndexName);
+  } catch (FileNotFoundException &e) {
+  }
+
+  std::cout << "Count the entries of an index that is not counted"
+            << std::endl;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int lowVal = 25, highVal = 40;
+    try {
+      index.countRange(&lowVal, GT, &highVal, LT);
+      std::cout << "NotCountedTreeException Test Failed." << std::endl;
+    } catch (NotCountedTreeException &e) {
+      std::cout << "NotCountedTreeException Test Passed." << std::endl;
+    }
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// parallelBuildTests
+// -----------------------------------------------------------------------------
+
+void parallelBuildTests() {
+  std::cout << "Scan the relation in ranges of pages" << std::endl;
+  {
+    PageId numPages;
+    {
+      PageFile relation(relationName, false);
+      numPages = relation.getNumPages();
+    }
+    // the last range goes past the end of the file
+    const PageId ends[] = {1, numPages / 3, numPages / 2, numPages + 5};
+    int numRecords = 0;
+    for (int r = 0; r < 3; r++) {
+      FileScan scan(relationName, bufMgr, ends[r], ends[r + 1]);
+      RecordId rid;
+      try {
+        while (true) {
+          scan.scanNext(rid);
+          numRecords++;
+        }
+      } catch (EndOfFileException &e) {
+      }
+    }
+    checkPassFail(numRecords, relationSize)
+  }
+
+  std::cout << "Build a B+ Tree index on the integer field with 4 threads"
+            << std::endl;
+  {
+    // every thread sorts in 3 pages and spills runs
+    BTreeOptions options;
+    options.buildThreads = 4;
+    options.sortMemory = 12 * Page::SIZE;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
+    checkPassFail(countEntries(&index), (std::size_t)relationSize)
+
+    // the leaves are full, so a second entry of every key splits them
+    int notFound = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const std::optional<RecordId> found = index.lookup(&key);
+      notFound += !found;
+      if (found) index.insertEntry(&key, *found);
+    }
+    checkPassFail(notFound, 0)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 2000)
+  }
+  removeIndex();
+
+  std::cout << "Build counted trees with 3 threads" << std::endl;
+  std::vector<int> keys;
+  for (int key = 0; key < relationSize; key++) keys.push_back(key);
+  for (int compress = 0; compress < 2; compress++) {
+    removeIndex();
+    BTreeOptions options;
+    options.buildThreads = 3;
+    options.countedTree = true;
+    options.compressLeaves = compress;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    checkPassFail(orderStatMismatches(&index, keys), 0)
+    checkPassFail(countEntries(&index), (std::size_t)relationSize)
+  }
+  removeIndex();
+
+  std::cout << "Build a half full B+ Tree index on the string field with a "
+            << "thread per core" << std::endl;
+  {
+    BTreeOptions options;
+    options.buildThreads = 0;
+    options.fillFactor = 0.5;
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING, options);
+
+    checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(stringScan(&index, 5000, GT, 6000, LT), 0)
+  }
+  try {
+    File::remove(stringIndexName);
+  } catch (FileNotFoundException &e) {
+  }
+
+  std::cout << "Build an index of an empty relation with 4 threads"
+            << std::endl;
+  {
+    const std::string emptyName = relationName + "Empty";
+    try {
+      File::remove(emptyName);
+    } catch (FileNotFoundException &e) {
+    }
+    PageFile::create(emptyName);
+    std::string emptyIndexName;
+    {
+      BTreeOptions options;
+      options.buildThreads = 4;
+      BTreeIndex index(emptyName, emptyIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER, options);
+      checkPassFail(countEntries(&index), (std::size_t)0)
+      int key = 7;
+      index.insertEntry(&key, RecordId{1, 1});
+      checkPassFail(countEntries(&index), (std::size_t)1)
+    }
+    File::remove(emptyIndexName);
+    File::remove(emptyName);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// statsTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of statistics that differ between a and b.
+ */
+int statsMismatches(const IndexStats &a, const IndexStats &b) {
+  return (a.height != b.height) + (a.leafPages != b.leafPages) +
+         (a.nonLeafPages != b.nonLeafPages) +
+         (a.postingPages != b.postingPages) + (a.numEntries != b.numEntries) +
+         (a.leafFill != b.leafFill) + (a.nonLeafFill != b.nonLeafFill) +
+         (a.distinctKeys != b.distinctKeys) +
+         (a.leafContiguity != b.leafContiguity);
+}
+
+/**
+ * The counters in the meta page of the index file intIndexName.
+ */
+IndexCounters metaCounters() {
+  BlobFile indexFile(intIndexName, false);
+  const Page page = indexFile.readPage(indexFile.getFirstPageNo());
+  return ((const IndexMetaInfo *)&page)->counters;
+}
+
+void statsTests() {
+  std::cout << "Statistics of an index built by inserts" << std::endl;
+  IndexStats closed;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const IndexStats built = index.stats();
+    checkPassFail(statsMismatches(built, index.analyze()), 0)
+    checkPassFail(built.numEntries, (std::int64_t)relationSize)
+    checkPassFail(built.distinctKeys, (std::int64_t)relationSize)
+    checkPassFail(built.height, 2)
+    checkPassFail(built.postingPages, (std::int64_t)0)
+    const bool splitFill = built.leafFill > 0.5 && built.leafFill < 1;
+    checkPassFail(splitFill, true)
+    // random inserts split leaves into pages far from their siblings
+    const bool scattered = built.leafContiguity < 0.5;
+    checkPassFail(scattered, true)
+
+    // the deletes merge leaves, and the distinct keys scale with the entries
+    for (int key = 0; key < relationSize; key += 2) {
+      RecordId rid = *index.lookup(&key);
+      index.deleteEntry(&key, rid);
+    }
+    closed = index.stats();
+    checkPassFail(closed.numEntries, (std::int64_t)relationSize / 2)
+    checkPassFail(closed.distinctKeys, (std::int64_t)relationSize / 2)
+    const bool merged = closed.leafPages < built.leafPages;
+    checkPassFail(merged, true)
+    checkPassFail(statsMismatches(closed, index.analyze()), 0)
+  }
+
+  std::cout << "Statistics stored in the meta page" << std::endl;
+  checkPassFail(metaCounters().numEntries, (std::int64_t)relationSize / 2)
+  checkPassFail(metaCounters().leafPages, closed.leafPages)
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(statsMismatches(index.stats(), closed), 0)
+  }
+  // an index file without counters is analyzed when it is opened
+  {
+    BlobFile indexFile(intIndexName, false);
+    const PageId headerPageNo = indexFile.getFirstPageNo();
+    Page page = indexFile.readPage(headerPageNo);
+    memset(&((IndexMetaInfo *)&page)->counters, 0, sizeof(IndexCounters));
+    indexFile.writePage(headerPageNo, page);
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(statsMismatches(index.stats(), closed), 0)
+  }
+  removeIndex();
+
+  std::cout << "Statistics of bulk loaded indexes" << std::endl;
+  for (int threads = 1; threads <= 4; threads += 3) {
+    removeIndex();
+    BTreeOptions options;
+    options.bulkLoad = true;
+    options.buildThreads = threads;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    const IndexStats built = index.stats();
+    checkPassFail(statsMismatches(built, index.analyze()), 0)
+    checkPassFail(built.numEntries, (std::int64_t)relationSize)
+    checkPassFail(built.distinctKeys, (std::int64_t)relationSize)
+    const bool packed = built.leafFill > 0.9;
+    checkPassFail(packed, true)
+    if (threads == 1) {
+      // the leaves are written one after another
+      checkPassFail(built.leafContiguity, 1.0)
+    }
+  }
+  removeIndex();
+
+  std::cout << "Statistics of an index with posting lists" << std::endl;
+  {
+    BTreeOptions options;
+    options.postingLists = true;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    RecordId rid;
+    rid.slot_number = 1;
+    srand(24);
+    for (int j = 0; j < 20000; j++) {
+      int key = relationSize + rand() % 2;
+      rid.page_number = j + 1;
+      index.insertEntry(&key, rid);
+    }
+    const IndexStats inserted = index.stats();
+    checkPassFail(inserted.numEntries, (std::int64_t)relationSize + 20000)
+    const bool posted = inserted.postingPages > 0;
+    checkPassFail(posted, true)
+    const IndexStats analyzed = index.analyze();
+    checkPassFail(analyzed.distinctKeys, (std::int64_t)relationSize + 2)
+    checkPassFail(analyzed.postingPages, inserted.postingPages)
+    checkPassFail(analyzed.leafPages, inserted.leafPages)
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// bloomFilterTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of the keys [from, to) that lookup() and lookupAll() find, and the
+ * pages they read in accesses.
+ */
+int lookupRange(BTreeIndex *index, int from, int to, int &accesses) {
+  bufMgr->clearBufStats();
+  int numFound = 0;
+  for (int key = from; key < to; key++) {
+    std::vector<RecordId> rids;
+    numFound += index->lookup(&key).has_value();
+    numFound += index->lookupAll(&key, rids) > 0;
+  }
+  accesses = bufMgr->getBufStats().pagereads;
+  return numFound / 2;
+}
+
+void bloomFilterTests() {
+  // a lookup that descends reads 2 pages or more, one that the filter rules
+  // out reads none
+  const int numMissing = 10000;
+  const int fewAccesses = numMissing * 2 * 2 / 20;
+  int accesses;
+
+  std::cout << "Build a B+ Tree index with a Bloom filter by inserts"
+            << std::endl;
+  std::vector<int> keys;
+  for (int key = -100; key < relationSize + 100; key++) keys.push_back(key);
+  {
+    BTreeOptions options;
+    options.bloomFalsePositiveRate = 0.01;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    checkPassFail(lookupRange(&index, 0, relationSize, accesses),
+                  relationSize)
+    checkPassFail(lookupRange(&index, relationSize, relationSize + numMissing,
+                              accesses),
+                  0)
+    const bool skipped = accesses < fewAccesses;
+    checkPassFail(skipped, true)
+    checkPassFail(multiGetMismatches(&index, keys), 0)
+  }
+
+  std::cout << "Reopen it and insert until the filter is built again"
+            << std::endl;
+  const int numInserted = 4 * relationSize;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(lookupRange(&index, relationSize, relationSize + numMissing,
+                              accesses),
+                  0)
+    const bool skipped = accesses < fewAccesses;
+    checkPassFail(skipped, true)
+    for (int key = -numInserted; key < 0; key++) {
+      index.insertEntry(&key, RecordId{1, 1});
+    }
+    checkPassFail(lookupRange(&index, -numInserted, relationSize, accesses),
+                  numInserted + relationSize)
+    checkPassFail(lookupRange(&index, relationSize, relationSize + numMissing,
+                              accesses),
+                  0)
+    const bool stillSkipped = accesses < fewAccesses;
+    checkPassFail(stillSkipped, true)
+  }
+
+  std::cout << "Reopen it without its filter file" << std::endl;
+  File::remove(BTreeIndex::bloomFileName(intIndexName));
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(lookupRange(&index, -numInserted, relationSize, accesses),
+                  numInserted + relationSize)
+    checkPassFail(lookupRange(&index, relationSize, relationSize + numMissing,
+                              accesses),
+                  0)
+    const bool skipped = accesses < fewAccesses;
+    checkPassFail(skipped, true)
+  }
+
+  // a filter file left from before the last inserts, as after a crash
+  std::cout << "Reopen it with a filter file older than the index"
+            << std::endl;
+  std::string staleFilter;
+  {
+    std::ifstream in(BTreeIndex::bloomFileName(intIndexName),
+                     std::ios::binary);
+    staleFilter.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+  }
+  const int numLater = 1000;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    // no file holds the filter while it changes
+    checkPassFail(File::exists(BTreeIndex::bloomFileName(intIndexName)),
+                  false)
+    for (int key = relationSize; key < relationSize + numLater; key++) {
+      index.insertEntry(&key, RecordId{1, 1});
+    }
+  }
+  {
+    std::ofstream out(BTreeIndex::bloomFileName(intIndexName),
+                      std::ios::binary | std::ios::trunc);
+    out << staleFilter;
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(lookupRange(&index, relationSize, relationSize + numLater,
+                              accesses),
+                  numLater)
+    checkPassFail(lookupRange(&index, relationSize + numLater,
+                              relationSize + numMissing, accesses),
+                  0)
+    const bool skipped = accesses < fewAccesses;
+    checkPassFail(skipped, true)
+  }
+  removeIndex();
+
+  std::cout << "Bulk load B+ Tree indexes with Bloom filters" << std::endl;
+  for (int compress = 0; compress < 2; compress++) {
+    removeIndex();
+    BTreeOptions options;
+    options.buildThreads = 4;
+    options.compressLeaves = compress;
+    options.bloomFalsePositiveRate = 0.01;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    checkPassFail(lookupRange(&index, 0, relationSize, accesses),
+                  relationSize)
+    checkPassFail(lookupRange(&index, relationSize, relationSize + numMissing,
+                              accesses),
+                  0)
+    const bool skipped = accesses < fewAccesses;
+    checkPassFail(skipped, true)
+    checkPassFail(multiGetMismatches(&index, keys), 0)
+  }
+  removeIndex();
+
+  {
+    BTreeOptions options;
+    options.bulkLoad = true;
+    options.bloomFalsePositiveRate = 0.01;
+    BTreeIndex index(relationName, doubleIndexName, bufMgr,
+                     offsetof(tuple, d), DOUBLE, options);
+    int numFound = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const double present = key;
+      numFound += index.lookup(&present).has_value();
+    }
+    bufMgr->clearBufStats();
+    for (int key = 0; key < relationSize; key++) {
+      const double missing = key + 0.5;
+      numFound += index.lookup(&missing).has_value();
+    }
+    checkPassFail(numFound, relationSize)
+    const bool skipped = bufMgr->getBufStats().pagereads < fewAccesses;
+    checkPassFail(skipped, true)
+  }
+  File::remove(doubleIndexName);
+  File::remove(BTreeIndex::bloomFileName(doubleIndexName));
+
+  std::cout << "A false positive rate of 1 or more is rejected" << std::endl;
+  try {
+    BTreeOptions options;
+    options.bloomFalsePositiveRate = 1;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    std::cout << "BadIndexInfoException Test Failed." << std::endl;
+  } catch (BadIndexInfoException &e) {
+    std::cout << "BadIndexInfoException Test Passed." << std::endl;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// hashIndexTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of keys in [from, to) for which the hash index and the B+ tree do
+ * not find the same record ids.
+ */
+int hashMismatches(HashIndex *hash, BTreeIndex *tree, int from, int to) {
+  auto ridLess = [](const RecordId &a, const RecordId &b) {
+    return a.page_number != b.page_number ? a.page_number < b.page_number
+                                          : a.slot_number < b.slot_number;
+  };
+  int mismatches = 0;
+  for (int key = from; key < to; key++) {
+    std::vector<RecordId> hashRids, treeRids;
+    hash->lookupAll(&key, hashRids);
+    tree->lookupAll(&key, treeRids);
+    std::sort(hashRids.begin(), hashRids.end(), ridLess);
+    std::sort(treeRids.begin(), treeRids.end(), ridLess);
+    const std::optional<RecordId> first = hash->lookup(&key);
+    if (hashRids != treeRids || first.has_value() != !treeRids.empty() ||
+        (first && std::find(treeRids.begin(), treeRids.end(), *first) ==
+                      treeRids.end())) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+void hashIndexTests() {
+  std::string hashIndexName;
+  std::cout << "Build an extendible hash index next to a B+ Tree index"
+            << std::endl;
+  {
+    BTreeIndex tree(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                    INTEGER);
+    HashIndexStats closed;
+    {
+      HashIndex hash(relationName, hashIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+      const HashIndexStats built = hash.stats();
+      checkPassFail(built.numEntries, (std::int64_t)relationSize)
+      checkPassFail(built.overflowPages, (std::int64_t)0)
+      const bool split = built.numBuckets > 1 &&
+                         built.numBuckets <= (1 << built.globalDepth);
+      checkPassFail(split, true)
+      checkPassFail(hashMismatches(&hash, &tree, -100, relationSize + 100), 0)
+
+      // a lookup reads the bucket of its key and nothing else
+      bufMgr->clearBufStats();
+      for (int key = 0; key < 2 * relationSize; key++) {
+        hash.lookup(&key);
+      }
+      checkPassFail(bufMgr->getBufStats().pagereads, 2 * relationSize)
+
+      std::cout << "Insert more entries of one key than a bucket holds"
+                << std::endl;
+      const int numDuplicates = 2000;
+      const int dupKey = 7;
+      for (int j = 0; j < numDuplicates; j++) {
+        RecordId rid;
+        rid.page_number = 100000 + j;
+        rid.slot_number = 1;
+        hash.insertEntry(&dupKey, rid);
+        tree.insertEntry(&dupKey, rid);
+      }
+      const bool overflowed = hash.stats().overflowPages > 0;
+      checkPassFail(overflowed, true)
+      std::vector<RecordId> rids;
+      checkPassFail(hash.lookupAll(&dupKey, rids),
+                    (std::size_t)numDuplicates + 1)
+      checkPassFail(hashMismatches(&hash, &tree, -100, relationSize + 100), 0)
+      int notDeleted = 0;
+      for (int j = 0; j < numDuplicates; j++) {
+        RecordId rid;
+        rid.page_number = 100000 + j;
+        rid.slot_number = 1;
+        notDeleted += !hash.deleteEntry(&dupKey, rid);
+        tree.deleteEntry(&dupKey, rid);
+      }
+      checkPassFail(notDeleted, 0)
+      checkPassFail(hash.stats().overflowPages, (std::int64_t)0)
+
+      std::cout << "Delete every other key" << std::endl;
+      for (int key = 0; key < relationSize; key += 2) {
+        RecordId rid = *tree.lookup(&key);
+        notDeleted += !hash.deleteEntry(&key, rid);
+        tree.deleteEntry(&key, rid);
+      }
+      checkPassFail(notDeleted, 0)
+      const int missing = relationSize + 1;
+      checkPassFail(hash.deleteEntry(&missing, rid), false)
+      checkPassFail(hash.stats().numEntries, (std::int64_t)relationSize / 2)
+      checkPassFail(hashMismatches(&hash, &tree, -100, relationSize + 100), 0)
+      closed = hash.stats();
+    }
+
+    std::cout << "Reopen the hash index" << std::endl;
+    HashIndex hash(relationName, hashIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+    const HashIndexStats opened = hash.stats();
+    checkPassFail(opened.globalDepth, closed.globalDepth)
+    checkPassFail(opened.numBuckets, closed.numBuckets)
+    checkPassFail(opened.numEntries, closed.numEntries)
+    checkPassFail(hashMismatches(&hash, &tree, -100, relationSize + 100), 0)
+  }
+  removeIndex();
+
+  std::cout << "A hash index file of other metadata is rejected" << std::endl;
+  try {
+    HashIndex hash(relationName, hashIndexName, bufMgr, offsetof(tuple, i),
+                   DOUBLE);
+    std::cout << "BadIndexInfoException Test Failed." << std::endl;
+  } catch (BadIndexInfoException &e) {
+    std::cout << "BadIndexInfoException Test Passed." << std::endl;
+  }
+  File::remove(hashIndexName);
+
+  std::cout << "Hash indexes of DOUBLE and STRING keys" << std::endl;
+  {
+    HashIndex hash(relationName, hashIndexName, bufMgr, offsetof(tuple, d),
+                   DOUBLE);
+    int numFound = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const double present = key;
+      const double missing = key + 0.5;
+      numFound += hash.lookup(&present).has_value();
+      numFound += hash.lookup(&missing).has_value();
+    }
+    checkPassFail(numFound, relationSize)
+    const double negativeZero = -0.0;
+    checkPassFail(hash.lookup(&negativeZero).has_value(), true)
+  }
+  File::remove(hashIndexName);
+  {
+    HashIndex hash(relationName, hashIndexName, bufMgr, offsetof(tuple, s),
+                   STRING);
+    int numFound = 0;
+    for (int key = 0; key < relationSize + 100; key++) {
+      char value[64];
+      sprintf(value, "%05d string record", key);
+      numFound += hash.lookup(value).has_value();
+    }
+    checkPassFail(numFound, relationSize)
+  }
+  File::remove(hashIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// innerCacheTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of the keys that lookup() does not find with the record id on page
+ * key + 1, and the pages the lookups read in pageReads.
+ */
+int cachedLookupMismatches(BTreeIndex *index, const std::vector<int> &keys,
+                           int &pageReads) {
+  bufMgr->clearBufStats();
+  int mismatches = 0;
+  for (int key : keys) {
+    const std::optional<RecordId> found = index->lookup(&key);
+    mismatches += !found || found->page_number != (PageId)key + 1;
+  }
+  pageReads = bufMgr->getBufStats().pagereads;
+  return mismatches;
+}
+
+void innerCacheTests() {
+  // payloads of 240 bytes leave about 30 entries to a leaf, so the inserts
+  // grow the tree to 3 levels
+  const int numInserted = 40000;
+  const PayloadColumn wide = {0, sizeof(RECORD)};
+  const std::vector<PayloadColumn> columns(3, wide);
+  std::vector<int> keys;
+  for (int key = relationSize; key < relationSize + numInserted; key++) {
+    keys.push_back(key);
+  }
+  srand(7);
+  for (int i = numInserted - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rand() % (i + 1)]);
+  }
+  int pageReads, numEntries;
+
+  for (int cachedLevels = 0; cachedLevels <= 3; cachedLevels++) {
+    std::cout << "Insert into and delete from an index caching "
+              << cachedLevels << " levels" << std::endl;
+    removeIndex();
+    BTreeOptions options;
+    options.cachedLevels = cachedLevels;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, columns, options);
+    RecordId rid;
+    rid.slot_number = 0;
+    for (int key : keys) {
+      rid.page_number = key + 1;
+      index.insertEntry(&key, rid);
+    }
+    checkPassFail(index.stats().height, 3)
+    checkPassFail(cachedLookupMismatches(&index, keys, pageReads), 0)
+    // a lookup reads a page for every level below the cache, and the next
+    // leaf for the first key of a leaf
+    const int levelsRead = 3 - std::min(cachedLevels, 2);
+    const bool fewReads = pageReads >= levelsRead * numInserted &&
+                          pageReads < levelsRead * numInserted +
+                                          numInserted / 10;
+    checkPassFail(fewReads, true)
+
+    // the deletes merge leaves and non-leaf nodes
+    const int numKept = numInserted / 4;
+    for (int i = numKept; i < numInserted; i++) {
+      rid.page_number = keys[i] + 1;
+      index.deleteEntry(&keys[i], rid);
+    }
+    const std::vector<int> kept(keys.begin(), keys.begin() + numKept);
+    checkPassFail(cachedLookupMismatches(&index, kept, pageReads), 0)
+    scanOutOfOrder(&index, numEntries);
+    checkPassFail(numEntries, relationSize + numKept)
+  }
+  removeIndex();
+
+  std::cout << "Insert from many threads into an index caching 2 levels"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.cachedLevels = 2;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, columns, options);
+    const int numThreads = 4;
+    std::vector<std::thread> inserters;
+    for (int t = 0; t < numThreads; t++) {
+      inserters.push_back(std::thread([&index, &keys, t]() {
+        RecordId rid;
+        rid.slot_number = 0;
+        for (std::size_t i = t; i < keys.size(); i += numThreads) {
+          rid.page_number = keys[i] + 1;
+          index.insertEntry(&keys[i], rid);
+          const int before = keys[i] - 1;
+          index.lookup(&before);
+        }
+      }));
+    }
+    for (std::thread &inserter : inserters) inserter.join();
+    checkPassFail(cachedLookupMismatches(&index, keys, pageReads), 0)
+    scanOutOfOrder(&index, numEntries);
+    checkPassFail(numEntries, relationSize + numInserted)
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// insertBufferTests
+// -----------------------------------------------------------------------------
+
+void insertBufferTests() {
+  // payloads of 240 bytes make the index much larger than bufMgr, so an
+  // insert in random order mostly reads its leaf from disk
+  const int numInserted = 40000;
+  const PayloadColumn wide = {0, sizeof(RECORD)};
+  const std::vector<PayloadColumn> columns(3, wide);
+  std::vector<int> keys;
+  for (int key = relationSize; key < relationSize + numInserted; key++) {
+    keys.push_back(key);
+  }
+  srand(11);
+  for (int i = numInserted - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rand() % (i + 1)]);
+  }
+  int pageReads, numEntries;
+  int diskReads[2];
+
+  for (int buffered = 0; buffered <= 1; buffered++) {
+    std::cout << "Insert in random order into an index "
+              << (buffered ? "with" : "without") << " an insert buffer"
+              << std::endl;
+    removeIndex();
+    BTreeOptions options;
+    options.insertBufferEntries = buffered ? 6000 : 0;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, columns, options);
+    bufMgr->clearBufStats();
+    RecordId rid;
+    rid.slot_number = 0;
+    for (int key : keys) {
+      rid.page_number = key + 1;
+      index.insertEntry(&key, rid);
+    }
+    diskReads[buffered] = bufMgr->getBufStats().diskreads;
+    // the last 4000 entries are still buffered
+    checkPassFail(index.stats().numEntries, relationSize + numInserted)
+    checkPassFail(cachedLookupMismatches(&index, keys, pageReads), 0)
+    scanOutOfOrder(&index, numEntries);
+    checkPassFail(numEntries, relationSize + numInserted)
+  }
+  const bool fewerReads = diskReads[1] * 4 < diskReads[0];
+  checkPassFail(fewerReads, true)
+  removeIndex();
+
+  std::cout << "Look up and delete entries in the insert buffer" << std::endl;
+  {
+    BTreeOptions options;
+    options.insertBufferEntries = 1000;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    // a second entry for each of the first 100 keys, and a new key
+    RecordId rid;
+    rid.slot_number = 0;
+    for (int key = 0; key < 100; key++) {
+      rid.page_number = relationSize + key + 1;
+      index.insertEntry(&key, rid);
+    }
+    const int newKey = 2 * relationSize;
+    rid.page_number = newKey + 1;
+    index.insertEntry(&newKey, rid);
+
+    int numFound = 0, firstInTree = 0;
+    for (int key = 0; key < 100; key++) {
+      std::vector<RecordId> rids;
+      numFound += index.lookupAll(&key, rids);
+      // the entry in the leaves comes before the buffered one
+      const std::optional<RecordId> first = index.lookup(&key);
+      const PageId bufferedPage = relationSize + key + 1;
+      firstInTree += first && first->page_number != bufferedPage &&
+                     rids.back().page_number == bufferedPage;
+    }
+    checkPassFail(numFound, 200)
+    checkPassFail(firstInTree, 100)
+
+    const int probes[3] = {newKey, 0, newKey + 1};
+    const void *probeKeys[3] = {&probes[0], &probes[1], &probes[2]};
+    std::optional<RecordId> outRids[3];
+    index.multiGet(probeKeys, 3, outRids);
+    const bool allFound = outRids[0] &&
+                          outRids[0]->page_number == (PageId)newKey + 1 &&
+                          outRids[1] && !outRids[2];
+    checkPassFail(allFound, true)
+
+    int numDeleted = 0;
+    for (int key = 0; key < 50; key++) {
+      rid.page_number = relationSize + key + 1;
+      numDeleted += index.deleteEntry(&key, rid);
+    }
+    checkPassFail(numDeleted, 50)
+    checkPassFail(index.stats().numEntries, relationSize + 51)
+  }
+  {
+    // closing the index flushed the entries left in the buffer
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    scanOutOfOrder(&index, numEntries);
+    checkPassFail(numEntries, relationSize + 51)
+  }
+  removeIndex();
+
+  std::cout << "Scan and count a counted tree with entries in the insert "
+            << "buffer" << std::endl;
+  {
+    BTreeOptions options;
+    options.countedTree = true;
+    options.insertBufferEntries = 1000;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    // a second entry for every tenth key, and entries of new keys after them
+    std::vector<int> sortedKeys;
+    for (int key = 0; key < relationSize; key++) sortedKeys.push_back(key);
+    RecordId rid;
+    rid.slot_number = 0;
+    for (int key = 0; key < relationSize + 200;
+         key += key < relationSize ? 10 : 2) {
+      rid.page_number = relationSize + key + 1;
+      index.insertEntry(&key, rid);
+      sortedKeys.push_back(key);
+    }
+    std::sort(sortedKeys.begin(), sortedKeys.end());
+    const double leafFill = index.stats().leafFill;
+
+    // the scan returns the entries of each key as lookupAll() does
+    int lowVal = 95, highVal = relationSize + 51;
+    std::vector<RecordId> expected, scanned(2 * relationSize);
+    for (int key = lowVal + 1; key <= highVal; key++) {
+      index.lookupAll(&key, expected);
+    }
+    index.startScan(&lowVal, GT, &highVal, LTE);
+    scanned.resize(index.scanNextBatch(scanned.data(), scanned.size()));
+    index.endScan();
+    const bool inOrder = scanned == expected;
+    checkPassFail(inOrder, true)
+
+    // a range that only the buffer holds entries of
+    lowVal = relationSize + 1, highVal = relationSize + 3;
+    index.startScan(&lowVal, GTE, &highVal, LTE);
+    const std::size_t numBuffered =
+        index.scanNextBatch(scanned.data(), scanned.size());
+    index.endScan();
+    checkPassFail(numBuffered, 1)
+
+    checkPassFail(orderStatMismatches(&index, sortedKeys), 0)
+    // after the entries of the keys up to 10 in the tree and that of key 0
+    int key = -1;
+    const std::optional<RecordId> second = index.select(12, &key);
+    const bool buffered = key == 10 && second &&
+                          second->page_number == (PageId)relationSize + 11;
+    checkPassFail(buffered, true)
+    // nothing was flushed into the leaves
+    const bool unchanged = index.stats().leafFill == leafFill;
+    checkPassFail(unchanged, true)
+  }
+  removeIndex();
+
+  std::cout << "Insert from many threads into an index with an insert buffer"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.insertBufferEntries = 500;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    const int numThreads = 4;
+    std::vector<std::thread> inserters;
+    for (int t = 0; t < numThreads; t++) {
+      inserters.push_back(std::thread([&index, &keys, t]() {
+        RecordId rid;
+        rid.slot_number = 0;
+        for (std::size_t i = t; i < keys.size(); i += numThreads) {
+          rid.page_number = keys[i] + 1;
+          index.insertEntry(&keys[i], rid);
+          const int before = keys[i] - 1;
+          index.lookup(&before);
+        }
+      }));
+    }
+    for (std::thread &inserter : inserters) inserter.join();
+    checkPassFail(cachedLookupMismatches(&index, keys, pageReads), 0)
+    scanOutOfOrder(&index, numEntries);
+    checkPassFail(numEntries, relationSize + numInserted)
+  }
+  removeIndex();
+
+  std::cout << "Insert and delete from many threads with an insert buffer"
+            << std::endl;
+  {
+    BTreeOptions options;
+    options.insertBufferEntries = 500;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, coveringColumns(), options);
+    // each thread deletes every other entry it inserts, mostly while it is
+    // still buffered, and now and then one it inserted long before
+    const int numThreads = 4;
+    std::atomic<int> wrongDeletes(0), numDeleted(0);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < numThreads; t++) {
+      writers.push_back(std::thread([&, t]() {
+        CoveringPayload payload;
+        RecordId fake;
+        fake.slot_number = 1;
+        for (std::size_t i = t; i < keys.size(); i += numThreads) {
+          int key = keys[i];
+          payload.d = key;
+          memset(payload.s, ' ', sizeof(payload.s));
+          sprintf(payload.s, "%05d string record", key);
+          fake.page_number = FAKEPAGEBASE + key;
+          index.insertEntry(&key, fake, &payload);
+          if (i / numThreads % 2 == 1) {
+            wrongDeletes += !index.deleteEntry(&key, fake);
+            wrongDeletes += index.deleteEntry(&key, fake);
+            numDeleted++;
+          } else if (i >= 1000 * numThreads && i / numThreads % 10 == 0) {
+            key = keys[i - 1000 * numThreads];
+            fake.page_number = FAKEPAGEBASE + key;
+            wrongDeletes += !index.deleteEntry(&key, fake);
+            numDeleted++;
+          }
+        }
+      }));
+    }
+    for (std::thread &writer : writers) writer.join();
+    checkPassFail(wrongDeletes.load(), 0)
+    const int numLeft = relationSize + numInserted - numDeleted;
+    checkPassFail(index.stats().numEntries, numLeft)
+    std::size_t numScanned;
+    checkPassFail(payloadMismatches(&index, numScanned), 0)
+    checkPassFail(numScanned, (std::size_t)numLeft)
+  }
+  removeIndex();
+}
+
+// -----------------------------------------------------------------------------
+// lsmIndexTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of keys in [from, to) for which the LSM index and the B+ tree do not
+ * find the same record ids.
+ */
+int lsmMismatches(LSMIndex *lsm, BTreeIndex *tree, int from, int to) {
+  int mismatches = 0;
+  for (int key = from; key < to; key++) {
+    std::vector<RecordId> lsmRids, treeRids;
+    lsm->lookupAll(&key, lsmRids);
+    tree->lookupAll(&key, treeRids);
+    const std::optional<RecordId> first = lsm->lookup(&key);
+    if (lsmRids != treeRids || first.has_value() != !treeRids.empty() ||
+        (first && std::find(treeRids.begin(), treeRids.end(), *first) ==
+                      treeRids.end())) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+/**
+ * Record ids the scan of the LSM index returns, appended to outRids.
+ * @return number of entries returned
+ */
+int lsmScan(LSMIndex *lsm, const void *lowVal, Operator lowOp,
+            const void *highVal, Operator highOp,
+            std::vector<RecordId> &outRids) {
+  int numResults = 0;
+  try {
+    lsm->startScan(lowVal, lowOp, highVal, highOp);
+  } catch (NoSuchKeyFoundException &e) {
+    return 0;
+  }
+  try {
+    while (1) {
+      RecordId rid;
+      lsm->scanNext(rid);
+      outRids.push_back(rid);
+      numResults++;
+    }
+  } catch (IndexScanCompletedException &e) {
+  }
+  lsm->endScan();
+  return numResults;
+}
+
+void lsmIndexTests() {
+  std::string lsmIndexName;
+  const int lowest = INT_MIN, highest = INT_MAX;
+  std::vector<RecordId> rids;
+  std::cout << "Build an LSM index next to a B+ Tree index" << std::endl;
+  {
+    BTreeIndex tree(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                    INTEGER);
+    LSMOptions options;
+    options.memtableEntries = 512;
+    options.runsPerLevel = 3;
+    options.backgroundCompaction = false;
+    LSMIndexStats closed;
+    {
+      LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER, options);
+      const LSMIndexStats built = lsm.stats();
+      checkPassFail(built.flushes, (std::int64_t)relationSize / 512)
+      const bool compacted = built.compactions > 0 && built.numLevels > 1 &&
+                             built.numRuns < 3 * built.numLevels;
+      checkPassFail(compacted, true)
+      checkPassFail(built.runEntries + built.memtableEntries,
+                    (std::int64_t)relationSize)
+      checkPassFail(lsmMismatches(&lsm, &tree, -100, relationSize + 100), 0)
+      checkPassFail(lsmScan(&lsm, &lowest, GTE, &highest, LTE, rids),
+                    relationSize)
+      int lowVal = 25, highVal = 40;
+      checkPassFail(lsmScan(&lsm, &lowVal, GT, &highVal, LT, rids), 14)
+      checkPassFail(lsmScan(&lsm, &lowVal, GTE, &highVal, LTE, rids), 16)
+      lowVal = relationSize;
+      checkPassFail(lsmScan(&lsm, &lowVal, GTE, &highest, LTE, rids), 0)
+
+      std::cout << "Insert more entries and delete some" << std::endl;
+      const int dupKey = 7;
+      for (int j = 0; j < 2000; j++) {
+        RecordId rid;
+        rid.page_number = 100000 + j;
+        rid.slot_number = 1;
+        lsm.insertEntry(&dupKey, rid);
+        tree.insertEntry(&dupKey, rid);
+      }
+      rids.clear();
+      checkPassFail(lsm.lookupAll(&dupKey, rids), (std::size_t)2001)
+      int notDeleted = 0;
+      for (int key = 0; key < relationSize; key += 2) {
+        RecordId rid = *tree.lookup(&key);
+        notDeleted += !lsm.deleteEntry(&key, rid);
+        tree.deleteEntry(&key, rid);
+        // a second delete finds the tombstone
+        notDeleted += lsm.deleteEntry(&key, rid);
+      }
+      checkPassFail(notDeleted, 0)
+      const int missing = relationSize + 1;
+      checkPassFail(lsm.deleteEntry(&missing, rid), false)
+      checkPassFail(lsmMismatches(&lsm, &tree, -100, relationSize + 100), 0)
+      rids.clear();
+      checkPassFail(lsmScan(&lsm, &lowest, GTE, &highest, LTE, rids),
+                    relationSize / 2 + 2000)
+      closed = lsm.stats();
+    }
+
+    std::cout << "Reopen the LSM index" << std::endl;
+    LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, i),
+                 INTEGER, options);
+    const LSMIndexStats opened = lsm.stats();
+    // closing the index wrote its memtable to a run
+    checkPassFail(opened.memtableEntries, (std::int64_t)0)
+    checkPassFail(opened.runEntries,
+                  closed.runEntries + closed.memtableEntries)
+    checkPassFail(lsmMismatches(&lsm, &tree, -100, relationSize + 100), 0)
+
+    std::cout << "Compact the LSM index into one run" << std::endl;
+    lsm.compact();
+    const LSMIndexStats compacted = lsm.stats();
+    checkPassFail(compacted.numRuns, 1)
+    // the tombstones are gone
+    checkPassFail(compacted.runEntries,
+                  (std::int64_t)relationSize / 2 + 2000)
+    checkPassFail(lsmMismatches(&lsm, &tree, -100, relationSize + 100), 0)
+
+    // the Bloom filter rules out absent keys, and a lookup of a present key
+    // reads about one page
+    bufMgr->clearBufStats();
+    for (int key = relationSize; key < 2 * relationSize; key++) {
+      lsm.lookup(&key);
+    }
+    const bool filtered = bufMgr->getBufStats().pagereads < relationSize / 20;
+    checkPassFail(filtered, true)
+    bufMgr->clearBufStats();
+    for (int key = 1; key < relationSize; key += 2) {
+      lsm.lookup(&key);
+    }
+    const bool onePage =
+        bufMgr->getBufStats().pagereads <= relationSize / 2 + 100;
+    checkPassFail(onePage, true)
+  }
+  removeIndex();
+
+  std::cout << "An LSM index file of other metadata is rejected" << std::endl;
+  try {
+    LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, i),
+                 DOUBLE);
+    std::cout << "BadIndexInfoException Test Failed." << std::endl;
+  } catch (BadIndexInfoException &e) {
+    std::cout << "BadIndexInfoException Test Passed." << std::endl;
+  }
+  LSMIndex::removeIndex(lsmIndexName);
+  checkPassFail(File::exists(lsmIndexName), false)
+  checkPassFail(File::exists(LSMIndex::runFileName(lsmIndexName, 0)), false)
+
+  std::cout << "Insert and look up from many threads with background "
+               "compaction"
+            << std::endl;
+  {
+    LSMOptions options;
+    options.memtableEntries = 1000;
+    LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, i),
+                 INTEGER, options);
+    const int numThreads = 4;
+    const int numInserted = 40000;
+    std::atomic<int> notFound(0);
+    std::vector<std::thread> inserters;
+    for (int t = 0; t < numThreads; t++) {
+      inserters.push_back(std::thread([&lsm, &notFound, t]() {
+        RecordId rid;
+        rid.slot_number = 0;
+        for (int key = relationSize + t; key < relationSize + numInserted;
+             key += numThreads) {
+          rid.page_number = key + 1;
+          lsm.insertEntry(&key, rid);
+          const std::optional<RecordId> found = lsm.lookup(&key);
+          if (!found || found->page_number != rid.page_number) notFound++;
+        }
+      }));
+    }
+    for (std::thread &inserter : inserters) inserter.join();
+    checkPassFail(notFound.load(), 0)
+    rids.clear();
+    const int lowVal = relationSize;
+    checkPassFail(lsmScan(&lsm, &lowVal, GTE, &highest, LTE, rids),
+                  numInserted)
+    int outOfOrder = 0;
+    for (std::size_t r = 1; r < rids.size(); r++) {
+      if (rids[r].page_number <= rids[r - 1].page_number) outOfOrder++;
+    }
+    checkPassFail(outOfOrder, 0)
+    const bool bounded = lsm.stats().numRuns <= MAXLSMRUNS / 2 + 1;
+    checkPassFail(bounded, true)
+  }
+  LSMIndex::removeIndex(lsmIndexName);
+
+  // each inserter flushes a run before it waits for compaction, so while
+  // compact() runs, inserters that outnumber the runs the meta page lists are
+  // held back only by the limit
+  std::cout << "Insert from more threads than the meta page lists runs"
+            << std::endl;
+  {
+    LSMOptions options;
+    options.memtableEntries = 64;
+    options.runsPerLevel = 8;
+    const int numThreads = MAXLSMRUNS + 32;
+    const int numInserted = 40000;
+    std::atomic<bool> inserting(true);
+    std::atomic<int> mostRuns(0);
+    {
+      LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER, options);
+      std::thread watcher([&lsm, &inserting, &mostRuns]() {
+        while (inserting) {
+          mostRuns = std::max<int>(mostRuns, lsm.stats().numRuns);
+          std::this_thread::yield();
+        }
+      });
+      std::thread compacter([&lsm, &inserting]() {
+        while (inserting) lsm.compact();
+      });
+      std::vector<std::thread> inserters;
+      for (int t = 0; t < numThreads; t++) {
+        inserters.push_back(std::thread([&lsm, t]() {
+          RecordId rid;
+          rid.slot_number = 0;
+          for (int key = relationSize + t; key < relationSize + numInserted;
+               key += numThreads) {
+            rid.page_number = key + 1;
+            lsm.insertEntry(&key, rid);
+          }
+        }));
+      }
+      for (std::thread &inserter : inserters) inserter.join();
+      inserting = false;
+      watcher.join();
+      compacter.join();
+    }
+    const bool bounded = mostRuns <= MAXLSMRUNS;
+    checkPassFail(bounded, true)
+    // the runs listed when it was closed are the ones it opens
+    LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, i),
+                 INTEGER, options);
+    rids.clear();
+    checkPassFail(lsmScan(&lsm, &lowest, GTE, &highest, LTE, rids),
+                  relationSize + numInserted)
+  }
+  LSMIndex::removeIndex(lsmIndexName);
+
+  std::cout << "LSM indexes of DOUBLE and STRING keys" << std::endl;
+  {
+    LSMOptions options;
+    options.memtableEntries = 700;
+    LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, d),
+                 DOUBLE, options);
+    int numFound = 0;
+    for (int key = 0; key < relationSize; key++) {
+      const double present = key;
+      const double missing = key + 0.5;
+      numFound += lsm.lookup(&present).has_value();
+      numFound += lsm.lookup(&missing).has_value();
+    }
+    checkPassFail(numFound, relationSize)
+    const double lowVal = 25, highVal = 40;
+    checkPassFail(lsmScan(&lsm, &lowVal, GT, &highVal, LT, rids), 14)
+  }
+  LSMIndex::removeIndex(lsmIndexName);
+  {
+    LSMOptions options;
+    options.memtableEntries = 700;
+    LSMIndex lsm(relationName, lsmIndexName, bufMgr, offsetof(tuple, s),
+                 STRING, options);
+    int numFound = 0;
+    for (int key = 0; key < relationSize + 100; key++) {
+      char value[64];
+      sprintf(value, "%05d string record", key);
+      numFound += lsm.lookup(value).has_value();
+    }
+    checkPassFail(numFound, relationSize)
+    char lowVal[64], highVal[64];
+    sprintf(lowVal, "%05d string record", 25);
+    sprintf(highVal, "%05d string record", 40);
+    checkPassFail(lsmScan(&lsm, lowVal, GT, highVal, LT, rids), 14)
+  }
+  LSMIndex::removeIndex(lsmIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// keySearchTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Number of searches of random keys, some of them in keys and some not, for
+ * which keyLowerBound or keyUpperBound differ from std::lower_bound or
+ * std::upper_bound.
+ */
+template <class T>
+int countSearchMismatches(const std::vector<T> &keys) {
+  int mismatches = 0;
+  const int n = keys.size();
+  for (int probe = 0; probe < 2000; probe++) {
+    const T key = probe % 2 == 0 && n > 0 ? keys[rand() % n]
+                                          : (T)(rand() % (4 * n + 10) - 5);
+    const int lower = std::lower_bound(keys.begin(), keys.end(), key) -
+                      keys.begin();
+    const int upper = std::upper_bound(keys.begin(), keys.end(), key) -
+                      keys.begin();
+    if (keyLowerBound(keys.data(), n, key) != lower) mismatches++;
+    if (keyUpperBound(keys.data(), n, key) != upper) mismatches++;
+  }
+  return mismatches;
+}
+
+void keySearchTests() {
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Key search with " << KEYSEARCHISA << std::endl;
+  srand(35);
+  int mismatches = 0;
+  const int sizes[] = {0, 1, 3, 8, 31, 32, 33, 100, INTARRAYLEAFSIZE,
+                       INTARRAYNONLEAFSIZE, DOUBLEARRAYLEAFSIZE};
+  for (int n : sizes) {
+    // runs of duplicates, and gaps between the keys
+    std::vector<int> intKeys;
+    std::vector<double> doubleKeys;
+    for (int i = 0; i < n; i++) {
+      const int key = intKeys.empty() ? 0 : intKeys.back() + rand() % 4;
+      intKeys.push_back(key);
+      doubleKeys.push_back(key + 0.5);
+    }
+    mismatches += countSearchMismatches(intKeys);
+    mismatches += countSearchMismatches(doubleKeys);
+  }
+  checkPassFail(mismatches, 0)
+}
+
+// -----------------------------------------------------------------------------
+// concurrencyTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Scans the index while other threads change it. The entries have unique keys
+ * and the record id of key k is {k + 1, 0}, so the scan must return strictly
+ * increasing page numbers.
+ * @param numEntries set to the number of entries returned
+ * @return number of entries returned out of order
+ */
+int scanOutOfOrder(BTreeIndex *index, int &numEntries) {
+  int lowVal = INT_MIN, highVal = INT_MAX;
+  int outOfOrder = 0;
+  numEntries = 0;
+  try {
+    index->startScan(&lowVal, GTE, &highVal, LTE);
+    PageId prev = 0;
+    RecordId scanRid;
+    try {
+      while (1) {
+        index->scanNext(scanRid);
+        if (scanRid.page_number <= prev) outOfOrder++;
+        numEntries++;
+        prev = scanRid.page_number;
+      }
+    } catch (IndexScanCompletedException &e) {
+    }
+    index->endScan();
+  } catch (NoSuchKeyFoundException &e) {
+  }
+  return outOfOrder;
+}
+
+void concurrencyTests() {
+  const int numThreads = 4;
+  const int perThread = 25000;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    std::cout << "Insert from " << numThreads
+              << " threads while scanning and looking up" << std::endl;
+    std::atomic<int> inserted[numThreads];
+    for (int t = 0; t < numThreads; t++) inserted[t] = 0;
+    std::atomic<bool> writing(true);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < numThreads; t++) {
+      writers.push_back(std::thread([&index, &inserted, t]() {
+        // thread t owns the keys t, t + numThreads, ...
+        for (int j = 0; j < perThread; j++) {
+          int key = t + j * numThreads;
+          RecordId rid;
+          rid.page_number = key + 1;
+          rid.slot_number = 0;
+          index.insertEntry(&key, rid);
+          inserted[t] = j + 1;
+        }
+      }));
+    }
+    int lookupsMissed = 0, scansOutOfOrder = 0, numScans = 0;
+    std::thread reader([&]() {
+      srand(14);
+      while (writing) {
+        for (int t = 0; t < numThreads; t++) {
+          const int done = inserted[t];
+          if (done == 0) continue;
+          int key = t + (rand() % done) * numThreads;
+          const std::optional<RecordId> rid = index.lookup(&key);
+          if (!rid || rid->page_number != (PageId)key + 1) {
+            lookupsMissed++;
+          }
+        }
+      }
+    });
+    std::thread scanner([&]() {
+      int numEntries;
+      while (writing) {
+        scansOutOfOrder += scanOutOfOrder(&index, numEntries);
+        numScans++;
+      }
+    });
+    for (int t = 0; t < numThreads; t++) writers[t].join();
+    writing = false;
+    reader.join();
+    scanner.join();
+    std::cout << numScans << " scans ran during the inserts" << std::endl;
+    checkPassFail(lookupsMissed, 0)
+    checkPassFail(scansOutOfOrder, 0)
+    int numEntries;
+    checkPassFail(scanOutOfOrder(&index, numEntries), 0)
+    checkPassFail(numEntries, numThreads * perThread)
+
+    int notFound = 0;
+    for (int key = 0; key < numThreads * perThread; key++) {
+      const std::optional<RecordId> rid = index.lookup(&key);
+      if (!rid || rid->page_number != (PageId)key + 1) {
+        notFound++;
+      }
+    }
+    checkPassFail(notFound, 0)
+    int missingKey = numThreads * perThread;
+    const bool missingFound = index.lookup(&missingKey).has_value();
+    checkPassFail(missingFound, false)
+
+    std::cout << "Delete from " << numThreads << " threads while scanning"
+              << std::endl;
+    std::atomic<int> wrongDeletes(0);
+    std::vector<std::thread> deleters;
+    writing = true;
+    for (int t = 0; t < numThreads; t++) {
+      deleters.push_back(std::thread([&index, &wrongDeletes, t]() {
+        for (int j = 0; j < perThread; j++) {
+          int key = t + j * numThreads;
+          RecordId rid;
+          rid.page_number = key + 1;
+          rid.slot_number = 0;
+          if (!index.deleteEntry(&key, rid)) wrongDeletes++;
+        }
+      }));
+    }
+    scansOutOfOrder = 0;
+    std::thread deleteScanner([&]() {
+      int numEntries;
+      while (writing) {
+        scansOutOfOrder += scanOutOfOrder(&index, numEntries);
+      }
+    });
+    for (int t = 0; t < numThreads; t++) deleters[t].join();
+    writing = false;
+    deleteScanner.join();
+    checkPassFail(wrongDeletes, 0)
+    checkPassFail(scansOutOfOrder, 0)
+    checkPassFail(scanOutOfOrder(&index, numEntries), 0)
+    checkPassFail(numEntries, 0)
+  }
+  removeIndex();
+}
+
+/**
+ * Scans the whole index and counts entries that are missing from it, are in
+ * it but not in the oracle, or are out of key order. Also checks the number
+ * of entries of some keys.
+ */
+int countMismatches(BTreeIndex *index,
+                    const std::multimap<int, PageId> &oracle) {
+  std::map<PageId, int> expected;
+  for (std::multimap<int, PageId>::const_iterator it = oracle.begin();
+       it != oracle.end(); ++it) {
+    expected[it->second] = it->first;
+  }
+
+  int mismatches = 0;
+  int lowVal = INT_MIN, highVal = INT_MAX;
+  try {
+    index->startScan(&lowVal, GTE, &highVal, LTE);
+    int prevKey = INT_MIN;
+    RecordId scanRid;
+    try {
+      while (1) {
+        index->scanNext(scanRid);
+        std::map<PageId, int>::iterator it = expected.find(scanRid.page_number);
+        if (it == expected.end() || it->second < prevKey) {
+          mismatches++;
+        } else {
+          prevKey = it->second;
+          expected.erase(it);
+        }
+      }
+    } catch (IndexScanCompletedException &e) {
+    }
+    index->endScan();
+  } catch (NoSuchKeyFoundException &e) {
+  }
+  mismatches += expected.size();
+
+  for (int i = 0; i < 20; i++) {
+    int key = rand() % 100000;
+    int numFound = 0;
+    try {
+      index->startScan(&key, GTE, &key, LTE);
+      RecordId scanRid;
+      try {
+        while (1) {
+          index->scanNext(scanRid);
+          numFound++;
+        }
+      } catch (IndexScanCompletedException &e) {
+      }
+      index->endScan();
+    } catch (NoSuchKeyFoundException &e) {
+    }
+    if (numFound != (int)oracle.count(key)) mismatches++;
+  }
+  return mismatches;
+}
+
+void intTestsWithSmallBuf() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BufMgr *smBufMgr = new BufMgr(6);
+  BTreeIndex index(relationName, intIndexName, smBufMgr, offsetof(tuple, i),
+                   INTEGER);
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+      checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+          checkPassFail(intScan(&index, -3, GT, 3, LT), 3) checkPassFail(
+              intScan(&index, 996, GT, 1001, LT), 4)
+              checkPassFail(intScan(&index, 0, GT, 1, LT), 0) checkPassFail(
+                  intScan(&index, 300, GT, 400, LT), 99)
+                  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+                      checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
+                          checkPassFail(intScan(&index, 26, GTE, 26, LTE), 1)
+                              checkPassFail(intScan(&index, 26, GTE, 26, LT), 0)
+}
+
+void intTestsWithResize() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  removeIndex();
+  BufMgr *rsBufMgr = new BufMgr(6);
+  BTreeIndex index(relationName, intIndexName, rsBufMgr, offsetof(tuple, i),
+                   INTEGER);
+  std::cout << "Grow buffer pool to 64 frames" << std::endl;
+  rsBufMgr->resize(64);
+  checkPassFail(rsBufMgr->getNumBufs(), 64)
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+
+  std::cout << "Shrink buffer pool to 4 frames" << std::endl;
+  rsBufMgr->resize(4);
+  checkPassFail(rsBufMgr->getNumBufs(), 4)
+  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+  checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+  checkPassFail(intScan(&index, 26, GTE, 26, LTE), 1)
+
+  std::cout << "Grow again and rescan" << std::endl;
+  rsBufMgr->resize(20);
+  checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+  checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
+
+  std::cout << "Grow past several chunks of frames and shrink back" << std::endl;
+  rsBufMgr->resize(500);
+  checkPassFail(intScan(&index, 0, GTE, 5000, LT), 5000)
+  rsBufMgr->resize(10);
+  checkPassFail(rsBufMgr->getNumBufs(), 10)
+  checkPassFail(intScan(&index, 1000, GTE, 1100, LT), 100)
+}
+
+void intTestsWithPools() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  removeIndex();
+  BufMgr *plBufMgr = new BufMgr(20);
+  PoolId indexPool = plBufMgr->createPool("index", 0);
+  PoolId scanPool = plBufMgr->createPool("scan", 3);
+  plBufMgr->routeAccess(ACCESS_INDEX_INNER, indexPool);
+  plBufMgr->routeAccess(ACCESS_INDEX_LEAF, indexPool);
+  plBufMgr->routeAccess(ACCESS_SCAN, scanPool);
+  checkPassFail(plBufMgr->getPool("scan"), scanPool)
+
+  std::cout << "Look up a pool that does not exist" << std::endl;
+  try {
+    plBufMgr->getPool("hot");
+    std::cout << "PoolNotFoundException Test Failed." << std::endl;
+  } catch (PoolNotFoundException &e) {
+    std::cout << "PoolNotFoundException Test Passed." << std::endl;
+  }
+
+  BTreeIndex index(relationName, intIndexName, plBufMgr, offsetof(tuple, i),
+                   INTEGER);
+  std::uint32_t indexFrames = plBufMgr->getPoolInfo(indexPool).used;
+  std::cout << "Index pool frames after build: " << indexFrames << std::endl;
+
+  // a full scan of the relation may only take scan quota frames from the index
+  {
+    FileScan fscan(relationName, plBufMgr);
+    RecordId scanRid;
+    int numRecords = 0;
+    try {
+      while (1) {
+        fscan.scanNext(scanRid);
+        numRecords++;
+        if (plBufMgr->getPoolInfo(scanPool).used > 3) break;
+      }
+    } catch (EndOfFileException &e) {
+    }
+    bool indexKept = plBufMgr->getPoolInfo(indexPool).used >= indexFrames - 3;
+    checkPassFail(numRecords, relationSize)
+    checkPassFail(indexKept, true)
+  }
+
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+  checkPassFail(plBufMgr->getPoolInfo(scanPool).used, 0)
+
+  std::cout << "Look up pools while others are being created" << std::endl;
+  std::atomic<int> badLookups(0);
+  std::thread creator([plBufMgr]() {
+    for (int i = 0; i < 500; i++)
+      plBufMgr->createPool("extra" + std::to_string(i), 0);
+  });
+  for (int i = 0; i < 2000; i++) {
+    if (plBufMgr->getPool("scan") != scanPool ||
+        plBufMgr->getPoolInfo(scanPool).name != "scan")
+      badLookups++;
+  }
+  creator.join();
+  checkPassFail(badLookups.load(), 0)
+  checkPassFail(plBufMgr->getPoolInfo(plBufMgr->getPool("extra499")).quota, 0)
+}
+
+void intTestsWithReservedPool() {
+  std::cout << "Scan more pages than the buffer pool holds past a pool with "
+               "reserved frames"
+            << std::endl;
+  removeIndex();
+  {
+    BufMgr rsvBufMgr(20);
+    PoolId reservedPool = rsvBufMgr.createPool("index", 0, 12);
+    rsvBufMgr.routeAccess(ACCESS_INDEX_INNER, reservedPool);
+    rsvBufMgr.routeAccess(ACCESS_INDEX_LEAF, reservedPool);
+    BTreeIndex rsvIndex(relationName, intIndexName, &rsvBufMgr,
+                        offsetof(tuple, i), INTEGER);
+    checkPassFail(intScan(&rsvIndex, 0, GTE, relationSize, LT), relationSize)
+    const std::uint32_t indexFrames = rsvBufMgr.getPoolInfo(reservedPool).used;
+
+    // the scan goes through the default pool, which has no quota
+    FileScan fscan(relationName, &rsvBufMgr);
+    RecordId scanRid;
+    int numRecords = 0;
+    std::set<PageId> scannedPages;
+    try {
+      while (1) {
+        fscan.scanNext(scanRid);
+        numRecords++;
+        scannedPages.insert(scanRid.page_number);
+      }
+    } catch (EndOfFileException &e) {
+    }
+    const bool scanLarger = scannedPages.size() > 20;
+    checkPassFail(scanLarger, true)
+    checkPassFail(numRecords, relationSize)
+    checkPassFail(rsvBufMgr.getPoolInfo(reservedPool).used, indexFrames)
+
+    // every index page is still cached
+    rsvBufMgr.clearBufStats();
+    checkPassFail(intScan(&rsvIndex, 0, GTE, relationSize, LT), relationSize)
+    checkPassFail(rsvBufMgr.getBufStats().diskreads, 0)
+  }
+  removeIndex();
+}
+
+void intTestsWithDirectIO() {
+  std::cout << "Create a B+ Tree index on the integer field with O_DIRECT"
+            << std::endl;
+  removeIndex();
+  BTreeOptions options;
+  options.ioMode = IO_DIRECT;
+  {
+    BufMgr *dioBufMgr = new BufMgr(20);
+    BTreeIndex index(relationName, intIndexName, dioBufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+  }
+
+  std::cout << "Reopen the index with O_DIRECT" << std::endl;
+  {
+    BufMgr *dioBufMgr = new BufMgr(20);
+    BTreeIndex index(relationName, intIndexName, dioBufMgr, offsetof(tuple, i),
+                     INTEGER, options);
+    checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+  }
+
+  // the page-aligned layout is recognised when opened without O_DIRECT too
+  std::cout << "Reopen the index without O_DIRECT" << std::endl;
+  {
+    BufMgr *bufBufMgr = new BufMgr(20);
+    BTreeIndex index(relationName, intIndexName, bufBufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+    checkPassFail(intScan(&index, 5000, GT, 6000, LT), 0)
+  }
+  removeIndex();
+
+  // a write the file size limit cuts short fails with EFBIG, which must not
+  // be taken for a finished write
+  std::cout << "Write past the file size limit with O_DIRECT" << std::endl;
+  const std::string limitedName = relationName + ".limited";
+  {
+    BlobFile limitedFile(limitedName, true, IO_DIRECT);
+    PageId pageNo;
+    limitedFile.allocatePage(pageNo);
+    struct rlimit saved, limited;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    limited = saved;
+    limited.rlim_cur = 4 * Page::SIZE;
+    void (*savedHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &limited);
+    int errorNumber = 0;
+    try {
+      for (int p = 0; p < 8; p++) {
+        limitedFile.allocatePage(pageNo);
+      }
+    } catch (FileIOException &e) {
+      errorNumber = e.errorNumber();
+    }
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, savedHandler);
+    const int expected = limitedFile.ioMode() == IO_DIRECT ? EFBIG : 0;
+    checkPassFail(errorNumber, expected)
+  }
+  File::remove(limitedName);
+}
+
+void batchReadTests() {
+  std::cout << "Read all pages of the relation in one batch" << std::endl;
+  PageFile relFile = PageFile::open(relationName);
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = relFile.begin(); iter != relFile.end(); ++iter) {
+    pageNos.push_back((*iter).page_number());
+  }
+  BufMgr *btBufMgr = new BufMgr(pageNos.size() + 4);
+
+  // one page is cached already, pages are requested last to first and the
+  // last page is requested twice
+  Page *cachedPage;
+  btBufMgr->readPage(&relFile, pageNos[1], cachedPage);
+  std::vector<PageRef> refs;
+  for (std::size_t i = pageNos.size(); i-- > 0;) {
+    PageRef ref = {&relFile, pageNos[i]};
+    refs.push_back(ref);
+  }
+  refs.push_back(refs.front());
+  std::vector<Page *> pages;
+  btBufMgr->readPages(refs, pages);
+
+  int numMatching = 0;
+  for (std::size_t i = 0; i < refs.size(); i++) {
+    if (pages[i]->page_number() == refs[i].pageNo) numMatching++;
+  }
+  checkPassFail(numMatching, (int)refs.size())
+  checkPassFail(btBufMgr->getBufStats().diskreads, (int)pageNos.size())
+
+  for (std::size_t i = 0; i < refs.size(); i++) {
+    btBufMgr->unPinPage(&relFile, refs[i].pageNo, false);
+  }
+  btBufMgr->unPinPage(&relFile, pageNos[1], false);
+  btBufMgr->flushFile(&relFile);
+
+  std::cout << "Read more pages in one batch than there are frames"
+            << std::endl;
+  BufMgr *smBufMgr = new BufMgr(4);
+  try {
+    smBufMgr->readPages(refs, pages);
+    std::cout << "BufferExceededException Test Failed." << std::endl;
+  } catch (BufferExceededException &e) {
+    std::cout << "BufferExceededException Test Passed." << std::endl;
+  }
+  // throws PagePinnedException if the failed batch left a page pinned
+  smBufMgr->flushFile(&relFile);
+  checkPassFail(smBufMgr->getBufStats().diskreads, 0)
+}
+
+/**
+ * Prints the scan range, then scans it with countScan()
+ */
+template <class V>
+int printAndCountScan(BTreeIndex *index, const V &lowVal, Operator lowOp,
+                      const V &highVal, Operator highOp, const void *lowKey,
+                      const void *highKey) {
+  std::cout << "Scan for ";
+  if (lowOp == GT) {
+    std::cout << "(";
+  } else {
+    std::cout << "[";
+  }
+  std::cout << lowVal << "," << highVal;
+  if (highOp == LT) {
+    std::cout << ")";
+  } else {
+    std::cout << "]";
+  }
+  std::cout << std::endl;
+
+  return countScan(index, lowKey, lowOp, highKey, highOp);
+}
+
+int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+            Operator highOp) {
+  return printAndCountScan(index, lowVal, lowOp, highVal, highOp, &lowVal,
+                           &highVal);
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp) {
+  return printAndCountScan(index, lowVal, lowOp, highVal, highOp, &lowVal,
+                           &highVal);
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp) {
+  char lowValStr[100];
+  sprintf(lowValStr, "%05d string record", lowVal);
+  char highValStr[100];
+  sprintf(highValStr, "%05d string record", highVal);
+
+  return printAndCountScan(index, std::string(lowValStr), lowOp,
+                           std::string(highValStr), highOp, lowValStr,
+                           highValStr);
+}
+
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp,
+              const void *highVal, Operator highOp) {
+  RecordId scanRid;
+  Page *curPage;
+
+  int numResults = 0;
+
+  try {
+    index->startScan(lowVal, lowOp, highVal, highOp);
+  } catch (NoSuchKeyFoundException &e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  while (1) {
+    try {
+      index->scanNext(scanRid);
+      bufMgr->readPage(file1, scanRid.page_number, curPage);
+      RECORD myRec = *(
+          reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+      bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+      if (numResults < 5) {
+        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s
+                  << ":" << std::endl;
+      } else if (numResults == 5) {
+        std::cout << "..." << std::endl;
+      }
+    } catch (IndexScanCompletedException &e) {
+      break;
+    }
+
+    numResults++;
+  }
+
+  if (numResults >= 5) {
+    std::cout << "Number of results: " << numResults << std::endl;
+  }
+  index->endScan();
+  std::cout << std::endl;
+
+  return numResults;
+}
 
 // -----------------------------------------------------------------------------
 // errorTests
@@ -514,53 +4223,60 @@ void errorTests() {
 
   file1->writePage(new_page_number, new_page);
 
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
 
-  int int2 = 2;
-  int int5 = 5;
+    int int2 = 2;
+    int int5 = 5;
 
-  // Scan Tests
-  std::cout << "Call endScan before startScan" << std::endl;
-  try {
-    index.endScan();
-    std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
-  } catch (ScanNotInitializedException &e) {
-    std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
-  }
+    // Scan Tests
+    std::cout << "Call endScan before startScan" << std::endl;
+    try {
+      index.endScan();
+      std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+    } catch (ScanNotInitializedException &e) {
+      std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
+    }
 
-  std::cout << "Call scanNext before startScan" << std::endl;
-  try {
-    RecordId foo;
-    index.scanNext(foo);
-    std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
-  } catch (ScanNotInitializedException &e) {
-    std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
-  }
+    std::cout << "Call scanNext before startScan" << std::endl;
+    try {
+      RecordId foo;
+      index.scanNext(foo);
+      std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
+    } catch (ScanNotInitializedException &e) {
+      std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+    }
 
-  std::cout << "Scan with bad lowOp" << std::endl;
-  try {
-    index.startScan(&int2, LTE, &int5, LTE);
-    std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
-  } catch (BadOpcodesException &e) {
-    std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
-  }
+    std::cout << "Scan with bad lowOp" << std::endl;
+    try {
+      index.startScan(&int2, LTE, &int5, LTE);
+      std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
+    } catch (BadOpcodesException &e) {
+      std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+    }
 
-  std::cout << "Scan with bad highOp" << std::endl;
-  try {
-    index.startScan(&int2, GTE, &int5, GTE);
-    std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
-  } catch (BadOpcodesException &e) {
-    std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
-  }
+    std::cout << "Scan with bad highOp" << std::endl;
+    try {
+      index.startScan(&int2, GTE, &int5, GTE);
+      std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+    } catch (BadOpcodesException &e) {
+      std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+    }
 
-  std::cout << "Scan with bad range" << std::endl;
-  try {
-    index.startScan(&int5, GTE, &int2, LTE);
-    std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
-  } catch (BadScanrangeException &e) {
-    std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+    std::cout << "Scan with bad range" << std::endl;
+    try {
+      index.startScan(&int5, GTE, &int2, LTE);
+      std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+    } catch (BadScanrangeException &e) {
+      std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+    }
+
+    // the root of this index is still a leaf
+    checkPassFail(intScan(&index, int2, GTE, int5, LTE), 4)
+    checkPassFail(intScan(&index, int5, GT, 100, LT), 4)
   }
+  removeIndex();
 
   deleteRelation();
 }
@@ -95,6 +95,13 @@ struct PageSlot {
 
 class PageIterator;
 
+/**
+ * @brief Alignment of Page objects in memory and of pages on disk in files
+ *        opened with IO_DIRECT.  O_DIRECT transfers must start at and cover
+ *        whole blocks of the device, and 4096 covers all common block sizes.
+ */
+const std::size_t IO_ALIGNMENT = 4096;
+
 /**
  * @brief Class which represents a fixed-size database page containing records.
  *
@@ -105,7 +112,7 @@ class PageIterator;
  *
  * @warning This class is not threadsafe.
  */
-class Page {
+class alignas(IO_ALIGNMENT) Page {
  public:
   /**
    * Page size in bytes.  If this is changed, database files created with a
@@ -343,5 +350,7 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(sizeof(Page) == Page::SIZE && Page::SIZE % IO_ALIGNMENT == 0,
+              "Page must be a whole number of aligned blocks.");
 
 }
@@ -24,6 +24,11 @@ typedef std::uint16_t SlotId;
  */
 typedef std::uint32_t FrameId;
 
+/**
+ * @brief Identifier for a named pool of frames in the buffer manager.
+ */
+typedef std::uint32_t PoolId;
+
 /**
  * @brief Identifier for a record in a page.
  */